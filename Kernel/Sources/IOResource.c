@@ -131,7 +131,7 @@ OVERRIDE_METHOD_IMPL(deinit, IOChannel, Object)
 // maintains state that is specific to this connection. This state will be
 // protected by the resource's internal locking mechanism. 'pNode' represents
 // the named resource instance that should be represented by the I/O channel.
-errno_t IOResource_open(IOResourceRef _Nonnull self, InodeRef _Nonnull _Locked pNode, unsigned int mode, User user, IOChannelRef _Nullable * _Nonnull pOutChannel)
+errno_t IOResource_open(IOResourceRef _Nonnull self, InodeRef _Nonnull pNode, unsigned int mode, User user, IOChannelRef _Nullable * _Nonnull pOutChannel)
 {
     *pOutChannel = NULL;
     return EBADF;
@@ -96,7 +96,7 @@ typedef struct _IOResourceMethodTable {
     // maintains state that is specific to this connection. This state will be
     // protected by the resource's internal locking mechanism. 'pNode' represents
     // the named resource instance that should be represented by the I/O channel. 
-    errno_t   (*open)(void* _Nonnull self, InodeRef _Nonnull _Locked pNode, unsigned int mode, User user, IOChannelRef _Nullable * _Nonnull pOutChannel);
+    errno_t   (*open)(void* _Nonnull self, InodeRef _Nonnull pNode, unsigned int mode, User user, IOChannelRef _Nullable * _Nonnull pOutChannel);
 
     // Creates an independent copy of the passed in I/O channel. Note that this function
     // is allowed to return a strong reference to the channel that was passed in if
@@ -86,7 +86,7 @@ size_t Pipe_GetCapacity(PipeRef _Nonnull self)
     return nbytes;
 }
 
-errno_t Pipe_open(PipeRef _Nonnull self, InodeRef _Nonnull _Locked pNode, unsigned int mode, User user, IOChannelRef _Nullable * _Nonnull pOutChannel)
+errno_t Pipe_open(PipeRef _Nonnull self, InodeRef _Nonnull pNode, unsigned int mode, User user, IOChannelRef _Nullable * _Nonnull pOutChannel)
 {
     return IOChannel_AbstractCreate(&kIOChannelClass, (IOResourceRef) self, mode, pOutChannel);
 }
@@ -312,6 +312,16 @@ SYSCALL_1(get_monotonic_time, TimeInterval* _Nullable time)
     return EOK;
 }
 
+SYSCALL_1(get_kalloc_info, HeapInfo* _Nullable pOutInfo)
+{
+    if (pArgs->pOutInfo == NULL) {
+        return EINVAL;
+    }
+
+    kalloc_get_info(pArgs->pOutInfo);
+    return EOK;
+}
+
 SYSCALL_4(dispatch, int od, unsigned long options, const Closure1Arg_Func _Nullable pUserClosure, void* _Nullable pContext)
 {
     if (pArgs->pUserClosure == NULL) {
@@ -330,6 +340,51 @@ SYSCALL_4(dispatch_after, int od, TimeInterval deadline, const Closure1Arg_Func
     return Process_DispatchUserClosureAsyncAfter(Process_GetCurrent(), pArgs->od, pArgs->deadline, pArgs->pUserClosure, pArgs->pContext);
 }
 
+SYSCALL_3(dispatch_batch, int od, const Dispatch_ClosureEntry* _Nullable pEntries, int count)
+{
+    if (pArgs->count < 0 || (pArgs->count > 0 && pArgs->pEntries == NULL)) {
+        return EINVAL;
+    }
+
+    return Process_DispatchUserClosureBatch(Process_GetCurrent(), pArgs->od, pArgs->pEntries, pArgs->count);
+}
+
+SYSCALL_2(dispatch_get_tunables, int od, DispatchQueueTunables* _Nullable pOutTunables)
+{
+    if (pArgs->pOutTunables == NULL) {
+        return EINVAL;
+    }
+
+    return Process_GetDispatchQueueTunables(Process_GetCurrent(), pArgs->od, pArgs->pOutTunables);
+}
+
+SYSCALL_2(dispatch_set_tunables, int od, const DispatchQueueTunables* _Nullable pTunables)
+{
+    if (pArgs->pTunables == NULL) {
+        return EINVAL;
+    }
+
+    return Process_SetDispatchQueueTunables(Process_GetCurrent(), pArgs->od, pArgs->pTunables);
+}
+
+SYSCALL_2(dispatch_get_max_concurrency, int od, int* _Nullable pOutMaxConcurrency)
+{
+    if (pArgs->pOutMaxConcurrency == NULL) {
+        return EINVAL;
+    }
+
+    return Process_GetDispatchQueueMaxConcurrency(Process_GetCurrent(), pArgs->od, pArgs->pOutMaxConcurrency);
+}
+
+SYSCALL_4(dispatch_remove_closure, int od, const Closure1Arg_Func _Nullable pUserClosure, void* _Nullable pContext, int* _Nullable pOutCount)
+{
+    if (pArgs->pUserClosure == NULL || pArgs->pOutCount == NULL) {
+        return EINVAL;
+    }
+
+    return Process_RemoveUserClosure(Process_GetCurrent(), pArgs->od, pArgs->pUserClosure, pArgs->pContext, pArgs->pOutCount);
+}
+
 SYSCALL_5(dispatch_queue_create, int minConcurrency, int maxConcurrency, int qos, int priority, int* _Nullable pOutQueue)
 {
     if (pArgs->pOutQueue == NULL) {
@@ -545,4 +600,10 @@ SystemCall gSystemCallTable[] = {
     REF_SYSCALL(cv_create),
     REF_SYSCALL(cv_wake),
     REF_SYSCALL(cv_wait),
+    REF_SYSCALL(get_kalloc_info),
+    REF_SYSCALL(dispatch_batch),
+    REF_SYSCALL(dispatch_get_tunables),
+    REF_SYSCALL(dispatch_set_tunables),
+    REF_SYSCALL(dispatch_get_max_concurrency),
+    REF_SYSCALL(dispatch_remove_closure),
 };
@@ -501,7 +501,7 @@ void Console_Execute_DL_Locked(ConsoleRef _Nonnull pConsole, int nLines)
 // Read/Write
 ////////////////////////////////////////////////////////////////////////////////
 
-errno_t Console_open(ConsoleRef _Nonnull pConsole, InodeRef _Nonnull _Locked pNode, unsigned int mode, User user, ConsoleChannelRef _Nullable * _Nonnull pOutChannel)
+errno_t Console_open(ConsoleRef _Nonnull pConsole, InodeRef _Nonnull pNode, unsigned int mode, User user, ConsoleChannelRef _Nullable * _Nonnull pOutChannel)
 {
     decl_try_err();
     ConsoleChannelRef pChannel;
@@ -49,7 +49,10 @@ void VirtualProcessorScheduler_CreateForLocalCPU(SystemDescription* _Nonnull pSy
         pScheduler->csw_hw |= CSW_HW_HAS_FPU;
     }
     
-    List_Init(&pScheduler->timeout_queue);
+    for (int i = 0; i < TIMEOUT_WHEEL_SLOT_COUNT; i++) {
+        List_Init(&pScheduler->timeout_wheel[i]);
+    }
+    pScheduler->timeout_wheel_time = 0;
     List_Init(&pScheduler->sleep_queue);
     List_Init(&pScheduler->scheduler_wait_queue);
     List_Init(&pScheduler->finalizer_queue);
@@ -176,20 +179,26 @@ VirtualProcessor* _Nullable VirtualProcessorScheduler_GetHighestPriorityReady(Vi
 // Invoked at the end of every quantum.
 void VirtualProcessorScheduler_OnEndOfQuantum(VirtualProcessorScheduler * _Nonnull pScheduler)
 {
-    // First, go through the timeout queue and move all VPs whose timeouts have
-    // expired to the ready queue.
+    // First, go through the timeout wheel slots of all quantums that have
+    // passed since we were last here and move all VPs whose timeouts have
+    // expired to the ready queue. This is usually a single slot.
     const Quantums curTime = MonotonicClock_GetCurrentQuantums();
+    const Quantums nSlots = __min(curTime - pScheduler->timeout_wheel_time, TIMEOUT_WHEEL_SLOT_COUNT);
     
-    while (pScheduler->timeout_queue.first) {
-        register Timeout* pCurTimeout = (Timeout*)pScheduler->timeout_queue.first;
-        
-        if (pCurTimeout->deadline > curTime) {
-            break;
+    for (Quantums t = pScheduler->timeout_wheel_time + 1; t <= pScheduler->timeout_wheel_time + nSlots; t++) {
+        register Timeout* pCurTimeout = (Timeout*)pScheduler->timeout_wheel[t & TIMEOUT_WHEEL_SLOT_MASK].first;
+
+        while (pCurTimeout) {
+            register Timeout* pNextTimeout = (Timeout*)pCurTimeout->queue_entry.next;
+
+            if (pCurTimeout->deadline <= curTime) {
+                VirtualProcessor* pVP = (VirtualProcessor*)pCurTimeout->owner;
+                VirtualProcessorScheduler_WakeUpOne(pScheduler, pVP->waiting_on_wait_queue, pVP, WAKEUP_REASON_TIMEOUT, false);
+            }
+            pCurTimeout = pNextTimeout;
         }
-        
-        VirtualProcessor* pVP = (VirtualProcessor*)pCurTimeout->owner;
-        VirtualProcessorScheduler_WakeUpOne(pScheduler, pVP->waiting_on_wait_queue, pVP, WAKEUP_REASON_TIMEOUT, false);
     }
+    pScheduler->timeout_wheel_time = curTime;
     
     
     // Second, update the time slice info for the currently running VP
@@ -228,24 +237,16 @@ void VirtualProcessorScheduler_OnEndOfQuantum(VirtualProcessorScheduler * _Nonnu
 }
 
 // Arms a timeout for the given virtual processor. This puts the VP on the timeout
-// queue.
+// wheel. A deadline that the wheel has already passed is moved to the next
+// quantum.
 static void VirtualProcessorScheduler_ArmTimeout(VirtualProcessorScheduler* _Nonnull pScheduler, VirtualProcessor* pVP, TimeInterval deadline)
 {
-    pVP->timeout.deadline = Quantums_MakeFromTimeInterval(deadline, QUANTUM_ROUNDING_AWAY_FROM_ZERO);
+    const Quantums qDeadline = Quantums_MakeFromTimeInterval(deadline, QUANTUM_ROUNDING_AWAY_FROM_ZERO);
+
+    pVP->timeout.deadline = __max(qDeadline, pScheduler->timeout_wheel_time + 1);
     pVP->timeout.is_valid = true;
     
-    register Timeout* pPrevTimeout = NULL;
-    register Timeout* pCurTimeout = (Timeout*)pScheduler->timeout_queue.first;
-    while (pCurTimeout) {
-        if (pCurTimeout->deadline > pVP->timeout.deadline) {
-            break;
-        }
-        
-        pPrevTimeout = pCurTimeout;
-        pCurTimeout = (Timeout*)pCurTimeout->queue_entry.next;
-    }
-    
-    List_InsertAfter(&pScheduler->timeout_queue, &pVP->timeout.queue_entry, &pPrevTimeout->queue_entry);
+    List_InsertAfterLast(&pScheduler->timeout_wheel[pVP->timeout.deadline & TIMEOUT_WHEEL_SLOT_MASK], &pVP->timeout.queue_entry);
 }
 
 // Cancels an armed timeout for the given virtual processor. Does nothing if
@@ -253,7 +254,7 @@ static void VirtualProcessorScheduler_ArmTimeout(VirtualProcessorScheduler* _Non
 static void VirtualProcessorScheduler_CancelTimeout(VirtualProcessorScheduler* _Nonnull pScheduler, VirtualProcessor* pVP)
 {
     if (pVP->timeout.is_valid) {
-        List_Remove(&pScheduler->timeout_queue, &pVP->timeout.queue_entry);
+        List_Remove(&pScheduler->timeout_wheel[pVP->timeout.deadline & TIMEOUT_WHEEL_SLOT_MASK], &pVP->timeout.queue_entry);
         pVP->timeout.deadline = kQuantums_Infinity;
         pVP->timeout.is_valid = false;
     }
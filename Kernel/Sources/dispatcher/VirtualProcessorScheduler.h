@@ -29,6 +29,17 @@
 #define SCHED_FLAG_VOLUNTARY_CSW_ENABLED   0x01
 
 
+// The timeout wheel is a hashed timing wheel. A timeout with deadline D is
+// stored in slot D % TIMEOUT_WHEEL_SLOT_COUNT. Timeouts are appended to their
+// slot so that timeouts with the same deadline expire in the order in which
+// they were armed. The scheduler visits one slot per quantum and a timeout that
+// is more than TIMEOUT_WHEEL_SLOT_COUNT quantums in the future simply stays in
+// its slot until the wheel comes around again. Must be a power of 2.
+// Note: Keep in sync with lowmem.i
+#define TIMEOUT_WHEEL_SLOT_COUNT    64
+#define TIMEOUT_WHEEL_SLOT_MASK     (TIMEOUT_WHEEL_SLOT_COUNT - 1)
+
+
 // The ready queue holds references to all VPs which are ready to run. The queue
 // is sorted from highest to lowest priority.
 typedef struct _ReadyQueue {
@@ -50,7 +61,8 @@ typedef struct _VirtualProcessorScheduler {
     uint8_t                               flags;                          // Scheduler flags
     int8_t                                reserved[1];
     Quantums                            quantums_per_quarter_second;    // 1/4 second in terms of quantums
-    List                                timeout_queue;                  // Timeout queue managed by the scheduler. Sorted ascending by timer deadlines
+    List                                timeout_wheel[TIMEOUT_WHEEL_SLOT_COUNT];    // Timeouts managed by the scheduler. See TIMEOUT_WHEEL_SLOT_COUNT
+    Quantums                            timeout_wheel_time;             // All timeouts with a deadline <= this time have expired
     List                                sleep_queue;                    // VPs which block in a sleep() call wait on this wait queue
     List                                scheduler_wait_queue;           // The scheduler VP waits on this queue
     List                                finalizer_queue;
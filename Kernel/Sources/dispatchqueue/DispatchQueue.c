@@ -30,10 +30,11 @@ errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int qos, in
     
     try(Object_CreateWithExtraBytes(DispatchQueue, sizeof(ConcurrencyLane) * (maxConcurrency - 1), &pQueue));
     SList_Init(&pQueue->item_queue);
-    SList_Init(&pQueue->timer_queue);
-    SList_Init(&pQueue->item_cache_queue);
-    SList_Init(&pQueue->timer_cache_queue);
-    SList_Init(&pQueue->completion_signaler_cache_queue);
+    pQueue->timer_queue = NULL;
+    pQueue->timer_count = 0;
+    pQueue->timer_capacity = 0;
+    pQueue->timer_reserved = 0;
+    pQueue->timer_sequence = 0;
     Lock_Init(&pQueue->lock);
     ConditionVariable_Init(&pQueue->work_available_signaler);
     ConditionVariable_Init(&pQueue->vp_shutdown_signaler);
@@ -44,6 +45,11 @@ errno_t DispatchQueue_Create(int minConcurrency, int maxConcurrency, int qos, in
     pQueue->maxConcurrency = (int8_t)maxConcurrency;
     pQueue->qos = qos;
     pQueue->priority = priority;
+    pQueue->tunables.latencyTarget = TimeInterval_MakeMilliseconds(DISPATCH_DEFAULT_LATENCY_TARGET_MS);
+    pQueue->tunables.idleTimeout = TimeInterval_MakeMilliseconds(DISPATCH_DEFAULT_IDLE_TIMEOUT_MS);
+    pQueue->latency_target = Quantums_MakeFromTimeInterval(pQueue->tunables.latencyTarget, QUANTUM_ROUNDING_AWAY_FROM_ZERO);
+    pQueue->avg_queue_latency = 0;
+    pQueue->avg_service_time = -1;
 
     for (int i = 0; i < minConcurrency; i++) {
         try(DispatchQueue_AcquireVirtualProcessor_Locked(pQueue));
@@ -64,15 +70,14 @@ static void DispatchQueue_Flush_Locked(DispatchQueueRef _Nonnull pQueue)
     // Flush the work item queue
     WorkItemRef pItem;
     while ((pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_queue)) != NULL) {
-        WorkItem_SignalCompletion(pItem, true);
-        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+        DispatchQueue_DiscardWorkItem_Locked(pQueue, pItem);
     }
 
 
     // Flush the timers
     TimerRef pTimer;
-    while ((pTimer = (TimerRef) SList_RemoveFirst(&pQueue->timer_queue)) != NULL) {
-        WorkItem_SignalCompletion(pItem, true);
+    while ((pTimer = DispatchQueue_RemoveFirstTimer_Locked(pQueue)) != NULL) {
+        WorkItem_SignalCompletion((WorkItemRef)pTimer, true);
         DispatchQueue_RelinquishTimer_Locked(pQueue, pTimer);
     }
 }
@@ -139,32 +144,14 @@ void DispatchQueue_WaitForTerminationCompleted(DispatchQueueRef _Nonnull pQueue)
 // Deallocates the dispatch queue. Expects that the queue is in 'terminated' state.
 static void _DispatchQueue_Destroy(DispatchQueueRef _Nonnull pQueue)
 {
-    CompletionSignaler* pCompSignaler;
-    WorkItemRef pItem;
-    TimerRef pTimer;
-
     assert(pQueue->state == kQueueState_Terminated);
 
     // No more VPs are attached to this queue. We can now go ahead and free
     // all resources.
     SList_Deinit(&pQueue->item_queue);      // guaranteed to be empty at this point
-    SList_Deinit(&pQueue->timer_queue);     // guaranteed to be empty at this point
-
-    while ((pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_cache_queue)) != NULL) {
-        WorkItem_Destroy(pItem);
-    }
-    SList_Deinit(&pQueue->item_cache_queue);
-        
-    while ((pTimer = (TimerRef) SList_RemoveFirst(&pQueue->timer_cache_queue)) != NULL) {
-        Timer_Destroy(pTimer);
-    }
-    SList_Deinit(&pQueue->timer_cache_queue);
+    kfree(pQueue->timer_queue);             // guaranteed to be empty at this point
+    pQueue->timer_queue = NULL;
 
-    while((pCompSignaler = (CompletionSignaler*) SList_RemoveFirst(&pQueue->completion_signaler_cache_queue)) != NULL) {
-        CompletionSignaler_Destroy(pCompSignaler);
-    }
-    SList_Deinit(&pQueue->completion_signaler_cache_queue);
-        
     Lock_Deinit(&pQueue->lock);
     ConditionVariable_Deinit(&pQueue->work_available_signaler);
     ConditionVariable_Deinit(&pQueue->vp_shutdown_signaler);
@@ -183,6 +170,47 @@ void DispatchQueue_deinit(DispatchQueueRef _Nonnull pQueue)
     _DispatchQueue_Destroy(pQueue);
 }
 
+// Returns the new value of the moving average 'avg' after adding the sample
+// 'quantums'.
+static int32_t DispatchQueue_UpdateAverage(int32_t avg, Quantums quantums)
+{
+    const int32_t sample = __min(__max(quantums, 0), DISPATCH_AVG_MAX_SAMPLE) << DISPATCH_AVG_FRACTION_BITS;
+
+    return (avg < 0) ? sample : avg + ((sample - avg) >> DISPATCH_AVG_WEIGHT_SHIFT);
+}
+
+// Returns true if the queue should acquire an additional concurrency lane. This
+// is the case if:
+// - we don't own any virtual processor at all
+// - we have < minConcurrency virtual processors (remember that this can be 0)
+// - we haven't measured anything yet and there are more queued work items than
+//   lanes. This allows a burst to ramp up immediately
+// - the queued work items are expected to wait longer than the latency target
+//   because the current lanes can not drain them fast enough or because the
+//   measured queue latency exceeds the latency target
+static bool DispatchQueue_ShouldAddLane_Locked(DispatchQueueRef _Nonnull pQueue)
+{
+    const int nLanes = pQueue->availableConcurrency;
+
+    if (nLanes >= pQueue->maxConcurrency) {
+        return false;
+    }
+    if (nLanes == 0 || nLanes < pQueue->minConcurrency) {
+        return true;
+    }
+    if (pQueue->items_queued_count <= 0) {
+        return false;
+    }
+    if (pQueue->avg_service_time < 0) {
+        return (pQueue->items_queued_count > nLanes) ? true : false;
+    }
+
+    const int64_t target = ((int64_t)pQueue->latency_target) << DISPATCH_AVG_FRACTION_BITS;
+    const int64_t drainTime = ((int64_t)pQueue->items_queued_count * pQueue->avg_service_time) / nLanes;
+
+    return (drainTime > target || pQueue->avg_queue_latency > target) ? true : false;
+}
+
 // Makes sure that we have enough virtual processors attached to the dispatch queue
 // and acquires a virtual processor from the virtual processor pool if necessary.
 // The virtual processor is attached to the dispatch queue and remains attached
@@ -192,14 +220,9 @@ static errno_t DispatchQueue_AcquireVirtualProcessor_Locked(DispatchQueueRef _No
     decl_try_err();
 
     // Acquire a new virtual processor if we haven't already filled up all
-    // concurrency lanes available to us and one of the following is true:
-    // - we don't own any virtual processor at all
-    // - we have < minConcurrency virtual processors (remember that this can be 0)
-    // - we've queued up at least 4 work items and < maxConcurrency virtual processors
-    if (pQueue->state == kQueueState_Running
-        && (pQueue->availableConcurrency == 0
-            || pQueue->availableConcurrency < pQueue->minConcurrency
-            || (pQueue->items_queued_count > 4 && pQueue->availableConcurrency < pQueue->maxConcurrency))) {
+    // concurrency lanes available to us and the lane scaling policy asks for
+    // another lane
+    if (pQueue->state == kQueueState_Running && DispatchQueue_ShouldAddLane_Locked(pQueue)) {
         int conLaneIdx = -1;
 
         for (int i = 0; i < pQueue->maxConcurrency; i++) {
@@ -246,119 +269,54 @@ static void DispatchQueue_RelinquishVirtualProcessor_Locked(DispatchQueueRef _No
     pQueue->availableConcurrency--;
 }
 
-// Creates a work item for the given closure and closure context. Tries to reuse
-// an existing work item from the work item cache whenever possible. Expects that
-// the caller holds the dispatch queue lock.
+// Creates a work item for the given closure and closure context. The work item
+// is allocated from the global work item cache. Expects that the caller holds
+// the dispatch queue lock.
 static errno_t DispatchQueue_AcquireWorkItem_Locked(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure, WorkItemRef _Nullable * _Nonnull pOutItem)
 {
-    decl_try_err();
-    WorkItemRef pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_cache_queue);
-
-    if (pItem != NULL) {
-        WorkItem_Init(pItem, kItemType_Immediate, closure, true);
-        pQueue->item_cache_count--;
-        *pOutItem = pItem;
-    } else {
-        try(WorkItem_Create_Internal(closure, true, pOutItem));
-    }
-    return EOK;
-
-catch:
-    *pOutItem = NULL;
-    return err;
+    return WorkItem_Create_Internal(closure, true, pOutItem);
 }
 
 // Relinquishes the given work item. A work item owned by the dispatch queue is
-// moved back to the item reuse cache if possible or freed if the cache is full.
-// Does nothing if the dispatch queue does not own the item.
+// returned to the global work item cache. Does nothing if the dispatch queue
+// does not own the item.
 static void DispatchQueue_RelinquishWorkItem_Locked(DispatchQueue* _Nonnull pQueue, WorkItemRef _Nonnull pItem)
 {
-    if (!pItem->is_owned_by_queue) {
-        return;
-    }
-
-    if (pQueue->item_cache_count < MAX_ITEM_CACHE_COUNT) {
-        WorkItem_Deinit(pItem);
-        SList_InsertBeforeFirst(&pQueue->item_cache_queue, &pItem->queue_entry);
-        pQueue->item_cache_count++;
-    } else {
+    if (pItem->is_owned_by_queue) {
         WorkItem_Destroy(pItem);
     }
 }
 
-// Creates a timer for the given closure and closure context. Tries to reuse
-// an existing timer from the timer cache whenever possible. Expects that the
-// caller holds the dispatch queue lock.
+// Creates a timer for the given closure and closure context. The timer is
+// allocated from the global timer cache. Expects that the caller holds the
+// dispatch queue lock.
 static errno_t DispatchQueue_AcquireTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimeInterval deadline, TimeInterval interval, DispatchQueueClosure closure, TimerRef _Nullable * _Nonnull pOutTimer)
 {
-    decl_try_err();
-    TimerRef pTimer = (TimerRef) SList_RemoveFirst(&pQueue->timer_cache_queue);
-
-    if (pTimer != NULL) {
-        Timer_Init(pTimer, deadline, interval, closure, true);
-        pQueue->timer_cache_count--;
-        *pOutTimer = pTimer;
-    } else {
-        try(Timer_Create_Internal(deadline, interval, closure, true, pOutTimer));
-    }
-    return EOK;
-
-catch:
-    *pOutTimer = NULL;
-    return err;
+    return Timer_Create_Internal(deadline, interval, closure, true, pOutTimer);
 }
 
-// Relinquishes the given timer. A timer owned by the queue is moved back to the
-// timer reuse queue if possible or freed id the reuse cache is already full.
-// Does nothing if the queue does not own the timer.
+// Relinquishes the given timer. A timer owned by the queue is returned to the
+// global timer cache. Does nothing if the queue does not own the timer.
 static void DispatchQueue_RelinquishTimer_Locked(DispatchQueue* _Nonnull pQueue, TimerRef _Nonnull pTimer)
 {
-    if (!pTimer->item.is_owned_by_queue) {
-        return;
-    }
-
-    if (pQueue->timer_cache_count < MAX_TIMER_CACHE_COUNT) {
-        Timer_Deinit(pTimer);
-        SList_InsertBeforeFirst(&pQueue->timer_cache_queue, &pTimer->item.queue_entry);
-        pQueue->timer_cache_count++;
-    } else {
+    if (pTimer->item.is_owned_by_queue) {
         Timer_Destroy(pTimer);
     }
 }
 
-// Creates a completion signaler. Tries to reuse an existing completion signaler
-// from the completion signaler cache whenever possible. Expects that
-// the caller holds the dispatch queue lock.
+// Creates a completion signaler. The completion signaler is allocated from the
+// global completion signaler cache. Expects that the caller holds the dispatch
+// queue lock.
 static errno_t DispatchQueue_AcquireCompletionSignaler_Locked(DispatchQueueRef _Nonnull pQueue, CompletionSignaler* _Nullable * _Nonnull pOutComp)
 {
-    decl_try_err();
-    CompletionSignaler* pItem = (CompletionSignaler*) SList_RemoveFirst(&pQueue->completion_signaler_cache_queue);
-
-    if (pItem != NULL) {
-        CompletionSignaler_Init(pItem);
-        pQueue->completion_signaler_count--;
-        *pOutComp = pItem;
-    } else {
-        try(CompletionSignaler_Create(pOutComp));
-    }
-    return EOK;
-
-catch:
-    *pOutComp = NULL;
-    return err;
+    return CompletionSignaler_Create(pOutComp);
 }
 
-// Relinquishes the given completion signaler back to the completion signaler
-// cache if possible. The completion signaler is freed if the cache is at capacity.
+// Relinquishes the given completion signaler back to the global completion
+// signaler cache.
 static void DispatchQueue_RelinquishCompletionSignaler_Locked(DispatchQueue* _Nonnull pQueue, CompletionSignaler* _Nonnull pItem)
 {
-    if (pQueue->completion_signaler_count < MAX_COMPLETION_SIGNALER_CACHE_COUNT) {
-        CompletionSignaler_Deinit(pItem);
-        SList_InsertBeforeFirst(&pQueue->completion_signaler_cache_queue, &pItem->queue_entry);
-        pQueue->completion_signaler_count++;
-    } else {
-        CompletionSignaler_Destroy(pItem);
-    }
+    CompletionSignaler_Destroy(pItem);
 }
 
 // Asynchronously executes the given work item. The work item is executed as
@@ -368,6 +326,7 @@ static errno_t DispatchQueue_DispatchWorkItemAsyncAndUnlock_Locked(DispatchQueue
 {
     decl_try_err();
 
+    pItem->enqueue_time = MonotonicClock_GetCurrentQuantums();
     SList_InsertAfterLast(&pQueue->item_queue, &pItem->queue_entry);
     pQueue->items_queued_count++;
 
@@ -455,23 +414,135 @@ static void DispatchQueue_RemoveWorkItem_Locked(DispatchQueueRef _Nonnull pQueue
     }
 }
 
-// Adds the given timer to the timer queue. Expects that the queue is already
-// locked. Does not wake up the queue.
-static void DispatchQueue_AddTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
+// Returns true if the timer 'pLhs' should fire before the timer 'pRhs'.
+static bool Timer_FiresBefore(TimerRef _Nonnull pLhs, TimerRef _Nonnull pRhs)
 {
-    TimerRef pPrevTimer = NULL;
-    TimerRef pCurTimer = (TimerRef)pQueue->timer_queue.first;
-    
-    while (pCurTimer) {
-        if (TimeInterval_Greater(pCurTimer->deadline, pTimer->deadline)) {
+    if (TimeInterval_Equals(pLhs->deadline, pRhs->deadline)) {
+        return (int32_t)(pLhs->sequence - pRhs->sequence) < 0;
+    }
+    return TimeInterval_Less(pLhs->deadline, pRhs->deadline);
+}
+
+// Stores the timer 'pTimer' at index 'idx' of the timer queue heap.
+static void DispatchQueue_SetTimerAt_Locked(DispatchQueueRef _Nonnull pQueue, int idx, TimerRef _Nonnull pTimer)
+{
+    pQueue->timer_queue[idx] = pTimer;
+    pTimer->heap_index = idx;
+}
+
+// Moves the timer at index 'idx' up the heap until its parent fires before it.
+static void DispatchQueue_SiftTimerUp_Locked(DispatchQueueRef _Nonnull pQueue, int idx)
+{
+    TimerRef pTimer = pQueue->timer_queue[idx];
+
+    while (idx > 0) {
+        const int parentIdx = (idx - 1) >> 1;
+        TimerRef pParent = pQueue->timer_queue[parentIdx];
+
+        if (!Timer_FiresBefore(pTimer, pParent)) {
             break;
         }
-        
-        pPrevTimer = pCurTimer;
-        pCurTimer = (TimerRef)pCurTimer->item.queue_entry.next;
+
+        DispatchQueue_SetTimerAt_Locked(pQueue, idx, pParent);
+        idx = parentIdx;
     }
-    
-    SList_InsertAfter(&pQueue->timer_queue, &pTimer->item.queue_entry, &pPrevTimer->item.queue_entry);
+    DispatchQueue_SetTimerAt_Locked(pQueue, idx, pTimer);
+}
+
+// Moves the timer at index 'idx' down the heap until it fires before its
+// children.
+static void DispatchQueue_SiftTimerDown_Locked(DispatchQueueRef _Nonnull pQueue, int idx)
+{
+    TimerRef pTimer = pQueue->timer_queue[idx];
+
+    while (true) {
+        int childIdx = (idx << 1) + 1;
+
+        if (childIdx >= pQueue->timer_count) {
+            break;
+        }
+        if (childIdx + 1 < pQueue->timer_count && Timer_FiresBefore(pQueue->timer_queue[childIdx + 1], pQueue->timer_queue[childIdx])) {
+            childIdx++;
+        }
+        if (!Timer_FiresBefore(pQueue->timer_queue[childIdx], pTimer)) {
+            break;
+        }
+
+        DispatchQueue_SetTimerAt_Locked(pQueue, idx, pQueue->timer_queue[childIdx]);
+        idx = childIdx;
+    }
+    DispatchQueue_SetTimerAt_Locked(pQueue, idx, pTimer);
+}
+
+// Removes the timer at index 'idx' from the timer queue.
+static void DispatchQueue_RemoveTimerAt_Locked(DispatchQueueRef _Nonnull pQueue, int idx)
+{
+    TimerRef pTimer = pQueue->timer_queue[idx];
+
+    pQueue->timer_count--;
+    if (idx < pQueue->timer_count) {
+        DispatchQueue_SetTimerAt_Locked(pQueue, idx, pQueue->timer_queue[pQueue->timer_count]);
+        DispatchQueue_SiftTimerDown_Locked(pQueue, idx);
+        DispatchQueue_SiftTimerUp_Locked(pQueue, idx);
+    }
+    pQueue->timer_queue[pQueue->timer_count] = NULL;
+    pTimer->heap_index = -1;
+}
+
+// Returns the timer that is due next without removing it from the timer queue.
+// Returns NULL if the timer queue is empty.
+#define DispatchQueue_GetFirstTimer_Locked(__pQueue) \
+    (((__pQueue)->timer_count > 0) ? (__pQueue)->timer_queue[0] : NULL)
+
+// Removes the timer that is due next from the timer queue and returns it.
+// Returns NULL if the timer queue is empty.
+static TimerRef _Nullable DispatchQueue_RemoveFirstTimer_Locked(DispatchQueueRef _Nonnull pQueue)
+{
+    TimerRef pTimer = DispatchQueue_GetFirstTimer_Locked(pQueue);
+
+    if (pTimer) {
+        DispatchQueue_RemoveTimerAt_Locked(pQueue, 0);
+    }
+    return pTimer;
+}
+
+// Inserts the given timer into the timer queue heap. Expects that the heap has
+// room for the timer. Timers with the same deadline fire in the order in which
+// they were inserted.
+static void DispatchQueue_InsertTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
+{
+    assert(pQueue->timer_count < pQueue->timer_capacity);
+
+    pTimer->sequence = pQueue->timer_sequence++;
+    DispatchQueue_SetTimerAt_Locked(pQueue, pQueue->timer_count, pTimer);
+    pQueue->timer_count++;
+    DispatchQueue_SiftTimerUp_Locked(pQueue, pTimer->heap_index);
+}
+
+// Adds the given timer to the timer queue. Expects that the queue is already
+// locked. Does not wake up the queue. Grows the timer queue heap if all of its
+// free slots are taken or reserved by executing repeating timers.
+static errno_t DispatchQueue_AddTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
+{
+    decl_try_err();
+
+    if (pQueue->timer_count + pQueue->timer_reserved == pQueue->timer_capacity) {
+        const int newCapacity = (pQueue->timer_capacity > 0) ? pQueue->timer_capacity * 2 : 8;
+        TimerRef* pNewQueue;
+
+        try(kalloc(sizeof(TimerRef) * newCapacity, (void**) &pNewQueue));
+        if (pQueue->timer_count > 0) {
+            memcpy(pNewQueue, pQueue->timer_queue, sizeof(TimerRef) * pQueue->timer_count);
+        }
+        kfree(pQueue->timer_queue);
+        pQueue->timer_queue = pNewQueue;
+        pQueue->timer_capacity = newCapacity;
+    }
+
+    DispatchQueue_InsertTimer_Locked(pQueue, pTimer);
+
+catch:
+    return err;
 }
 
 // Asynchronously executes the given timer when it comes due. Expects that the
@@ -480,7 +551,7 @@ errno_t DispatchQueue_DispatchTimer_Locked(DispatchQueueRef _Nonnull pQueue, Tim
 {
     decl_try_err();
 
-    DispatchQueue_AddTimer_Locked(pQueue, pTimer);
+    try(DispatchQueue_AddTimer_Locked(pQueue, pTimer));
     try(DispatchQueue_AcquireVirtualProcessor_Locked(pQueue));
     ConditionVariable_SignalAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
 
@@ -494,22 +565,12 @@ catch:
 // queue.
 static void DispatchQueue_RemoveTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
 {
-    TimerRef pCurItem = (TimerRef) pQueue->timer_queue.first;
-    TimerRef pPrevItem = NULL;
-
-    while (pCurItem) {
-        if (pCurItem == pTimer) {
-            TimerRef pNextItem = (TimerRef) pCurItem->item.queue_entry.next;
+    const int idx = pTimer->heap_index;
 
-            SList_Remove(&pQueue->timer_queue, &pPrevItem->item.queue_entry, &pCurItem->item.queue_entry);
-            DispatchQueue_RelinquishTimer_Locked(pQueue, pCurItem);
-            // pPrevItem doesn't change here
-            pCurItem = pNextItem;
-        }
-        else {
-            pPrevItem = pCurItem;
-            pCurItem = (TimerRef) pCurItem->item.queue_entry.next;
-        }
+    // A timer is in at most one timer queue at any given time
+    if (idx >= 0 && idx < pQueue->timer_count && pQueue->timer_queue[idx] == pTimer) {
+        DispatchQueue_RemoveTimerAt_Locked(pQueue, idx);
+        DispatchQueue_RelinquishTimer_Locked(pQueue, pTimer);
     }
 }
 
@@ -536,6 +597,38 @@ DispatchQueueRef _Nullable DispatchQueue_GetCurrent(void)
     return (DispatchQueueRef) VirtualProcessor_GetCurrent()->dispatchQueue;
 }
 
+// Returns the current lane scaling tunables of the queue.
+void DispatchQueue_GetTunables(DispatchQueueRef _Nonnull pQueue, DispatchQueueTunables* _Nonnull pOutTunables)
+{
+    Lock_Lock(&pQueue->lock);
+    *pOutTunables = pQueue->tunables;
+    Lock_Unlock(&pQueue->lock);
+}
+
+// Replaces the lane scaling tunables of the queue. The new values take effect
+// the next time that the queue decides whether it should add or remove a lane.
+errno_t DispatchQueue_SetTunables(DispatchQueueRef _Nonnull pQueue, const DispatchQueueTunables* _Nonnull pTunables)
+{
+    if (TimeInterval_LessEquals(pTunables->latencyTarget, kTimeInterval_Zero)
+        || TimeInterval_IsNegative(pTunables->idleTimeout)) {
+        return EINVAL;
+    }
+
+    Lock_Lock(&pQueue->lock);
+    pQueue->tunables = *pTunables;
+    pQueue->latency_target = Quantums_MakeFromTimeInterval(pTunables->latencyTarget, QUANTUM_ROUNDING_AWAY_FROM_ZERO);
+    Lock_Unlock(&pQueue->lock);
+
+    return EOK;
+}
+
+// Returns the maximum number of concurrency lanes of the queue. The value never
+// changes and thus doesn't need the queue lock.
+int DispatchQueue_GetMaxConcurrency(DispatchQueueRef _Nonnull pQueue)
+{
+    return pQueue->maxConcurrency;
+}
+
 
 // Synchronously executes the given closure. The closure is executed as soon as
 // possible and the caller remains blocked until the closure has finished
@@ -551,7 +644,7 @@ errno_t DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, DispatchQue
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
         Lock_Unlock(&pQueue->lock);
-        return EOK;
+        return ECANCELED;
     }
 
     try(DispatchQueue_AcquireWorkItem_Locked(pQueue, closure, &pItem));
@@ -580,7 +673,7 @@ errno_t DispatchQueue_DispatchAsync(DispatchQueueRef _Nonnull pQueue, DispatchQu
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
         Lock_Unlock(&pQueue->lock);
-        return EOK;
+        return ECANCELED;
     }
 
     try(DispatchQueue_AcquireWorkItem_Locked(pQueue, closure, &pItem));
@@ -597,6 +690,213 @@ catch:
     return err;
 }
 
+// Asynchronously executes the given closures. The closures are enqueued in the
+// order in which they appear in the array. Either all closures are enqueued or
+// none of them is. All closures are enqueued inside a single critical section
+// and the queue wakes up at most as many virtual processors as it has closures
+// to execute.
+errno_t DispatchQueue_DispatchAsyncBatch(DispatchQueueRef _Nonnull pQueue, const DispatchQueueClosure* _Nonnull pClosures, int count)
+{
+    decl_try_err();
+    SList items;
+    SListNode* pPrevLast;
+    WorkItem* pItem;
+    Quantums now;
+
+    if (count <= 0) {
+        return (count == 0) ? EOK : EINVAL;
+    }
+
+    SList_Init(&items);
+    Lock_Lock(&pQueue->lock);
+    if (pQueue->state >= kQueueState_Terminating) {
+        Lock_Unlock(&pQueue->lock);
+        return ECANCELED;
+    }
+
+    now = MonotonicClock_GetCurrentQuantums();
+    for (int i = 0; i < count; i++) {
+        try(DispatchQueue_AcquireWorkItem_Locked(pQueue, pClosures[i], &pItem));
+        pItem->enqueue_time = now;
+        SList_InsertAfterLast(&items, &pItem->queue_entry);
+    }
+
+    // Append the whole batch to the work item queue in one go
+    pPrevLast = pQueue->item_queue.last;
+    if (pPrevLast) {
+        pQueue->item_queue.last->next = items.first;
+    } else {
+        pQueue->item_queue.first = items.first;
+    }
+    pQueue->item_queue.last = items.last;
+    pQueue->items_queued_count += count;
+
+
+    // Acquire as many virtual processors as the queue is willing to give us
+    // for this batch. Failing to acquire an additional virtual processor is
+    // fine as long as we have at least one that will drain the queue.
+    for (int i = 0; i < count; i++) {
+        const int oldConcurrency = pQueue->availableConcurrency;
+
+        err = DispatchQueue_AcquireVirtualProcessor_Locked(pQueue);
+        if (err != EOK || pQueue->availableConcurrency == oldConcurrency) {
+            break;
+        }
+    }
+    if (err != EOK) {
+        if (pQueue->availableConcurrency == 0) {
+            // Nobody is able to execute the batch. Take it back out of the queue
+            if (pPrevLast) {
+                pPrevLast->next = NULL;
+            } else {
+                pQueue->item_queue.first = NULL;
+            }
+            pQueue->item_queue.last = pPrevLast;
+            pQueue->items_queued_count -= count;
+            throw(err);
+        }
+        err = EOK;
+    }
+
+
+    // Wake up one virtual processor per work item but never more than we have.
+    // The lanes are signaled after the queue lock has been dropped so that a
+    // woken lane doesn't immediately block on the lock that we still hold
+    if (count >= pQueue->availableConcurrency) {
+        ConditionVariable_BroadcastAndUnlock(&pQueue->work_available_signaler, &pQueue->lock);
+    } else {
+        Lock_Unlock(&pQueue->lock);
+        for (int i = 0; i < count; i++) {
+            ConditionVariable_SignalAndUnlock(&pQueue->work_available_signaler, NULL);
+        }
+    }
+    return err;
+
+catch:
+    while ((pItem = (WorkItemRef) SList_RemoveFirst(&items)) != NULL) {
+        DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+    }
+    Lock_Unlock(&pQueue->lock);
+    return err;
+}
+
+// Drops a reference to the apply state and frees it once the last reference is
+// gone.
+static void ApplyState_Release(ApplyState* _Nonnull pState)
+{
+    if (AtomicInt_Decrement(&pState->refCount) == 0) {
+        Semaphore_Deinit(&pState->allChunksDone);
+        kfree(pState);
+    }
+}
+
+// Executes chunks of the apply range until no more chunks are left.
+static void DispatchQueue_ExecuteApplyChunks(ApplyState* _Nonnull pState)
+{
+    int chunk;
+
+    while ((chunk = AtomicInt_Increment(&pState->nextChunk) - 1) < pState->chunkCount) {
+        const int firstIndex = chunk * pState->chunkSize;
+        const int lastIndex = __min(firstIndex + pState->chunkSize, pState->iterations);
+
+        for (int i = firstIndex; i < lastIndex; i++) {
+            pState->func(pState->context, i);
+        }
+
+        if (AtomicInt_Increment(&pState->chunksDone) == pState->chunkCount) {
+            Semaphore_Relinquish(&pState->allChunksDone);
+        }
+    }
+}
+
+// The closure of an apply helper work item.
+static void DispatchQueue_ApplyHelper(ApplyState* _Nonnull pState)
+{
+    DispatchQueue_ExecuteApplyChunks(pState);
+    ApplyState_Release(pState);
+}
+
+// Flushes a work item that won't execute. Signals its completion and drops the
+// apply state reference of an apply helper.
+static void DispatchQueue_DiscardWorkItem_Locked(DispatchQueue* _Nonnull pQueue, WorkItemRef _Nonnull pItem)
+{
+    WorkItem_SignalCompletion(pItem, true);
+    if (!pItem->closure.isUser && pItem->closure.func == (Closure1Arg_Func)DispatchQueue_ApplyHelper) {
+        ApplyState_Release((ApplyState*)pItem->closure.context);
+    }
+    DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
+}
+
+// Invokes 'func' once for every index in the range [0, iterations) and returns
+// once all invocations have completed. See the header for details.
+errno_t DispatchQueue_Apply(DispatchQueueRef _Nonnull pQueue, int iterations, DispatchQueueApplyFunc _Nonnull func, void* _Nullable pContext)
+{
+    decl_try_err();
+    ApplyState* pState;
+    DispatchQueueClosure helpers[APPLY_MAX_HELPER_COUNT];
+    int helperCount;
+
+    if (iterations <= 0) {
+        return (iterations == 0) ? EOK : EINVAL;
+    }
+
+    // We participate ourselves. So we only need helpers for the remaining
+    // concurrency lanes. One of those lanes is us if we are running on the
+    // queue
+    helperCount = pQueue->maxConcurrency;
+    if (DispatchQueue_GetCurrent() == pQueue) {
+        helperCount--;
+    }
+    helperCount = __min(helperCount, APPLY_MAX_HELPER_COUNT);
+
+    try(kalloc(sizeof(ApplyState), (void**) &pState));
+    pState->func = func;
+    pState->context = pContext;
+    pState->iterations = iterations;
+    pState->chunkCount = __min(iterations, (helperCount + 1) * APPLY_CHUNKS_PER_LANE);
+    pState->chunkSize = (iterations + pState->chunkCount - 1) / pState->chunkCount;
+    pState->chunkCount = (iterations + pState->chunkSize - 1) / pState->chunkSize;
+    pState->nextChunk = 0;
+    pState->chunksDone = 0;
+    pState->refCount = 1;
+    Semaphore_Init(&pState->allChunksDone, 0);
+
+    helperCount = __min(helperCount, pState->chunkCount - 1);
+    if (helperCount > 0) {
+        for (int i = 0; i < helperCount; i++) {
+            helpers[i] = DispatchQueueClosure_Make((Closure1Arg_Func)DispatchQueue_ApplyHelper, pState);
+        }
+
+        pState->refCount += helperCount;
+        if (DispatchQueue_DispatchAsyncBatch(pQueue, helpers, helperCount) != EOK) {
+            // Do all the work ourselves
+            pState->refCount -= helperCount;
+            helperCount = 0;
+        }
+    }
+
+    DispatchQueue_ExecuteApplyChunks(pState);
+
+
+    // Helpers that haven't started by now would only find that there's nothing
+    // left to do. They may be queued behind us or behind other lanes that are
+    // waiting for an apply themselves. So we take them back out of the queue
+    // instead of waiting for them to run
+    if (helperCount > 0) {
+        (void) DispatchQueue_RemoveClosure(pQueue, DispatchQueueClosure_Make((Closure1Arg_Func)DispatchQueue_ApplyHelper, pState));
+    }
+
+
+    // Wait for the participants that are still executing the chunks they have
+    // claimed. A helper that finishes after we have stopped waiting because we
+    // were interrupted keeps the state alive until it is done
+    err = Semaphore_Acquire(&pState->allChunksDone, kTimeInterval_Infinity);
+    ApplyState_Release(pState);
+
+catch:
+    return err;
+}
+
 // Asynchronously executes the given closure on or after 'deadline'. The dispatch
 // queue will try to execute the closure as close to 'deadline' as possible.
 errno_t DispatchQueue_DispatchAsyncAfter(DispatchQueueRef _Nonnull pQueue, TimeInterval deadline, DispatchQueueClosure closure)
@@ -609,7 +909,7 @@ errno_t DispatchQueue_DispatchAsyncAfter(DispatchQueueRef _Nonnull pQueue, TimeI
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
         Lock_Unlock(&pQueue->lock);
-        return EOK;
+        return ECANCELED;
     }
 
     try(DispatchQueue_AcquireTimer_Locked(pQueue, deadline, kTimeInterval_Zero, closure, &pTimer));
@@ -645,7 +945,7 @@ errno_t DispatchQueue_DispatchWorkItemSync(DispatchQueueRef _Nonnull pQueue, Wor
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
         Lock_Unlock(&pQueue->lock);
-        return EOK;
+        return ECANCELED;
     }
 
     try(DispatchQueue_DispatchWorkItemSyncAndUnlock_Locked(pQueue, pItem));
@@ -674,7 +974,7 @@ errno_t DispatchQueue_DispatchWorkItemAsync(DispatchQueueRef _Nonnull pQueue, Wo
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
         Lock_Unlock(&pQueue->lock);
-        return EOK;
+        return ECANCELED;
     }
 
     try(DispatchQueue_DispatchWorkItemAsyncAndUnlock_Locked(pQueue, pItem));
@@ -705,6 +1005,39 @@ void DispatchQueue_RemoveWorkItem(DispatchQueueRef _Nonnull pQueue, WorkItemRef
     Lock_Unlock(&pQueue->lock);
 }
 
+// Removes all queued work items with the closure 'closure' from the dispatch
+// queue and returns how many were removed. Closures are compared by function,
+// context and whether they are user closures.
+int DispatchQueue_RemoveClosure(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure)
+{
+    int count = 0;
+
+    Lock_Lock(&pQueue->lock);
+    WorkItemRef pCurItem = (WorkItemRef) pQueue->item_queue.first;
+    WorkItemRef pPrevItem = NULL;
+
+    while (pCurItem) {
+        WorkItemRef pNextItem = (WorkItemRef) pCurItem->queue_entry.next;
+
+        if (pCurItem->closure.func == closure.func
+            && pCurItem->closure.context == closure.context
+            && pCurItem->closure.isUser == closure.isUser) {
+            SList_Remove(&pQueue->item_queue, &pPrevItem->queue_entry, &pCurItem->queue_entry);
+            pQueue->items_queued_count--;
+            DispatchQueue_DiscardWorkItem_Locked(pQueue, pCurItem);
+            count++;
+            // pPrevItem doesn't change here
+        }
+        else {
+            pPrevItem = pCurItem;
+        }
+        pCurItem = pNextItem;
+    }
+    Lock_Unlock(&pQueue->lock);
+
+    return count;
+}
+
 
 // Asynchronously executes the given timer when it comes due.
 errno_t DispatchQueue_DispatchTimer(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
@@ -721,7 +1054,7 @@ errno_t DispatchQueue_DispatchTimer(DispatchQueueRef _Nonnull pQueue, TimerRef _
     needsUnlock = true;
     if (pQueue->state >= kQueueState_Terminating) {
         Lock_Unlock(&pQueue->lock);
-        return EOK;
+        return ECANCELED;
     }
 
     try(DispatchQueue_DispatchTimer_Locked(pQueue, pTimer));
@@ -765,6 +1098,8 @@ void DispatchQueue_Flush(DispatchQueueRef _Nonnull pQueue)
 // MARK: Queue Main Loop
 ////////////////////////////////////////////////////////////////////////////////
 
+// Rearms the repeating timer 'pTimer' after it has executed. The timer reuses
+// the heap slot that was reserved for it when it was taken off the timer queue.
 static void DispatchQueue_RearmTimer_Locked(DispatchQueueRef _Nonnull pQueue, TimerRef _Nonnull pTimer)
 {
     // Repeating timer: rearm it with the next fire date that's in
@@ -775,7 +1110,7 @@ static void DispatchQueue_RearmTimer_Locked(DispatchQueueRef _Nonnull pQueue, Ti
         pTimer->deadline = TimeInterval_Add(pTimer->deadline, pTimer->interval);
     } while (TimeInterval_Less(pTimer->deadline, curTime));
     
-    DispatchQueue_AddTimer_Locked(pQueue, pTimer);
+    DispatchQueue_InsertTimer_Locked(pQueue, pTimer);
 }
 
 void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
@@ -790,6 +1125,8 @@ void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
     while (true) {
         WorkItemRef pItem = NULL;
         bool mayRelinquish = false;
+        bool isIdle = false;
+        TimeInterval idleDeadline;
         
         // Wait for work items to arrive or for timers to fire
         while (true) {
@@ -797,16 +1134,19 @@ void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
             // they are tied to a specific deadline time while immediate work items
             // do not guarantee that they will execute at a specific time. So it's
             // acceptable to push them back on the timeline.
-            Timer* pFirstTimer = (Timer*)pQueue->timer_queue.first;
+            Timer* pFirstTimer = DispatchQueue_GetFirstTimer_Locked(pQueue);
             if (pFirstTimer && TimeInterval_LessEquals(pFirstTimer->deadline, MonotonicClock_GetCurrentTime())) {
-                pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->timer_queue);
+                pItem = (WorkItemRef) DispatchQueue_RemoveFirstTimer_Locked(pQueue);
             }
 
 
             // Grab the first work item if no timer is due
             if (pItem == NULL) {
                 pItem = (WorkItemRef) SList_RemoveFirst(&pQueue->item_queue);
-                pQueue->items_queued_count--;
+                if (pItem) {
+                    pQueue->items_queued_count--;
+                    pQueue->avg_queue_latency = DispatchQueue_UpdateAverage(pQueue->avg_queue_latency, MonotonicClock_GetCurrentQuantums() - pItem->enqueue_time);
+                }
             }
 
 
@@ -819,47 +1159,81 @@ void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
             }
             
 
-            // Compute a deadline for the wait. We do not wait if the deadline
-            // is equal to the current time or it's in the past
+            // Compute a deadline for the wait. We wait until the next timer
+            // is due or the idle timeout has expired, whichever comes first.
+            // We do not wait if the deadline is equal to the current time or
+            // it's in the past
             TimeInterval deadline;
 
-            if (pQueue->timer_queue.first) {
-                deadline = ((TimerRef)pQueue->timer_queue.first)->deadline;
-            } else {
-                deadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), TimeInterval_MakeSeconds(2));
+            if (!isIdle) {
+                idleDeadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), pQueue->tunables.idleTimeout);
+                isIdle = true;
+            }
+            deadline = idleDeadline;
+            if (pQueue->timer_count > 0 && TimeInterval_Less(DispatchQueue_GetFirstTimer_Locked(pQueue)->deadline, deadline)) {
+                deadline = DispatchQueue_GetFirstTimer_Locked(pQueue)->deadline;
             }
 
 
             // Wait for work. This drops the queue lock while we're waiting. This
             // call may return with a ETIMEDOUT error. This is fine. Either some
             // new work has arrived in the meantime or if not then we are free
-            // to relinquish the VP since it hasn't done anything useful for a
-            // longer time.
+            // to relinquish the VP once it has been idle for the idle timeout.
+            // The last lane stays around as long as timers are pending.
             const int err = ConditionVariable_Wait(&pQueue->work_available_signaler, &pQueue->lock, deadline);
-            if (err == ETIMEDOUT && pQueue->availableConcurrency > pQueue->minConcurrency) {
+            if (err == ETIMEDOUT
+                && TimeInterval_GreaterEquals(MonotonicClock_GetCurrentTime(), idleDeadline)
+                && pQueue->availableConcurrency > pQueue->minConcurrency
+                && (pQueue->availableConcurrency > 1 || pQueue->timer_count == 0)) {
                 mayRelinquish = true;
             }
         }
 
         
         // Relinquish this VP if we did not get an item to execute or the queue
-        // is terminating
+        // is terminating. An item that we won't execute is flushed
         if (pItem == NULL || pQueue->state >= kQueueState_Terminating) {
+            if (pItem) {
+                if (pItem->type == kItemType_Immediate) {
+                    DispatchQueue_DiscardWorkItem_Locked(pQueue, pItem);
+                } else {
+                    WorkItem_SignalCompletion(pItem, true);
+                    DispatchQueue_RelinquishTimer_Locked(pQueue, (TimerRef)pItem);
+                }
+            }
             break;
         }
 
 
+        // Bring another lane online if the backlog is growing faster than the
+        // existing lanes are able to drain it. Failing to acquire one is fine
+        // since we are going to drain the queue ourselves anyway
+        if (pQueue->items_queued_count > 0) {
+            DispatchQueue_AcquireVirtualProcessor_Locked(pQueue);
+        }
+
+
+        // Keep the heap slot of a repeating timer reserved while it executes.
+        // Other timers may be added while we don't hold the lock and rearming
+        // the timer must not have to grow the heap
+        if (pItem->type == kItemType_RepeatingTimer) {
+            pQueue->timer_reserved++;
+        }
+
+
         // Drop the lock. We do not want to hold it while the closure is executing
         // and we are (if needed) signaling completion.
         Lock_Unlock(&pQueue->lock);
 
 
         // Execute the work item
+        const Quantums startTime = MonotonicClock_GetCurrentQuantums();
         if (pItem->closure.isUser) {
             VirtualProcessor_CallAsUser(pVP, pItem->closure.func, pItem->closure.context);
         } else {
             pItem->closure.func(pItem->closure.context);
         }
+        const Quantums serviceTime = MonotonicClock_GetCurrentQuantums() - startTime;
 
         // Signal the work item's completion semaphore if needed
         if (pItem->completion != NULL) {
@@ -869,9 +1243,10 @@ void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
 
         // Reacquire the lock
         Lock_Lock(&pQueue->lock);
+        pQueue->avg_service_time = DispatchQueue_UpdateAverage(pQueue->avg_service_time, serviceTime);
 
 
-        // Move the work item back to the item cache if possible or destroy it
+        // Return the work item to the item cache if the queue owns it
         switch (pItem->type) {
             case kItemType_Immediate:
                 DispatchQueue_RelinquishWorkItem_Locked(pQueue, pItem);
@@ -884,6 +1259,7 @@ void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue)
             case kItemType_RepeatingTimer: {
                 Timer* pTimer = (TimerRef)pItem;
                 
+                pQueue->timer_reserved--;
                 if (pTimer->item.cancelled) {
                     DispatchQueue_RelinquishTimer_Locked(pQueue, pTimer);
                 } else if (pQueue->state == kQueueState_Running) {
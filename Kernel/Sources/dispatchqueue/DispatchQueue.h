@@ -48,10 +48,17 @@ typedef struct _DispatchQueueClosure {
     ((DispatchQueueClosure) {__pFunc, __pContext, true, {0, 0, 0}})
 
 
+// The function that DispatchQueue_Apply() invokes once per iteration index.
+typedef void (* _Nonnull DispatchQueueApplyFunc)(void* _Nullable pContext, int index);
+
+
 //
 // Work Items
 //
 
+// Creates the global work item, timer and completion signaler caches. Must be
+// called once at boot time before the first dispatch queue is created.
+extern errno_t WorkItem_InitCaches(void);
 
 // Creates a work item which will invoke the given closure. Note that work items
 // are one-shot: they execute their closure and then the work item is destroyed.
@@ -169,6 +176,21 @@ extern ProcessRef _Nullable _Weak DispatchQueue_GetOwningProcess(DispatchQueueRe
 // from the virtual processor pool.
 extern DispatchQueueRef _Nullable DispatchQueue_GetCurrent(void);
 
+// Returns the current lane scaling tunables of the queue.
+extern void DispatchQueue_GetTunables(DispatchQueueRef _Nonnull pQueue, DispatchQueueTunables* _Nonnull pOutTunables);
+
+// Replaces the lane scaling tunables of the queue. Returns EINVAL if the latency
+// target is not positive or the idle timeout is negative. See the libsystem
+// DispatchQueue_SetTunables() for a description of the policy.
+extern errno_t DispatchQueue_SetTunables(DispatchQueueRef _Nonnull pQueue, const DispatchQueueTunables* _Nonnull pTunables);
+
+// Returns the maximum number of concurrency lanes of the queue.
+extern int DispatchQueue_GetMaxConcurrency(DispatchQueueRef _Nonnull pQueue);
+
+
+// The dispatch functions below return ECANCELED and do not enqueue anything if
+// the queue is terminating or terminated. The closure, work item or timer will
+// not execute in this case.
 
 // Synchronously executes the given closure. The closure is executed as soon as
 // possible and the caller remains blocked until the closure has finished
@@ -180,6 +202,24 @@ extern errno_t DispatchQueue_DispatchSync(DispatchQueueRef _Nonnull pQueue, Disp
 // possible.
 extern errno_t DispatchQueue_DispatchAsync(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
 
+// Asynchronously executes the 'count' closures in 'pClosures' in array order.
+// All closures are enqueued in a single critical section and the queue wakes up
+// at most as many concurrency lanes as there are closures. Either all closures
+// are enqueued or none of them is.
+extern errno_t DispatchQueue_DispatchAsyncBatch(DispatchQueueRef _Nonnull pQueue, const DispatchQueueClosure* _Nonnull pClosures, int count);
+
+// Invokes 'func' once for every index in the range [0, iterations) and returns
+// once all invocations have completed. The invocations are distributed over the
+// concurrency lanes of the queue and the caller executes invocations itself
+// while it waits for the lanes. The index range is split into chunks and every
+// participant pulls the next chunk from a shared counter. Invocations may run
+// in parallel and in any order. The caller never waits for a helper that hasn't
+// started. Helpers that are still queued once the caller has run out of chunks
+// are removed from the queue. So this function may be called from a closure
+// that executes on the same queue and it may be nested. Returns EINTR if the
+// caller is interrupted while it waits for the other participants.
+extern errno_t DispatchQueue_Apply(DispatchQueueRef _Nonnull pQueue, int iterations, DispatchQueueApplyFunc _Nonnull func, void* _Nullable pContext);
+
 // Asynchronously executes the given closure on or after 'deadline'. The dispatch
 // queue will try to execute the closure as close to 'deadline' as possible.
 extern errno_t DispatchQueue_DispatchAsyncAfter(DispatchQueueRef _Nonnull pQueue, TimeInterval deadline, DispatchQueueClosure closure);
@@ -212,6 +252,12 @@ extern errno_t DispatchQueue_DispatchWorkItemAsync(DispatchQueueRef _Nonnull pQu
 // EINTR error.
 extern void DispatchQueue_RemoveWorkItem(DispatchQueueRef _Nonnull pQueue, WorkItemRef _Nonnull pItem);
 
+// Removes all queued work items with the given closure from the dispatch queue
+// and returns the number of removed work items. Closures are equal if they have
+// the same function, context and user flag. Closures which are executing when
+// this function is called continue to execute undisturbed.
+extern int DispatchQueue_RemoveClosure(DispatchQueueRef _Nonnull pQueue, DispatchQueueClosure closure);
+
 
 // Asynchronously executes the given timer when it comes due. Note that a timer
 // in cancelled state is still dispatched since it is the job of the timer
@@ -42,6 +42,35 @@ extern void CompletionSignaler_Deinit(CompletionSignaler* _Nonnull pItem);
 extern void CompletionSignaler_Destroy(CompletionSignaler* _Nullable pItem);
 
 
+//
+// Apply
+//
+
+// Maximum number of helper work items that DispatchQueue_Apply() dispatches
+#define APPLY_MAX_HELPER_COUNT      8
+
+// Number of chunks per participating concurrency lane. More chunks improve the
+// load balance between lanes at the cost of more counter updates
+#define APPLY_CHUNKS_PER_LANE       4
+
+// Shared state of a DispatchQueue_Apply() invocation. Every participant claims
+// the next chunk of iterations by atomically incrementing 'nextChunk'. The
+// caller and every dispatched helper hold a reference to the state because a
+// helper may run after the caller has returned. The caller only waits for the
+// chunks that have been claimed and never for helpers that haven't started.
+typedef struct _ApplyState {
+    DispatchQueueApplyFunc _Nonnull func;
+    void* _Nullable                 context;
+    int                             iterations;
+    int                             chunkSize;
+    int                             chunkCount;
+    volatile AtomicInt              nextChunk;
+    volatile AtomicInt              chunksDone;
+    volatile AtomicInt              refCount;
+    Semaphore                       allChunksDone;  // Relinquished by the participant that finishes the last chunk
+} ApplyState;
+
+
 //
 // Work Items
 //
@@ -50,10 +79,11 @@ typedef struct _WorkItem {
     SListNode                               queue_entry;
     DispatchQueueClosure                    closure;
     CompletionSignaler * _Nullable _Weak    completion;
-    bool                                    is_owned_by_queue;      // item was created and is owned by the dispatch queue and thus is eligble to be moved to the work item cache
+    bool                                    is_owned_by_queue;      // item was created and is owned by the dispatch queue and thus is returned to the work item cache by the queue
     AtomicBool                              is_being_dispatched;    // shared between all dispatch queues (set to true while the work item is in the process of being dispatched by a queue; false if no queue is using it)
     AtomicBool                              cancelled;              // shared between dispatch queue and queue user
     int8_t                                  type;
+    Quantums                                enqueue_time;           // Time when the work item was added to the work item queue
 } WorkItem;
 
 extern errno_t WorkItem_Create_Internal(DispatchQueueClosure closure, bool isOwnedByQueue, WorkItemRef _Nullable * _Nonnull pOutItem);
@@ -70,6 +100,8 @@ typedef struct _Timer {
     WorkItem        item;
     TimeInterval    deadline;           // Time when the timer closure should be executed
     TimeInterval    interval;
+    uint32_t        sequence;           // Orders timers with the same deadline by the time they were added to the timer queue
+    int             heap_index;         // Index of the timer in the timer queue heap; -1 if not in a timer queue
 } Timer;
 
 extern errno_t Timer_Create_Internal(TimeInterval deadline, TimeInterval interval, DispatchQueueClosure closure, bool isOwnedByQueue, TimerRef _Nullable * _Nonnull pOutTimer);
@@ -91,6 +123,20 @@ typedef struct _ConcurrencyLane {
 } ConcurrencyLane;
 
 
+// Default values of the lane scaling tunables
+#define DISPATCH_DEFAULT_LATENCY_TARGET_MS  20
+#define DISPATCH_DEFAULT_IDLE_TIMEOUT_MS    250
+
+// The queue latency and service time averages are exponentially weighted moving
+// averages. They are stored as fixed point numbers in units of 1/256 quantums
+// which allows us to measure service times that are shorter than a quantum:
+// the fraction of samples that straddle a quantum boundary is proportional to
+// the service time.
+#define DISPATCH_AVG_FRACTION_BITS          8
+#define DISPATCH_AVG_WEIGHT_SHIFT           3
+#define DISPATCH_AVG_MAX_SAMPLE             (1 << 16)
+
+
 enum QueueState {
     kQueueState_Running,                // Queue is running and willing to accept and execute closures
     kQueueState_Terminating,            // DispatchQueue_Terminate() was called and the queue is in the process of terminating
@@ -98,30 +144,29 @@ enum QueueState {
 };
 
 
-#define MAX_ITEM_CACHE_COUNT    8
-#define MAX_TIMER_CACHE_COUNT   8
-#define MAX_COMPLETION_SIGNALER_CACHE_COUNT 8
 CLASS_IVARS(DispatchQueue, Object,
     SList                               item_queue;         // Queue of work items that should be executed as soon as possible
-    SList                               timer_queue;        // Queue of items that should be executed on or after their deadline
-    SList                               item_cache_queue;   // Cache of reusable work items
-    SList                               timer_cache_queue;  // Cache of reusable timers
-    SList                               completion_signaler_cache_queue;    // Cache of reusable completion signalers
+    TimerRef _Nullable * _Nullable      timer_queue;        // Min-heap of timers ordered by deadline. Timers with the same deadline are ordered by their sequence number
+    int                                 timer_count;        // Number of timers in the timer queue
+    int                                 timer_capacity;     // Capacity of the timer queue heap
+    int                                 timer_reserved;     // Number of heap slots reserved for repeating timers that are executing and will be rearmed
+    uint32_t                            timer_sequence;     // Sequence number of the next timer that is added to the timer queue
     Lock                                lock;
     ConditionVariable                   work_available_signaler;    // Used by the queue to indicate to its VPs that a new work item/timer has bbeen enqueued
     ConditionVariable                   vp_shutdown_signaler;       // Used by a VP to indicate that it has relinqushed itself because the queue is in the process of shutting down
     ProcessRef _Nullable _Weak          owning_process;             // The process that owns this queue
     VirtualProcessorPoolRef _Nonnull    virtual_processor_pool;     // Pool from which the queue should retrieve virtual processors
     int                                 items_queued_count;         // Number of work items queued up (item_queue)
+    DispatchQueueTunables               tunables;                   // Lane scaling policy tunables
+    Quantums                            latency_target;             // tunables.latencyTarget in quantums
+    int32_t                             avg_queue_latency;          // Average time a work item waits in the work item queue before it starts executing [1/256 quantums]
+    int32_t                             avg_service_time;           // Average time a work item takes to execute [1/256 quantums]; -1 if nothing has been measured yet
     int8_t                              state;                      // The current dispatch queue state
     int8_t                              minConcurrency;             // Minimum number of concurrency lanes that we are required to maintain. So we should not allow availableConcurrency to fall below this when we think we want to voluntarily relinquish a VP
     int8_t                              maxConcurrency;             // Maximum number of concurrency lanes we are allowed to allocate and use
     int8_t                              availableConcurrency;       // Number of concurrency lanes we have acquired and are available for use
     int8_t                              qos;
     int8_t                              priority;
-    int8_t                              item_cache_count;
-    int8_t                              timer_cache_count;
-    int8_t                              completion_signaler_count;
     ConcurrencyLane                     concurrency_lanes[1];       // Up to 'maxConcurrency' concurrency lanes
 );
 
@@ -131,6 +176,8 @@ extern void DispatchQueue_Run(DispatchQueueRef _Nonnull pQueue);
 
 static errno_t DispatchQueue_AcquireVirtualProcessor_Locked(DispatchQueueRef _Nonnull pQueue);
 static void DispatchQueue_RelinquishWorkItem_Locked(DispatchQueue* _Nonnull pQueue, WorkItemRef _Nonnull pItem);
+static void DispatchQueue_DiscardWorkItem_Locked(DispatchQueue* _Nonnull pQueue, WorkItemRef _Nonnull pItem);
 static void DispatchQueue_RelinquishTimer_Locked(DispatchQueue* _Nonnull pQueue, TimerRef _Nonnull pTimer);
+static TimerRef _Nullable DispatchQueue_RemoveFirstTimer_Locked(DispatchQueueRef _Nonnull pQueue);
 
 #endif /* DispatchQueuePriv_h */
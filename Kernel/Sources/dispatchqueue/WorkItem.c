@@ -8,6 +8,32 @@
 
 #include "DispatchQueuePriv.h"
 
+
+static KmemCacheRef _Nonnull    gWorkItemCache;
+static KmemCacheRef _Nonnull    gTimerCache;
+static KmemCacheRef _Nonnull    gCompletionSignalerCache;
+
+
+static void CompletionSignaler_Construct(void* _Nonnull pObject)
+{
+    Semaphore_Init(&((CompletionSignaler*)pObject)->semaphore, 0);
+}
+
+// Creates the object caches from which work items, timers and completion
+// signalers are allocated. Must be called before the first dispatch queue is
+// created.
+errno_t WorkItem_InitCaches(void)
+{
+    decl_try_err();
+
+    try(kmem_cache_create("WorkItem", sizeof(WorkItem), NULL, &gWorkItemCache));
+    try(kmem_cache_create("Timer", sizeof(Timer), NULL, &gTimerCache));
+    try(kmem_cache_create("CompletionSignaler", sizeof(CompletionSignaler), CompletionSignaler_Construct, &gCompletionSignalerCache));
+
+catch:
+    return err;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // MARK: -
 // MARK: Work Items
@@ -18,8 +44,10 @@ void WorkItem_Init(WorkItemRef _Nonnull pItem, enum ItemType type, DispatchQueue
     SListNode_Init(&pItem->queue_entry);
     pItem->closure = closure;
     pItem->is_owned_by_queue = isOwnedByQueue;
+    pItem->enqueue_time = 0;
     pItem->is_being_dispatched = false;
     pItem->cancelled = false;
+    pItem->completion = NULL;
     pItem->type = type;
 }
 
@@ -30,7 +58,7 @@ errno_t WorkItem_Create_Internal(DispatchQueueClosure closure, bool isOwnedByQue
     decl_try_err();
     WorkItemRef pItem;
     
-    try(kalloc(sizeof(WorkItem), (void**) &pItem));
+    try(kmem_cache_alloc(gWorkItemCache, (void**) &pItem));
     WorkItem_Init(pItem, kItemType_Immediate, closure, isOwnedByQueue);
     *pOutItem = pItem;
     return EOK;
@@ -65,8 +93,13 @@ void WorkItem_Deinit(WorkItemRef _Nonnull pItem)
 void WorkItem_Destroy(WorkItemRef _Nullable pItem)
 {
     if (pItem) {
+        if (pItem->type != kItemType_Immediate) {
+            Timer_Destroy((TimerRef)pItem);
+            return;
+        }
+
         WorkItem_Deinit(pItem);
-        kfree(pItem);
+        kmem_cache_free(gWorkItemCache, pItem);
     }
 }
 
@@ -111,6 +144,8 @@ void _Nullable Timer_Init(TimerRef _Nonnull pTimer, TimeInterval deadline, TimeI
     WorkItem_Init((WorkItem*)pTimer, type, closure, isOwnedByQueue);
     pTimer->deadline = deadline;
     pTimer->interval = interval;
+    pTimer->sequence = 0;
+    pTimer->heap_index = -1;
 }
 
 // Creates a new timer. The timer will fire on or after 'deadline'. If 'interval'
@@ -120,7 +155,7 @@ errno_t Timer_Create_Internal(TimeInterval deadline, TimeInterval interval, Disp
     decl_try_err();
     TimerRef pTimer;
     
-    try(kalloc(sizeof(Timer), (void**) &pTimer));
+    try(kmem_cache_alloc(gTimerCache, (void**) &pTimer));
     Timer_Init(pTimer, deadline, interval, closure, isOwnedByQueue);
     *pOutTimer = pTimer;
     return EOK;
@@ -143,7 +178,7 @@ void Timer_Destroy(TimerRef _Nullable pTimer)
 {
     if (pTimer) {
         Timer_Deinit(pTimer);
-        kfree(pTimer);
+        kmem_cache_free(gTimerCache, pTimer);
     }
 }
 
@@ -165,9 +200,9 @@ errno_t CompletionSignaler_Create(CompletionSignaler* _Nullable * _Nonnull pOutC
     decl_try_err();
     CompletionSignaler* pItem;
     
-    try(kalloc(sizeof(CompletionSignaler), (void**) &pItem));
+    // The semaphore is initialized once by the cache constructor
+    try(kmem_cache_alloc(gCompletionSignalerCache, (void**) &pItem));
     CompletionSignaler_Init(pItem);
-    Semaphore_Init(&pItem->semaphore, 0);
     *pOutComp = pItem;
     return EOK;
 
@@ -187,7 +222,6 @@ void CompletionSignaler_Destroy(CompletionSignaler* _Nullable pItem)
 {
     if (pItem) {
         CompletionSignaler_Deinit(pItem);
-        Semaphore_Deinit(&pItem->semaphore);
-        kfree(pItem);
+        kmem_cache_free(gCompletionSignalerCache, pItem);
     }
 }
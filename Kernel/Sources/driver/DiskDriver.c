@@ -7,9 +7,73 @@
 //
 
 #include "DiskDriver.h"
+#include "MonotonicClock.h"
+#include <dispatcher/Semaphore.h>
+#include <dispatchqueue/DispatchQueue.h>
 #include <System/IOChannel.h>
 
 
+// Max number of buffer segments that a coalesced transfer may use
+#define DISK_IO_MAX_SEGMENTS    16
+
+// Max number of transfers that the elevator executes before it wraps around to
+// the lowest pending block address
+#define DISK_IO_MAX_SWEEP_LENGTH    32
+
+// Delay before the driver retries to dispatch completion functions that could
+// not be dispatched to their completion queue
+#define DISK_IO_COMPLETION_RETRY_DELAY_MS   10
+
+
+// A single data transfer. Serves one or more requests for adjacent blocks.
+typedef struct DiskTransfer {
+    List                                requests;       // The requests served by this transfer
+    DiskRequestType                     type;
+    LogicalBlockAddress                 lba;
+    LogicalBlockCount                   blockCount;
+    const DiskBufferSegment* _Nonnull   segments;
+    int                                 segmentCount;
+    DiskBufferSegment                   coalescedSegments[DISK_IO_MAX_SEGMENTS];
+} DiskTransfer;
+
+
+// Creates an instance of a disk driver subclass and sets up its request queue.
+errno_t DiskDriver_Create(ClassRef _Nonnull pClass, DiskDriverRef _Nullable * _Nonnull pOutSelf)
+{
+    decl_try_err();
+    DiskDriverRef self;
+
+    try(_Object_Create(pClass, 0, (ObjectRef*)&self));
+    Lock_Init(&self->ioLock);
+    List_Init(&self->ioQueue);
+    List_Init(&self->ioCompletionBacklog);
+    self->ioHeadLba = 0;
+    self->ioSweepCount = 0;
+    self->isIOScheduled = false;
+    try(DispatchQueue_Create(0, 1, kDispatchQoS_Utility, kDispatchPriority_Normal, gVirtualProcessorPool, NULL, (DispatchQueueRef*)&self->ioDispatchQueue));
+
+    *pOutSelf = self;
+    return EOK;
+
+catch:
+    Object_Release(self);
+    *pOutSelf = NULL;
+    return err;
+}
+
+// Tears down the request queue of the driver. There must be no requests
+// pending at this point.
+void DiskDriver_deinit(DiskDriverRef _Nonnull self)
+{
+    assert(List_IsEmpty(&self->ioQueue));
+    assert(List_IsEmpty(&self->ioCompletionBacklog));
+
+    Object_Release(self->ioDispatchQueue);
+    self->ioDispatchQueue = NULL;
+    Lock_Deinit(&self->ioLock);
+}
+
+
 // Returns the size of a block.
 size_t DiskDriver_getBlockSize(DiskDriverRef _Nonnull self)
 {
@@ -48,11 +112,438 @@ errno_t DiskDriver_putBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pB
     return EIO;
 }
 
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'. Subclasses
+// which are able to transfer multiple blocks more efficiently than one at a
+// time should override this method.
+errno_t DiskDriver_getBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    decl_try_err();
+    const size_t blockSize = DiskDriver_GetBlockSize(self);
+
+    for (int i = 0; i < segmentCount && blockCount > 0; i++) {
+        const LogicalBlockCount nBlocks = __min(pSegments[i].blockCount, blockCount);
+        uint8_t* pData = pSegments[i].data;
+
+        for (LogicalBlockCount j = 0; j < nBlocks; j++) {
+            try(Object_InvokeN(getBlock, DiskDriver, self, pData, lba));
+            pData += blockSize;
+            lba++;
+        }
+        blockCount -= nBlocks;
+    }
+
+catch:
+    return err;
+}
+
+// Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+// the buffers described by the scatter/gather list 'pSegments'. Subclasses
+// which are able to transfer multiple blocks more efficiently than one at a
+// time should override this method.
+errno_t DiskDriver_putBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    decl_try_err();
+    const size_t blockSize = DiskDriver_GetBlockSize(self);
+
+    for (int i = 0; i < segmentCount && blockCount > 0; i++) {
+        const LogicalBlockCount nBlocks = __min(pSegments[i].blockCount, blockCount);
+        const uint8_t* pData = pSegments[i].data;
+
+        for (LogicalBlockCount j = 0; j < nBlocks; j++) {
+            try(Object_InvokeN(putBlock, DiskDriver, self, pData, lba));
+            pData += blockSize;
+            lba++;
+        }
+        blockCount -= nBlocks;
+    }
+
+catch:
+    return err;
+}
+
+// Maps the block at index 'lba' for in-place access. Subclasses whose backing
+// store is directly addressable memory should override this method.
+errno_t DiskDriver_mapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData)
+{
+    *pOutData = NULL;
+    return ENOSYS;
+}
+
+// Unmaps a block that was mapped with mapBlock().
+void DiskDriver_unmapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, void* _Nonnull pData)
+{
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Request Queue
+////////////////////////////////////////////////////////////////////////////////
+
+// Returns true if the requests 'a' and 'b' access overlapping blocks and at
+// least one of them is a write. Conflicting requests must execute in the order
+// in which they were submitted.
+static bool DiskRequest_Conflicts(const DiskRequest* _Nonnull a, const DiskRequest* _Nonnull b)
+{
+    return (a->type == kDiskRequest_Write || b->type == kDiskRequest_Write)
+        && a->lba < b->lba + b->blockCount && b->lba < a->lba + a->blockCount;
+}
+
+// Returns true if a request that is queued before 'pRequest' conflicts with it.
+static bool DiskDriver_IsRequestBlocked_Locked(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest)
+{
+    for (ListNode* pCurNode = self->ioQueue.first; pCurNode != &pRequest->node; pCurNode = pCurNode->next) {
+        if (DiskRequest_Conflicts((DiskRequest*)pCurNode, pRequest)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Inserts 'pRequest' into the request queue. The queue is sorted ascending by
+// block address except that a request is never placed before a request that it
+// conflicts with.
+static void DiskDriver_InsertRequest_Locked(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest)
+{
+    ListNode* pAfterNode = NULL;
+
+    List_ForEach(&self->ioQueue, DiskRequest, {
+        if (pCurNode->lba <= pRequest->lba || DiskRequest_Conflicts(pCurNode, pRequest)) {
+            pAfterNode = &pCurNode->node;
+        }
+    });
+    List_InsertAfter(&self->ioQueue, &pRequest->node, pAfterNode);
+}
+
+// Returns the request that should be executed next. This is the first request
+// at or after the current head position that isn't blocked by an earlier
+// request. We wrap around to the beginning of the queue if no such request
+// exists or the current sweep has reached its maximum length.
+static DiskRequest* _Nonnull DiskDriver_GetNextRequest_Locked(DiskDriverRef _Nonnull self)
+{
+    if (self->ioSweepCount < DISK_IO_MAX_SWEEP_LENGTH) {
+        List_ForEach(&self->ioQueue, DiskRequest, {
+            if (pCurNode->lba >= self->ioHeadLba && !DiskDriver_IsRequestBlocked_Locked(self, pCurNode)) {
+                self->ioSweepCount++;
+                return pCurNode;
+            }
+        });
+    }
+
+    self->ioSweepCount = 0;
+    return (DiskRequest*)self->ioQueue.first;
+}
+
+// Appends the buffer segments of 'pRequest' to the coalesced segment list of
+// the transfer. Returns false and leaves the transfer unchanged if the segments
+// do not fit.
+static bool DiskTransfer_AddRequest(DiskTransfer* _Nonnull self, DiskRequest* _Nonnull pRequest)
+{
+    LogicalBlockCount nBlocksLeft = pRequest->blockCount;
+    int n = self->segmentCount;
+
+    for (int i = 0; i < pRequest->segmentCount && nBlocksLeft > 0; i++) {
+        if (n == DISK_IO_MAX_SEGMENTS) {
+            return false;
+        }
+
+        self->coalescedSegments[n].data = pRequest->segments[i].data;
+        self->coalescedSegments[n].blockCount = __min(pRequest->segments[i].blockCount, nBlocksLeft);
+        nBlocksLeft -= self->coalescedSegments[n].blockCount;
+        n++;
+    }
+
+    self->segmentCount = n;
+    self->blockCount += pRequest->blockCount;
+    return true;
+}
+
+// Removes the next request from the request queue plus all queued requests that
+// continue it, and sets up a single transfer which serves all of them.
+static void DiskDriver_DequeueTransfer_Locked(DiskDriverRef _Nonnull self, DiskTransfer* _Nonnull pTransfer)
+{
+    DiskRequest* pRequest = DiskDriver_GetNextRequest_Locked(self);
+
+    List_Init(&pTransfer->requests);
+    pTransfer->type = pRequest->type;
+    pTransfer->lba = pRequest->lba;
+    pTransfer->blockCount = 0;
+    pTransfer->segmentCount = 0;
+
+    if (DiskTransfer_AddRequest(pTransfer, pRequest)) {
+        ListNode* pNextNode = pRequest->node.next;
+
+        pTransfer->segments = pTransfer->coalescedSegments;
+        List_Remove(&self->ioQueue, &pRequest->node);
+        List_InsertAfterLast(&pTransfer->requests, &pRequest->node);
+
+        while (pNextNode) {
+            DiskRequest* pNextRequest = (DiskRequest*)pNextNode;
+
+            if (pNextRequest->type != pTransfer->type
+                || pNextRequest->lba != pTransfer->lba + pTransfer->blockCount
+                || DiskDriver_IsRequestBlocked_Locked(self, pNextRequest)
+                || !DiskTransfer_AddRequest(pTransfer, pNextRequest)) {
+                break;
+            }
+
+            pNextNode = pNextNode->next;
+            List_Remove(&self->ioQueue, &pNextRequest->node);
+            List_InsertAfterLast(&pTransfer->requests, &pNextRequest->node);
+        }
+    }
+    else {
+        // Too many segments to coalesce. Use the request's own segment list
+        pTransfer->blockCount = pRequest->blockCount;
+        pTransfer->segments = pRequest->segments;
+        pTransfer->segmentCount = pRequest->segmentCount;
+        List_Remove(&self->ioQueue, &pRequest->node);
+        List_InsertAfterLast(&pTransfer->requests, &pRequest->node);
+    }
+
+    self->ioHeadLba = pTransfer->lba + pTransfer->blockCount;
+}
+
+// Executes the transfer 'pTransfer'.
+static errno_t DiskDriver_DoTransfer(DiskDriverRef _Nonnull self, DiskTransfer* _Nonnull pTransfer)
+{
+    if (pTransfer->type == kDiskRequest_Read) {
+        return Object_InvokeN(getBlocks, DiskDriver, self, pTransfer->lba, pTransfer->blockCount, pTransfer->segments, pTransfer->segmentCount);
+    }
+    else {
+        return Object_InvokeN(putBlocks, DiskDriver, self, pTransfer->lba, pTransfer->blockCount, pTransfer->segments, pTransfer->segmentCount);
+    }
+}
+
+// Invokes the completion function of the completed request 'pRequest'. The
+// completion function is invoked right here if the request has no completion
+// queue and it is dispatched to the completion queue otherwise. Returns an
+// error if the completion function could not be dispatched. The caller should
+// retry later in this case. Running the completion function here instead could
+// deadlock because it may wait for a lock that is held by a client which waits
+// for a request of this driver. A completion queue that is terminating will
+// never accept the completion function. The request is dropped in this case.
+static errno_t DiskDriver_CompleteRequest(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest)
+{
+    if (pRequest->completionQueue == NULL) {
+        pRequest->done(pRequest);
+        return EOK;
+    }
+    else {
+        const errno_t err = DispatchQueue_DispatchAsync(pRequest->completionQueue, DispatchQueueClosure_Make(pRequest->done, pRequest));
+
+        return (err == ECANCELED) ? EOK : err;
+    }
+}
+
+// Retries the dispatch of the completion functions in the completion backlog.
+static void DiskDriver_RetryCompletions_Locked(DiskDriverRef _Nonnull self)
+{
+    List backlog = self->ioCompletionBacklog;
+    ListNode* pCurNode = backlog.first;
+
+    List_Init(&self->ioCompletionBacklog);
+    while (pCurNode) {
+        ListNode* pNextNode = pCurNode->next;
+
+        if (DiskDriver_CompleteRequest(self, (DiskRequest*)pCurNode) != EOK) {
+            List_InsertAfterLast(&self->ioCompletionBacklog, pCurNode);
+        }
+        pCurNode = pNextNode;
+    }
+}
+
+// Drains the request queue. Runs on the driver's dispatch queue.
+static void DiskDriver_ProcessRequests(DiskDriverRef _Nonnull self)
+{
+    DiskTransfer transfer;
+
+    Lock_Lock(&self->ioLock);
+    DiskDriver_RetryCompletions_Locked(self);
+
+    while (!List_IsEmpty(&self->ioQueue)) {
+        DiskDriver_DequeueTransfer_Locked(self, &transfer);
+        Lock_Unlock(&self->ioLock);
+
+        const errno_t err = DiskDriver_DoTransfer(self, &transfer);
+
+        // Note that a request may be freed by its completion function. Requests
+        // whose completion function could not be dispatched are moved to the
+        // completion backlog
+        List failed;
+        ListNode* pCurNode = transfer.requests.first;
+
+        List_Init(&failed);
+        while (pCurNode) {
+            ListNode* pNextNode = pCurNode->next;
+
+            ((DiskRequest*)pCurNode)->status = err;
+            if (DiskDriver_CompleteRequest(self, (DiskRequest*)pCurNode) != EOK) {
+                List_InsertAfterLast(&failed, pCurNode);
+            }
+            pCurNode = pNextNode;
+        }
+
+        Lock_Lock(&self->ioLock);
+        while ((pCurNode = List_RemoveFirst(&failed)) != NULL) {
+            List_InsertAfterLast(&self->ioCompletionBacklog, pCurNode);
+        }
+    }
+
+    // Try again a bit later if there are completion functions which we were not
+    // able to dispatch. The next request triggers a retry anyway if scheduling
+    // the retry fails
+    self->isIOScheduled = false;
+    if (!List_IsEmpty(&self->ioCompletionBacklog)) {
+        const TimeInterval deadline = TimeInterval_Add(MonotonicClock_GetCurrentTime(), TimeInterval_MakeMilliseconds(DISK_IO_COMPLETION_RETRY_DELAY_MS));
+
+        if (DispatchQueue_DispatchAsyncAfter(self->ioDispatchQueue, deadline, DispatchQueueClosure_Make((Closure1Arg_Func)DiskDriver_ProcessRequests, self)) == EOK) {
+            self->isIOScheduled = true;
+        }
+    }
+    Lock_Unlock(&self->ioLock);
+}
+
+// Submits the request 'pRequest' to the request queue of the driver and returns
+// without waiting for the transfer to complete. Returns an error and does not
+// invoke the completion function if the request could not be submitted.
+errno_t DiskDriver_BeginIO(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest)
+{
+    decl_try_err();
+    LogicalBlockCount nSegmentBlocks = 0;
+
+    for (int i = 0; i < pRequest->segmentCount && nSegmentBlocks < pRequest->blockCount; i++) {
+        nSegmentBlocks += pRequest->segments[i].blockCount;
+    }
+    if (pRequest->blockCount == 0 || nSegmentBlocks < pRequest->blockCount) {
+        return EINVAL;
+    }
+
+    const LogicalBlockCount diskBlockCount = DiskDriver_GetBlockCount(self);
+    if (pRequest->lba >= diskBlockCount || pRequest->blockCount > diskBlockCount - pRequest->lba) {
+        return EIO;
+    }
+    if (pRequest->type == kDiskRequest_Write && DiskDriver_IsReadOnly(self)) {
+        return EROFS;
+    }
+
+
+    ListNode_Init(&pRequest->node);
+
+    Lock_Lock(&self->ioLock);
+    DiskDriver_InsertRequest_Locked(self, pRequest);
+
+    if (!self->isIOScheduled) {
+        err = DispatchQueue_DispatchAsync(self->ioDispatchQueue, DispatchQueueClosure_Make((Closure1Arg_Func)DiskDriver_ProcessRequests, self));
+        if (err == EOK) {
+            self->isIOScheduled = true;
+        }
+        else {
+            List_Remove(&self->ioQueue, &pRequest->node);
+        }
+    }
+    Lock_Unlock(&self->ioLock);
+
+    return err;
+}
+
+static void DiskDriver_OnSyncIODone(DiskRequest* _Nonnull pRequest)
+{
+    Semaphore_Relinquish((Semaphore*)pRequest->context);
+}
+
+// Submits a request and blocks the caller until the request has completed.
+static errno_t DiskDriver_DoSyncIO(DiskDriverRef _Nonnull self, DiskRequestType type, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    decl_try_err();
+    DiskRequest req;
+    Semaphore done;
+
+    req.type = type;
+    req.lba = lba;
+    req.blockCount = blockCount;
+    req.segments = pSegments;
+    req.segmentCount = segmentCount;
+    req.done = (Closure1Arg_Func)DiskDriver_OnSyncIODone;
+    req.context = &done;
+    req.completionQueue = NULL;
+
+    // A completion function that runs on the request queue can not wait for the
+    // request queue. Execute the transfer directly in this case
+    if (DispatchQueue_GetCurrent() == (DispatchQueueRef)self->ioDispatchQueue) {
+        DiskTransfer transfer;
+
+        transfer.type = type;
+        transfer.lba = lba;
+        transfer.blockCount = blockCount;
+        transfer.segments = pSegments;
+        transfer.segmentCount = segmentCount;
+        return DiskDriver_DoTransfer(self, &transfer);
+    }
+
+    Semaphore_Init(&done, 0);
+    err = DiskDriver_BeginIO(self, &req);
+    if (err == EOK) {
+        // The request lives on our stack. We can not return before the driver
+        // is done with it
+        while (Semaphore_Acquire(&done, kTimeInterval_Infinity) != EOK) {}
+        err = req.status;
+    }
+    Semaphore_Deinit(&done);
+
+    return err;
+}
+
+// Reads the contents of the block at index 'lba'. 'buffer' must be big
+// enough to hold the data of a block. Blocks the caller until the read
+// operation has completed.
+errno_t DiskDriver_GetBlock(DiskDriverRef _Nonnull self, void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    DiskBufferSegment seg;
+
+    seg.data = pBuffer;
+    seg.blockCount = 1;
+    return DiskDriver_DoSyncIO(self, kDiskRequest_Read, lba, 1, &seg, 1);
+}
+
+// Writes the contents of 'pBuffer' to the block at index 'lba'. 'pBuffer'
+// must be big enough to hold a full block. Blocks the caller until the
+// write has completed.
+errno_t DiskDriver_PutBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    DiskBufferSegment seg;
+
+    seg.data = (void*)pBuffer;
+    seg.blockCount = 1;
+    return DiskDriver_DoSyncIO(self, kDiskRequest_Write, lba, 1, &seg, 1);
+}
+
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'. Blocks the
+// caller until the read operation has completed.
+errno_t DiskDriver_GetBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return DiskDriver_DoSyncIO(self, kDiskRequest_Read, lba, blockCount, pSegments, segmentCount);
+}
+
+// Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+// the buffers described by the scatter/gather list 'pSegments'. Blocks the
+// caller until the write has completed.
+errno_t DiskDriver_PutBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return DiskDriver_DoSyncIO(self, kDiskRequest_Write, lba, blockCount, pSegments, segmentCount);
+}
+
 
 CLASS_METHODS(DiskDriver, IOResource,
+OVERRIDE_METHOD_IMPL(deinit, DiskDriver, Object)
 METHOD_IMPL(getBlockSize, DiskDriver)
 METHOD_IMPL(getBlockCount, DiskDriver)
 METHOD_IMPL(isReadOnly, DiskDriver)
 METHOD_IMPL(getBlock, DiskDriver)
 METHOD_IMPL(putBlock, DiskDriver)
+METHOD_IMPL(getBlocks, DiskDriver)
+METHOD_IMPL(putBlocks, DiskDriver)
+METHOD_IMPL(mapBlock, DiskDriver)
+METHOD_IMPL(unmapBlock, DiskDriver)
 );
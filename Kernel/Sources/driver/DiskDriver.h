@@ -10,6 +10,7 @@
 #define DiskDriver_h
 
 #include "IOResource.h"
+#include <dispatcher/Lock.h>
 
 
 // Represents a logical block address in the range 0..<DiskDriver.blockCount
@@ -19,11 +20,71 @@ typedef uint32_t    LogicalBlockAddress;
 typedef LogicalBlockAddress LogicalBlockCount;
 
 
+// One entry of a scatter/gather list. Describes a buffer which holds
+// 'blockCount' consecutive blocks.
+typedef struct DiskBufferSegment {
+    void* _Nonnull      data;
+    LogicalBlockCount   blockCount;
+} DiskBufferSegment;
+
+
+// The kind of transfer that a disk request does
+typedef enum DiskRequestType {
+    kDiskRequest_Read,
+    kDiskRequest_Write
+} DiskRequestType;
+
+// An asynchronous disk I/O request. The request is owned by the driver from the
+// time it is passed to DiskDriver_BeginIO() until the driver invokes the
+// completion function 'done' with the request as the argument. 'status' holds
+// the result of the transfer at this point. The completion function is invoked
+// on 'completionQueue' or on the driver's request queue if 'completionQueue' is
+// NULL. The driver retries the dispatch later if the completion function can
+// not be dispatched to 'completionQueue' right away. A completion function that
+// runs on the driver's request queue delays all other requests of the driver.
+// It should return quickly and it must not wait for a lock that may be held by
+// a client which waits for a request of the same driver.
+typedef struct DiskRequest {
+    ListNode                            node;               // Private to the driver
+    DiskRequestType                     type;
+    LogicalBlockAddress                 lba;
+    LogicalBlockCount                   blockCount;
+    const DiskBufferSegment* _Nonnull   segments;
+    int                                 segmentCount;
+    Closure1Arg_Func _Nonnull           done;
+    void* _Nullable                     context;            // For use by the completion function
+    struct _DispatchQueue* _Nullable    completionQueue;
+    errno_t                             status;
+} DiskRequest;
+
+
+// Specifies how DiskDriver_MapBlock() should map a block
+typedef enum MapBlock {
+    kMapBlock_ReadOnly,     // The caller will not modify the block contents
+    kMapBlock_Update,       // The caller may modify the block contents in place
+} MapBlock;
+
+
 // A disk driver manages the data stored on a disk. It provides read and write
 // access to the disk data. Data on a disk is organized in blocks. All blocks
 // are of the same size. Blocks are addresses with an index in the range
 // [0, BlockCount].
+// Every disk driver has a request queue. Requests are executed one at a time
+// on a serial dispatch queue that is private to the driver. Pending requests
+// are executed in ascending block order (one-way elevator) and requests for
+// adjacent blocks are coalesced into a single transfer. The elevator wraps
+// around after a bounded number of transfers so that a steady stream of
+// requests at higher addresses can not starve requests at lower addresses.
+// Requests which access overlapping blocks are always executed in submission
+// order.
 OPEN_CLASS_WITH_REF(DiskDriver, IOResource,
+    Lock                                ioLock;
+    List                                ioQueue;            // Pending requests
+    List                                ioCompletionBacklog;    // Completed requests whose completion function could not be dispatched yet
+    struct _DispatchQueue* _Nonnull     ioDispatchQueue;    // Executes the pending requests
+    LogicalBlockAddress                 ioHeadLba;          // Block following the last transfer
+    int                                 ioSweepCount;       // Number of transfers since the elevator last wrapped around
+    bool                                isIOScheduled;      // true if the request queue is being drained
 );
 typedef struct _DiskDriverMethodTable {
     IOResourceMethodTable   super;
@@ -40,6 +101,9 @@ typedef struct _DiskDriverMethodTable {
     // The abstract implementation returns true.
     bool (*isReadOnly)(void* _Nonnull self);
 
+    // The following methods do the actual data transfers. They are invoked by
+    // the request queue and should not be called directly.
+
     // Reads the contents of the block at index 'lba'. 'buffer' must be big
     // enough to hold the data of a block. Blocks the caller until the read
     // operation has completed. Note that this function will never return a
@@ -56,6 +120,40 @@ typedef struct _DiskDriverMethodTable {
     // The abstract implementation returns EIO.
     errno_t (*putBlock)(void* _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba);
 
+    // Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+    // the buffers described by the scatter/gather list 'pSegments'. The
+    // segments are filled in order until 'blockCount' blocks have been
+    // transferred. Blocks the caller until the read operation has completed.
+    // The contents of the buffers is indeterminate if the read fails.
+    // The abstract implementation invokes getBlock() for every block.
+    errno_t (*getBlocks)(void* _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount);
+
+    // Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+    // the buffers described by the scatter/gather list 'pSegments'. Blocks the
+    // caller until the write has completed. Any subset of the blocks may have
+    // been written if the write fails.
+    // The abstract implementation invokes putBlock() for every block.
+    errno_t (*putBlocks)(void* _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount);
+
+
+    // Optional capability of drivers whose backing store is directly addressable
+    // memory. Mapping bypasses the request queue. The caller is responsible for
+    // serializing accesses to a mapped block with requests for the same block.
+
+    // Maps the block at index 'lba' and returns a pointer to the block contents
+    // in 'pOutData'. The pointer stays valid until the block is unmapped. A
+    // block mapped with kMapBlock_Update may be modified through the returned
+    // pointer and the modifications are immediately visible to all readers of
+    // the block. Returns EROFS if the disk is read-only and 'mode' is
+    // kMapBlock_Update.
+    // The abstract implementation returns ENOSYS.
+    errno_t (*mapBlock)(void* _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData);
+
+    // Unmaps the block at index 'lba'. 'pData' is the pointer that mapBlock()
+    // returned for the block.
+    // The abstract implementation does nothing.
+    void (*unmapBlock)(void* _Nonnull self, LogicalBlockAddress lba, void* _Nonnull pData);
+
 } DiskDriverMethodTable;
 
 
@@ -63,6 +161,18 @@ typedef struct _DiskDriverMethodTable {
 // Methods for use by disk driver users.
 //
 
+// Submits the request 'pRequest' to the request queue of the driver and returns
+// without waiting for the transfer to complete. Returns an error and does not
+// invoke the completion function if the request could not be submitted.
+extern errno_t DiskDriver_BeginIO(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest);
+
+// The following functions submit a request and block the caller until the
+// request has completed.
+extern errno_t DiskDriver_GetBlock(DiskDriverRef _Nonnull self, void* _Nonnull pBuffer, LogicalBlockAddress lba);
+extern errno_t DiskDriver_PutBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba);
+extern errno_t DiskDriver_GetBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount);
+extern errno_t DiskDriver_PutBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount);
+
 #define DiskDriver_GetBlockSize(__self) \
 Object_Invoke0(getBlockSize, DiskDriver, __self)
 
@@ -72,10 +182,28 @@ Object_Invoke0(getBlockCount, DiskDriver, __self)
 #define DiskDriver_IsReadOnly(__self) \
 Object_Invoke0(isReadOnly, DiskDriver, __self)
 
-#define DiskDriver_GetBlock(__self, __pBuffer, __lba) \
-Object_InvokeN(getBlock, DiskDriver, __self, __pBuffer, __lba)
+// Maps a block for in-place access. Returns ENOSYS if the driver doesn't
+// support mapping. The caller should fall back to DiskDriver_GetBlock() in
+// this case.
+#define DiskDriver_MapBlock(__self, __lba, __mode, __pOutData) \
+Object_InvokeN(mapBlock, DiskDriver, __self, __lba, __mode, __pOutData)
+
+#define DiskDriver_UnmapBlock(__self, __lba, __pData) \
+Object_InvokeN(unmapBlock, DiskDriver, __self, __lba, __pData)
+
+
+//
+// Methods for use by disk driver subclassers.
+//
+
+// Creates an instance of a disk driver subclass and sets up its request queue.
+// Users of a concrete disk driver should not use this function to allocate an
+// instance of the concrete driver. This function is for use by DiskDriver
+// subclassers to define the driver specific instance allocation function.
+extern errno_t DiskDriver_Create(ClassRef _Nonnull pClass, DiskDriverRef _Nullable * _Nonnull pOutSelf);
 
-#define DiskDriver_PutBlock(__self, __pBuffer, __lba) \
-Object_InvokeN(putBlock, DiskDriver, __self, __pBuffer, __lba)
+// Tears down the request queue of the driver. A subclass must invoke this
+// function from its deinit method.
+extern void DiskDriver_deinit(DiskDriverRef _Nonnull self);
 
 #endif /* DiskDriver_h */
@@ -0,0 +1,237 @@
+//
+//  OverlayDisk.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/28/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "OverlayDisk.h"
+#include "RamDisk.h"
+#include <dispatcher/Lock.h>
+
+
+CLASS_IVARS(OverlayDisk, DiskDriver,
+    DiskDriverRef _Nonnull  baseDisk;
+    RamDiskRef _Nonnull     ramDisk;        // Stores the overridden blocks
+    uint8_t* _Nonnull       overrideMap;    // One bit per block. Set if the block is stored in 'ramDisk'
+    LogicalBlockCount       blockCount;
+    size_t                  blockSize;
+    Lock                    lock;           // Protects 'overrideMap'
+);
+
+
+errno_t OverlayDisk_Create(DiskDriverRef _Nonnull pBaseDisk, LogicalBlockCount nExtentBlockCount, OverlayDiskRef _Nullable * _Nonnull pOutSelf)
+{
+    decl_try_err();
+    OverlayDiskRef self;
+
+    try(DiskDriver_Create(&kOverlayDiskClass, (DiskDriverRef*)&self));
+    self->baseDisk = Object_RetainAs(pBaseDisk, DiskDriver);
+    self->blockCount = DiskDriver_GetBlockCount(pBaseDisk);
+    self->blockSize = DiskDriver_GetBlockSize(pBaseDisk);
+    Lock_Init(&self->lock);
+
+    try(kalloc_cleared((self->blockCount + 7) >> 3, (void**)&self->overrideMap));
+    try(RamDisk_Create(self->blockSize, self->blockCount, nExtentBlockCount, &self->ramDisk));
+
+    *pOutSelf = self;
+    return EOK;
+
+catch:
+    Object_Release(self);
+    *pOutSelf = NULL;
+    return err;
+}
+
+void OverlayDisk_deinit(OverlayDiskRef _Nonnull self)
+{
+    Object_Release(self->ramDisk);
+    self->ramDisk = NULL;
+    kfree(self->overrideMap);
+    self->overrideMap = NULL;
+    Object_Release(self->baseDisk);
+    self->baseDisk = NULL;
+    DiskDriver_deinit((DiskDriverRef)self);
+}
+
+// Returns the size of a block.
+size_t OverlayDisk_getBlockSize(OverlayDiskRef _Nonnull self)
+{
+    return self->blockSize;
+}
+
+// Returns the number of blocks that the disk is able to store.
+LogicalBlockCount OverlayDisk_getBlockCount(OverlayDiskRef _Nonnull self)
+{
+    return self->blockCount;
+}
+
+// Returns true if the disk if read-only.
+bool OverlayDisk_isReadOnly(OverlayDiskRef _Nonnull self)
+{
+    return false;
+}
+
+// Returns true if the block 'lba' is stored in the RAM disk and false if it is
+// stored in the base disk.
+static bool OverlayDisk_IsOverridden_Locked(OverlayDiskRef _Nonnull self, LogicalBlockAddress lba)
+{
+    return ((self->overrideMap[lba >> 3] & (1 << (7 - (lba & 0x07)))) != 0) ? true : false;
+}
+
+// Reads the block 'lba' of the disk 'pDisk' into 'pBuffer'. The block is
+// mapped and copied if the disk supports mapping and read with a regular
+// request otherwise.
+static errno_t OverlayDisk_ReadBlockFrom(OverlayDiskRef _Nonnull self, DiskDriverRef _Nonnull pDisk, void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    void* pData;
+    errno_t err = DiskDriver_MapBlock(pDisk, lba, kMapBlock_ReadOnly, &pData);
+
+    if (err == EOK) {
+        memcpy(pBuffer, pData, self->blockSize);
+        DiskDriver_UnmapBlock(pDisk, lba, pData);
+    }
+    else if (err == ENOSYS) {
+        err = DiskDriver_GetBlock(pDisk, pBuffer, lba);
+    }
+    return err;
+}
+
+// Maps the RAM block which overrides the base disk block 'lba' for updating.
+// The RAM block is allocated and marked as overridden if the block hasn't been
+// written to before. Its contents are initialized from the base disk if
+// 'copyBase' is true. The caller must unmap the returned block.
+static errno_t OverlayDisk_OverrideBlock_Locked(OverlayDiskRef _Nonnull self, LogicalBlockAddress lba, bool copyBase, void* _Nullable * _Nonnull pOutData)
+{
+    decl_try_err();
+    void* pData;
+
+    try(DiskDriver_MapBlock((DiskDriverRef)self->ramDisk, lba, kMapBlock_Update, &pData));
+
+    if (!OverlayDisk_IsOverridden_Locked(self, lba)) {
+        if (copyBase) {
+            err = OverlayDisk_ReadBlockFrom(self, self->baseDisk, pData, lba);
+            if (err != EOK) {
+                DiskDriver_UnmapBlock((DiskDriverRef)self->ramDisk, lba, pData);
+                throw(err);
+            }
+        }
+        self->overrideMap[lba >> 3] |= (1 << (7 - (lba & 0x07)));
+    }
+
+    *pOutData = pData;
+    return EOK;
+
+catch:
+    *pOutData = NULL;
+    return err;
+}
+
+// Reads the contents of the block at index 'lba'. 'buffer' must be big
+// enough to hold the data of a block. Blocks the caller until the read
+// operation has completed. Note that this function will never return a
+// partially read block. Either it succeeds and the full block data is
+// returned, or it fails and no block data is returned.
+errno_t OverlayDisk_getBlock(OverlayDiskRef _Nonnull self, void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    if (lba >= self->blockCount) {
+        return EIO;
+    }
+
+    Lock_Lock(&self->lock);
+    const bool isOverridden = OverlayDisk_IsOverridden_Locked(self, lba);
+    Lock_Unlock(&self->lock);
+
+    // Blocks never go back to the base disk once they have been overridden
+    return OverlayDisk_ReadBlockFrom(self, (isOverridden) ? (DiskDriverRef)self->ramDisk : self->baseDisk, pBuffer, lba);
+}
+
+// Writes the contents of 'pBuffer' to the block at index 'lba'. 'pBuffer'
+// must be big enough to hold a full block. Blocks the caller until the
+// write has completed. The first write to a block allocates the RAM block
+// that overrides it. There is no need to copy the base disk block because
+// the write replaces the whole block.
+errno_t OverlayDisk_putBlock(OverlayDiskRef _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    decl_try_err();
+    void* pData;
+
+    if (lba >= self->blockCount) {
+        return EIO;
+    }
+
+    Lock_Lock(&self->lock);
+    err = OverlayDisk_OverrideBlock_Locked(self, lba, false, &pData);
+    if (err == EOK) {
+        memcpy(pData, pBuffer, self->blockSize);
+        DiskDriver_UnmapBlock((DiskDriverRef)self->ramDisk, lba, pData);
+    }
+    Lock_Unlock(&self->lock);
+
+    return err;
+}
+
+// Maps the block at index 'lba'. A block that hasn't been written to is mapped
+// read-only from the base disk. Mapping it with kMapBlock_Update copies the
+// base disk block into a newly allocated RAM block first. Returns ENOSYS if the
+// block has to be mapped from a base disk that doesn't support mapping.
+errno_t OverlayDisk_mapBlock(OverlayDiskRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData)
+{
+    decl_try_err();
+
+    if (lba >= self->blockCount) {
+        *pOutData = NULL;
+        return EIO;
+    }
+
+    Lock_Lock(&self->lock);
+    if (mode == kMapBlock_Update) {
+        err = OverlayDisk_OverrideBlock_Locked(self, lba, true, pOutData);
+    }
+    else if (OverlayDisk_IsOverridden_Locked(self, lba)) {
+        err = DiskDriver_MapBlock((DiskDriverRef)self->ramDisk, lba, kMapBlock_ReadOnly, pOutData);
+    }
+    else {
+        err = DiskDriver_MapBlock(self->baseDisk, lba, kMapBlock_ReadOnly, pOutData);
+    }
+    Lock_Unlock(&self->lock);
+
+    return err;
+}
+
+// Unmaps the block at index 'lba'. Another client may have overridden the block
+// since it was mapped from the base disk. So the override bit alone doesn't tell
+// us which disk produced the mapping. The mapping came from the RAM disk if the
+// block is overridden and the RAM disk maps it at 'pData'. RAM blocks never move.
+void OverlayDisk_unmapBlock(OverlayDiskRef _Nonnull self, LogicalBlockAddress lba, void* _Nonnull pData)
+{
+    DiskDriverRef pDisk = self->baseDisk;
+
+    Lock_Lock(&self->lock);
+    if (OverlayDisk_IsOverridden_Locked(self, lba)) {
+        void* pRamData;
+
+        if (DiskDriver_MapBlock((DiskDriverRef)self->ramDisk, lba, kMapBlock_ReadOnly, &pRamData) == EOK) {
+            if (pRamData == pData) {
+                pDisk = (DiskDriverRef)self->ramDisk;
+            }
+            DiskDriver_UnmapBlock((DiskDriverRef)self->ramDisk, lba, pRamData);
+        }
+    }
+    Lock_Unlock(&self->lock);
+
+    DiskDriver_UnmapBlock(pDisk, lba, pData);
+}
+
+
+CLASS_METHODS(OverlayDisk, DiskDriver,
+OVERRIDE_METHOD_IMPL(deinit, OverlayDisk, Object)
+OVERRIDE_METHOD_IMPL(getBlockSize, OverlayDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlockCount, OverlayDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(isReadOnly, OverlayDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlock, OverlayDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(putBlock, OverlayDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(mapBlock, OverlayDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(unmapBlock, OverlayDisk, DiskDriver)
+);
@@ -0,0 +1,35 @@
+//
+//  OverlayDisk.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/28/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef OverlayDisk_h
+#define OverlayDisk_h
+
+#include "DiskDriver.h"
+
+
+// An OverlayDisk object manages a writable virtual disk that is layered on top
+// of a read-only base disk like a RomDisk. Blocks which have not been written
+// to are read from the base disk. The first write to a block allocates a RAM
+// block which overrides the base disk block from then on. A bitmap with one bit
+// per block tracks which blocks have been overridden. Creating an overlay disk
+// does not copy any data and the RAM used by the disk is proportional to the
+// number of blocks that have been written to. Modifications are lost when the
+// overlay disk is deallocated.
+OPAQUE_CLASS(OverlayDisk, DiskDriver);
+typedef struct _OverlayDiskMethodTable {
+    DiskDriverMethodTable   super;
+} OverlayDiskMethodTable;
+
+
+// Creates a new overlay disk on top of the disk 'pBaseDisk'. The overlay disk
+// has the same block size and block count as the base disk and it retains the
+// base disk. The base disk is never written to. RAM for overridden blocks is
+// allocated in extents of 'nExtentBlockCount' blocks.
+extern errno_t OverlayDisk_Create(DiskDriverRef _Nonnull pBaseDisk, LogicalBlockCount nExtentBlockCount, OverlayDiskRef _Nullable * _Nonnull pOutSelf);
+
+#endif /* OverlayDisk_h */
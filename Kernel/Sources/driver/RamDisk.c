@@ -11,19 +11,33 @@
 #include <System/IOChannel.h>
 
 
+// Extents are found through a two-level radix table. The upper bits of the
+// index of an extent select a leaf in the extent directory and the lower bits
+// select the extent in the leaf. Leaves and extents are allocated on demand.
+#define EXTENT_LEAF_SHIFT   6
+#define EXTENT_LEAF_SIZE    (1 << EXTENT_LEAF_SHIFT)
+#define EXTENT_LEAF_MASK    (EXTENT_LEAF_SIZE - 1)
+
+
 typedef struct DiskExtent {
-    SListNode           node;
     LogicalBlockAddress firstBlockIndex;
     char                data[1];
 } DiskExtent;
 
+typedef struct DiskExtentLeaf {
+    DiskExtent* _Nullable   extent[EXTENT_LEAF_SIZE];
+} DiskExtentLeaf;
+
 
 CLASS_IVARS(RamDisk, DiskDriver,
-    SList               extents;            // Sorted ascending by 'firstBlockIndex'
-    LogicalBlockCount   extentBlockCount;   // How many blocks an extent stores
-    LogicalBlockCount   blockCount;
-    size_t              blockSize;
-    Lock                lock;               // Protects extent allocation and lookup
+    DiskExtentLeaf* _Nullable * _Nonnull    extentDirectory;    // 'extentDirectoryCount' leaf pointers
+    size_t                                  extentDirectoryCount;
+    DiskExtent* _Nullable                   lastExtent;         // Most recently accessed extent
+    char* _Nullable                         zeroBlock;          // Read-only mapping of blocks that haven't been written to yet
+    LogicalBlockCount                       extentBlockCount;   // How many blocks an extent stores
+    LogicalBlockCount                       blockCount;
+    size_t                                  blockSize;
+    Lock                                    lock;               // Protects extent allocation and lookup
 );
 
 
@@ -32,28 +46,48 @@ errno_t RamDisk_Create(size_t nBlockSize, LogicalBlockCount nBlockCount, Logical
     decl_try_err();
     RamDiskRef self;
 
-    try(Object_Create(RamDisk, &self));
-    SList_Init(&self->extents);
+    try(DiskDriver_Create(&kRamDiskClass, (DiskDriverRef*)&self));
     self->extentBlockCount = __min(nExtentBlockCount, nBlockCount);
     self->blockCount = nBlockCount;
     self->blockSize = nBlockSize;
+    self->lastExtent = NULL;
+    self->zeroBlock = NULL;
     Lock_Init(&self->lock);
 
+    const size_t extentCount = (nBlockCount + self->extentBlockCount - 1) / self->extentBlockCount;
+    self->extentDirectoryCount = (extentCount + EXTENT_LEAF_SIZE - 1) >> EXTENT_LEAF_SHIFT;
+    try(kalloc_cleared(self->extentDirectoryCount * sizeof(DiskExtentLeaf*), (void**)&self->extentDirectory));
+
     *pOutSelf = self;
     return EOK;
 
 catch:
+    Object_Release(self);
     *pOutSelf = NULL;
     return err;
 }
 
 void RamDisk_deinit(RamDiskRef _Nonnull self)
 {
-    SList_ForEach(&self->extents, DiskExtent, {
-        kfree(pCurNode);
-    });
+    if (self->extentDirectory) {
+        for (size_t i = 0; i < self->extentDirectoryCount; i++) {
+            DiskExtentLeaf* pLeaf = self->extentDirectory[i];
+
+            if (pLeaf) {
+                for (int j = 0; j < EXTENT_LEAF_SIZE; j++) {
+                    kfree(pLeaf->extent[j]);
+                }
+                kfree(pLeaf);
+            }
+        }
+        kfree(self->extentDirectory);
+        self->extentDirectory = NULL;
+    }
 
-    SList_Deinit(&self->extents);
+    kfree(self->zeroBlock);
+    self->zeroBlock = NULL;
+    self->lastExtent = NULL;
+    DiskDriver_deinit((DiskDriverRef)self);
 }
 
 // Returns the size of a block.
@@ -74,32 +108,23 @@ bool RamDisk_isReadOnly(RamDiskRef _Nonnull self)
     return false;
 }
 
-// Tries to find the disk extent that contains the given block index. This disk
-// extent is returned if it exists. Also returns the disk extent that exists and
-// is closest to the given block index and whose 'firstBlockIndex' is <= the
-// given block index. 
-static DiskExtent* _Nullable RamDisk_GetDiskExtentForBlockIndex_Locked(RamDiskRef _Nonnull self, LogicalBlockAddress lba, DiskExtent* _Nullable * _Nullable pOutDiskExtentBeforeBlockIndex)
+// Returns the disk extent that contains the block 'lba' and NULL if no such
+// extent exists yet. Checks the most recently accessed extent first since
+// accesses tend to be sequential.
+static DiskExtent* _Nullable RamDisk_GetExtent_Locked(RamDiskRef _Nonnull self, LogicalBlockAddress lba)
 {
-    DiskExtent* pPrevExtent = NULL;
-    DiskExtent* pExtent = NULL;
-    const LogicalBlockCount extentBlockCount = self->extentBlockCount;
+    DiskExtent* pExtent = self->lastExtent;
 
-    SList_ForEach(&self->extents, DiskExtent, {
-        const LogicalBlockAddress firstBlockIndex = pCurNode->firstBlockIndex;
-
-        if (lba >= firstBlockIndex && lba < (firstBlockIndex + extentBlockCount)) {
-            pExtent = pCurNode;
-            break;
-        }
-        else if (lba < firstBlockIndex) {
-            break;
-        }
+    if (pExtent && lba >= pExtent->firstBlockIndex && lba - pExtent->firstBlockIndex < self->extentBlockCount) {
+        return pExtent;
+    }
 
-        pPrevExtent = pCurNode;
-    });
+    const size_t extentIdx = lba / self->extentBlockCount;
+    DiskExtentLeaf* pLeaf = self->extentDirectory[extentIdx >> EXTENT_LEAF_SHIFT];
 
-    if (pOutDiskExtentBeforeBlockIndex) {
-        *pOutDiskExtentBeforeBlockIndex = pPrevExtent;
+    pExtent = (pLeaf) ? pLeaf->extent[extentIdx & EXTENT_LEAF_MASK] : NULL;
+    if (pExtent) {
+        self->lastExtent = pExtent;
     }
     return pExtent;
 }
@@ -118,7 +143,7 @@ errno_t RamDisk_getBlock(RamDiskRef _Nonnull self, void* _Nonnull pBuffer, Logic
 
     Lock_Lock(&self->lock);
 
-    DiskExtent* pExtent = RamDisk_GetDiskExtentForBlockIndex_Locked(self, lba, NULL);
+    DiskExtent* pExtent = RamDisk_GetExtent_Locked(self, lba);
     if (pExtent) {
         // Request for a block that was previously written to -> return the block
         memcpy(pBuffer, &pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize], self->blockSize);
@@ -133,22 +158,29 @@ errno_t RamDisk_getBlock(RamDiskRef _Nonnull self, void* _Nonnull pBuffer, Logic
     return EOK;
 }
 
-// Adds a new extent after 'pPrevExtent' and before 'pPrevExtent'->next. All data
-// in the newly allocated extent is cleared. 'firstBlockIndex' is the index of the
-// first block in the newly allocated extent. Remember that we allocate extents
-// on demand which means that the end of 'pPrevExtent' is not necessarily the
-// beginning of the new extent in terms of block numbers.
-static errno_t RamDisk_AddExtentAfter_Locked(RamDiskRef _Nonnull self, LogicalBlockAddress firstBlockIndex, DiskExtent* _Nullable pPrevExtent, DiskExtent* _Nullable * _Nonnull pOutExtent)
+// Allocates the extent that contains the block 'lba'. All data in the newly
+// allocated extent is cleared. The leaf for the extent is allocated too if it
+// doesn't exist yet.
+static errno_t RamDisk_AddExtent_Locked(RamDiskRef _Nonnull self, LogicalBlockAddress lba, DiskExtent* _Nullable * _Nonnull pOutExtent)
 {
     decl_try_err();
+    const size_t extentIdx = lba / self->extentBlockCount;
+    DiskExtentLeaf** ppLeaf = &self->extentDirectory[extentIdx >> EXTENT_LEAF_SHIFT];
     DiskExtent* pExtent;
 
+    if (*ppLeaf == NULL) {
+        try(kalloc_cleared(sizeof(DiskExtentLeaf), (void**)ppLeaf));
+    }
+
     try(kalloc_cleared(sizeof(DiskExtent) - 1 + self->extentBlockCount * self->blockSize, (void**)&pExtent));
-    SList_InsertAfter(&self->extents, &pExtent->node, (pPrevExtent) ? &pPrevExtent->node : NULL);
-    pExtent->firstBlockIndex = firstBlockIndex;
+    pExtent->firstBlockIndex = extentIdx * self->extentBlockCount;
+    (*ppLeaf)->extent[extentIdx & EXTENT_LEAF_MASK] = pExtent;
+    self->lastExtent = pExtent;
     *pOutExtent = pExtent;
+    return EOK;
 
 catch:
+    *pOutExtent = NULL;
     return err;
 }
 
@@ -167,15 +199,68 @@ errno_t RamDisk_putBlock(RamDiskRef _Nonnull self, const void* _Nonnull pBuffer,
 
     Lock_Lock(&self->lock);
 
-    DiskExtent* pPrevExtent;
-    DiskExtent* pExtent = RamDisk_GetDiskExtentForBlockIndex_Locked(self, lba, &pPrevExtent);
+    DiskExtent* pExtent = RamDisk_GetExtent_Locked(self, lba);
     if (pExtent == NULL) {
         // Extent doesn't exist yet for the range intersected by 'lba'. Allocate
         // it and make sure all the data in there is cleared out.
-        try(RamDisk_AddExtentAfter_Locked(self, (lba / self->extentBlockCount) * self->extentBlockCount, pPrevExtent, &pExtent));
+        try(RamDisk_AddExtent_Locked(self, lba, &pExtent));
     }
-    if (pExtent) {
-        memcpy(&pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize], pBuffer, self->blockSize);
+    memcpy(&pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize], pBuffer, self->blockSize);
+
+catch:
+    Lock_Unlock(&self->lock);
+
+    return err;
+}
+
+// Transfers the 'blockCount' consecutive blocks starting at index 'lba' between
+// the disk and the scatter/gather list 'pSegments'. The list is walked in spans
+// which never cross a segment or an extent boundary and every span is moved
+// with a single memcpy(). Missing extents are allocated on demand if 'isWrite'
+// is true and read back as zeros otherwise.
+static errno_t RamDisk_TransferBlocks(RamDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount, bool isWrite)
+{
+    decl_try_err();
+    const LogicalBlockCount extentBlockCount = self->extentBlockCount;
+    const size_t blockSize = self->blockSize;
+    LogicalBlockCount segBlockOffset = 0;
+    int segIdx = 0;
+
+    if (lba >= self->blockCount || blockCount > self->blockCount - lba) {
+        return EIO;
+    }
+
+    Lock_Lock(&self->lock);
+
+    while (blockCount > 0 && segIdx < segmentCount) {
+        const LogicalBlockAddress extentBase = (lba / extentBlockCount) * extentBlockCount;
+        const LogicalBlockCount extentAvail = extentBlockCount - (lba - extentBase);
+        const LogicalBlockCount segAvail = pSegments[segIdx].blockCount - segBlockOffset;
+        const LogicalBlockCount nBlocks = __min(__min(extentAvail, segAvail), blockCount);
+        const size_t nBytes = nBlocks * blockSize;
+        char* pSegData = (char*)pSegments[segIdx].data + segBlockOffset * blockSize;
+        DiskExtent* pExtent = RamDisk_GetExtent_Locked(self, lba);
+
+        if (isWrite) {
+            if (pExtent == NULL) {
+                try(RamDisk_AddExtent_Locked(self, lba, &pExtent));
+            }
+            memcpy(&pExtent->data[(lba - pExtent->firstBlockIndex) * blockSize], pSegData, nBytes);
+        }
+        else if (pExtent) {
+            memcpy(pSegData, &pExtent->data[(lba - pExtent->firstBlockIndex) * blockSize], nBytes);
+        }
+        else {
+            memset(pSegData, 0, nBytes);
+        }
+
+        lba += nBlocks;
+        blockCount -= nBlocks;
+        segBlockOffset += nBlocks;
+        if (segBlockOffset == pSegments[segIdx].blockCount) {
+            segBlockOffset = 0;
+            segIdx++;
+        }
     }
 
 catch:
@@ -184,6 +269,60 @@ catch:
     return err;
 }
 
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'.
+errno_t RamDisk_getBlocks(RamDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return RamDisk_TransferBlocks(self, lba, blockCount, pSegments, segmentCount, false);
+}
+
+// Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+// the buffers described by the scatter/gather list 'pSegments'.
+errno_t RamDisk_putBlocks(RamDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return RamDisk_TransferBlocks(self, lba, blockCount, pSegments, segmentCount, true);
+}
+
+// Maps the block at index 'lba'. Returns a pointer into the extent that holds
+// the block. Extents are never freed while the disk exists and thus unmapping
+// a block is a no-op. A block that hasn't been written to yet is mapped to a
+// shared zero-filled block if 'mode' is kMapBlock_ReadOnly. Its extent is
+// allocated if 'mode' is kMapBlock_Update.
+errno_t RamDisk_mapBlock(RamDiskRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData)
+{
+    decl_try_err();
+
+    if (lba >= self->blockCount) {
+        *pOutData = NULL;
+        return EIO;
+    }
+
+    Lock_Lock(&self->lock);
+
+    DiskExtent* pExtent = RamDisk_GetExtent_Locked(self, lba);
+    if (pExtent) {
+        *pOutData = &pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize];
+    }
+    else if (mode == kMapBlock_Update) {
+        try(RamDisk_AddExtent_Locked(self, lba, &pExtent));
+        *pOutData = &pExtent->data[(lba - pExtent->firstBlockIndex) * self->blockSize];
+    }
+    else {
+        if (self->zeroBlock == NULL) {
+            try(kalloc_cleared(self->blockSize, (void**)&self->zeroBlock));
+        }
+        *pOutData = self->zeroBlock;
+    }
+
+    Lock_Unlock(&self->lock);
+    return EOK;
+
+catch:
+    Lock_Unlock(&self->lock);
+    *pOutData = NULL;
+    return err;
+}
+
 
 CLASS_METHODS(RamDisk, DiskDriver,
 OVERRIDE_METHOD_IMPL(deinit, RamDisk, Object)
@@ -192,4 +331,7 @@ OVERRIDE_METHOD_IMPL(getBlockCount, RamDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(isReadOnly, RamDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlock, RamDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(putBlock, RamDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlocks, RamDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(putBlocks, RamDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(mapBlock, RamDisk, DiskDriver)
 );
@@ -24,7 +24,7 @@ errno_t RomDisk_Create(const void* _Nonnull pDiskImage, size_t nBlockSize, Logic
     RomDiskRef self;
 
     assert(pDiskImage != NULL);
-    try(Object_Create(RomDisk, &self));
+    try(DiskDriver_Create(&kRomDiskClass, (DiskDriverRef*)&self));
     self->diskImage = pDiskImage;
     self->blockCount = nBlockCount;
     self->blockSize = nBlockSize;
@@ -44,6 +44,7 @@ void RomDisk_deinit(RomDiskRef _Nonnull self)
         kfree(self->diskImage);
         self->diskImage = NULL;
     }
+    DiskDriver_deinit((DiskDriverRef)self);
 }
 
 // Returns the size of a block.
@@ -74,10 +75,52 @@ errno_t RomDisk_getBlock(RomDiskRef _Nonnull self, void* _Nonnull pBuffer, Logic
     }
 }
 
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'. Needs a single
+// memcpy() per segment because the disk image is contiguous in memory.
+errno_t RomDisk_getBlocks(RomDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    if (lba >= self->blockCount || blockCount > self->blockCount - lba) {
+        return EIO;
+    }
+
+    const char* pSrc = self->diskImage + lba * self->blockSize;
+
+    for (int i = 0; i < segmentCount && blockCount > 0; i++) {
+        const LogicalBlockCount nBlocks = __min(pSegments[i].blockCount, blockCount);
+        const size_t nBytes = nBlocks * self->blockSize;
+
+        memcpy(pSegments[i].data, pSrc, nBytes);
+        pSrc += nBytes;
+        blockCount -= nBlocks;
+    }
+
+    return EOK;
+}
+
+// Maps the block at index 'lba'. Returns a pointer into the disk image. Blocks
+// can only be mapped read-only and unmapping a block is a no-op.
+errno_t RomDisk_mapBlock(RomDiskRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData)
+{
+    if (mode != kMapBlock_ReadOnly) {
+        *pOutData = NULL;
+        return EROFS;
+    }
+    if (lba >= self->blockCount) {
+        *pOutData = NULL;
+        return EIO;
+    }
+
+    *pOutData = (void*)(self->diskImage + lba * self->blockSize);
+    return EOK;
+}
+
 
 CLASS_METHODS(RomDisk, DiskDriver,
 OVERRIDE_METHOD_IMPL(deinit, RomDisk, Object)
 OVERRIDE_METHOD_IMPL(getBlockSize, RomDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlockCount, RomDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlock, RomDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlocks, RomDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(mapBlock, RomDisk, DiskDriver)
 );
@@ -274,7 +274,7 @@ errno_t FloppyDisk_Create(int drive, FloppyDiskRef _Nullable * _Nonnull pOutDisk
     decl_try_err();
     FloppyDisk* pDisk;
     
-    try(Object_Create(FloppyDisk, &pDisk));
+    try(DiskDriver_Create(&kFloppyDiskClass, (DiskDriverRef*)&pDisk));
     try(kalloc_options(sizeof(uint16_t) * FLOPPY_TRACK_BUFFER_CAPACITY, KALLOC_OPTION_UNIFIED, (void**) &pDisk->track_buffer));
     
     pDisk->track_size = FLOPPY_TRACK_BUFFER_CAPACITY;
@@ -299,6 +299,7 @@ static void FloppyDisk_deinit(FloppyDiskRef _Nonnull pDisk)
 {
     kfree(pDisk->track_buffer);
     pDisk->track_buffer = NULL;
+    DiskDriver_deinit((DiskDriverRef)pDisk);
 }
 
 // Invalidates the track cache.
@@ -765,6 +766,81 @@ errno_t FloppyDisk_putBlock(FloppyDiskRef _Nonnull self, const void* _Nonnull pB
     return FloppyDisk_WriteSector(self, h, c, s, pBuffer);
 }
 
+// Transfers the 'blockCount' consecutive blocks starting at index 'lba' between
+// the disk and the scatter/gather list 'pSegments'. The blocks are processed
+// track by track: every track is read into the track buffer once and a write
+// encodes all affected sectors into the track buffer before the track is
+// written back to the disk with a single DMA operation.
+static errno_t FloppyDisk_TransferBlocks(FloppyDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount, bool isWrite)
+{
+    decl_try_err();
+    LogicalBlockCount segBlockOffset = 0;
+    int segIdx = 0;
+
+    if (lba >= FloppyDisk_getBlockCount(self) || blockCount > FloppyDisk_getBlockCount(self) - lba) {
+        return EIO;
+    }
+
+    while (blockCount > 0 && segIdx < segmentCount) {
+        // XXX hardcoded to HD for now
+        const size_t c = lba / (ADF_HD_HEADS_PER_CYL * ADF_HD_SECS_PER_TRACK);
+        const size_t h = (lba / ADF_HD_SECS_PER_TRACK) % ADF_HD_HEADS_PER_CYL;
+        const size_t s = lba % ADF_HD_SECS_PER_TRACK;
+        const LogicalBlockCount nSectors = __min(ADF_HD_SECS_PER_TRACK - s, blockCount);
+        uint16_t* track_buffer = self->track_buffer;
+        const int16_t* sector_table = self->track_sectors;
+
+        try(FloppyDisk_ReadTrack(self, h, c));
+
+        for (LogicalBlockCount i = 0; i < nSectors && segIdx < segmentCount; i++) {
+            const int16_t idx = sector_table[s + i];
+            uint8_t* pData = (uint8_t*)pSegments[segIdx].data + segBlockOffset * ADF_SECTOR_SIZE;
+
+            if (idx == 0) {
+                throw(EIO);
+            }
+
+            if (isWrite) {
+                mfm_encode_sector((const uint32_t*)pData, (uint32_t*)&track_buffer[idx + 28], ADF_SECTOR_SIZE / sizeof(uint32_t));
+            }
+            else {
+                mfm_decode_sector((const uint32_t*)&track_buffer[idx + 28], (uint32_t*)pData, ADF_SECTOR_SIZE / sizeof(uint32_t));
+            }
+
+            lba++;
+            blockCount--;
+            segBlockOffset++;
+            if (segBlockOffset == pSegments[segIdx].blockCount) {
+                segBlockOffset = 0;
+                segIdx++;
+            }
+        }
+
+        if (isWrite) {
+            try(FloppyDisk_WriteTrack(self, h, c));
+        }
+    }
+
+catch:
+    return err;
+}
+
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'. Reads every
+// track at most once.
+errno_t FloppyDisk_getBlocks(FloppyDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return FloppyDisk_TransferBlocks(self, lba, blockCount, pSegments, segmentCount, false);
+}
+
+// Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+// the buffers described by the scatter/gather list 'pSegments'. Writes every
+// track at most once.
+errno_t FloppyDisk_putBlocks(FloppyDiskRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return FloppyDisk_TransferBlocks(self, lba, blockCount, pSegments, segmentCount, true);
+}
+
 
 
 CLASS_METHODS(FloppyDisk, DiskDriver,
@@ -774,4 +850,6 @@ OVERRIDE_METHOD_IMPL(getBlockCount, FloppyDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(isReadOnly, FloppyDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(getBlock, FloppyDisk, DiskDriver)
 OVERRIDE_METHOD_IMPL(putBlock, FloppyDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(getBlocks, FloppyDisk, DiskDriver)
+OVERRIDE_METHOD_IMPL(putBlocks, FloppyDisk, DiskDriver)
 );
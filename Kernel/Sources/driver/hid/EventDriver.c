@@ -554,7 +554,7 @@ uint32_t EventDriver_GetMouseDeviceButtonsDown(EventDriverRef _Nonnull pDriver)
 // MARK: Getting Events
 ////////////////////////////////////////////////////////////////////////////////
 
-errno_t EventDriver_open(EventDriverRef _Nonnull pDriver, InodeRef _Nonnull _Locked pNode, unsigned int mode, User user, EventDriverChannelRef _Nullable * _Nonnull pOutChannel)
+errno_t EventDriver_open(EventDriverRef _Nonnull pDriver, InodeRef _Nonnull pNode, unsigned int mode, User user, EventDriverChannelRef _Nullable * _Nonnull pOutChannel)
 {
     decl_try_err();
     EventDriverChannelRef pChannel;
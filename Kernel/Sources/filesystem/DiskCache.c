@@ -0,0 +1,819 @@
+//
+//  DiskCache.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/14/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "DiskCache.h"
+#include <dispatcher/ConditionVariable.h>
+#ifndef __DISKIMAGE__
+#include <dispatchqueue/DispatchQueue.h>
+#endif
+
+
+#define DISK_BLOCK_HASH_CHAIN_COUNT         32
+#define DISK_BLOCK_HASH_CHAIN_MASK          (DISK_BLOCK_HASH_CHAIN_COUNT - 1)
+
+#define DiskBlockFromLruNode(__pNode) \
+    ((DiskBlockRef)(((uint8_t*)(__pNode)) - offsetof(DiskBlock, lruNode)))
+
+
+typedef struct _DiskCache {
+    Lock                lock;
+    ConditionVariable   condition;          // Signaled when a block becomes unused
+    size_t              blockSize;
+    size_t              blockCount;         // Number of blocks allocated so far
+    size_t              maxBlockCount;
+    List                lruChain;           // All blocks. First block is the most recently used one
+    List                hashChain[DISK_BLOCK_HASH_CHAIN_COUNT];
+    List                bypassChain;        // Block ranges which are transferred directly between the disk and a client buffer
+    struct _DispatchQueue* _Nullable    ioCompletionQueue;  // Runs the completion functions of read-aheads
+} DiskCache;
+
+
+// A run of uncached blocks which DiskCache_ReadBlocks() or DiskCache_WriteBlocks()
+// transfers directly. The blocks can not be added to the cache while the
+// transfer is in progress. Lives on the stack of the client
+typedef struct BypassRange {
+    ListNode                node;
+    DiskDriverRef _Nonnull  driver;
+    LogicalBlockAddress     lba;
+    LogicalBlockCount       blockCount;
+} BypassRange;
+
+
+// An asynchronous read-ahead of a single block
+typedef struct PrefetchRequest {
+    DiskRequest             request;
+    DiskBufferSegment       segment;
+    DiskCacheRef _Nonnull   cache;
+    DiskBlockRef _Nonnull   block;
+} PrefetchRequest;
+
+
+DiskCacheRef _Nonnull  gDiskCache;
+
+
+static size_t DiskCache_HashKey(DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    return (((size_t)pDriver >> 4) ^ lba) & DISK_BLOCK_HASH_CHAIN_MASK;
+}
+
+// Creates a disk cache which caches up to 'maxBlockCount' blocks of size
+// 'blockSize'. Blocks are allocated on demand and the least recently used block
+// is reused once the cache has reached its maximum size.
+errno_t DiskCache_Create(size_t blockSize, size_t maxBlockCount, DiskCacheRef _Nullable * _Nonnull pOutSelf)
+{
+    decl_try_err();
+    DiskCacheRef self;
+
+    assert(blockSize > 0);
+    assert(maxBlockCount > 0);
+
+    try(kalloc(sizeof(DiskCache), (void**) &self));
+    Lock_Init(&self->lock);
+    ConditionVariable_Init(&self->condition);
+    self->blockSize = blockSize;
+    self->blockCount = 0;
+    self->maxBlockCount = maxBlockCount;
+    List_Init(&self->lruChain);
+    for (int i = 0; i < DISK_BLOCK_HASH_CHAIN_COUNT; i++) {
+        List_Init(&self->hashChain[i]);
+    }
+    List_Init(&self->bypassChain);
+
+    // Read-ahead completions take the cache lock. They can not run on the
+    // request queue of a disk driver because a client may hold the cache lock
+    // while it waits for a write-back by that driver.
+#ifndef __DISKIMAGE__
+    try(DispatchQueue_Create(0, 1, kDispatchQoS_Utility, kDispatchPriority_Normal, gVirtualProcessorPool, NULL, (DispatchQueueRef*)&self->ioCompletionQueue));
+#else
+    self->ioCompletionQueue = NULL;
+#endif
+
+    *pOutSelf = self;
+    return EOK;
+
+catch:
+    *pOutSelf = NULL;
+    return err;
+}
+
+// Returns the cached block for (pDriver, lba) if it exists and NULL otherwise.
+static DiskBlockRef _Nullable DiskCache_FindBlock_Locked(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    List_ForEach(&self->hashChain[DiskCache_HashKey(pDriver, lba)], DiskBlock, {
+        if (pCurNode->driver == pDriver && pCurNode->lba == lba) {
+            return pCurNode;
+        }
+    });
+
+    return NULL;
+}
+
+// Returns true if the block (pDriver, lba) is part of a direct transfer that is
+// in progress.
+static bool DiskCache_IsBypassed_Locked(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    List_ForEach(&self->bypassChain, BypassRange, {
+        if (pCurNode->driver == pDriver && lba >= pCurNode->lba && lba < pCurNode->lba + pCurNode->blockCount) {
+            return true;
+        }
+    });
+
+    return false;
+}
+
+// Points the block at the contents of its disk block as mapped by the driver.
+// Returns an error if the driver doesn't support mapping or failed to map the block.
+static errno_t DiskCache_MapBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock)
+{
+    void* pData;
+    const errno_t err = DiskDriver_MapBlock(pBlock->driver, pBlock->lba, kMapBlock_ReadOnly, &pData);
+
+    if (err == EOK) {
+        pBlock->data = pData;
+        pBlock->flags.isMapped = true;
+        pBlock->flags.hasData = true;
+    }
+    return err;
+}
+
+// Unmaps a mapped block and switches it back to its own buffer. The mapped
+// contents are copied to the buffer if 'keepData' is true.
+static void DiskCache_UnmapBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock, bool keepData)
+{
+    uint8_t* pBuffer = ((uint8_t*)pBlock) + sizeof(DiskBlock);
+
+    if (keepData) {
+        memcpy(pBuffer, pBlock->data, self->blockSize);
+    }
+    DiskDriver_UnmapBlock(pBlock->driver, pBlock->lba, pBlock->data);
+    pBlock->data = pBuffer;
+    pBlock->flags.isMapped = false;
+    pBlock->flags.hasData = keepData;
+}
+
+// Writes the contents of the block back to disk and clears the dirty flag if
+// the write was successful.
+static errno_t DiskCache_WriteBack(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock)
+{
+    const errno_t err = DiskDriver_PutBlock(pBlock->driver, pBlock->data, pBlock->lba);
+
+    if (err == EOK) {
+        pBlock->flags.isDirty = false;
+    }
+    return err;
+}
+
+// Returns a block that can be assigned to a new disk block. Allocates a new
+// block if the cache hasn't reached its maximum size yet. Otherwise the least
+// recently used block that isn't in use and isn't dirty is reused. Returns
+// EBUSY if no such block exists. Dirty blocks are cleaned with
+// DiskCache_CleanBlock_Locked() because their write-back can not be done with
+// the cache lock held.
+static errno_t DiskCache_GetReusableBlock_Locked(DiskCacheRef _Nonnull self, DiskBlockRef _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    DiskBlockRef pBlock = NULL;
+
+    if (self->blockCount < self->maxBlockCount) {
+        try(kalloc(sizeof(DiskBlock) + self->blockSize, (void**) &pBlock));
+        ListNode_Init(&pBlock->hashNode);
+        ListNode_Init(&pBlock->lruNode);
+        Lock_Init(&pBlock->lock);
+        pBlock->driver = NULL;
+        pBlock->lba = 0;
+        pBlock->useCount = 0;
+        pBlock->flags.hasData = false;
+        pBlock->flags.isDirty = false;
+        pBlock->flags.isLoading = false;
+        pBlock->flags.isMapped = false;
+        pBlock->flags.reserved = 0;
+        pBlock->data = ((uint8_t*)pBlock) + sizeof(DiskBlock);
+
+        List_InsertBeforeFirst(&self->lruChain, &pBlock->lruNode);
+        self->blockCount++;
+    }
+    else {
+        ListNode* pCurNode = self->lruChain.last;
+
+        while (pCurNode) {
+            DiskBlockRef pCurBlock = DiskBlockFromLruNode(pCurNode);
+
+            if (pCurBlock->useCount == 0 && !pCurBlock->flags.isDirty) {
+                pBlock = pCurBlock;
+                break;
+            }
+            pCurNode = pCurNode->prev;
+        }
+
+        if (pBlock == NULL) {
+            throw(EBUSY);
+        }
+
+        if (pBlock->flags.isMapped) {
+            DiskCache_UnmapBlock(self, pBlock, false);
+        }
+        if (pBlock->driver) {
+            List_Remove(&self->hashChain[DiskCache_HashKey(pBlock->driver, pBlock->lba)], &pBlock->hashNode);
+            Object_Release(pBlock->driver);
+            pBlock->driver = NULL;
+        }
+        pBlock->flags.hasData = false;
+    }
+
+    *pOutBlock = pBlock;
+    return EOK;
+
+catch:
+    *pOutBlock = NULL;
+    return err;
+}
+
+// Marks the block as used by the caller without acquiring it. A used block is
+// not reused for another disk block.
+static void DiskCache_PinBlock_Locked(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock)
+{
+    pBlock->useCount++;
+}
+
+// Reverses a DiskCache_PinBlock_Locked(). Unlike DiskCache_UnuseBlock() this
+// does not change the position of the block in the LRU chain.
+static void DiskCache_UnpinBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock)
+{
+    Lock_Lock(&self->lock);
+    pBlock->useCount--;
+
+    if (pBlock->useCount == 0) {
+        ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+    }
+    else {
+        Lock_Unlock(&self->lock);
+    }
+}
+
+// Writes the given pinned block back to disk if it is dirty. Waits until the
+// client which has acquired the block relinquishes it. Must be called without
+// holding the cache lock.
+static errno_t DiskCache_WriteBackPinnedBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock)
+{
+    decl_try_err();
+
+    Lock_Lock(&pBlock->lock);
+    if (pBlock->flags.isDirty) {
+        err = DiskCache_WriteBack(self, pBlock);
+    }
+    Lock_Unlock(&pBlock->lock);
+
+    return err;
+}
+
+// Writes the least recently used dirty block that isn't in use back to disk so
+// that it can be reused. Drops the cache lock while the write is in progress.
+// A block that fails to write is moved to the front of the LRU chain so that it
+// doesn't stay first in line and the next candidate is tried. The write error
+// belongs to the block's owner and is reported by a later sync. Returns EBUSY
+// if no block could be cleaned.
+static errno_t DiskCache_CleanBlock_Locked(DiskCacheRef _Nonnull self)
+{
+    for (size_t nAttempts = 0; nAttempts < self->blockCount; nAttempts++) {
+        ListNode* pCurNode = self->lruChain.last;
+        DiskBlockRef pBlock = NULL;
+
+        while (pCurNode) {
+            DiskBlockRef pCurBlock = DiskBlockFromLruNode(pCurNode);
+
+            if (pCurBlock->useCount == 0 && pCurBlock->flags.isDirty) {
+                pBlock = pCurBlock;
+                break;
+            }
+            pCurNode = pCurNode->prev;
+        }
+
+        if (pBlock == NULL) {
+            break;
+        }
+
+        DiskCache_PinBlock_Locked(self, pBlock);
+        Lock_Unlock(&self->lock);
+
+        const errno_t err = DiskCache_WriteBackPinnedBlock(self, pBlock);
+        DiskCache_UnpinBlock(self, pBlock);
+
+        Lock_Lock(&self->lock);
+        if (err == EOK) {
+            return EOK;
+        }
+        List_Remove(&self->lruChain, &pBlock->lruNode);
+        List_InsertBeforeFirst(&self->lruChain, &pBlock->lruNode);
+    }
+
+    return EBUSY;
+}
+
+// Assigns the block 'pBlock' to the disk block (pDriver, lba).
+static void DiskCache_AssignBlock_Locked(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    pBlock->driver = Object_RetainAs(pDriver, DiskDriver);
+    pBlock->lba = lba;
+    pBlock->flags.hasData = false;
+    pBlock->flags.isDirty = false;
+    List_InsertBeforeFirst(&self->hashChain[DiskCache_HashKey(pDriver, lba)], &pBlock->hashNode);
+}
+
+// Marks the block as unused by the caller and moves it to the front of the LRU
+// chain. Wakes up clients that are waiting for an unused block.
+static void DiskCache_UnuseBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock)
+{
+    Lock_Lock(&self->lock);
+    pBlock->useCount--;
+    List_Remove(&self->lruChain, &pBlock->lruNode);
+    List_InsertBeforeFirst(&self->lruChain, &pBlock->lruNode);
+
+    if (pBlock->useCount == 0) {
+        ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+    }
+    else {
+        Lock_Unlock(&self->lock);
+    }
+}
+
+// Acquires the block 'lba' of the disk 'pDriver'. Blocks the caller until the
+// block is available if another client has acquired the block. The block
+// contents are prepared as specified by 'mode'. The caller owns the block until
+// it relinquishes it.
+errno_t DiskCache_AcquireBlock(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, AcquireBlock mode, DiskBlockRef _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    DiskBlockRef pBlock = NULL;
+
+    if (DiskDriver_GetBlockSize(pDriver) != self->blockSize) {
+        *pOutBlock = NULL;
+        return EINVAL;
+    }
+
+    Lock_Lock(&self->lock);
+    while (true) {
+        pBlock = DiskCache_FindBlock_Locked(self, pDriver, lba);
+        if (pBlock) {
+            break;
+        }
+
+        // The disk block is about to change or to be read behind our back if
+        // it is part of a direct transfer. Wait for the transfer to finish
+        if (!DiskCache_IsBypassed_Locked(self, pDriver, lba)) {
+            err = DiskCache_GetReusableBlock_Locked(self, &pBlock);
+            if (err == EOK) {
+                DiskCache_AssignBlock_Locked(self, pBlock, pDriver, lba);
+                break;
+            }
+            if (err == EBUSY) {
+                // Write back a dirty block and try again. Otherwise wait
+                err = DiskCache_CleanBlock_Locked(self);
+                if (err == EOK) {
+                    continue;
+                }
+            }
+            if (err != EBUSY) {
+                Lock_Unlock(&self->lock);
+                *pOutBlock = NULL;
+                return err;
+            }
+        }
+
+        // All blocks are in use or the block is being transferred directly.
+        // Wait until one becomes available and then try again. Another client
+        // may have loaded our block in the meantime.
+        err = ConditionVariable_Wait(&self->condition, &self->lock, kTimeInterval_Infinity);
+        if (err != EOK) {
+            Lock_Unlock(&self->lock);
+            *pOutBlock = NULL;
+            return err;
+        }
+    }
+    pBlock->useCount++;
+    Lock_Unlock(&self->lock);
+
+
+    // Take ownership of the block and prepare its contents. Wait for a read-ahead
+    // of the block to finish first
+    Lock_Lock(&pBlock->lock);
+
+    if (pBlock->flags.isLoading) {
+        Lock_Lock(&self->lock);
+        while (pBlock->flags.isLoading) {
+            ConditionVariable_Wait(&self->condition, &self->lock, kTimeInterval_Infinity);
+        }
+        Lock_Unlock(&self->lock);
+    }
+
+    // A mapped block must not be modified. Switch it back to its own buffer if
+    // the caller may modify the block
+    if (pBlock->flags.isMapped && mode != kAcquireBlock_ReadOnly) {
+        DiskCache_UnmapBlock(self, pBlock, (mode == kAcquireBlock_Update) ? true : false);
+    }
+
+    switch (mode) {
+        case kAcquireBlock_ReadOnly:
+            if (!pBlock->flags.hasData) {
+                // Fall back to reading the block if the driver can't map it
+                if (DiskCache_MapBlock(self, pBlock) == EOK) {
+                    break;
+                }
+                err = DiskDriver_GetBlock(pDriver, pBlock->data, lba);
+                if (err == EOK) {
+                    pBlock->flags.hasData = true;
+                }
+            }
+            break;
+
+        case kAcquireBlock_Update:
+            if (!pBlock->flags.hasData) {
+                err = DiskDriver_GetBlock(pDriver, pBlock->data, lba);
+                if (err == EOK) {
+                    pBlock->flags.hasData = true;
+                }
+            }
+            break;
+
+        case kAcquireBlock_Replace:
+            break;
+
+        case kAcquireBlock_Cleared:
+            memset(pBlock->data, 0, self->blockSize);
+            pBlock->flags.hasData = true;
+            break;
+
+        default:
+            abort();
+    }
+
+    if (err != EOK) {
+        Lock_Unlock(&pBlock->lock);
+        DiskCache_UnuseBlock(self, pBlock);
+        pBlock = NULL;
+    }
+
+    *pOutBlock = pBlock;
+    return err;
+}
+
+// Relinquishes the block 'pBlock' without writing it. The caller must not have
+// modified the block contents.
+void DiskCache_RelinquishBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nullable pBlock)
+{
+    if (pBlock) {
+        Lock_Unlock(&pBlock->lock);
+        DiskCache_UnuseBlock(self, pBlock);
+    }
+}
+
+// Relinquishes the block 'pBlock' and writes its contents back to disk as
+// specified by 'mode'. The block is relinquished even if the write fails. A
+// block that failed to write stays dirty and the write will be retried later.
+errno_t DiskCache_RelinquishBlockWriting(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock, WriteBlock mode)
+{
+    decl_try_err();
+
+    assert(!pBlock->flags.isMapped);
+
+    // A replaced block holds the new block contents from here on
+    pBlock->flags.hasData = true;
+    pBlock->flags.isDirty = true;
+
+    if (mode == kWriteBlock_Sync) {
+        err = DiskCache_WriteBack(self, pBlock);
+    }
+
+    Lock_Unlock(&pBlock->lock);
+    DiskCache_UnuseBlock(self, pBlock);
+
+    return err;
+}
+
+// Called by the disk driver when the read of a prefetched block has completed.
+// Marks the block as loaded and wakes up clients that are waiting for it.
+static void DiskCache_OnPrefetchDone(PrefetchRequest* _Nonnull pRequest)
+{
+    DiskCacheRef self = pRequest->cache;
+    DiskBlockRef pBlock = pRequest->block;
+
+    Lock_Lock(&self->lock);
+    pBlock->flags.hasData = (pRequest->request.status == EOK) ? 1 : 0;
+    pBlock->flags.isLoading = false;
+    pBlock->useCount--;
+    List_Remove(&self->lruChain, &pBlock->lruNode);
+    List_InsertBeforeFirst(&self->lruChain, &pBlock->lruNode);
+    ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+
+    kfree(pRequest);
+}
+
+// Read-ahead hook. Tells the cache that the block 'lba' of the disk 'pDriver'
+// is likely to be needed soon. The cache starts an asynchronous read of the
+// block if it isn't cached yet, it isn't part of a direct transfer and a block
+// can be assigned without waiting for a busy block. Does not wait for the read
+// to complete.
+void DiskCache_PrefetchBlock(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba)
+{
+    DiskBlockRef pBlock = NULL;
+    PrefetchRequest* pRequest;
+
+    if (DiskDriver_GetBlockSize(pDriver) != self->blockSize) {
+        return;
+    }
+
+    // Nothing to prefetch if the driver is able to map the block in place
+    void* pMappedData;
+    if (DiskDriver_MapBlock(pDriver, lba, kMapBlock_ReadOnly, &pMappedData) == EOK) {
+        DiskDriver_UnmapBlock(pDriver, lba, pMappedData);
+        return;
+    }
+
+    if (kalloc(sizeof(PrefetchRequest), (void**) &pRequest) != EOK) {
+        return;
+    }
+
+    // A block which is part of a direct transfer is about to be written behind
+    // our back. A read-ahead that is queued before the write would cache the
+    // old contents
+    Lock_Lock(&self->lock);
+    if (DiskCache_FindBlock_Locked(self, pDriver, lba)
+        || DiskCache_IsBypassed_Locked(self, pDriver, lba)
+        || DiskCache_GetReusableBlock_Locked(self, &pBlock) != EOK) {
+        Lock_Unlock(&self->lock);
+        kfree(pRequest);
+        return;
+    }
+    DiskCache_AssignBlock_Locked(self, pBlock, pDriver, lba);
+    pBlock->useCount++;
+    pBlock->flags.isLoading = true;
+    Lock_Unlock(&self->lock);
+
+    pRequest->segment.data = pBlock->data;
+    pRequest->segment.blockCount = 1;
+    pRequest->request.type = kDiskRequest_Read;
+    pRequest->request.lba = lba;
+    pRequest->request.blockCount = 1;
+    pRequest->request.segments = &pRequest->segment;
+    pRequest->request.segmentCount = 1;
+    pRequest->request.done = (Closure1Arg_Func)DiskCache_OnPrefetchDone;
+    pRequest->request.context = NULL;
+    pRequest->request.completionQueue = self->ioCompletionQueue;
+    pRequest->cache = self;
+    pRequest->block = pBlock;
+
+    if (DiskDriver_BeginIO(pDriver, &pRequest->request) != EOK) {
+        pRequest->request.status = EIO;
+        DiskCache_OnPrefetchDone(pRequest);
+    }
+}
+
+// Returns the number of consecutive blocks starting at 'lba' and up to 'maxCount'
+// blocks which are not in the cache.
+static LogicalBlockCount DiskCache_GetUncachedRunLength_Locked(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount maxCount)
+{
+    LogicalBlockCount n = 0;
+
+    while (n < maxCount && DiskCache_FindBlock_Locked(self, pDriver, lba + n) == NULL) {
+        n++;
+    }
+    return n;
+}
+
+// Determines the run of uncached blocks starting at 'lba' and up to 'maxCount'
+// blocks and reserves it for a direct transfer. No client is able to add the
+// blocks of the run to the cache until the run is released. Returns 0 and
+// reserves nothing if the block 'lba' is cached.
+static LogicalBlockCount DiskCache_ReserveUncachedRun(DiskCacheRef _Nonnull self, BypassRange* _Nonnull pRange, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount maxCount)
+{
+    Lock_Lock(&self->lock);
+    const LogicalBlockCount nUncached = DiskCache_GetUncachedRunLength_Locked(self, pDriver, lba, maxCount);
+
+    if (nUncached > 0) {
+        ListNode_Init(&pRange->node);
+        pRange->driver = pDriver;
+        pRange->lba = lba;
+        pRange->blockCount = nUncached;
+        List_InsertBeforeFirst(&self->bypassChain, &pRange->node);
+    }
+    Lock_Unlock(&self->lock);
+
+    return nUncached;
+}
+
+// Releases a run of blocks that was reserved for a direct transfer and wakes up
+// clients that are waiting for one of its blocks.
+static void DiskCache_ReleaseUncachedRun(DiskCacheRef _Nonnull self, BypassRange* _Nonnull pRange)
+{
+    Lock_Lock(&self->lock);
+    List_Remove(&self->bypassChain, &pRange->node);
+    ConditionVariable_BroadcastAndUnlock(&self->condition, &self->lock);
+}
+
+// Reads the 'blockCount' consecutive blocks starting at 'lba' of the disk
+// 'pDriver' into 'pBuffer'. Blocks which are in the cache are copied from the
+// cache. Runs of blocks which are not in the cache are read directly into
+// 'pBuffer' with a single multi-block read and are not added to the cache.
+// Clients which acquire one of these blocks wait until the read has completed.
+// The caller is responsible for serializing this call with writes to the
+// same blocks.
+errno_t DiskCache_ReadBlocks(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount blockCount, void* _Nonnull pBuffer)
+{
+    decl_try_err();
+    uint8_t* pData = pBuffer;
+
+    if (DiskDriver_GetBlockSize(pDriver) != self->blockSize) {
+        return EINVAL;
+    }
+
+    while (blockCount > 0) {
+        BypassRange range;
+        const LogicalBlockCount nUncached = DiskCache_ReserveUncachedRun(self, &range, pDriver, lba, blockCount);
+
+        if (nUncached > 0) {
+            DiskBufferSegment seg;
+
+            seg.data = pData;
+            seg.blockCount = nUncached;
+            err = DiskDriver_GetBlocks(pDriver, lba, nUncached, &seg, 1);
+            DiskCache_ReleaseUncachedRun(self, &range);
+            if (err != EOK) {
+                throw(err);
+            }
+
+            lba += nUncached;
+            blockCount -= nUncached;
+            pData += nUncached * self->blockSize;
+        }
+        else {
+            DiskBlockRef pBlock;
+
+            try(DiskCache_AcquireBlock(self, pDriver, lba, kAcquireBlock_ReadOnly, &pBlock));
+            memcpy(pData, DiskBlock_GetData(pBlock), self->blockSize);
+            DiskCache_RelinquishBlock(self, pBlock);
+
+            lba++;
+            blockCount--;
+            pData += self->blockSize;
+        }
+    }
+
+catch:
+    return err;
+}
+
+// Writes the 'blockCount' consecutive blocks starting at 'lba' of the disk
+// 'pDriver' from 'pBuffer'. Blocks which are in the cache are updated in the
+// cache and written back later. Runs of blocks which are not in the cache are
+// written directly from 'pBuffer' with a single multi-block write. Clients
+// which acquire one of these blocks wait until the write has completed and thus
+// never cache the old contents. The caller is responsible for serializing this
+// call with other accesses to the same blocks.
+errno_t DiskCache_WriteBlocks(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount blockCount, const void* _Nonnull pBuffer)
+{
+    decl_try_err();
+    const uint8_t* pData = pBuffer;
+
+    if (DiskDriver_GetBlockSize(pDriver) != self->blockSize) {
+        return EINVAL;
+    }
+
+    while (blockCount > 0) {
+        BypassRange range;
+        const LogicalBlockCount nUncached = DiskCache_ReserveUncachedRun(self, &range, pDriver, lba, blockCount);
+
+        if (nUncached > 0) {
+            DiskBufferSegment seg;
+
+            seg.data = (void*)pData;
+            seg.blockCount = nUncached;
+            err = DiskDriver_PutBlocks(pDriver, lba, nUncached, &seg, 1);
+            DiskCache_ReleaseUncachedRun(self, &range);
+            if (err != EOK) {
+                throw(err);
+            }
+
+            lba += nUncached;
+            blockCount -= nUncached;
+            pData += nUncached * self->blockSize;
+        }
+        else {
+            DiskBlockRef pBlock;
+
+            try(DiskCache_AcquireBlock(self, pDriver, lba, kAcquireBlock_Replace, &pBlock));
+            memcpy(DiskBlock_GetMutableData(pBlock), pData, self->blockSize);
+            try(DiskCache_RelinquishBlockWriting(self, pBlock, kWriteBlock_Deferred));
+
+            lba++;
+            blockCount--;
+            pData += self->blockSize;
+        }
+    }
+
+catch:
+    return err;
+}
+
+// Writes all dirty blocks of the disk 'pDriver' back to disk. The dirty blocks
+// are collected and pinned with the cache lock held and they are written after
+// the cache lock has been dropped. Waits for blocks which are currently
+// acquired by a client.
+errno_t DiskCache_Sync(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver)
+{
+    decl_try_err();
+    DiskBlockRef* pDirtyBlocks;
+    size_t nDirtyBlocks = 0;
+
+    try(kalloc(sizeof(DiskBlockRef) * self->maxBlockCount, (void**) &pDirtyBlocks));
+
+    Lock_Lock(&self->lock);
+    ListNode* pCurNode = self->lruChain.first;
+
+    while (pCurNode) {
+        DiskBlockRef pCurBlock = DiskBlockFromLruNode(pCurNode);
+
+        if (pCurBlock->driver == pDriver && pCurBlock->flags.isDirty) {
+            DiskCache_PinBlock_Locked(self, pCurBlock);
+            pDirtyBlocks[nDirtyBlocks++] = pCurBlock;
+        }
+        pCurNode = pCurNode->next;
+    }
+    Lock_Unlock(&self->lock);
+
+    for (size_t i = 0; i < nDirtyBlocks; i++) {
+        const errno_t e1 = DiskCache_WriteBackPinnedBlock(self, pDirtyBlocks[i]);
+
+        if (err == EOK) {
+            err = e1;
+        }
+        DiskCache_UnpinBlock(self, pDirtyBlocks[i]);
+    }
+
+    kfree(pDirtyBlocks);
+
+catch:
+    return err;
+}
+
+// Writes the dirty blocks in the range [lba, lba + blockCount) of the disk
+// 'pDriver' back to disk. The cache lock is dropped while a block is written.
+errno_t DiskCache_SyncBlocks(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount blockCount)
+{
+    decl_try_err();
+
+    for (LogicalBlockCount i = 0; i < blockCount; i++) {
+        Lock_Lock(&self->lock);
+        DiskBlockRef pBlock = DiskCache_FindBlock_Locked(self, pDriver, lba + i);
+
+        if (pBlock && pBlock->flags.isDirty) {
+            DiskCache_PinBlock_Locked(self, pBlock);
+            Lock_Unlock(&self->lock);
+
+            const errno_t e1 = DiskCache_WriteBackPinnedBlock(self, pBlock);
+            if (err == EOK) {
+                err = e1;
+            }
+            DiskCache_UnpinBlock(self, pBlock);
+        }
+        else {
+            Lock_Unlock(&self->lock);
+        }
+    }
+
+    return err;
+}
+
+// Writes all dirty blocks of the disk 'pDriver' back to disk and then removes
+// all blocks of the disk from the cache. This drops the references that the
+// cache holds to the driver. Blocks that fail to write are removed anyway.
+// The caller must ensure that no block of the disk is in use.
+errno_t DiskCache_Purge(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver)
+{
+    const errno_t err = DiskCache_Sync(self, pDriver);
+
+    Lock_Lock(&self->lock);
+    ListNode* pCurNode = self->lruChain.first;
+
+    while (pCurNode) {
+        DiskBlockRef pCurBlock = DiskBlockFromLruNode(pCurNode);
+
+        if (pCurBlock->driver == pDriver && pCurBlock->useCount == 0) {
+            if (pCurBlock->flags.isMapped) {
+                DiskCache_UnmapBlock(self, pCurBlock, false);
+            }
+            List_Remove(&self->hashChain[DiskCache_HashKey(pDriver, pCurBlock->lba)], &pCurBlock->hashNode);
+            Object_Release(pCurBlock->driver);
+            pCurBlock->driver = NULL;
+            pCurBlock->flags.hasData = false;
+            pCurBlock->flags.isDirty = false;
+        }
+        pCurNode = pCurNode->next;
+    }
+    Lock_Unlock(&self->lock);
+
+    return err;
+}
@@ -0,0 +1,124 @@
+//
+//  DiskCache.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/14/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef DiskCache_h
+#define DiskCache_h
+
+#include <klib/klib.h>
+#include <dispatcher/Lock.h>
+#include <driver/DiskDriver.h>
+
+
+// A cached disk block. A block is identified by the disk driver and the logical
+// block address of the block on the disk. The block contents may only be
+// accessed while the block is acquired. An acquired block is locked and
+// exclusively owned by the client that acquired it.
+typedef struct _DiskBlock {
+    ListNode                hashNode;       // Hash chain
+    ListNode                lruNode;        // LRU chain. First block is the most recently used one
+    Lock                    lock;           // Held by the client that has acquired the block
+    DiskDriverRef _Nullable driver;         // Strong reference. NULL if the block isn't assigned to a disk block
+    LogicalBlockAddress     lba;
+    int                     useCount;       // Number of clients that have acquired the block or are waiting to acquire it. Protected by the cache lock
+    struct {
+        unsigned int    hasData: 1;         // true if 'data' holds the contents of the disk block
+        unsigned int    isDirty: 1;         // true if 'data' has to be written back to disk
+        unsigned int    isLoading: 1;       // true while an asynchronous read into 'data' is in progress. Protected by the cache lock
+        unsigned int    isMapped: 1;        // true if 'data' points to the disk block contents mapped by the driver
+        unsigned int    reserved: 28;
+    }                       flags;
+    uint8_t* _Nonnull       data;
+} DiskBlock;
+
+typedef DiskBlock* DiskBlockRef;
+
+
+// Returns a pointer to the contents of the block
+#define DiskBlock_GetData(__self) \
+    ((const void*)(__self)->data)
+
+#define DiskBlock_GetMutableData(__self) \
+    ((void*)(__self)->data)
+
+
+// Specifies how DiskCache_AcquireBlock() should prepare the contents of a block
+typedef enum AcquireBlock {
+    kAcquireBlock_ReadOnly,     // Block contents are read from disk if necessary. The caller will not modify the block
+    kAcquireBlock_Update,       // Block contents are read from disk if necessary. The caller may modify the block and write it back
+    kAcquireBlock_Replace,      // The caller will overwrite the whole block. The block contents are not read from disk
+    kAcquireBlock_Cleared,      // The block contents are zero filled. The block contents are not read from disk
+} AcquireBlock;
+
+// Specifies how DiskCache_RelinquishBlockWriting() should write a block back to disk
+typedef enum WriteBlock {
+    kWriteBlock_Sync,           // The block is written to disk before the relinquish returns
+    kWriteBlock_Deferred,       // The block is marked dirty and written back when it is evicted or the cache is synced
+} WriteBlock;
+
+
+struct _DiskCache;
+typedef struct _DiskCache* DiskCacheRef;
+
+
+extern DiskCacheRef _Nonnull  gDiskCache;
+
+
+// Creates a disk cache which caches up to 'maxBlockCount' blocks of size
+// 'blockSize'. Blocks are allocated on demand and the least recently used block
+// is reused once the cache has reached its maximum size.
+extern errno_t DiskCache_Create(size_t blockSize, size_t maxBlockCount, DiskCacheRef _Nullable * _Nonnull pOutSelf);
+
+// Acquires the block 'lba' of the disk 'pDriver'. Blocks the caller until the
+// block is available if another client has acquired the block. The block
+// contents are prepared as specified by 'mode'. The caller owns the block until
+// it relinquishes it. A block acquired with kAcquireBlock_ReadOnly refers to
+// the disk block contents in place if the driver supports mapping blocks.
+extern errno_t DiskCache_AcquireBlock(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, AcquireBlock mode, DiskBlockRef _Nullable * _Nonnull pOutBlock);
+
+// Relinquishes the block 'pBlock' without writing it. The caller must not have
+// modified the block contents.
+extern void DiskCache_RelinquishBlock(DiskCacheRef _Nonnull self, DiskBlockRef _Nullable pBlock);
+
+// Relinquishes the block 'pBlock' and writes its contents back to disk as
+// specified by 'mode'. The block is relinquished even if the write fails. A
+// block that failed to write stays dirty and the write will be retried later.
+extern errno_t DiskCache_RelinquishBlockWriting(DiskCacheRef _Nonnull self, DiskBlockRef _Nonnull pBlock, WriteBlock mode);
+
+// Read-ahead hook. Tells the cache that the block 'lba' of the disk 'pDriver'
+// is likely to be needed soon. The cache starts an asynchronous read of the
+// block if it isn't cached yet and a block can be assigned without waiting for
+// a busy block. Does not wait for the read to complete.
+extern void DiskCache_PrefetchBlock(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba);
+
+// Reads the 'blockCount' consecutive blocks starting at 'lba' of the disk
+// 'pDriver' into 'pBuffer'. Cached blocks are copied from the cache and runs of
+// uncached blocks are read from the disk with a single multi-block read that
+// bypasses the cache.
+extern errno_t DiskCache_ReadBlocks(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount blockCount, void* _Nonnull pBuffer);
+
+// Writes the 'blockCount' consecutive blocks starting at 'lba' of the disk
+// 'pDriver' from 'pBuffer'. Cached blocks are updated in the cache and runs of
+// uncached blocks are written to the disk with a single multi-block write that
+// bypasses the cache.
+extern errno_t DiskCache_WriteBlocks(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount blockCount, const void* _Nonnull pBuffer);
+
+// Writes all dirty blocks of the disk 'pDriver' back to disk. Waits for blocks
+// which are currently acquired by a client. The caller must not hold a block
+// of the disk.
+extern errno_t DiskCache_Sync(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver);
+
+// Writes the dirty blocks in the range [lba, lba + blockCount) of the disk
+// 'pDriver' back to disk. Blocks in the range which aren't cached are skipped.
+// Waits for blocks which are currently acquired by a client.
+extern errno_t DiskCache_SyncBlocks(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver, LogicalBlockAddress lba, LogicalBlockCount blockCount);
+
+// Writes all dirty blocks of the disk 'pDriver' back to disk and removes all
+// blocks of the disk from the cache. Call this when the disk is unmounted.
+extern errno_t DiskCache_Purge(DiskCacheRef _Nonnull self, DiskDriverRef _Nonnull pDriver);
+
+#endif /* DiskCache_h */
@@ -237,7 +237,13 @@ errno_t Filesystem_Create(ClassRef pClass, FilesystemRef _Nullable * _Nonnull pO
     try(_Object_Create(pClass, 0, (ObjectRef*)&self));
     self->fsid = Filesystem_GetNextAvailableId();
     Lock_Init(&self->inodeManagementLock);
-    PointerArray_Init(&self->inodesInUse, 16);
+    for (int i = 0; i < INODE_HASH_CHAIN_COUNT; i++) {
+        List_Init(&self->inodeHashChain[i]);
+    }
+    List_Init(&self->cachedInodes);
+    self->inUseInodeCount = 0;
+    self->cachedInodeCount = 0;
+    self->maxCachedInodeCount = kFilesystem_DefaultMaxCachedNodeCount;
 
     *pOutFileSys = self;
     return EOK;
@@ -249,15 +255,54 @@ catch:
 
 void Filesystem_deinit(FilesystemRef _Nonnull self)
 {
-    PointerArray_Deinit(&self->inodesInUse);
     Lock_Deinit(&self->inodeManagementLock);
 }
 
+#define Filesystem_HashKey(__id) \
+    ((size_t)(__id) & INODE_HASH_CHAIN_MASK)
+
+#define InodeFromLruNode(__pNode) \
+    ((InodeRef)(((uint8_t*)(__pNode)) - offsetof(Inode, lruNode)))
+
+// Returns the in-core inode with the id 'id' if it exists; NULL otherwise. The
+// inode may be in use or cached.
+static InodeRef _Nullable Filesystem_GetInodeWithId_Locked(FilesystemRef _Nonnull self, InodeId id)
+{
+    List_ForEach(&self->inodeHashChain[Filesystem_HashKey(id)], Inode, {
+        if (Inode_GetId(pCurNode) == id) {
+            return pCurNode;
+        }
+    });
+
+    return NULL;
+}
+
+// Removes the unreferenced inode 'pNode' from the inode table and destroys it.
+static void Filesystem_DestroyNode_Locked(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode)
+{
+    List_Remove(&self->inodeHashChain[Filesystem_HashKey(Inode_GetId(pNode))], &pNode->sibling);
+    Filesystem_OnDestroyNode(self, pNode);
+    Inode_Destroy(pNode);
+}
+
+// Destroys the least recently used cached inodes until at most 'maxCount'
+// inodes are left in the cache.
+static void Filesystem_TrimCachedNodes_Locked(FilesystemRef _Nonnull self, int maxCount)
+{
+    while (self->cachedInodeCount > maxCount) {
+        InodeRef pNode = InodeFromLruNode(self->cachedInodes.last);
+
+        List_Remove(&self->cachedInodes, &pNode->lruNode);
+        self->cachedInodeCount--;
+        Filesystem_DestroyNode_Locked(self, pNode);
+    }
+}
+
 // Allocates a new inode on disk and in-core. The allocation is protected
 // by the same lock that is used to protect the acquisition, relinquishing,
 // write-back and deletion of inodes. The returned inode id is not visible to
 // any other thread of execution until it is explicitly shared with other code.
-errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, UserId uid, GroupId gid, FilePermissions permissions, void* _Nullable pContext, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, UserId uid, GroupId gid, FilePermissions permissions, void* _Nullable pContext, InodeRef _Nullable * _Nonnull pOutNode)
 {
     decl_try_err();
     InodeId id = 0;
@@ -266,8 +311,9 @@ errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, User
     Lock_Lock(&self->inodeManagementLock);
 
     try(Filesystem_OnAllocateNodeOnDisk(self, type, pContext, &pNode));
-    try(PointerArray_Add(&self->inodesInUse, pNode));
+    List_InsertBeforeFirst(&self->inodeHashChain[Filesystem_HashKey(Inode_GetId(pNode))], &pNode->sibling);
     pNode->useCount++;
+    self->inUseInodeCount++;
     
     Inode_SetUserId(pNode, uid);
     Inode_SetGroupId(pNode, gid);
@@ -289,38 +335,38 @@ catch:
     return err;
 }
 
-// Acquires the inode with the ID 'id'. The node is returned in a locked state.
+// Acquires the inode with the ID 'id'. The node is not locked. Filesystem
+// operations lock it as needed (see the locking protocol in Filesystem.h).
 // This methods guarantees that there will always only be at most one inode instance
-// in memory at any given time and that only one VP can access/modify the inode.
+// in memory at any given time.
 // Once you're done with the inode, you should relinquish it back to the filesystem.
 // This method should be used by subclassers to acquire inodes in order to return
 // them to a filesystem user.
 // This method calls the filesystem method onReadNodeFromDisk() to read the
 // requested inode off the disk if there is no inode instance in memory at the
 // time this method is called.
-errno_t Filesystem_AcquireNodeWithId(FilesystemRef _Nonnull self, InodeId id, void* _Nullable pContext, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t Filesystem_AcquireNodeWithId(FilesystemRef _Nonnull self, InodeId id, void* _Nullable pContext, InodeRef _Nullable * _Nonnull pOutNode)
 {
     decl_try_err();
     InodeRef pNode = NULL;
 
     Lock_Lock(&self->inodeManagementLock);
 
-    for (int i = 0; i < PointerArray_GetCount(&self->inodesInUse); i++) {
-        InodeRef pCurNode = (InodeRef)PointerArray_GetAt(&self->inodesInUse, i);
-
-        if (Inode_GetId(pCurNode) == id) {
-            pNode = pCurNode;
-            break;
-        }
-    }
-
+    pNode = Filesystem_GetInodeWithId_Locked(self, id);
     if (pNode == NULL) {
         try(Filesystem_OnReadNodeFromDisk(self, id, pContext, &pNode));
-        try(PointerArray_Add(&self->inodesInUse, pNode));
+        List_InsertBeforeFirst(&self->inodeHashChain[Filesystem_HashKey(id)], &pNode->sibling);
+    }
+    else if (pNode->useCount == 0) {
+        // Revive a cached inode
+        List_Remove(&self->cachedInodes, &pNode->lruNode);
+        self->cachedInodeCount--;
     }
 
+    if (pNode->useCount == 0) {
+        self->inUseInodeCount++;
+    }
     pNode->useCount++;
-    //XXX Inode_Lock(pNode);
     Lock_Unlock(&self->inodeManagementLock);
     *pOutNode = pNode;
 
@@ -332,12 +378,11 @@ catch:
     return err;
 }
 
-// Acquires a new reference to the given node. The returned node is locked.
-InodeRef _Nonnull _Locked Filesystem_ReacquireNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode)
+// Acquires a new reference to the given node. The returned node is not locked.
+InodeRef _Nonnull Filesystem_ReacquireNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode)
 {
     Lock_Lock(&self->inodeManagementLock);
     pNode->useCount++;
-    //XXX Inode_Lock(pNode);
     Lock_Unlock(&self->inodeManagementLock);
 
     return pNode;
@@ -356,12 +401,15 @@ InodeRef _Nonnull Filesystem_ReacquireUnlockedNode(FilesystemRef _Nonnull self,
 // Relinquishes the given node back to the filesystem. This method will invoke
 // the filesystem onRemoveNodeFromDisk() if no directory is referencing the inode
 // anymore. This will remove the inode from disk.
-void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nullable _Locked pNode)
+void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nullable pNode)
 {
     if (pNode == NULL) {
         return;
     }
     
+    // The inode lock keeps the write-back from racing with a concurrent
+    // operation on the inode
+    Inode_Lock(pNode);
     Lock_Lock(&self->inodeManagementLock);
 
     // XXX take FS readonly status into account here
@@ -377,25 +425,59 @@ void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nullable _
     assert(pNode->useCount > 0);
     pNode->useCount--;
     if (pNode->useCount == 0) {
-        PointerArray_Remove(&self->inodesInUse, pNode);
-        Inode_Destroy(pNode);
+        self->inUseInodeCount--;
+
+        if (pNode->linkCount > 0 && self->maxCachedInodeCount > 0) {
+            // The inode is clean at this point. Keep it around in case that
+            // someone wants to acquire it again soon
+            List_InsertBeforeFirst(&self->cachedInodes, &pNode->lruNode);
+            self->cachedInodeCount++;
+            Filesystem_TrimCachedNodes_Locked(self, self->maxCachedInodeCount);
+        }
+        else {
+            // Nobody else can reach the inode anymore at this point
+            Inode_Unlock(pNode);
+            Filesystem_DestroyNode_Locked(self, pNode);
+            pNode = NULL;
+        }
     }
-    //XXX Inode_Unlock(pNode);
-
 
+    if (pNode) {
+        Inode_Unlock(pNode);
+    }
     Lock_Unlock(&self->inodeManagementLock);
 }
 
 // Returns true if the filesystem can be safely unmounted which means that no
-// inodes owned by the filesystem is currently in memory.
+// inodes owned by the filesystem is currently in use.
 bool Filesystem_CanSafelyUnmount(FilesystemRef _Nonnull self)
 {
     Lock_Lock(&self->inodeManagementLock);
-    const bool ok = PointerArray_IsEmpty(&self->inodesInUse);
+    const bool ok = (self->inUseInodeCount == 0) ? true : false;
     Lock_Unlock(&self->inodeManagementLock);
     return ok;
 }
 
+// Sets the maximum number of unreferenced inodes that the filesystem keeps in
+// memory. Cached inodes in excess of the new budget are destroyed. A budget of
+// 0 disables the inode cache.
+void Filesystem_SetMaxCachedNodeCount(FilesystemRef _Nonnull self, int count)
+{
+    Lock_Lock(&self->inodeManagementLock);
+    self->maxCachedInodeCount = __max(count, 0);
+    Filesystem_TrimCachedNodes_Locked(self, self->maxCachedInodeCount);
+    Lock_Unlock(&self->inodeManagementLock);
+}
+
+// Destroys all cached inodes. Inodes which are in use are not affected. Must be
+// called before the filesystem is unmounted.
+void Filesystem_PurgeCachedNodes(FilesystemRef _Nonnull self)
+{
+    Lock_Lock(&self->inodeManagementLock);
+    Filesystem_TrimCachedNodes_Locked(self, 0);
+    Lock_Unlock(&self->inodeManagementLock);
+}
+
 // Invoked when Filesystem_AllocateNode() is called. Subclassers should
 // override this method to allocate and initialize an inode of the given type.
 errno_t Filesystem_onAllocateNodeOnDisk(FilesystemRef _Nonnull self, FileType type, void* _Nullable pContext, InodeRef _Nullable * _Nonnull pOutNode)
@@ -429,6 +511,14 @@ void Filesystem_onRemoveNodeFromDisk(FilesystemRef _Nonnull self, InodeRef _Nonn
 {
 }
 
+// Invoked when Filesystem_RelinquishNode() is about to destroy the in-core
+// representation of an inode because it is no longer in use. The override
+// should free the filesystem specific state that it has associated with the
+// inode.
+void Filesystem_onDestroyNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode)
+{
+}
+
 
 // Invoked when an instance of this file system is mounted. Note that the
 // kernel guarantees that no operations will be issued to the filesystem
@@ -451,7 +541,7 @@ errno_t Filesystem_onUnmount(FilesystemRef _Nonnull self)
 
 // Returns the root node of the filesystem if the filesystem is currently in
 // mounted state. Returns ENOENT and NULL if the filesystem is not mounted.
-errno_t Filesystem_acquireRootNode(FilesystemRef _Nonnull self, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t Filesystem_acquireRootNode(FilesystemRef _Nonnull self, InodeRef _Nullable * _Nonnull pOutNode)
 {
     *pOutNode = NULL;
     return ENOENT;
@@ -464,7 +554,7 @@ errno_t Filesystem_acquireRootNode(FilesystemRef _Nonnull self, InodeRef _Nullab
 // the root node of the filesystem and 'pComponent' is ".." then 'pParentNode'
 // should be returned. If the path component name is longer than what is
 // supported by the file system, ENAMETOOLONG should be returned.
-errno_t Filesystem_acquireNodeForName(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pComponent, User user, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t Filesystem_acquireNodeForName(FilesystemRef _Nonnull self, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pComponent, User user, InodeRef _Nullable * _Nonnull pOutNode)
 {
     *pOutNode = NULL;
     return ENOENT;
@@ -478,7 +568,7 @@ errno_t Filesystem_acquireNodeForName(FilesystemRef _Nonnull self, InodeRef _Non
 // contains 'id' and ENOENT otherwise. If the name of 'id' as stored in the
 // file system is > the capacity of the path component, then ERANGE should
 // be returned.
-errno_t Filesystem_getNameOfNode(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pParentNode, InodeId id, User user, MutablePathComponent* _Nonnull pComponent)
+errno_t Filesystem_getNameOfNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pParentNode, InodeId id, User user, MutablePathComponent* _Nonnull pComponent)
 {
     pComponent->count = 0;
     return ENOENT;
@@ -486,14 +576,14 @@ errno_t Filesystem_getNameOfNode(FilesystemRef _Nonnull self, InodeRef _Nonnull
 
 // Returns a file info record for the given Inode. The Inode may be of any
 // file type.
-errno_t Filesystem_getFileInfo(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileInfo* _Nonnull pOutInfo)
+errno_t Filesystem_getFileInfo(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode, FileInfo* _Nonnull pOutInfo)
 {
     return EIO;
 }
 
 // Modifies one or more attributes stored in the file info record of the given
 // Inode. The Inode may be of any type.
-errno_t Filesystem_setFileInfo(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, MutableFileInfo* _Nonnull pInfo)
+errno_t Filesystem_setFileInfo(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode, User user, MutableFileInfo* _Nonnull pInfo)
 {
     return EIO;
 }
@@ -504,7 +594,7 @@ errno_t Filesystem_setFileInfo(FilesystemRef _Nonnull self, InodeRef _Nonnull _L
 // the mode is exclusive then the file is created if it doesn't exist and
 // an error is thrown if the file exists. Note that the file is not opened.
 // This must be done by calling the open() method.
-errno_t Filesystem_createFile(FilesystemRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, User user, unsigned int options, FilePermissions permissions, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t Filesystem_createFile(FilesystemRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, User user, unsigned int options, FilePermissions permissions, InodeRef _Nullable * _Nonnull pOutNode)
 {
     return EIO;
 }
@@ -512,7 +602,7 @@ errno_t Filesystem_createFile(FilesystemRef _Nonnull self, const PathComponent*
 // Creates an empty directory as a child of the given directory node and with
 // the given name, user and file permissions. Returns EEXIST if a node with
 // the given name already exists.
-errno_t Filesystem_createDirectory(FilesystemRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, User user, FilePermissions permissions)
+errno_t Filesystem_createDirectory(FilesystemRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, User user, FilePermissions permissions)
 {
     return EACCESS;
 }
@@ -520,7 +610,7 @@ errno_t Filesystem_createDirectory(FilesystemRef _Nonnull self, const PathCompon
 // Opens the directory represented by the given node. Returns a directory
 // descriptor object which is teh I/O channel that allows you to read the
 // directory content.
-errno_t Filesystem_openDirectory(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode, User user, DirectoryRef _Nullable * _Nonnull pOutDir)
+errno_t Filesystem_openDirectory(FilesystemRef _Nonnull self, InodeRef _Nonnull pDirNode, User user, DirectoryRef _Nullable * _Nonnull pOutDir)
 {
     return EACCESS;
 }
@@ -544,7 +634,7 @@ errno_t Filesystem_closeDirectory(FilesystemRef _Nonnull self, DirectoryRef _Non
 }
 
 // Verifies that the given node is accessible assuming the given access mode.
-errno_t Filesystem_checkAccess(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, AccessMode mode)
+errno_t Filesystem_checkAccess(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode, User user, AccessMode mode)
 {
     return EACCESS;
 }
@@ -556,7 +646,7 @@ errno_t Filesystem_checkAccess(FilesystemRef _Nonnull self, InodeRef _Nonnull _L
 // old length. Note that a filesystem implementation is free to defer the
 // actual allocation of the new blocks until an attempt is made to read or
 // write them.
-errno_t Filesystem_truncate(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, FileOffset length)
+errno_t Filesystem_truncate(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode, User user, FileOffset length)
 {
     return EIO;
 }
@@ -567,7 +657,7 @@ errno_t Filesystem_truncate(FilesystemRef _Nonnull self, InodeRef _Nonnull _Lock
 // node of the filesystem.
 // This function must validate that that if 'pNode' is a directory, that the
 // directory is empty (contains nothing except "." and "..").
-errno_t Filesystem_unlink(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked pNode, InodeRef _Nonnull _Locked pParentNode, User user)
+errno_t Filesystem_unlink(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode, InodeRef _Nonnull pParentNode, User user)
 {
     return EACCESS;
 }
@@ -575,7 +665,7 @@ errno_t Filesystem_unlink(FilesystemRef _Nonnull self, InodeRef _Nonnull _Locked
 // Renames the node with name 'pName' and which is an immediate child of the
 // node 'pParentNode' such that it becomes a child of 'pNewParentNode' with
 // the name 'pNewName'. All nodes are guaranteed to be owned by the filesystem.
-errno_t Filesystem_rename(FilesystemRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull _Locked pNewParentNode, User user)
+errno_t Filesystem_rename(FilesystemRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull pNewParentNode, User user)
 {
     return EACCESS;
 }
@@ -587,6 +677,7 @@ METHOD_IMPL(onAllocateNodeOnDisk, Filesystem)
 METHOD_IMPL(onReadNodeFromDisk, Filesystem)
 METHOD_IMPL(onWriteNodeToDisk, Filesystem)
 METHOD_IMPL(onRemoveNodeFromDisk, Filesystem)
+METHOD_IMPL(onDestroyNode, Filesystem)
 METHOD_IMPL(onMount, Filesystem)
 METHOD_IMPL(onUnmount, Filesystem)
 METHOD_IMPL(acquireRootNode, Filesystem)
@@ -129,13 +129,39 @@ extern errno_t Directory_CreateCopy(DirectoryRef _Nonnull pInDir, DirectoryRef _
 // 
 // Locking protocol
 //
-// Every inode has a lock associated with it. The filesystem (XXX currently)
-// must lock the inode before it accesses or modifies any of its properties. 
+// Every inode has a lock associated with it. The filesystem must lock the inode
+// before it accesses or modifies any of its properties. Acquiring an inode does
+// not lock it. Instead every filesystem operation locks the inodes that it works
+// on for the duration of the operation. An operation that locks a directory and
+// one of its children must lock the directory first. Inode locks are always
+// taken before the inode management lock. Filesystem_RelinquishNode() locks the
+// inode before it takes the inode management lock and it writes the inode back
+// with both locks held. Thus an operation must not relinquish an inode that it
+// has locked.
 //
+// Inode cache
+//
+// All in-core inodes are kept in a hash table which is keyed by the inode id.
+// An inode is not destroyed immediately when its use count drops to zero.
+// Instead it is written back if it is modified and it is then moved to a LRU
+// list of unreferenced inodes. Acquiring an inode which is on this list does
+// not require a call to onReadNodeFromDisk(). The least recently used inode is
+// destroyed once the number of unreferenced inodes exceeds the inode cache
+// budget. Inodes which are no longer referenced by any directory are never
+// cached.
+//
+#define INODE_HASH_CHAIN_COUNT              32
+#define INODE_HASH_CHAIN_MASK               (INODE_HASH_CHAIN_COUNT - 1)
+#define kFilesystem_DefaultMaxCachedNodeCount   64
+
 OPEN_CLASS(Filesystem, IOResource,
     FilesystemId        fsid;
     Lock                inodeManagementLock;
-    PointerArray        inodesInUse;
+    List                inodeHashChain[INODE_HASH_CHAIN_COUNT]; // All in-core inodes; in use or cached
+    List                cachedInodes;                           // Unreferenced inodes. First inode is the most recently used one
+    int                 inUseInodeCount;                        // Number of inodes with a use count > 0
+    int                 cachedInodeCount;                       // Number of inodes on the 'cachedInodes' list
+    int                 maxCachedInodeCount;                    // Inode cache budget
 );
 typedef struct _FilesystemMethodTable {
     IOResourceMethodTable   super;
@@ -163,7 +189,7 @@ typedef struct _FilesystemMethodTable {
 
     // Returns the root node of the filesystem if the filesystem is currently in
     // mounted state. Returns ENOENT and NULL if the filesystem is not mounted.
-    errno_t (*acquireRootNode)(void* _Nonnull self, InodeRef _Nullable _Locked * _Nonnull pOutNode);
+    errno_t (*acquireRootNode)(void* _Nonnull self, InodeRef _Nullable * _Nonnull pOutNode);
 
     // Returns EOK and the node that corresponds to the tuple (parent-node, name),
     // if that node exists. Otherwise returns ENOENT and NULL.  Note that this
@@ -172,7 +198,7 @@ typedef struct _FilesystemMethodTable {
     // the root node of the filesystem and 'pComponent' is ".." then 'pParentNode'
     // should be returned. If the path component name is longer than what is
     // supported by the file system, ENAMETOOLONG should be returned.
-    errno_t (*acquireNodeForName)(void* _Nonnull self, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pComponent, User user, InodeRef _Nullable _Locked * _Nonnull pOutNode);
+    errno_t (*acquireNodeForName)(void* _Nonnull self, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pComponent, User user, InodeRef _Nullable * _Nonnull pOutNode);
 
     // Returns the name of the node with the id 'id' which a child of the
     // directory node 'pParentNode'. 'id' may be of any type. The name is
@@ -182,7 +208,7 @@ typedef struct _FilesystemMethodTable {
     // contains 'id' and ENOENT otherwise. If the name of 'id' as stored in the
     // file system is > the capacity of the path component, then ERANGE should
     // be returned.
-    errno_t (*getNameOfNode)(void* _Nonnull self, InodeRef _Nonnull _Locked pParentNode, InodeId id, User user, MutablePathComponent* _Nonnull pComponent);
+    errno_t (*getNameOfNode)(void* _Nonnull self, InodeRef _Nonnull pParentNode, InodeId id, User user, MutablePathComponent* _Nonnull pComponent);
 
 
     //
@@ -191,11 +217,11 @@ typedef struct _FilesystemMethodTable {
 
     // Returns a file info record for the given Inode. The Inode may be of any
     // file type.
-    errno_t (*getFileInfo)(void* _Nonnull self, InodeRef _Nonnull _Locked pNode, FileInfo* _Nonnull pOutInfo);
+    errno_t (*getFileInfo)(void* _Nonnull self, InodeRef _Nonnull pNode, FileInfo* _Nonnull pOutInfo);
 
     // Modifies one or more attributes stored in the file info record of the given
     // Inode. The Inode may be of any type.
-    errno_t (*setFileInfo)(void* _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, MutableFileInfo* _Nonnull pInfo);
+    errno_t (*setFileInfo)(void* _Nonnull self, InodeRef _Nonnull pNode, User user, MutableFileInfo* _Nonnull pInfo);
 
 
     //
@@ -208,7 +234,7 @@ typedef struct _FilesystemMethodTable {
     // the mode is exclusive then the file is created if it doesn't exist and
     // an error is thrown if the file exists. Note that the file is not opened.
     // This must be done by calling the open() method.
-    errno_t (*createFile)(void* _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, User user, unsigned int options, FilePermissions permissions, InodeRef _Nullable _Locked * _Nonnull pOutNode);
+    errno_t (*createFile)(void* _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, User user, unsigned int options, FilePermissions permissions, InodeRef _Nullable * _Nonnull pOutNode);
 
 
     //
@@ -218,12 +244,12 @@ typedef struct _FilesystemMethodTable {
     // Creates an empty directory as a child of the given directory node and with
     // the given name, user and file permissions. Returns EEXIST if a node with
     // the given name already exists.
-    errno_t (*createDirectory)(void* _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, User user, FilePermissions permissions);
+    errno_t (*createDirectory)(void* _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, User user, FilePermissions permissions);
 
     // Opens the directory represented by the given node. Returns a directory
     // descriptor object which is teh I/O channel that allows you to read the
     // directory content.
-    errno_t (*openDirectory)(void* _Nonnull self, InodeRef _Nonnull _Locked pDirNode, User user, DirectoryRef _Nullable * _Nonnull pOutDir);
+    errno_t (*openDirectory)(void* _Nonnull self, InodeRef _Nonnull pDirNode, User user, DirectoryRef _Nullable * _Nonnull pOutDir);
 
     // Reads the next set of directory entries. The first entry read is the one
     // at the current directory index stored in 'pDir'. This function guarantees
@@ -242,7 +268,7 @@ typedef struct _FilesystemMethodTable {
     //
 
     // Verifies that the given node is accessible assuming the given access mode.
-    errno_t (*checkAccess)(void* _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, AccessMode mode);
+    errno_t (*checkAccess)(void* _Nonnull self, InodeRef _Nonnull pNode, User user, AccessMode mode);
 
     // Change the size of the file 'pNode' to 'length'. EINVAL is returned if
     // the new length is negative. No longer needed blocks are deallocated if
@@ -251,7 +277,7 @@ typedef struct _FilesystemMethodTable {
     // old length. Note that a filesystem implementation is free to defer the
     // actual allocation of the new blocks until an attempt is made to read or
     // write them.
-    errno_t (*truncate)(void* _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, FileOffset length);
+    errno_t (*truncate)(void* _Nonnull self, InodeRef _Nonnull pNode, User user, FileOffset length);
 
     // Unlink the node 'pNode' which is an immediate child of 'pParentNode'.
     // Both nodes are guaranteed to be members of the same filesystem. 'pNode'
@@ -259,12 +285,12 @@ typedef struct _FilesystemMethodTable {
     // node of the filesystem.
     // This function must validate that that if 'pNode' is a directory, that the
     // directory is empty (contains nothing except "." and "..").
-    errno_t (*unlink)(void* _Nonnull self, InodeRef _Nonnull _Locked pNode, InodeRef _Nonnull _Locked pParentNode, User user);
+    errno_t (*unlink)(void* _Nonnull self, InodeRef _Nonnull pNode, InodeRef _Nonnull pParentNode, User user);
 
     // Renames the node with name 'pName' and which is an immediate child of the
     // node 'pParentNode' such that it becomes a child of 'pNewParentNode' with
     // the name 'pNewName'. All nodes are guaranteed to be owned by the filesystem.
-    errno_t (*rename)(void* _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull _Locked pNewParentNode, User user);
+    errno_t (*rename)(void* _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull pNewParentNode, User user);
 
 
     //
@@ -300,6 +326,12 @@ typedef struct _FilesystemMethodTable {
     // operation is assumed to never fail.
     void (*onRemoveNodeFromDisk)(void* _Nonnull self, InodeRef _Nonnull pNode);
 
+    // Invoked when Filesystem_RelinquishNode() is about to destroy the in-core
+    // representation of an inode because it is no longer in use. The override
+    // should free the filesystem specific state that it has associated with the
+    // inode.
+    void (*onDestroyNode)(void* _Nonnull self, InodeRef _Nonnull pNode);
+
 } FilesystemMethodTable;
 
 
@@ -370,8 +402,8 @@ Object_InvokeN(unlink, Filesystem, __self, __pNode, __pParentNode, __user)
 #define Filesystem_Rename(__self, __pName, __pParentNode, __pNewName, __pNewParentNode, __user) \
 Object_InvokeN(rename, Filesystem, __self, __pName, __pParentNode, __pNewName, __pNewParentNode, __user)
 
-// Acquires a new reference to the given node. The returned node is locked.
-extern InodeRef _Nonnull _Locked Filesystem_ReacquireNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode);
+// Acquires a new reference to the given node. The returned node is not locked.
+extern InodeRef _Nonnull Filesystem_ReacquireNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode);
 
 // Acquires a new reference to the given node. The returned node is NOT locked.
 extern InodeRef _Nonnull Filesystem_ReacquireUnlockedNode(FilesystemRef _Nonnull self, InodeRef _Nonnull pNode);
@@ -379,7 +411,7 @@ extern InodeRef _Nonnull Filesystem_ReacquireUnlockedNode(FilesystemRef _Nonnull
 // Relinquishes the given node back to the filesystem. This method will invoke
 // the filesystem onRemoveNodeFromDisk() if no directory is referencing the inode
 // anymore. This will remove the inode from disk.
-extern void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nullable _Locked pNode);
+extern void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nullable pNode);
 
 
 //
@@ -390,11 +422,12 @@ extern void Filesystem_RelinquishNode(FilesystemRef _Nonnull self, InodeRef _Nul
 // by the same lock that is used to protect the acquisition, relinquishing,
 // write-back and deletion of inodes. The returned inode id is not visible to
 // any other thread of execution until it is explicitly shared with other code.
-extern errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, UserId uid, GroupId gid, FilePermissions permissions, void* _Nullable pContext, InodeRef _Nullable _Locked * _Nonnull pOutNode);
+extern errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType type, UserId uid, GroupId gid, FilePermissions permissions, void* _Nullable pContext, InodeRef _Nullable * _Nonnull pOutNode);
 
-// Acquires the inode with the ID 'id'. The node is returned in a locked state.
+// Acquires the inode with the ID 'id'. The node is not locked. Filesystem
+// operations lock it as needed (see the locking protocol above).
 // This methods guarantees that there will always only be at most one inode instance
-// in memory at any given time and that only one VP can access/modify the inode.
+// in memory at any given time.
 // Once you're done with the inode, you should relinquish it back to the filesystem.
 // This method should be used by subclassers to acquire inodes in order to return
 // them to a filesystem user.
@@ -405,12 +438,21 @@ extern errno_t Filesystem_AllocateNode(FilesystemRef _Nonnull self, FileType typ
 // \param id the id of the inode to acquire
 // \param pContext an optional context tp help the acquire method to find the inode
 // \param pOutNode receives the acquired inode
-extern errno_t Filesystem_AcquireNodeWithId(FilesystemRef _Nonnull self, InodeId id, void* _Nullable pContext, InodeRef _Nullable _Locked * _Nonnull pOutNode);
+extern errno_t Filesystem_AcquireNodeWithId(FilesystemRef _Nonnull self, InodeId id, void* _Nullable pContext, InodeRef _Nullable * _Nonnull pOutNode);
 
 // Returns true if the filesystem can be safely unmounted which means that no
-// inodes owned by the filesystem is currently in memory.
+// inodes owned by the filesystem is currently in use.
 extern bool Filesystem_CanSafelyUnmount(FilesystemRef _Nonnull self);
 
+// Sets the maximum number of unreferenced inodes that the filesystem keeps in
+// memory. Cached inodes in excess of the new budget are destroyed. A budget of
+// 0 disables the inode cache.
+extern void Filesystem_SetMaxCachedNodeCount(FilesystemRef _Nonnull self, int count);
+
+// Destroys all cached inodes. Inodes which are in use are not affected. Must be
+// called before the filesystem is unmounted.
+extern void Filesystem_PurgeCachedNodes(FilesystemRef _Nonnull self);
+
 #define Filesystem_OnAllocateNodeOnDisk(__self, __type, __pContext, __pOutNode) \
 Object_InvokeN(onAllocateNodeOnDisk, Filesystem, __self, __type, __pContext, __pOutNode)
 
@@ -423,4 +465,7 @@ Object_InvokeN(onWriteNodeToDisk, Filesystem, __self, __pNode)
 #define Filesystem_OnRemoveNodeFromDisk(__self, __pNode) \
 Object_InvokeN(onRemoveNodeFromDisk, Filesystem, __self, __pNode)
 
+#define Filesystem_OnDestroyNode(__self, __pNode) \
+Object_InvokeN(onDestroyNode, Filesystem, __self, __pNode)
+
 #endif /* Filesystem_h */
@@ -7,6 +7,7 @@
 //
 
 #include "FilesystemManager.h"
+#include "NameCache.h"
 #include <dispatcher/Lock.h>
 
 
@@ -154,6 +155,7 @@ static errno_t FilesystemManager_Mount_Locked(FilesystemManagerRef _Nonnull self
 
     // Notify the filesystem that we are mounting it
     try(Filesystem_OnMount(pFileSysToMount, pDriver, pParams, paramsSize));
+    NameCache_RemoveFilesystem(gNameCache, Filesystem_GetId(pFileSysToMount));
 
 
     // Update our mount table
@@ -199,6 +201,8 @@ static errno_t FilesystemManager_Unmount_Locked(FilesystemManagerRef _Nonnull se
 
 
     // The error returned from OnUnmount is purely advisory but will not stop the unmount from completing
+    NameCache_RemoveFilesystem(gNameCache, unmountingFsid);
+    Filesystem_PurgeCachedNodes(pMount->mountedFilesystem);
     err = Filesystem_OnUnmount(pMount->mountedFilesystem);
 
     Inode_SetMountpoint(pDirNode, false);
@@ -10,17 +10,35 @@
 #include "FilesystemManager.h"
 #include <driver/MonotonicClock.h>
 
+
+static KmemCacheRef _Nonnull    gInodeCache;
+
+
+static void Inode_Construct(void* _Nonnull pObject)
+{
+    Lock_Init(&((InodeRef)pObject)->lock);
+}
+
+// Creates the object cache from which inodes are allocated. Must be called
+// before the first filesystem is mounted.
+errno_t Inode_InitCache(void)
+{
+    return kmem_cache_create("Inode", sizeof(Inode), Inode_Construct, &gInodeCache);
+}
+
 errno_t Inode_Create(FilesystemId fsid, InodeId id, FileType type, int linkCount, UserId uid, GroupId gid, FilePermissions permissions, FileOffset size, TimeInterval accessTime, TimeInterval modTime, TimeInterval statusChangeTime, void* refcon, InodeRef _Nullable * _Nonnull pOutNode)
 {
     decl_try_err();
     InodeRef self;
 
-    try(kalloc_cleared(sizeof(Inode), (void**) &self));
+    // The lock is initialized once by the cache constructor
+    try(kmem_cache_alloc(gInodeCache, (void**) &self));
+    ListNode_Init(&self->sibling);
+    ListNode_Init(&self->lruNode);
     self->accessTime = accessTime;
     self->modificationTime = modTime;
     self->statusChangeTime = statusChangeTime;
     self->size = size;
-    Lock_Init(&self->lock);
     self->fsid = fsid;
     self->inid = id;
     self->useCount = 0;
@@ -44,8 +62,7 @@ void Inode_Destroy(InodeRef _Nullable self)
 {
     if (self) {
         self->refcon = NULL;
-        Lock_Deinit(&self->lock);
-        kfree(self);
+        kmem_cache_free(gInodeCache, self);
     }
 }
 
@@ -31,6 +31,8 @@ enum {
 // See the description of the Filesystem class to learn about how locking for
 // Inodes works.
 typedef struct _Inode {
+    ListNode            sibling;    // Inode hash chain (protected by the FS inode management lock)
+    ListNode            lruNode;    // Cached inodes LRU chain. Only used while useCount == 0 (protected by the FS inode management lock)
     TimeInterval        accessTime;
     TimeInterval        modificationTime;
     TimeInterval        statusChangeTime;
@@ -54,6 +56,10 @@ typedef struct _Inode* InodeRef;
 // Only filesystem implementations should call the following functions.
 //
 
+// Creates the inode cache. Must be called once at boot time before the first
+// filesystem is mounted.
+extern errno_t Inode_InitCache(void);
+
 // Creates an instance of the abstract Inode class. Should only ever be called
 // by the implement of a creation function for a concrete Inode subclass.
 extern errno_t Inode_Create(FilesystemId fsid, InodeId id,
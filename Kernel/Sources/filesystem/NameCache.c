@@ -0,0 +1,253 @@
+//
+//  NameCache.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/21/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "NameCache.h"
+#include <dispatcher/Lock.h>
+
+
+#define NAME_CACHE_HASH_CHAIN_COUNT         64
+#define NAME_CACHE_HASH_CHAIN_MASK          (NAME_CACHE_HASH_CHAIN_COUNT - 1)
+
+#define NameCacheEntryFromLruNode(__pNode) \
+    ((NameCacheEntry*)(((uint8_t*)(__pNode)) - offsetof(NameCacheEntry, lruNode)))
+
+
+typedef struct NameCacheEntry {
+    ListNode        hashNode;       // Hash chain
+    ListNode        lruNode;        // LRU chain. First entry is the most recently used one
+    FilesystemId    fsid;
+    InodeId         parentId;
+    InodeId         childId;        // 0 -> negative entry
+    uint32_t        hash;
+    int8_t          nameLength;
+    char            name[kNameCacheMaxNameLength];
+} NameCacheEntry;
+
+typedef struct _NameCache {
+    Lock                lock;
+    uint32_t            generation;         // Incremented every time an entry is removed
+    size_t              entryCount;         // Number of entries allocated so far
+    size_t              maxEntryCount;
+    List                lruChain;           // All entries. First entry is the most recently used one
+    List                hashChain[NAME_CACHE_HASH_CHAIN_COUNT];
+} NameCache;
+
+
+NameCacheRef _Nonnull  gNameCache;
+
+
+// Returns the hash of the tuple (fsid, parentId, pName).
+static uint32_t NameCache_Hash(FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)fsid ^ ((uint32_t)parentId * 31u);
+
+    for (ssize_t i = 0; i < pName->count; i++) {
+        hash ^= (uint8_t)pName->name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Returns true if the name 'pName' can be stored in the cache.
+static bool NameCache_IsCacheableName(const PathComponent* _Nonnull pName)
+{
+    if (pName->count == 0 || pName->count > kNameCacheMaxNameLength) {
+        return false;
+    }
+    if (pName->name[0] == '.' && (pName->count == 1 || (pName->count == 2 && pName->name[1] == '.'))) {
+        return false;
+    }
+    return true;
+}
+
+// Creates a name cache which caches up to 'maxEntryCount' names.
+errno_t NameCache_Create(size_t maxEntryCount, NameCacheRef _Nullable * _Nonnull pOutSelf)
+{
+    decl_try_err();
+    NameCacheRef self;
+
+    assert(maxEntryCount > 0);
+
+    try(kalloc(sizeof(NameCache), (void**) &self));
+    Lock_Init(&self->lock);
+    self->generation = 0;
+    self->entryCount = 0;
+    self->maxEntryCount = maxEntryCount;
+    List_Init(&self->lruChain);
+    for (int i = 0; i < NAME_CACHE_HASH_CHAIN_COUNT; i++) {
+        List_Init(&self->hashChain[i]);
+    }
+
+    *pOutSelf = self;
+    return EOK;
+
+catch:
+    *pOutSelf = NULL;
+    return err;
+}
+
+// Returns the current generation of the cache. The generation changes every
+// time that an entry is removed.
+uint32_t NameCache_GetGeneration(NameCacheRef _Nonnull self)
+{
+    Lock_Lock(&self->lock);
+    const uint32_t generation = self->generation;
+    Lock_Unlock(&self->lock);
+
+    return generation;
+}
+
+// Returns the entry for (fsid, parentId, pName) if it exists and NULL otherwise.
+static NameCacheEntry* _Nullable NameCache_FindEntry_Locked(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, uint32_t hash)
+{
+    List_ForEach(&self->hashChain[hash & NAME_CACHE_HASH_CHAIN_MASK], NameCacheEntry, {
+        if (pCurNode->hash == hash && pCurNode->fsid == fsid && pCurNode->parentId == parentId
+            && pCurNode->nameLength == pName->count && String_EqualsUpTo(pCurNode->name, pName->name, pName->count)) {
+            return pCurNode;
+        }
+    });
+
+    return NULL;
+}
+
+// Unlinks the entry from the hash chain and moves it to the end of the LRU
+// chain so that it will be reused first.
+static void NameCache_RemoveEntry_Locked(NameCacheRef _Nonnull self, NameCacheEntry* _Nonnull pEntry)
+{
+    List_Remove(&self->hashChain[pEntry->hash & NAME_CACHE_HASH_CHAIN_MASK], &pEntry->hashNode);
+    List_Remove(&self->lruChain, &pEntry->lruNode);
+    List_InsertAfterLast(&self->lruChain, &pEntry->lruNode);
+    pEntry->nameLength = -1;
+    self->generation++;
+}
+
+// Looks up the child 'pName' of the directory (fsid, parentId). Returns true
+// and the inode id of the child if an entry exists. The returned id is 0 if the
+// entry is a negative entry. Returns false if no entry exists.
+bool NameCache_Lookup(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId* _Nonnull pOutId)
+{
+    NameCacheEntry* pEntry = NULL;
+
+    if (NameCache_IsCacheableName(pName)) {
+        const uint32_t hash = NameCache_Hash(fsid, parentId, pName);
+
+        Lock_Lock(&self->lock);
+        pEntry = NameCache_FindEntry_Locked(self, fsid, parentId, pName, hash);
+        if (pEntry) {
+            List_Remove(&self->lruChain, &pEntry->lruNode);
+            List_InsertBeforeFirst(&self->lruChain, &pEntry->lruNode);
+            *pOutId = pEntry->childId;
+        }
+        Lock_Unlock(&self->lock);
+    }
+
+    return (pEntry != NULL) ? true : false;
+}
+
+// Adds the entry (fsid, parentId, pName) -> childId to the cache. 'childId' is
+// 0 for a negative entry. The entry is not added if the cache generation is no
+// longer equal to 'generation'.
+void NameCache_Enter(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId childId, uint32_t generation)
+{
+    NameCacheEntry* pEntry;
+
+    if (!NameCache_IsCacheableName(pName)) {
+        return;
+    }
+
+    const uint32_t hash = NameCache_Hash(fsid, parentId, pName);
+
+    Lock_Lock(&self->lock);
+    if (self->generation != generation) {
+        Lock_Unlock(&self->lock);
+        return;
+    }
+
+    pEntry = NameCache_FindEntry_Locked(self, fsid, parentId, pName, hash);
+    if (pEntry == NULL) {
+        if (self->entryCount < self->maxEntryCount) {
+            if (kalloc(sizeof(NameCacheEntry), (void**) &pEntry) != EOK) {
+                Lock_Unlock(&self->lock);
+                return;
+            }
+            ListNode_Init(&pEntry->hashNode);
+            ListNode_Init(&pEntry->lruNode);
+            List_InsertBeforeFirst(&self->lruChain, &pEntry->lruNode);
+            self->entryCount++;
+        }
+        else {
+            // Reuse the least recently used entry
+            pEntry = NameCacheEntryFromLruNode(self->lruChain.last);
+            if (pEntry->nameLength >= 0) {
+                List_Remove(&self->hashChain[pEntry->hash & NAME_CACHE_HASH_CHAIN_MASK], &pEntry->hashNode);
+            }
+        }
+
+        pEntry->fsid = fsid;
+        pEntry->parentId = parentId;
+        pEntry->hash = hash;
+        pEntry->nameLength = (int8_t)pName->count;
+        memcpy(pEntry->name, pName->name, pName->count);
+        List_InsertBeforeFirst(&self->hashChain[hash & NAME_CACHE_HASH_CHAIN_MASK], &pEntry->hashNode);
+    }
+
+    pEntry->childId = childId;
+    List_Remove(&self->lruChain, &pEntry->lruNode);
+    List_InsertBeforeFirst(&self->lruChain, &pEntry->lruNode);
+    Lock_Unlock(&self->lock);
+}
+
+// Removes the entry for the child 'pName' of the directory (fsid, parentId).
+void NameCache_RemoveName(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName)
+{
+    const uint32_t hash = NameCache_Hash(fsid, parentId, pName);
+
+    Lock_Lock(&self->lock);
+    NameCacheEntry* pEntry = NameCache_FindEntry_Locked(self, fsid, parentId, pName, hash);
+    if (pEntry) {
+        NameCache_RemoveEntry_Locked(self, pEntry);
+    }
+    else {
+        // Make sure that a lookup which is in progress can not add an entry
+        // for the old state of the directory
+        self->generation++;
+    }
+    Lock_Unlock(&self->lock);
+}
+
+// Removes all entries that refer to the child 'childId' of the directory
+// (fsid, parentId) and all entries of the directory 'childId' itself.
+void NameCache_RemoveChild(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, InodeId childId)
+{
+    Lock_Lock(&self->lock);
+    for (int i = 0; i < NAME_CACHE_HASH_CHAIN_COUNT; i++) {
+        List_ForEach(&self->hashChain[i], NameCacheEntry, {
+            if (pCurNode->fsid == fsid
+                && ((pCurNode->parentId == parentId && pCurNode->childId == childId) || pCurNode->parentId == childId)) {
+                NameCache_RemoveEntry_Locked(self, pCurNode);
+            }
+        });
+    }
+    self->generation++;
+    Lock_Unlock(&self->lock);
+}
+
+// Removes all entries that belong to the filesystem 'fsid'.
+void NameCache_RemoveFilesystem(NameCacheRef _Nonnull self, FilesystemId fsid)
+{
+    Lock_Lock(&self->lock);
+    for (int i = 0; i < NAME_CACHE_HASH_CHAIN_COUNT; i++) {
+        List_ForEach(&self->hashChain[i], NameCacheEntry, {
+            if (pCurNode->fsid == fsid) {
+                NameCache_RemoveEntry_Locked(self, pCurNode);
+            }
+        });
+    }
+    self->generation++;
+    Lock_Unlock(&self->lock);
+}
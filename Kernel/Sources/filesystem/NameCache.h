@@ -0,0 +1,66 @@
+//
+//  NameCache.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/21/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef NameCache_h
+#define NameCache_h
+
+#include <klib/klib.h>
+#include "Inode.h"
+#include "PathComponent.h"
+
+// Names longer than this are not cached
+#define kNameCacheMaxNameLength     31
+
+
+// The name cache maps the tuple (filesystem id, parent directory inode id,
+// name) to the inode id of the child node with that name. A cached inode id of
+// 0 is a negative entry which records that the directory does not contain a
+// child with that name. The entries "." and ".." and names which are longer
+// than kNameCacheMaxNameLength are never cached.
+//
+// Entries are added by the path resolver after a successful or a failed lookup.
+// Code which changes the content of a directory must remove the affected
+// entries. An entry is only added if no entry was removed since the caller
+// took a snapshot of the cache generation before it started the lookup. This
+// ensures that a lookup which raced with a directory change does not add a
+// stale entry.
+struct _NameCache;
+typedef struct _NameCache* NameCacheRef;
+
+
+extern NameCacheRef _Nonnull  gNameCache;
+
+
+// Creates a name cache which caches up to 'maxEntryCount' names.
+extern errno_t NameCache_Create(size_t maxEntryCount, NameCacheRef _Nullable * _Nonnull pOutSelf);
+
+// Returns the current generation of the cache. The generation changes every
+// time that an entry is removed.
+extern uint32_t NameCache_GetGeneration(NameCacheRef _Nonnull self);
+
+// Looks up the child 'pName' of the directory (fsid, parentId). Returns true
+// and the inode id of the child if an entry exists. The returned id is 0 if the
+// entry is a negative entry. Returns false if no entry exists.
+extern bool NameCache_Lookup(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId* _Nonnull pOutId);
+
+// Adds the entry (fsid, parentId, pName) -> childId to the cache. 'childId' is
+// 0 for a negative entry. The entry is not added if the cache generation is no
+// longer equal to 'generation'.
+extern void NameCache_Enter(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName, InodeId childId, uint32_t generation);
+
+// Removes the entry for the child 'pName' of the directory (fsid, parentId).
+extern void NameCache_RemoveName(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, const PathComponent* _Nonnull pName);
+
+// Removes all entries that refer to the child 'childId' of the directory
+// (fsid, parentId) and all entries of the directory 'childId' itself.
+extern void NameCache_RemoveChild(NameCacheRef _Nonnull self, FilesystemId fsid, InodeId parentId, InodeId childId);
+
+// Removes all entries that belong to the filesystem 'fsid'.
+extern void NameCache_RemoveFilesystem(NameCacheRef _Nonnull self, FilesystemId fsid);
+
+#endif /* NameCache_h */
@@ -8,6 +8,7 @@
 
 #include "PathResolver.h"
 #include "FilesystemManager.h"
+#include "NameCache.h"
 
 static void PathResolverResult_Init(PathResolverResult* _Nonnull pResult)
 {
@@ -234,7 +235,7 @@ errno_t PathResolver_SetWorkingDirectoryPath(PathResolverRef _Nonnull pResolver,
 // unchanged if an error (eg access denied) occurs.
 static errno_t PathResolver_UpdateIteratorWalkingUp(PathResolverRef _Nonnull pResolver, User user, InodeIterator* _Nonnull pIter)
 {
-    InodeRef _Locked pParentNode = NULL;
+    InodeRef pParentNode = NULL;
     InodeRef _Locked pMountingDir = NULL;
     InodeRef _Locked pParentOfMountingDir = NULL;
     FilesystemRef pMountingFilesystem = NULL;
@@ -281,6 +282,42 @@ catch:
     return err;
 }
 
+// Acquires the child node named 'pComponent' of the directory 'pParentNode'.
+// The name cache is consulted first and the filesystem is only asked to look
+// up the name if the cache doesn't know it. The result of the filesystem
+// lookup is then added to the cache. Note that the caller must have search
+// permission on the directory even if the name is found in the cache.
+static errno_t PathResolver_AcquireNodeForName(FilesystemRef _Nonnull pFileSys, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pComponent, User user, InodeRef _Nullable * _Nonnull pOutNode)
+{
+    decl_try_err();
+    const FilesystemId fsid = Filesystem_GetId(pFileSys);
+    const InodeId parentId = Inode_GetId(pParentNode);
+    InodeId childId;
+
+    try(Filesystem_CheckAccess(pFileSys, pParentNode, user, kFilePermission_Execute));
+
+    if (NameCache_Lookup(gNameCache, fsid, parentId, pComponent, &childId)) {
+        if (childId == 0) {
+            throw(ENOENT);
+        }
+        return Filesystem_AcquireNodeWithId(pFileSys, childId, NULL, pOutNode);
+    }
+
+    const uint32_t generation = NameCache_GetGeneration(gNameCache);
+    err = Filesystem_AcquireNodeForName(pFileSys, pParentNode, pComponent, user, pOutNode);
+    if (err == EOK) {
+        NameCache_Enter(gNameCache, fsid, parentId, pComponent, Inode_GetId(*pOutNode), generation);
+    }
+    else if (err == ENOENT) {
+        NameCache_Enter(gNameCache, fsid, parentId, pComponent, 0, generation);
+    }
+    return err;
+
+catch:
+    *pOutNode = NULL;
+    return err;
+}
+
 // Updates the inode iterator with the inode that represents the given path
 // component and returns EOK if that works out. Otherwise returns a suitable
 // error and leaves the passed in iterator unchanged. This function handles the
@@ -292,7 +329,7 @@ static errno_t PathResolver_UpdateIteratorWalkingDown(PathResolverRef _Nonnull p
 
     // Ask the current filesystem for the inode that is named by the tuple
     // (parent-inode, path-component)
-    try(Filesystem_AcquireNodeForName(pIter->filesystem, pIter->inode, pComponent, user, &pChildNode));
+    try(PathResolver_AcquireNodeForName(pIter->filesystem, pIter->inode, pComponent, user, &pChildNode));
 
 
     // Note that if we do a lookup for ".", that we get back the same inode with
@@ -7,21 +7,10 @@
 //
 
 #include "SerenaFSPriv.h"
+#include <filesystem/NameCache.h>
 #include <System/ByteOrder.h>
 
 
-////////////////////////////////////////////////////////////////////////////////
-// MARK: -
-// MARK: Inode extensions
-////////////////////////////////////////////////////////////////////////////////
-
-// Returns true if the given directory node is empty (contains just "." and "..").
-static bool DirectoryNode_IsEmpty(InodeRef _Nonnull _Locked self)
-{
-    return Inode_GetFileSize(self) <= sizeof(SFSDirectoryEntry) * 2;
-}
-
-
 ////////////////////////////////////////////////////////////////////////////////
 // MARK: -
 // MARK: Allocation Bitmaps
@@ -97,7 +86,7 @@ errno_t SerenaFS_FormatDrive(DiskDriverRef _Nonnull pDriver, User user, FilePerm
     SFSVolumeHeader* vhp = (SFSVolumeHeader*)p;
     vhp->signature = UInt32_HostToBig(kSFSSignature_SerenaFS);
     vhp->version = UInt32_HostToBig(kSFSVersion_Current);
-    vhp->attributes = UInt32_HostToBig(0);
+    vhp->attributes = UInt32_HostToBig(1 << kSFSVolumeAttributeBit_IsConsistent);
     vhp->creationTime.tv_sec = UInt32_HostToBig(curTime.tv_sec);
     vhp->creationTime.tv_nsec = UInt32_HostToBig(curTime.tv_nsec);
     vhp->modificationTime.tv_sec = UInt32_HostToBig(curTime.tv_sec);
@@ -139,7 +128,7 @@ errno_t SerenaFS_FormatDrive(DiskDriverRef _Nonnull pDriver, User user, FilePerm
     ip->modificationTime.tv_nsec = UInt32_HostToBig(curTime.tv_nsec);
     ip->statusChangeTime.tv_sec = UInt32_HostToBig(curTime.tv_sec);
     ip->statusChangeTime.tv_nsec = UInt32_HostToBig(curTime.tv_nsec);
-    ip->size = Int64_HostToBig(2 * sizeof(SFSDirectoryEntry));
+    ip->size = Int64_HostToBig(kSFSBlockSize);
     ip->uid = UInt32_HostToBig(user.uid);
     ip->gid = UInt32_HostToBig(user.gid);
     ip->linkCount = Int32_HostToBig(1);
@@ -151,14 +140,21 @@ errno_t SerenaFS_FormatDrive(DiskDriverRef _Nonnull pDriver, User user, FilePerm
 
     // Write the root directory content. This is just the entries '.' and '..'
     // which both point back to the root directory.
+    // The '..' entry covers the rest of the block.
     memset(p, 0, diskBlockSize);
     SFSDirectoryEntry* dep = (SFSDirectoryEntry*)p;
-    dep[0].id = UInt32_HostToBig(rootDirInodeLba);
-    dep[0].filename[0] = '.';
-    dep[1].id = UInt32_HostToBig(rootDirInodeLba);
-    dep[1].filename[0] = '.';
-    dep[1].filename[1] = '.';
-    try(DiskDriver_PutBlock(pDriver, dep, rootDirContentLba));
+    const size_t dotRecLen = SFSDirectoryEntry_GetRecordLength(1);
+    dep->id = UInt32_HostToBig(rootDirInodeLba);
+    dep->recordLength = UInt16_HostToBig(dotRecLen);
+    dep->nameLength = 1;
+    dep->filename[0] = '.';
+    dep = (SFSDirectoryEntry*)(p + dotRecLen);
+    dep->id = UInt32_HostToBig(rootDirInodeLba);
+    dep->recordLength = UInt16_HostToBig(diskBlockSize - dotRecLen);
+    dep->nameLength = 2;
+    dep->filename[0] = '.';
+    dep->filename[1] = '.';
+    try(DiskDriver_PutBlock(pDriver, p, rootDirContentLba));
 
 catch:
     kfree(p);
@@ -174,10 +170,13 @@ errno_t SerenaFS_Create(SerenaFSRef _Nullable * _Nonnull pOutSelf)
 
     assert(sizeof(SFSVolumeHeader) <= kSFSBlockSize);
     assert(sizeof(SFSInode) <= kSFSBlockSize);
-    assert(sizeof(SFSDirectoryEntry) * kSFSDirectoryEntriesPerBlock == kSFSBlockSize);
+    assert(offsetof(SFSDirectoryEntry, filename) == kSFSDirectoryEntryHeaderSize);
+    assert(kSFSMaxFilenameLength <= UINT8_MAX);
+    assert(sizeof(uint32_t) * kSFSBlockPointersPerBlock == kSFSBlockSize);
     
     try(Filesystem_Create(&kSerenaFSClass, (FilesystemRef*)&self));
     Lock_Init(&self->lock);
+    Lock_Init(&self->allocationLock);
     ConditionVariable_Init(&self->notifier);
     self->isReadOnly = false;
 
@@ -198,59 +197,275 @@ void SerenaFS_deinit(SerenaFSRef _Nonnull self)
     assert(self->diskDriver == NULL);
 #endif
     ConditionVariable_Deinit(&self->notifier);
+    Lock_Deinit(&self->allocationLock);
     Lock_Deinit(&self->lock);
 }
 
-static errno_t SerenaFS_WriteBackAllocationBitmapForLba(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
+// Returns the number of free blocks on the mounted volume. This is an O(1)
+// operation because the count is maintained by the block allocator.
+LogicalBlockCount SerenaFS_GetFreeBlockCount(SerenaFSRef _Nonnull self)
 {
-    const LogicalBlockAddress idxOfAllocBitmapBlockModified = (lba >> 3) / kSFSBlockSize;
-    const uint8_t* pBlock = &self->allocationBitmap[idxOfAllocBitmapBlockModified * kSFSBlockSize];
-    const LogicalBlockAddress allocationBitmapBlockLba = self->allocationBitmapLba + idxOfAllocBitmapBlockModified;
+    Lock_Lock(&self->allocationLock);
+    const LogicalBlockCount count = self->freeBlockCount;
+    Lock_Unlock(&self->allocationLock);
+
+    return count;
+}
 
-    memset(self->tmpBlock, 0, kSFSBlockSize);
-    memcpy(self->tmpBlock, pBlock, &self->allocationBitmap[self->allocationBitmapByteSize] - pBlock);
-    return DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, allocationBitmapBlockLba);
+// Marks the allocation bitmap block which tracks the block 'lba' as dirty. Dirty
+// bitmap blocks are written back in a batch by SerenaFS_FlushAllocationBitmap().
+static void SerenaFS_MarkAllocationBitmapDirtyForLba(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
+{
+    self->allocationBitmapDirtyFlags[(lba >> 3) / kSFSBlockSize] = true;
+    self->isAllocationBitmapDirty = true;
 }
 
-static errno_t SerenaFS_AllocateBlock_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress* _Nonnull pOutLba)
+// Writes all dirty allocation bitmap blocks back to disk. This must be done
+// before an on-disk structure (inode, pointer block or directory entry) is
+// written that references a newly allocated block.
+static errno_t SerenaFS_FlushAllocationBitmap(SerenaFSRef _Nonnull self)
 {
     decl_try_err();
-    LogicalBlockAddress lba = 0;    // Safe because LBA #0 is the volume header which is always allocated when the FS is mounted
 
-    for (LogicalBlockAddress i = 1; i < self->volumeBlockCount; i++) {
-        if (!AllocationBitmap_IsBlockInUse(self->allocationBitmap, i)) {
-            lba = i;
-            break;
+    Lock_Lock(&self->allocationLock);
+    if (!self->isAllocationBitmapDirty) {
+        Lock_Unlock(&self->allocationLock);
+        return EOK;
+    }
+
+    for (LogicalBlockCount i = 0; i < self->allocationBitmapBlockCount; i++) {
+        if (!self->allocationBitmapDirtyFlags[i]) {
+            continue;
         }
+
+        const size_t byteOffset = i * kSFSBlockSize;
+        const size_t nBytesToCopy = __min(kSFSBlockSize, self->allocationBitmapByteSize - byteOffset);
+        DiskBlockRef pBlock;
+
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, self->allocationBitmapLba + i, kAcquireBlock_Cleared, &pBlock));
+        memcpy(DiskBlock_GetMutableData(pBlock), &self->allocationBitmap[byteOffset], nBytesToCopy);
+        try(DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync));
+        self->allocationBitmapDirtyFlags[i] = false;
     }
-    if (lba == 0) {
-        throw(ENOSPC);
+    self->isAllocationBitmapDirty = false;
+
+catch:
+    Lock_Unlock(&self->allocationLock);
+    return err;
+}
+
+// Number of blocks that a single allocation bitmap block tracks
+#define kAllocationBitmapBlocksPerBitmapBlock   (kSFSBlockSize << 3)
+
+// Builds the in-core free space summary of the allocation bitmap: the number of
+// free blocks per bitmap block and on the whole volume.
+static errno_t SerenaFS_BuildAllocationSummary(SerenaFSRef _Nonnull self)
+{
+    decl_try_err();
+    const uint8_t* pBitmap = self->allocationBitmap;
+
+    try(kalloc_cleared(sizeof(uint16_t) * self->allocationBitmapBlockCount, (void**)&self->allocationBitmapFreeCounts));
+    self->freeBlockCount = 0;
+    self->nextFreeLbaHint = self->volumeBlockCount;
+
+    for (LogicalBlockAddress lba = 0; lba < self->volumeBlockCount;) {
+        const size_t bitmapBlockIdx = lba / kAllocationBitmapBlocksPerBitmapBlock;
+        LogicalBlockCount nFree = 0;
+
+        if (self->nextFreeLbaHint == self->volumeBlockCount && !AllocationBitmap_IsBlockInUse(pBitmap, lba)) {
+            self->nextFreeLbaHint = lba;
+        }
+
+        if ((lba & 0x07) == 0 && lba + 8 <= self->volumeBlockCount && (pBitmap[lba >> 3] == 0 || pBitmap[lba >> 3] == 0xff)) {
+            nFree = (pBitmap[lba >> 3] == 0) ? 8 : 0;
+            lba += 8;
+        }
+        else {
+            nFree = (AllocationBitmap_IsBlockInUse(pBitmap, lba)) ? 0 : 1;
+            lba++;
+        }
+
+        self->allocationBitmapFreeCounts[bitmapBlockIdx] += nFree;
+        self->freeBlockCount += nFree;
+    }
+
+catch:
+    return err;
+}
+
+// Marks the block 'lba' as in use or free and updates the free space summary.
+static void SerenaFS_SetBlockInUse_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress lba, bool inUse)
+{
+    if (AllocationBitmap_IsBlockInUse(self->allocationBitmap, lba) == inUse) {
+        return;
+    }
+
+    AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, inUse);
+    if (inUse) {
+        self->allocationBitmapFreeCounts[lba / kAllocationBitmapBlocksPerBitmapBlock]--;
+        self->freeBlockCount--;
+    }
+    else {
+        self->allocationBitmapFreeCounts[lba / kAllocationBitmapBlocksPerBitmapBlock]++;
+        self->freeBlockCount++;
+        if (lba < self->nextFreeLbaHint) {
+            self->nextFreeLbaHint = lba;
+        }
+    }
+}
+
+// Returns the 32 allocation bits of the blocks 'lba' to 'lba + 31'. The bit of
+// block 'lba' is the most significant bit. 'lba' must be a multiple of 32.
+static uint32_t AllocationBitmap_GetWord(const uint8_t* _Nonnull bitmap, LogicalBlockAddress lba)
+{
+    const uint8_t* p = &bitmap[lba >> 3];
+
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// Searches the allocation bitmap range [lba, endLba) for a run of 'nBlocks'
+// free blocks. Returns the first run that is long enough or the longest run in
+// the range if no run has the requested length. Returns 0 if the range doesn't
+// contain any free block. Bitmap blocks without a free block are skipped as a
+// whole and the bitmap is otherwise scanned a word at a time where possible.
+static LogicalBlockCount SerenaFS_FindFreeRun_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockAddress endLba, LogicalBlockCount nBlocks, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    LogicalBlockAddress bestLba = 0, runLba = 0;
+    LogicalBlockCount bestCount = 0, runCount = 0;
+
+    while (lba < endLba) {
+        const size_t bitmapBlockIdx = lba / kAllocationBitmapBlocksPerBitmapBlock;
+        LogicalBlockCount nFree;
+
+        if (self->allocationBitmapFreeCounts[bitmapBlockIdx] == 0) {
+            // Skip the whole region covered by a full bitmap block
+            lba = (bitmapBlockIdx + 1) * kAllocationBitmapBlocksPerBitmapBlock;
+            runCount = 0;
+            continue;
+        }
+
+        if ((lba & 0x1f) == 0 && lba + 32 <= endLba) {
+            const uint32_t w = AllocationBitmap_GetWord(self->allocationBitmap, lba);
+
+            if (w == 0xffffffff) {
+                lba += 32;
+                runCount = 0;
+                continue;
+            }
+            else if (w != 0) {
+                nFree = (AllocationBitmap_IsBlockInUse(self->allocationBitmap, lba)) ? 0 : 1;
+            }
+            else {
+                nFree = 32;
+            }
+        }
+        else {
+            nFree = (AllocationBitmap_IsBlockInUse(self->allocationBitmap, lba)) ? 0 : 1;
+        }
+
+        if (nFree == 0) {
+            lba++;
+            runCount = 0;
+            continue;
+        }
+
+        if (runCount == 0) {
+            runLba = lba;
+        }
+        runCount += nFree;
+        lba += nFree;
+
+        if (runCount > bestCount) {
+            bestLba = runLba;
+            bestCount = runCount;
+            if (bestCount >= nBlocks) {
+                bestCount = nBlocks;
+                break;
+            }
+        }
+    }
+
+    *pOutLba = bestLba;
+    return bestCount;
+}
+
+// Allocates a run of up to 'nBlocks' contiguous blocks. The search for free
+// blocks starts at 'goalLba' and wraps around to the beginning of the volume.
+// Returns the address of the first block and the number of blocks in the run.
+// The run may be shorter than requested if the volume doesn't have a long
+// enough run of free blocks. Returns ENOSPC if the volume is full.
+static errno_t SerenaFS_AllocateBlocks_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress goalLba, LogicalBlockCount nBlocks, LogicalBlockAddress* _Nonnull pOutLba, LogicalBlockCount* _Nonnull pOutCount)
+{
+    LogicalBlockAddress lba, lba2;
+    LogicalBlockCount count, count2;
+
+    // LBA #0 is the volume header which is always allocated when the FS is mounted
+    if (goalLba < 1 || goalLba >= self->volumeBlockCount) {
+        goalLba = 1;
+    }
+    if (self->freeBlockCount == 0) {
+        *pOutLba = 0;
+        *pOutCount = 0;
+        return ENOSPC;
+    }
+
+    count = SerenaFS_FindFreeRun_Locked(self, goalLba, self->volumeBlockCount, nBlocks, &lba);
+    if (count < nBlocks && goalLba > 1) {
+        count2 = SerenaFS_FindFreeRun_Locked(self, 1, goalLba, nBlocks, &lba2);
+        if (count2 > count) {
+            lba = lba2;
+            count = count2;
+        }
+    }
+    if (count == 0) {
+        *pOutLba = 0;
+        *pOutCount = 0;
+        return ENOSPC;
     }
 
-    AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, true);
-    try(SerenaFS_WriteBackAllocationBitmapForLba(self, lba));
+    for (LogicalBlockCount i = 0; i < count; i++) {
+        SerenaFS_SetBlockInUse_Locked(self, lba + i, true);
+        SerenaFS_MarkAllocationBitmapDirtyForLba(self, lba + i);
+    }
+    if (lba == self->nextFreeLbaHint) {
+        self->nextFreeLbaHint = lba + count;
+    }
 
     *pOutLba = lba;
+    *pOutCount = count;
     return EOK;
+}
+
+static errno_t SerenaFS_AllocateBlocks(SerenaFSRef _Nonnull self, LogicalBlockAddress goalLba, LogicalBlockCount nBlocks, LogicalBlockAddress* _Nonnull pOutLba, LogicalBlockCount* _Nonnull pOutCount)
+{
+    Lock_Lock(&self->allocationLock);
+    const errno_t err = SerenaFS_AllocateBlocks_Locked(self, goalLba, nBlocks, pOutLba, pOutCount);
+    Lock_Unlock(&self->allocationLock);
+
+    return err;
+}
+
+static errno_t SerenaFS_AllocateBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress* _Nonnull pOutLba)
+{
+    LogicalBlockCount count;
+
+    Lock_Lock(&self->allocationLock);
+    const errno_t err = SerenaFS_AllocateBlocks_Locked(self, self->nextFreeLbaHint, 1, pOutLba, &count);
+    Lock_Unlock(&self->allocationLock);
 
-catch:
-    if (lba > 0) {
-        AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, false);
-    }
-    *pOutLba = 0;
     return err;
 }
 
-static void SerenaFS_DeallocateBlock_Locked(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
+static void SerenaFS_DeallocateBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress lba)
 {
     if (lba == 0) {
         return;
     }
 
-    AllocationBitmap_SetBlockInUse(self->allocationBitmap, lba, false);
-
-    // XXX check for error here?
-    SerenaFS_WriteBackAllocationBitmapForLba(self, lba);
+    Lock_Lock(&self->allocationLock);
+    SerenaFS_SetBlockInUse_Locked(self, lba, false);
+    SerenaFS_MarkAllocationBitmapDirtyForLba(self, lba);
+    Lock_Unlock(&self->allocationLock);
 }
 
 // Invoked when Filesystem_AllocateNode() is called. Subclassers should
@@ -260,10 +475,10 @@ errno_t SerenaFS_onAllocateNodeOnDisk(SerenaFSRef _Nonnull self, FileType type,
     decl_try_err();
     const TimeInterval curTime = MonotonicClock_GetCurrentTime();
     LogicalBlockAddress lba = 0;
-    void* pBlockMap = NULL;
+    SFSInodeInfo* pInfo = NULL;
 
-    try(kalloc_cleared(sizeof(SFSBlockMap), &pBlockMap));
-    try(SerenaFS_AllocateBlock_Locked(self, &lba));
+    try(kalloc_cleared(sizeof(SFSInodeInfo), (void**)&pInfo));
+    try(SerenaFS_AllocateBlock(self, &lba));
 
     try(Inode_Create(
         Filesystem_GetId(self),
@@ -277,13 +492,13 @@ errno_t SerenaFS_onAllocateNodeOnDisk(SerenaFSRef _Nonnull self, FileType type,
         curTime,
         curTime,
         curTime,
-        pBlockMap,
+        pInfo,
         pOutNode));
     return EOK;
 
 catch:
-    kfree(pBlockMap);
-    SerenaFS_DeallocateBlock_Locked(self, lba);
+    kfree(pInfo);
+    SerenaFS_DeallocateBlock(self, lba);
     *pOutNode = NULL;
     return err;
 }
@@ -297,17 +512,21 @@ errno_t SerenaFS_onReadNodeFromDisk(SerenaFSRef _Nonnull self, InodeId id, void*
 {
     decl_try_err();
     const LogicalBlockAddress lba = (LogicalBlockAddress)id;
-    SFSBlockMap* pBlockMap = NULL;
+    SFSInodeInfo* pInfo = NULL;
+    DiskBlockRef pBlock = NULL;
 
-    try(kalloc(sizeof(SFSBlockMap), (void**)&pBlockMap));
-    try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba));
-    const SFSInode* ip = (const SFSInode*)self->tmpBlock;
+    try(kalloc_cleared(sizeof(SFSInodeInfo), (void**)&pInfo));
+    try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, kAcquireBlock_ReadOnly, &pBlock));
+    const SFSInode* ip = (const SFSInode*)DiskBlock_GetData(pBlock);
+    SFSBlockMap* pBlockMap = &pInfo->blockMap;
 
     for (int i = 0; i < kSFSMaxDirectDataBlockPointers; i++) {
         pBlockMap->p[i] = UInt32_BigToHost(ip->blockMap.p[i]);
     }
+    pBlockMap->indirect = UInt32_BigToHost(ip->blockMap.indirect);
+    pBlockMap->doubleIndirect = UInt32_BigToHost(ip->blockMap.doubleIndirect);
 
-    return Inode_Create(
+    err = Inode_Create(
         Filesystem_GetId(self),
         id,
         ip->type,
@@ -319,11 +538,17 @@ errno_t SerenaFS_onReadNodeFromDisk(SerenaFSRef _Nonnull self, InodeId id, void*
         TimeInterval_Make(UInt32_BigToHost(ip->accessTime.tv_sec), UInt32_BigToHost(ip->accessTime.tv_nsec)),
         TimeInterval_Make(UInt32_BigToHost(ip->modificationTime.tv_sec), UInt32_BigToHost(ip->modificationTime.tv_nsec)),
         TimeInterval_Make(UInt32_BigToHost(ip->statusChangeTime.tv_sec), UInt32_BigToHost(ip->statusChangeTime.tv_nsec)),
-        pBlockMap,
+        pInfo,
         pOutNode);
+    DiskCache_RelinquishBlock(gDiskCache, pBlock);
+    pBlock = NULL;
+    if (err == EOK) {
+        return EOK;
+    }
 
 catch:
-    kfree(pBlockMap);
+    DiskCache_RelinquishBlock(gDiskCache, pBlock);
+    kfree(pInfo);
     *pOutNode = NULL;
     return err;
 }
@@ -331,14 +556,55 @@ catch:
 // Invoked when the inode is relinquished and it is marked as modified. The
 // filesystem override should write the inode meta-data back to the 
 // corresponding disk node.
+// Writes the file blocks of the inode that have been written with a deferred
+// write back to disk. Consecutive disk blocks are handed to the disk cache as
+// a single range.
+static errno_t SerenaFS_FlushFileBlocks(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode)
+{
+    decl_try_err();
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+    int fba = pInfo->dirtyStartBlock;
+
+    while (fba < pInfo->dirtyEndBlock) {
+        LogicalBlockAddress lba;
+        int nBlocks;
+
+        try(SerenaFS_GetFileExtent(self, pNode, fba, pInfo->dirtyEndBlock - fba, &lba, &nBlocks));
+        if (lba != 0) {
+            try(DiskCache_SyncBlocks(gDiskCache, self->diskDriver, lba, nBlocks));
+        }
+        fba += nBlocks;
+        pInfo->dirtyStartBlock = fba;
+    }
+
+    pInfo->dirtyStartBlock = 0;
+    pInfo->dirtyEndBlock = 0;
+
+catch:
+    return err;
+}
+
 errno_t SerenaFS_onWriteNodeToDisk(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode)
 {
+    decl_try_err();
     const LogicalBlockAddress lba = (LogicalBlockAddress)Inode_GetId(pNode);
-    const SFSBlockMap* pBlockMap = (const SFSBlockMap*)Inode_GetBlockMap(pNode);
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+    const SFSBlockMap* pBlockMap = &pInfo->blockMap;
     const TimeInterval curTime = MonotonicClock_GetCurrentTime();
-    SFSInode* ip = (SFSInode*)self->tmpBlock;
+    DiskBlockRef pBlock;
+
+    // Write the file data, the allocation bitmap and the pointer blocks first
+    // so that the inode never references a block that isn't allocated or
+    // doesn't exist on disk yet. Only the file blocks that have seen a deferred
+    // write need to be written
+    try(SerenaFS_FlushFileBlocks(self, pNode));
+    try(SerenaFS_FlushAllocationBitmap(self));
+    try(SerenaFS_FlushPointerBlock(self, pInfo->doubleIndirectL2));
+    try(SerenaFS_FlushPointerBlock(self, pInfo->doubleIndirect));
+    try(SerenaFS_FlushPointerBlock(self, pInfo->indirect));
 
-    memset(ip, 0, kSFSBlockSize);
+    try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, kAcquireBlock_Cleared, &pBlock));
+    SFSInode* ip = (SFSInode*)DiskBlock_GetMutableData(pBlock);
 
     const TimeInterval accTime = (Inode_IsAccessed(pNode)) ? curTime : Inode_GetAccessTime(pNode);
     const TimeInterval modTime = (Inode_IsUpdated(pNode)) ? curTime : Inode_GetModificationTime(pNode);
@@ -360,21 +626,13 @@ errno_t SerenaFS_onWriteNodeToDisk(SerenaFSRef _Nonnull self, InodeRef _Nonnull
     for (int i = 0; i < kSFSMaxDirectDataBlockPointers; i++) {
         ip->blockMap.p[i] = UInt32_HostToBig(pBlockMap->p[i]);
     }
+    ip->blockMap.indirect = UInt32_HostToBig(pBlockMap->indirect);
+    ip->blockMap.doubleIndirect = UInt32_HostToBig(pBlockMap->doubleIndirect);
 
-    return DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, lba);
-}
-
-static void SerenaFS_DeallocateFileContentBlocks_Locked(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode)
-{
-    const SFSBlockMap* pBlockMap = (const SFSBlockMap*)Inode_GetBlockMap(pNode);
-
-    for (int i = 0; i < kSFSMaxDirectDataBlockPointers; i++) {
-        if (pBlockMap->p[i] == 0) {
-            break;
-        }
+    return DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync);
 
-        SerenaFS_DeallocateBlock_Locked(self, pBlockMap->p[i]);
-    }
+catch:
+    return err;
 }
 
 // Invoked when Filesystem_RelinquishNode() has determined that the inode is
@@ -385,8 +643,25 @@ void SerenaFS_onRemoveNodeFromDisk(SerenaFSRef _Nonnull self, InodeRef _Nonnull
 {
     const LogicalBlockAddress lba = (LogicalBlockAddress)Inode_GetId(pNode);
 
-    SerenaFS_DeallocateFileContentBlocks_Locked(self, pNode);
-    SerenaFS_DeallocateBlock_Locked(self, lba);
+    SerenaFS_DeallocateFileBlocks_Locked(self, pNode, 0);
+    SerenaFS_DeallocateBlock(self, lba);
+}
+
+// Invoked when Filesystem_RelinquishNode() is about to destroy the in-core
+// representation of an inode because it is no longer in use. Frees the inode
+// info, the pointer block cache and the directory index.
+void SerenaFS_onDestroyNode(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode)
+{
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+
+    if (pInfo) {
+        kfree(pInfo->indirect);
+        kfree(pInfo->doubleIndirect);
+        kfree(pInfo->doubleIndirectL2);
+        SerenaFS_DropDirectoryIndex(pInfo);
+        kfree(pInfo);
+        Inode_SetRefCon(pNode, NULL);
+    }
 }
 
 // Checks whether the given user should be granted access to the given node based
@@ -412,43 +687,249 @@ static errno_t SerenaFS_CheckAccess_Locked(SerenaFSRef _Nonnull self, InodeRef _
     return Inode_CheckAccess(pNode, user, permissions);
 }
 
-// Returns true if the array of directory entries starting at 'pEntry' and holding
-// 'nEntries' entries contains a directory entry that matches 'pQuery'.
-static bool xHasMatchingDirectoryEntry(const SFSDirectoryQuery* _Nonnull pQuery, const SFSDirectoryEntry* _Nonnull pBlock, int nEntries, SFSDirectoryEntry* _Nullable * _Nullable pOutEmptyPtr, SFSDirectoryEntry* _Nullable * _Nonnull pOutEntryPtr)
+// Returns the hash of the directory entry name 'pName' of length 'len'.
+// This is the 32-bit FNV-1a hash.
+static uint32_t SerenaFS_HashName(const char* _Nonnull pName, ssize_t len)
 {
-    const SFSDirectoryEntry* pEntry = pBlock;
+    uint32_t hash = 2166136261u;
 
-    *pOutEmptyPtr = NULL;
-    *pOutEntryPtr = NULL;
+    while (len-- > 0) {
+        hash ^= (uint8_t)*pName++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    while (nEntries-- > 0) {
-        if (pEntry->id > 0) {
-            switch (pQuery->kind) {
-                case kSFSDirectoryQuery_PathComponent:
-                    if (PathComponent_EqualsString(pQuery->u.pc, pEntry->filename)) {
-                        *pOutEntryPtr = (SFSDirectoryEntry*)pEntry;
-                        return true;
-                    }
-                    break;
+// Returns true if the directory entry 'pEntry' which is located at the byte
+// offset 'blockOffset' in its directory block is well-formed.
+static bool SFSDirectoryEntry_IsValid(const SFSDirectoryEntry* _Nonnull pEntry, size_t blockOffset)
+{
+    const size_t recLen = UInt16_BigToHost(pEntry->recordLength);
 
-                case kSFSDirectoryQuery_InodeId:
-                    if (pEntry->id == pQuery->u.id) {
-                       *pOutEntryPtr = (SFSDirectoryEntry*)pEntry;
-                        return true;
-                    }
-                    break;
+    if (recLen < kSFSDirectoryEntryHeaderSize || (recLen & (kSFSDirectoryEntryAlignment - 1)) != 0 || blockOffset + recLen > kSFSBlockSize) {
+        return false;
+    }
+    if (pEntry->id > 0 && (pEntry->nameLength == 0 || SFSDirectoryEntry_GetRecordLength(pEntry->nameLength) > recLen)) {
+        return false;
+    }
+    return true;
+}
 
-                default:
-                    abort();
-            }
+// Returns the number of bytes at the end of the directory entry 'pEntry' which
+// are not used by the entry and which may be claimed by a new entry.
+static size_t SFSDirectoryEntry_GetFreeSize(const SFSDirectoryEntry* _Nonnull pEntry)
+{
+    const size_t recLen = UInt16_BigToHost(pEntry->recordLength);
+
+    return (pEntry->id > 0) ? recLen - SFSDirectoryEntry_GetRecordLength(pEntry->nameLength) : recLen;
+}
+
+// Returns the size of the largest free space in the directory block 'pBlockData'.
+// Returns EIO if the block contains a malformed entry.
+static errno_t SerenaFS_GetDirectoryBlockFreeSize(const uint8_t* _Nonnull pBlockData, size_t* _Nonnull pOutFreeSize)
+{
+    size_t blockOffset = 0;
+    size_t maxFreeSize = 0;
+
+    while (blockOffset < kSFSBlockSize) {
+        const SFSDirectoryEntry* pEntry = (const SFSDirectoryEntry*)(pBlockData + blockOffset);
+
+        if (!SFSDirectoryEntry_IsValid(pEntry, blockOffset)) {
+            *pOutFreeSize = 0;
+            return EIO;
+        }
+
+        maxFreeSize = __max(maxFreeSize, SFSDirectoryEntry_GetFreeSize(pEntry));
+        blockOffset += UInt16_BigToHost(pEntry->recordLength);
+    }
+
+    *pOutFreeSize = maxFreeSize;
+    return EOK;
+}
+
+// Frees the in-core index of the directory 'pInfo'. It will be rebuilt from
+// the directory content the next time it is needed.
+static void SerenaFS_DropDirectoryIndex(SFSInodeInfo* _Nonnull pInfo)
+{
+    SFSDirectoryIndex* pIndex = pInfo->dirIndex;
+
+    if (pIndex) {
+        kfree(pIndex->entries);
+        kfree(pIndex->blockFreeSizes);
+        kfree(pIndex);
+        pInfo->dirIndex = NULL;
+    }
+}
+
+// Returns the position of the first index entry with a hash >= 'hash'.
+static int DirectoryIndex_LowerBound(const SFSDirectoryIndex* _Nonnull pIndex, uint32_t hash)
+{
+    int lo = 0, hi = pIndex->count;
+
+    while (lo < hi) {
+        const int mid = lo + ((hi - lo) >> 1);
+
+        if (pIndex->entries[mid].hash < hash) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Grows the array '*pArray' with capacity '*pCapacity' and elements of size
+// 'elementSize' so that it is able to store at least 'count' + 1 elements.
+static errno_t DirectoryIndex_EnsureCapacity(void* _Nullable * _Nonnull pArray, int* _Nonnull pCapacity, int count, size_t elementSize)
+{
+    decl_try_err();
+    void* pNewArray;
+
+    if (count < *pCapacity) {
+        return EOK;
+    }
+
+    const int newCapacity = (*pCapacity > 0) ? *pCapacity * 2 : 16;
+    try(kalloc(elementSize * newCapacity, &pNewArray));
+    if (*pArray) {
+        memcpy(pNewArray, *pArray, elementSize * count);
+        kfree(*pArray);
+    }
+    *pArray = pNewArray;
+    *pCapacity = newCapacity;
+
+catch:
+    return err;
+}
+
+// Adds an entry for the directory entry (hash, id) at file offset 'offset' to
+// the index.
+static errno_t DirectoryIndex_InsertEntry(SFSDirectoryIndex* _Nonnull pIndex, uint32_t hash, InodeId id, uint32_t offset)
+{
+    decl_try_err();
+
+    try(DirectoryIndex_EnsureCapacity((void**)&pIndex->entries, &pIndex->capacity, pIndex->count, sizeof(SFSDirectoryIndexEntry)));
+
+    const int i = DirectoryIndex_LowerBound(pIndex, hash);
+    memmove(&pIndex->entries[i + 1], &pIndex->entries[i], sizeof(SFSDirectoryIndexEntry) * (pIndex->count - i));
+    pIndex->entries[i].hash = hash;
+    pIndex->entries[i].id = id;
+    pIndex->entries[i].offset = offset;
+    pIndex->count++;
+
+catch:
+    return err;
+}
+
+// Removes the index entry at position 'i'.
+static void DirectoryIndex_RemoveEntryAt(SFSDirectoryIndex* _Nonnull pIndex, int i)
+{
+    memmove(&pIndex->entries[i], &pIndex->entries[i + 1], sizeof(SFSDirectoryIndexEntry) * (pIndex->count - i - 1));
+    pIndex->count--;
+}
+
+// Appends the free size of a new directory block to the index.
+static errno_t DirectoryIndex_AppendBlock(SFSDirectoryIndex* _Nonnull pIndex, size_t freeSize)
+{
+    decl_try_err();
+
+    try(DirectoryIndex_EnsureCapacity((void**)&pIndex->blockFreeSizes, &pIndex->blockCapacity, pIndex->blockCount, sizeof(uint16_t)));
+    pIndex->blockFreeSizes[pIndex->blockCount++] = (uint16_t)freeSize;
+
+catch:
+    return err;
+}
+
+// Returns the index of the first directory block which has enough free space
+// to store a directory entry of size 'recLen'. Returns -1 if no such block
+// exists.
+static int DirectoryIndex_FindBlockWithFreeSize(const SFSDirectoryIndex* _Nonnull pIndex, size_t recLen)
+{
+    for (int i = 0; i < pIndex->blockCount; i++) {
+        if (pIndex->blockFreeSizes[i] >= recLen) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Returns the in-core index of the directory 'pNode'. The index is built from
+// the directory content if it doesn't exist yet. This requires a single pass
+// over the directory. All lookups after that are done with a binary search
+// over the index and without reading directory blocks that don't hold a
+// matching entry.
+static errno_t SerenaFS_GetDirectoryIndex(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, SFSDirectoryIndex* _Nullable * _Nonnull pOutIndex)
+{
+    decl_try_err();
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+    const FileOffset fileSize = Inode_GetFileSize(pNode);
+    FileOffset offset = 0ll;
+    DiskBlockRef pBlock = NULL;
+
+    if (pInfo->dirIndex) {
+        *pOutIndex = pInfo->dirIndex;
+        return EOK;
+    }
+
+    try(kalloc_cleared(sizeof(SFSDirectoryIndex), (void**)&pInfo->dirIndex));
+
+    while (offset < fileSize) {
+        const int blockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);
+        LogicalBlockAddress lba;
+        size_t blockOffset = 0;
+        size_t freeSize;
+
+        try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba));
+        if (lba == 0) {
+            // Directories don't have holes. Skip the block if it is missing anyway
+            try(DirectoryIndex_AppendBlock(pInfo->dirIndex, 0));
+            offset += (FileOffset)kSFSBlockSize;
+            continue;
         }
-        else if (pOutEmptyPtr) {
-            *pOutEmptyPtr = (SFSDirectoryEntry*)pEntry;
+
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, kAcquireBlock_ReadOnly, &pBlock));
+        const uint8_t* pBlockData = (const uint8_t*)DiskBlock_GetData(pBlock);
+
+        try(SerenaFS_GetDirectoryBlockFreeSize(pBlockData, &freeSize));
+        try(DirectoryIndex_AppendBlock(pInfo->dirIndex, freeSize));
+
+        while (blockOffset < kSFSBlockSize) {
+            const SFSDirectoryEntry* pEntry = (const SFSDirectoryEntry*)(pBlockData + blockOffset);
+
+            if (pEntry->id > 0) {
+                const uint32_t hash = SerenaFS_HashName(pEntry->filename, pEntry->nameLength);
+
+                try(DirectoryIndex_InsertEntry(pInfo->dirIndex, hash, UInt32_BigToHost(pEntry->id), (uint32_t)offset + blockOffset));
+            }
+            blockOffset += UInt16_BigToHost(pEntry->recordLength);
         }
-        pEntry++;
+
+        DiskCache_RelinquishBlock(gDiskCache, pBlock);
+        pBlock = NULL;
+        offset += (FileOffset)kSFSBlockSize;
     }
 
-    return false;
+    *pOutIndex = pInfo->dirIndex;
+    return EOK;
+
+catch:
+    DiskCache_RelinquishBlock(gDiskCache, pBlock);
+    SerenaFS_DropDirectoryIndex(pInfo);
+    *pOutIndex = NULL;
+    return err;
+}
+
+// Returns true if the given directory node is empty (contains just "." and "..").
+// A directory whose index can not be built is treated as not empty.
+static bool SerenaFS_IsDirectoryEmpty(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode)
+{
+    SFSDirectoryIndex* pIndex;
+
+    if (SerenaFS_GetDirectoryIndex(self, pDirNode, &pIndex) != EOK) {
+        return false;
+    }
+    return (pIndex->count <= 2) ? true : false;
 }
 
 // Points to a directory entry inside a disk block
@@ -458,114 +939,334 @@ typedef struct SFSDirectoryEntryPointer {
     FileOffset              fileOffset; // Byte offset relative to the start of the directory file
 } SFSDirectoryEntryPointer;
 
+// Returns a pointer to the directory entry at the file offset 'fileOffset' of
+// the directory 'pNode'.
+static errno_t SerenaFS_GetDirectoryEntryPointer(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset fileOffset, SFSDirectoryEntryPointer* _Nonnull pOutPtr)
+{
+    decl_try_err();
+    const int blockIdx = (int)(fileOffset >> (FileOffset)kSFSBlockSizeShift);
+
+    try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &pOutPtr->lba));
+    pOutPtr->offset = fileOffset & (FileOffset)kSFSBlockSizeMask;
+    pOutPtr->fileOffset = fileOffset;
+    if (pOutPtr->lba == 0) {
+        throw(EIO);
+    }
+
+catch:
+    return err;
+}
+
 // Returns a reference to the directory entry that holds 'pName'. NULL and a
 // suitable error is returned if no such entry exists or 'pName' is empty or
-// too long.
+// too long. The lookup is done with the help of the directory index.
 static errno_t SerenaFS_GetDirectoryEntry(
     SerenaFSRef _Nonnull self,
     InodeRef _Nonnull _Locked pNode,
     const SFSDirectoryQuery* _Nonnull pQuery,
-    SFSDirectoryEntryPointer* _Nullable pOutEmptyPtr,
     SFSDirectoryEntryPointer* _Nullable pOutEntryPtr,
     InodeId* _Nullable pOutId,
     MutablePathComponent* _Nullable pOutFilename)
 {
     decl_try_err();
-    const SFSDirectoryEntry* pDirBuffer = (const SFSDirectoryEntry*)self->tmpBlock;
-    const FileOffset fileSize = Inode_GetFileSize(pNode);
-    FileOffset offset = 0ll;
-    LogicalBlockAddress lba = 0;
-    SFSDirectoryEntry* pEmptyEntry = NULL;
-    SFSDirectoryEntry* pMatchingEntry = NULL;
-    SFSDirectoryQuery swappedQuery;
-    bool hasMatch = false;
+    SFSDirectoryIndex* pIndex;
+    SFSDirectoryEntryPointer ep;
+    DiskBlockRef pBlock = NULL;
+    const SFSDirectoryEntry* pMatchingEntry = NULL;
+    int matchIdx = -1;
+
+    if (pOutEntryPtr) {
+        pOutEntryPtr->lba = 0;
+        pOutEntryPtr->offset = 0;
+        pOutEntryPtr->fileOffset = 0ll;
+    }
+    if (pOutId) {
+        *pOutId = 0;
+    }
+    if (pOutFilename) {
+        pOutFilename->count = 0;
+    }
+
+    if (pQuery->kind == kSFSDirectoryQuery_PathComponent) {
+        if (pQuery->u.pc->count == 0) {
+            return ENOENT;
+        }
+        if (pQuery->u.pc->count > kSFSMaxFilenameLength) {
+            return ENAMETOOLONG;
+        }
+    }
+
+    try(SerenaFS_GetDirectoryIndex(self, pNode, &pIndex));
+
+    switch (pQuery->kind) {
+        case kSFSDirectoryQuery_PathComponent: {
+            const PathComponent* pc = pQuery->u.pc;
+            const uint32_t hash = SerenaFS_HashName(pc->name, pc->count);
+
+            // Only the entries with a matching hash have to be compared by name
+            for (int i = DirectoryIndex_LowerBound(pIndex, hash); i < pIndex->count && pIndex->entries[i].hash == hash; i++) {
+                try(SerenaFS_GetDirectoryEntryPointer(self, pNode, pIndex->entries[i].offset, &ep));
+                try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, ep.lba, kAcquireBlock_ReadOnly, &pBlock));
+
+                const SFSDirectoryEntry* pEntry = (const SFSDirectoryEntry*)(((const uint8_t*)DiskBlock_GetData(pBlock)) + ep.offset);
+                if (pEntry->nameLength == pc->count && String_EqualsUpTo(pEntry->filename, pc->name, pc->count)) {
+                    pMatchingEntry = pEntry;
+                    matchIdx = i;
+                    break;
+                }
+
+                DiskCache_RelinquishBlock(gDiskCache, pBlock);
+                pBlock = NULL;
+            }
+            break;
+        }
+
+        case kSFSDirectoryQuery_InodeId:
+            for (int i = 0; i < pIndex->count; i++) {
+                if (pIndex->entries[i].id == pQuery->u.id) {
+                    matchIdx = i;
+                    break;
+                }
+            }
+
+            if (matchIdx >= 0 && pOutFilename) {
+                try(SerenaFS_GetDirectoryEntryPointer(self, pNode, pIndex->entries[matchIdx].offset, &ep));
+                try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, ep.lba, kAcquireBlock_ReadOnly, &pBlock));
+                pMatchingEntry = (const SFSDirectoryEntry*)(((const uint8_t*)DiskBlock_GetData(pBlock)) + ep.offset);
+            }
+            break;
+
+        default:
+            abort();
+    }
+
+    if (matchIdx < 0) {
+        throw(ENOENT);
+    }
+
+    if (pOutEntryPtr) {
+        try(SerenaFS_GetDirectoryEntryPointer(self, pNode, pIndex->entries[matchIdx].offset, pOutEntryPtr));
+    }
+    if (pOutId) {
+        *pOutId = pIndex->entries[matchIdx].id;
+    }
+    if (pOutFilename) {
+        const ssize_t len = pMatchingEntry->nameLength;
+        if (len > pOutFilename->capacity) {
+            throw(ERANGE);
+        }
+
+        memcpy(pOutFilename->name, pMatchingEntry->filename, len);
+        pOutFilename->count = len;
+    }
+
+catch:
+    DiskCache_RelinquishBlock(gDiskCache, pBlock);
+    return err;
+}
+
+// Writes the pointer block 'pb' back to disk if it is dirty.
+static errno_t SerenaFS_FlushPointerBlock(SerenaFSRef _Nonnull self, SFSPointerBlock* _Nullable pb)
+{
+    decl_try_err();
+
+    if (pb && pb->isDirty) {
+        DiskBlockRef pBlock;
+
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, pb->lba, kAcquireBlock_Replace, &pBlock));
+        uint32_t* pDst = (uint32_t*)DiskBlock_GetMutableData(pBlock);
+
+        for (int i = 0; i < kSFSBlockPointersPerBlock; i++) {
+            pDst[i] = UInt32_HostToBig(pb->p[i]);
+        }
+
+        try(DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync));
+        pb->isDirty = false;
+    }
+
+catch:
+    return err;
+}
+
+// Returns the pointer block that '*pLba' points to. '*pCache' is the cache entry
+// that should be used to hold the pointer block. The entry is allocated if it
+// doesn't exist yet and the block that it currently holds is written back first
+// if it is dirty. The allocation bitmap is written before it. A new empty
+// pointer block is allocated and its address is stored in '*pLba' if '*pLba' is
+// 0 and 'mode' is write. NULL is returned if '*pLba' is 0 and 'mode' is read.
+static errno_t SerenaFS_GetPointerBlock(SerenaFSRef _Nonnull self, SFSPointerBlock* _Nullable * _Nonnull pCache, LogicalBlockAddress* _Nonnull pLba, SFSBlockMode mode, SFSPointerBlock* _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    SFSPointerBlock* pb = *pCache;
+
+    *pOutBlock = NULL;
+
+    if (*pLba == 0 && mode == kSFSBlockMode_Read) {
+        return EOK;
+    }
+    if (pb && pb->lba == *pLba && *pLba != 0) {
+        *pOutBlock = pb;
+        return EOK;
+    }
+
+    if (pb == NULL) {
+        try(kalloc(sizeof(SFSPointerBlock), (void**)&pb));
+        pb->lba = 0;
+        pb->isDirty = false;
+        *pCache = pb;
+    }
+
+    // The evicted pointer block may point to blocks which were allocated since
+    // the allocation bitmap was last written. Write the bitmap first so that the
+    // disk never holds a pointer to a block that is marked as free
+    if (pb->isDirty) {
+        try(SerenaFS_FlushAllocationBitmap(self));
+    }
+    try(SerenaFS_FlushPointerBlock(self, pb));
+    pb->lba = 0;
+
+    if (*pLba == 0) {
+        LogicalBlockAddress lba;
+
+        try(SerenaFS_AllocateBlock(self, &lba));
+        memset(pb->p, 0, sizeof(pb->p));
+        pb->isDirty = true;
+        *pLba = lba;
+    }
+    else {
+        DiskBlockRef pBlock;
+
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, *pLba, kAcquireBlock_ReadOnly, &pBlock));
+        const uint32_t* pSrc = (const uint32_t*)DiskBlock_GetData(pBlock);
+
+        for (int i = 0; i < kSFSBlockPointersPerBlock; i++) {
+            pb->p[i] = UInt32_BigToHost(pSrc[i]);
+        }
+        DiskCache_RelinquishBlock(gDiskCache, pBlock);
+    }
+    pb->lba = *pLba;
+
+    *pOutBlock = pb;
+    return EOK;
+
+catch:
+    return err;
+}
+
+// Returns a pointer to the block map slot which stores the disk address of the
+// file block 'fba'. Also returns the pointer block that contains the slot or
+// NULL if the slot is one of the direct block pointers in the inode. Missing
+// pointer blocks are allocated if 'mode' is write. A NULL slot pointer is
+// returned if 'mode' is read and the slot doesn't exist because one of the
+// pointer blocks on the path to the slot doesn't exist.
+static errno_t SerenaFS_GetBlockMapSlot(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, SFSBlockMode mode, uint32_t* _Nullable * _Nonnull pOutSlot, SFSPointerBlock* _Nullable * _Nonnull pOutBlock)
+{
+    decl_try_err();
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+    SFSBlockMap* pBlockMap = &pInfo->blockMap;
+    SFSPointerBlock* pb = NULL;
 
-    if (pOutEmptyPtr) {
-        pOutEmptyPtr->lba = 0;
-        pOutEmptyPtr->offset = 0;
-        pOutEmptyPtr->fileOffset = 0ll;
-    }
-    if (pOutEntryPtr) {
-        pOutEntryPtr->lba = 0;
-        pOutEntryPtr->offset = 0;
-        pOutEntryPtr->fileOffset = 0ll;
-    }
-    if (pOutId) {
-        *pOutId = 0;
+    *pOutSlot = NULL;
+    *pOutBlock = NULL;
+
+    if (fba < 0) {
+        throw(EFBIG);
     }
-    if (pOutFilename) {
-        pOutFilename->count = 0;
+
+    if (fba < kSFSMaxDirectDataBlockPointers) {
+        *pOutSlot = &pBlockMap->p[fba];
+        return EOK;
     }
+    fba -= kSFSMaxDirectDataBlockPointers;
 
-    if (pQuery->kind == kSFSDirectoryQuery_PathComponent) {
-        if (pQuery->u.pc->count == 0) {
-            return ENOENT;
+    if (fba < kSFSMaxIndirectDataBlockPointers) {
+        try(SerenaFS_GetPointerBlock(self, &pInfo->indirect, &pBlockMap->indirect, mode, &pb));
+    }
+    else {
+        fba -= kSFSMaxIndirectDataBlockPointers;
+        if (fba >= kSFSMaxDoubleIndirectDataBlockPointers) {
+            throw(EFBIG);
         }
-        if (pQuery->u.pc->count > kSFSMaxFilenameLength) {
-            return ENAMETOOLONG;
+
+        SFSPointerBlock* pb1;
+        try(SerenaFS_GetPointerBlock(self, &pInfo->doubleIndirect, &pBlockMap->doubleIndirect, mode, &pb1));
+        if (pb1) {
+            uint32_t* pL2Slot = &pb1->p[fba >> kSFSBlockPointersPerBlockShift];
+            const uint32_t oldL2Lba = *pL2Slot;
+
+            try(SerenaFS_GetPointerBlock(self, &pInfo->doubleIndirectL2, pL2Slot, mode, &pb));
+            if (*pL2Slot != oldL2Lba) {
+                pb1->isDirty = true;
+            }
         }
+        fba &= kSFSBlockPointersPerBlockMask;
     }
 
-    swappedQuery = *pQuery;
-    if (swappedQuery.kind == kSFSDirectoryQuery_InodeId) {
-        swappedQuery.u.id = UInt32_HostToBig(swappedQuery.u.id);
+    if (pb) {
+        *pOutSlot = &pb->p[fba];
+        *pOutBlock = pb;
     }
+    return EOK;
 
-    while (true) {
-        const int blockIdx = offset >> (FileOffset)kSFSBlockSizeShift;
-        const ssize_t nBytesAvailable = (ssize_t)__min((FileOffset)kSFSBlockSize, fileSize - offset);
+catch:
+    return err;
+}
 
-        if (nBytesAvailable <= 0) {
-            break;
-        }
+// Allocates disk blocks for the unmapped file blocks 'fba' up to 'fba + nBlocks - 1'
+// of the file 'pNode'. The disk blocks are allocated as a single contiguous run
+// that continues the run of the file block that precedes 'fba' if possible.
+// Fewer than 'nBlocks' blocks are allocated if the volume doesn't have a long
+// enough run of free blocks or if the file already has a disk block assigned
+// to one of the file blocks in the range. Returns the disk address of file
+// block 'fba' and the number of file blocks that were assigned a disk block.
+static errno_t SerenaFS_AllocateFileBlocks_Locked(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, int nBlocks, LogicalBlockAddress* _Nonnull pOutLba, int* _Nonnull pOutBlockCount)
+{
+    decl_try_err();
+    LogicalBlockAddress goalLba = (LogicalBlockAddress)Inode_GetId(pNode) + 1;
+    LogicalBlockAddress runLba;
+    LogicalBlockCount runCount;
+    int i;
 
-        try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba));
-        if (lba == 0) {
-            memset(self->tmpBlock, 0, kSFSBlockSize);
-        }
-        else {
-            try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba));
-        }
+    if (fba > 0) {
+        LogicalBlockAddress prevLba;
 
-        const int nDirEntries = nBytesAvailable / sizeof(SFSDirectoryEntry);
-        hasMatch = xHasMatchingDirectoryEntry(&swappedQuery, pDirBuffer, nDirEntries, &pEmptyEntry, &pMatchingEntry);
-        if (pEmptyEntry) {
-            pOutEmptyPtr->lba = lba;
-            pOutEmptyPtr->offset = ((uint8_t*)pEmptyEntry) - ((uint8_t*)pDirBuffer);
-            pOutEmptyPtr->fileOffset = offset + pOutEmptyPtr->offset;
-        }
-        if (hasMatch) {
-            break;
+        try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, fba - 1, kSFSBlockMode_Read, &prevLba));
+        if (prevLba > 0) {
+            goalLba = prevLba + 1;
         }
-
-        offset += (FileOffset)nBytesAvailable;
     }
 
-    if (hasMatch) {
-        if (pOutEntryPtr) {
-            pOutEntryPtr->lba = lba;
-            pOutEntryPtr->offset = ((uint8_t*)pMatchingEntry) - ((uint8_t*)pDirBuffer);
-            pOutEntryPtr->fileOffset = offset + pOutEntryPtr->offset;
-        }
-        if (pOutId) {
-            *pOutId = UInt32_BigToHost(pMatchingEntry->id);
+    try(SerenaFS_AllocateBlocks(self, goalLba, nBlocks, &runLba, &runCount));
+    for (i = 0; i < runCount; i++) {
+        uint32_t* pSlot;
+        SFSPointerBlock* pb;
+
+        err = SerenaFS_GetBlockMapSlot(self, pNode, fba + i, kSFSBlockMode_Write, &pSlot, &pb);
+        if (err != EOK || *pSlot != 0) {
+            break;
         }
-        if (pOutFilename) {
-            const ssize_t len = String_LengthUpTo(pMatchingEntry->filename, kSFSMaxFilenameLength);
-            if (len > pOutFilename->capacity) {
-                throw(ERANGE);
-            }
 
-            String_CopyUpTo(pOutFilename->name, pMatchingEntry->filename, len);
-            pOutFilename->count = len;
+        *pSlot = runLba + i;
+        if (pb) {
+            pb->isDirty = true;
         }
-        return EOK;
     }
-    else {
-        return ENOENT;
+
+    // Return the blocks that we weren't able to assign to the file
+    for (LogicalBlockCount j = i; j < runCount; j++) {
+        SerenaFS_DeallocateBlock(self, runLba + j);
+    }
+    if (i == 0) {
+        throw((err != EOK) ? err : EIO);
     }
 
+    *pOutLba = runLba;
+    *pOutBlockCount = i;
+    return EOK;
+
 catch:
+    *pOutLba = 0;
+    *pOutBlockCount = 0;
     return err;
 }
 
@@ -575,29 +1276,59 @@ catch:
 // block addresses increment by one until the end of the file. Note that not every
 // logical block address may be backed by an actual disk block. A missing disk block
 // must be substituted by an empty block. 0 is returned if no absolute logical
-// block address exists for 'fba'.
+// block address exists for 'fba'. A disk block is allocated for 'fba' if none
+// exists and 'mode' is write.
 // XXX 'fba' should be LogicalBlockAddress. However we want to be able to detect overflows
 static errno_t SerenaFS_GetLogicalBlockAddressForFileBlockAddress(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, SFSBlockMode mode, LogicalBlockAddress* _Nonnull pOutLba)
 {
     decl_try_err();
+    uint32_t* pSlot;
+    SFSPointerBlock* pb;
 
-    if (fba < 0 || fba >= kSFSMaxDirectDataBlockPointers) {
-        throw(EFBIG);
+    try(SerenaFS_GetBlockMapSlot(self, pNode, fba, mode, &pSlot, &pb));
+    LogicalBlockAddress lba = (pSlot) ? *pSlot : 0;
+
+    if (lba == 0 && mode == kSFSBlockMode_Write) {
+        int nBlocksAllocated;
+
+        try(SerenaFS_AllocateFileBlocks_Locked(self, pNode, fba, 1, &lba, &nBlocksAllocated));
     }
+    *pOutLba = lba;
+    return EOK;
 
-    SFSBlockMap* pBlockMap = Inode_GetBlockMap(pNode);
-    LogicalBlockAddress lba = pBlockMap->p[fba];
+catch:
+    *pOutLba = 0;
+    return err;
+}
 
-    if (lba == 0 && mode == kSFSBlockMode_Write) {
-        // XXX fix locking here
-        try(SerenaFS_AllocateBlock_Locked(self, &lba));
-        pBlockMap->p[fba] = lba;
+// Returns the disk address of the file block 'fba' and the number of file blocks,
+// starting at 'fba' and up to 'nMaxBlocks', which are stored in consecutive
+// disk blocks. This is the extent that contains 'fba'. An extent of unallocated
+// file blocks is returned with a disk address of 0.
+static errno_t SerenaFS_GetFileExtent(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, int nMaxBlocks, LogicalBlockAddress* _Nonnull pOutLba, int* _Nonnull pOutBlockCount)
+{
+    decl_try_err();
+    LogicalBlockAddress lba, nextLba;
+    int nBlocks = 1;
+
+    try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, fba, kSFSBlockMode_Read, &lba));
+    while (nBlocks < nMaxBlocks) {
+        if (SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, fba + nBlocks, kSFSBlockMode_Read, &nextLba) != EOK) {
+            break;
+        }
+        if ((lba == 0 && nextLba != 0) || (lba != 0 && nextLba != lba + nBlocks)) {
+            break;
+        }
+        nBlocks++;
     }
+
     *pOutLba = lba;
+    *pOutBlockCount = nBlocks;
     return EOK;
 
 catch:
     *pOutLba = 0;
+    *pOutBlockCount = 0;
     return err;
 }
 
@@ -615,28 +1346,60 @@ static errno_t SerenaFS_xRead(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Lock
 
     while (nBytesToRead > 0 && offset < fileSize) {
         const int blockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);   //XXX blockIdx should be 64bit
-        const size_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
-        const size_t nBytesToReadInCurrentBlock = (size_t)__min((FileOffset)(kSFSBlockSize - blockOffset), __min(fileSize - offset, (FileOffset)nBytesToRead));
+        const FileOffset nBytesAvailable = __min(fileSize - offset, (FileOffset)nBytesToRead);
+        const int nBlocksSpanned = (int)(((offset & (FileOffset)kSFSBlockSizeMask) + nBytesAvailable + (FileOffset)kSFSBlockSizeMask) >> (FileOffset)kSFSBlockSizeShift);
         LogicalBlockAddress lba;
+        int nExtentBlocks;
+
+        // Transfer the whole extent that contains the current file block
+        errno_t e1 = SerenaFS_GetFileExtent(self, pNode, blockIdx, nBlocksSpanned, &lba, &nExtentBlocks);
+        for (int i = 0; e1 == EOK && i < nExtentBlocks; i++) {
+            const size_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
+            const FileOffset nBytesLeft = __min(fileSize - offset, (FileOffset)nBytesToRead);
+            const int nFullBlocks = __min(nExtentBlocks - i, (int)(nBytesLeft >> (FileOffset)kSFSBlockSizeShift));
+            size_t nBytesToReadInCurrentBlock = (size_t)__min((FileOffset)(kSFSBlockSize - blockOffset), nBytesLeft);
+            uint8_t* pDst = ((uint8_t*)pBuffer) + nBytesRead;
 
-        errno_t e1 = SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba);
-        if (e1 == EOK) {
             if (lba == 0) {
-                memset(self->tmpBlock, 0, kSFSBlockSize);
+                memset(pDst, 0, nBytesToReadInCurrentBlock);
+            }
+            else if (blockOffset == 0 && nFullBlocks > 1) {
+                // A run of full blocks: read them straight into the caller's
+                // buffer with a single multi-block transfer
+                e1 = DiskCache_ReadBlocks(gDiskCache, self->diskDriver, lba + i, nFullBlocks, pDst);
+                nBytesToReadInCurrentBlock = (size_t)nFullBlocks * kSFSBlockSize;
+                i += nFullBlocks - 1;
             }
             else {
-                e1 = DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba);
+                DiskBlockRef pBlock;
+
+                e1 = DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba + i, kAcquireBlock_ReadOnly, &pBlock);
+                if (e1 == EOK) {
+                    memcpy(pDst, ((const uint8_t*)DiskBlock_GetData(pBlock)) + blockOffset, nBytesToReadInCurrentBlock);
+                    DiskCache_RelinquishBlock(gDiskCache, pBlock);
+                }
+            }
+
+            if (e1 == EOK) {
+                nBytesToRead -= nBytesToReadInCurrentBlock;
+                nBytesRead += nBytesToReadInCurrentBlock;
+                offset += (FileOffset)nBytesToReadInCurrentBlock;
             }
         }
         if (e1 != EOK) {
             err = (nBytesRead == 0) ? e1 : EOK;
             break;
         }
+    }
+
+    // Sequential read: start an asynchronous read of the block that follows
+    // the data that we just returned
+    if (err == EOK && nBytesRead > 0 && offset < fileSize) {
+        LogicalBlockAddress nextLba;
 
-        memcpy(((uint8_t*)pBuffer) + nBytesRead, self->tmpBlock + blockOffset, nBytesToReadInCurrentBlock);
-        nBytesToRead -= nBytesToReadInCurrentBlock;
-        nBytesRead += nBytesToReadInCurrentBlock;
-        offset += (FileOffset)nBytesToReadInCurrentBlock;
+        if (SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, (int)(offset >> (FileOffset)kSFSBlockSizeShift), kSFSBlockMode_Read, &nextLba) == EOK && nextLba != 0) {
+            DiskCache_PrefetchBlock(gDiskCache, self->diskDriver, nextLba);
+        }
     }
 
     *pOutBytesRead = nBytesRead;
@@ -646,11 +1409,29 @@ static errno_t SerenaFS_xRead(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Lock
     return err;
 }
 
+// Adds the file blocks [fba, fba + nBlocks) to the range of file blocks with
+// deferred writes.
+static void SerenaFS_MarkFileBlocksDirty(InodeRef _Nonnull _Locked pNode, int fba, int nBlocks)
+{
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+
+    if (pInfo->dirtyStartBlock >= pInfo->dirtyEndBlock) {
+        pInfo->dirtyStartBlock = fba;
+        pInfo->dirtyEndBlock = fba + nBlocks;
+    }
+    else {
+        pInfo->dirtyStartBlock = __min(pInfo->dirtyStartBlock, fba);
+        pInfo->dirtyEndBlock = __max(pInfo->dirtyEndBlock, fba + nBlocks);
+    }
+}
+
 // Writes 'nBytesToWrite' bytes to the file 'pNode' starting at offset 'offset'.
 static errno_t SerenaFS_xWrite(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset offset, const void* _Nonnull pBuffer, ssize_t nBytesToWrite, ssize_t* _Nonnull pOutBytesWritten)
 {
     decl_try_err();
     ssize_t nBytesWritten = 0;
+    LogicalBlockAddress newRunLba = 0;
+    LogicalBlockAddress newRunEndLba = 0;
 
     if (offset < 0ll) {
         *pOutBytesWritten = 0;
@@ -660,29 +1441,64 @@ static errno_t SerenaFS_xWrite(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Loc
     while (nBytesToWrite > 0) {
         const int blockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);   //XXX blockIdx should be 64bit
         const size_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
-        const size_t nBytesToWriteInCurrentBlock = __min(kSFSBlockSize - blockOffset, nBytesToWrite);
+        size_t nBytesToWriteInCurrentBlock = __min(kSFSBlockSize - blockOffset, nBytesToWrite);
+        const uint8_t* pSrc = ((const uint8_t*) pBuffer) + nBytesWritten;
+        bool didWriteRun = false;
         LogicalBlockAddress lba;
 
-        errno_t e1 = SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Write, &lba);
-        if (e1 == EOK) {
-            if (lba == 0) {
-                memset(self->tmpBlock, 0, kSFSBlockSize);
+        errno_t e1 = SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba);
+        if (e1 == EOK && lba == 0) {
+            // Allocate disk blocks for all file blocks that the rest of the
+            // write will touch in one go. This way they end up in a single
+            // contiguous extent on the disk if at all possible.
+            const int nBlocksSpanned = (int)((blockOffset + nBytesToWrite + kSFSBlockSizeMask) >> kSFSBlockSizeShift);
+            int nBlocksAllocated;
+
+            e1 = SerenaFS_AllocateFileBlocks_Locked(self, pNode, blockIdx, nBlocksSpanned, &lba, &nBlocksAllocated);
+            newRunLba = lba;
+            newRunEndLba = lba + nBlocksAllocated;
+        }
+        if (e1 == EOK && blockOffset == 0 && nBytesToWrite >= 2 * kSFSBlockSize) {
+            // A run of full blocks: write all blocks that are backed by the
+            // same extent with a single multi-block transfer
+            LogicalBlockAddress extentLba;
+            int nExtentBlocks;
+
+            e1 = SerenaFS_GetFileExtent(self, pNode, blockIdx, (int)(nBytesToWrite >> kSFSBlockSizeShift), &extentLba, &nExtentBlocks);
+            if (e1 == EOK && extentLba == lba && nExtentBlocks > 1) {
+                nBytesToWriteInCurrentBlock = (size_t)nExtentBlocks * kSFSBlockSize;
+                e1 = DiskCache_WriteBlocks(gDiskCache, self->diskDriver, lba, nExtentBlocks, pSrc);
+                SerenaFS_MarkFileBlocksDirty(pNode, blockIdx, nExtentBlocks);
+                didWriteRun = true;
+            }
+        }
+        if (e1 == EOK && !didWriteRun) {
+            AcquireBlock acquireMode;
+            DiskBlockRef pBlock;
+
+            if (nBytesToWriteInCurrentBlock == kSFSBlockSize) {
+                // Full block: no need to read in the old block contents
+                acquireMode = kAcquireBlock_Replace;
+            }
+            else if (lba >= newRunLba && lba < newRunEndLba) {
+                // Freshly allocated block: no old contents to preserve
+                acquireMode = kAcquireBlock_Cleared;
             }
             else {
-                e1 = DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba);
+                acquireMode = kAcquireBlock_Update;
+            }
+
+            e1 = DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, acquireMode, &pBlock);
+            if (e1 == EOK) {
+                memcpy(((uint8_t*)DiskBlock_GetMutableData(pBlock)) + blockOffset, pSrc, nBytesToWriteInCurrentBlock);
+                e1 = DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Deferred);
+                SerenaFS_MarkFileBlocksDirty(pNode, blockIdx, 1);
             }
         }
         if (e1 != EOK) {
             err = (nBytesWritten == 0) ? e1 : EOK;
             break;
         }
-        
-        memcpy(self->tmpBlock + blockOffset, ((const uint8_t*) pBuffer) + nBytesWritten, nBytesToWriteInCurrentBlock);
-        e1 = DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, lba);
-        if (e1 != EOK) {
-            err = (nBytesWritten == 0) ? e1 : EOK;
-            break;
-        }
 
         nBytesToWrite -= nBytesToWriteInCurrentBlock;
         nBytesWritten += nBytesToWriteInCurrentBlock;
@@ -695,17 +1511,51 @@ static errno_t SerenaFS_xWrite(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Loc
         }
         Inode_SetModified(pNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
     }
+
+    // Write back the allocation bitmap blocks that were touched by this write
+    const errno_t e2 = SerenaFS_FlushAllocationBitmap(self);
+    if (err == EOK && nBytesWritten == 0) {
+        err = e2;
+    }
     *pOutBytesWritten = nBytesWritten;
     return err;
 }
 
 
+// Sets or clears the IsConsistent attribute bit in the on-disk volume header.
+static errno_t SerenaFS_SetVolumeConsistent(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriver, bool isConsistent)
+{
+    decl_try_err();
+    DiskBlockRef pBlock;
+
+    try(DiskCache_AcquireBlock(gDiskCache, pDriver, 0, kAcquireBlock_Update, &pBlock));
+    SFSVolumeHeader* vhp = (SFSVolumeHeader*)DiskBlock_GetMutableData(pBlock);
+    uint32_t attributes = UInt32_BigToHost(vhp->attributes);
+
+    if (isConsistent) {
+        const TimeInterval curTime = MonotonicClock_GetCurrentTime();
+
+        attributes |= (1 << kSFSVolumeAttributeBit_IsConsistent);
+        vhp->modificationTime.tv_sec = UInt32_HostToBig(curTime.tv_sec);
+        vhp->modificationTime.tv_nsec = UInt32_HostToBig(curTime.tv_nsec);
+    }
+    else {
+        attributes &= ~(1 << kSFSVolumeAttributeBit_IsConsistent);
+    }
+    vhp->attributes = UInt32_HostToBig(attributes);
+    try(DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync));
+
+catch:
+    return err;
+}
+
 // Invoked when an instance of this file system is mounted. Note that the
 // kernel guarantees that no operations will be issued to the filesystem
 // before onMount() has returned with EOK.
 errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriver, const void* _Nonnull pParams, ssize_t paramsSize)
 {
     decl_try_err();
+    DiskBlockRef pBlock = NULL;
 
     Lock_Lock(&self->lock);
 
@@ -722,15 +1572,19 @@ errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriv
         throw(EIO);
     }
 
-    try(DiskDriver_GetBlock(pDriver, self->tmpBlock, 0));
-    const SFSVolumeHeader* vhp = (const SFSVolumeHeader*)self->tmpBlock;
+    try(DiskCache_AcquireBlock(gDiskCache, pDriver, 0, kAcquireBlock_ReadOnly, &pBlock));
+    const SFSVolumeHeader* vhp = (const SFSVolumeHeader*)DiskBlock_GetData(pBlock);
     const uint32_t signature = UInt32_BigToHost(vhp->signature);
     const uint32_t version = UInt32_BigToHost(vhp->version);
     const uint32_t blockSize = UInt32_BigToHost(vhp->blockSize);
     const uint32_t volumeBlockCount = UInt32_BigToHost(vhp->volumeBlockCount);
     const uint32_t allocationBitmapByteSize = UInt32_BigToHost(vhp->allocationBitmapByteSize);
+    const LogicalBlockAddress rootDirLba = UInt32_BigToHost(vhp->rootDirectoryLba);
+    const LogicalBlockAddress allocationBitmapLba = UInt32_BigToHost(vhp->allocationBitmapLba);
+    DiskCache_RelinquishBlock(gDiskCache, pBlock);
+    pBlock = NULL;
 
-    if (signature != kSFSSignature_SerenaFS || version != kSFSVersion_v0_1) {
+    if (signature != kSFSSignature_SerenaFS || version != kSFSVersion_v2_0) {
         throw(EIO);
     }
     if (blockSize != kSFSBlockSize || volumeBlockCount < kSFSVolume_MinBlockCount || allocationBitmapByteSize < 1) {
@@ -742,11 +1596,11 @@ errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriv
 
 
     // Cache the root directory info
-    self->rootDirLba = UInt32_BigToHost(vhp->rootDirectoryLba);
+    self->rootDirLba = rootDirLba;
 
 
     // Cache the allocation bitmap in RAM
-    self->allocationBitmapLba = UInt32_BigToHost(vhp->allocationBitmapLba);
+    self->allocationBitmapLba = allocationBitmapLba;
     self->allocationBitmapBlockCount = (allocBitmapByteSize + (diskBlockSize - 1)) / diskBlockSize;
     self->allocationBitmapByteSize = allocBitmapByteSize;
     self->volumeBlockCount = volumeBlockCount;
@@ -757,11 +1611,24 @@ errno_t SerenaFS_onMount(SerenaFSRef _Nonnull self, DiskDriverRef _Nonnull pDriv
     for (LogicalBlockAddress lba = 0; lba < self->allocationBitmapBlockCount; lba++) {
         const size_t nBytesToCopy = __min(kSFSBlockSize, allocBitmapByteSize);
 
-        try(DiskDriver_GetBlock(pDriver, self->tmpBlock, self->allocationBitmapLba + lba));
-        memcpy(pAllocBitmap, self->tmpBlock, nBytesToCopy);
+        try(DiskCache_AcquireBlock(gDiskCache, pDriver, self->allocationBitmapLba + lba, kAcquireBlock_ReadOnly, &pBlock));
+        memcpy(pAllocBitmap, DiskBlock_GetData(pBlock), nBytesToCopy);
+        DiskCache_RelinquishBlock(gDiskCache, pBlock);
+        pBlock = NULL;
         allocBitmapByteSize -= nBytesToCopy;
         pAllocBitmap += diskBlockSize;
     }
+    try(SerenaFS_BuildAllocationSummary(self));
+    try(kalloc_cleared(sizeof(bool) * self->allocationBitmapBlockCount, (void**)&self->allocationBitmapDirtyFlags));
+    self->isAllocationBitmapDirty = false;
+
+
+    // Mark the volume as in use. The IsConsistent bit is set again on unmount
+    // after everything has been written back to disk
+    // XXX we should do a consistency check if the bit isn't set at this point
+    if (!DiskDriver_IsReadOnly(pDriver)) {
+        try(SerenaFS_SetVolumeConsistent(self, pDriver, false));
+    }
 
 
     // Store the disk driver reference
@@ -790,12 +1657,36 @@ errno_t SerenaFS_onUnmount(SerenaFSRef _Nonnull self)
 
     // XXX make sure that there are no inodes in use anymore
 
-    // XXX flush all still cached file data to disk (synchronously)
+    // Write the cached file data and the allocation bitmap back to disk and
+    // then mark the volume as consistent. The latter must be the very last
+    // write to the disk
+    if (!DiskDriver_IsReadOnly(self->diskDriver)) {
+        err = DiskCache_Sync(gDiskCache, self->diskDriver);
+        if (err == EOK) {
+            err = SerenaFS_FlushAllocationBitmap(self);
+        }
+        if (err == EOK) {
+            err = SerenaFS_SetVolumeConsistent(self, self->diskDriver, true);
+        }
+    }
 
-    // XXX flush the allocation bitmap to disk (synchronously)
-    // XXX free the allocation bitmap and clear self->volumeBlockCount
+    kfree(self->allocationBitmap);
+    self->allocationBitmap = NULL;
+    kfree(self->allocationBitmapDirtyFlags);
+    self->allocationBitmapDirtyFlags = NULL;
+    self->isAllocationBitmapDirty = false;
+    kfree(self->allocationBitmapFreeCounts);
+    self->allocationBitmapFreeCounts = NULL;
+    self->freeBlockCount = 0;
+    self->volumeBlockCount = 0;
 
     // XXX clear rootDirLba
+
+    // Drop the cached blocks of the disk and the driver references they hold
+    const errno_t e1 = DiskCache_Purge(gDiskCache, self->diskDriver);
+    if (err == EOK) {
+        err = e1;
+    }
     
     Object_Release(self->diskDriver);
     self->diskDriver = NULL;
@@ -834,7 +1725,7 @@ catch:
 
 // Returns the root node of the filesystem if the filesystem is currently in
 // mounted state. Returns ENOENT and NULL if the filesystem is not mounted.
-errno_t SerenaFS_acquireRootNode(SerenaFSRef _Nonnull self, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t SerenaFS_acquireRootNode(SerenaFSRef _Nonnull self, InodeRef _Nullable * _Nonnull pOutNode)
 {
     return Filesystem_AcquireNodeWithId((FilesystemRef)self, self->rootDirLba, NULL, pOutNode);
 }
@@ -846,16 +1737,24 @@ errno_t SerenaFS_acquireRootNode(SerenaFSRef _Nonnull self, InodeRef _Nullable _
 // the root node of the filesystem and 'pComponent' is ".." then 'pParentNode'
 // should be returned. If the path component name is longer than what is
 // supported by the file system, ENAMETOOLONG should be returned.
-errno_t SerenaFS_acquireNodeForName(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pName, User user, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t SerenaFS_acquireNodeForName(SerenaFSRef _Nonnull self, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pName, User user, InodeRef _Nullable * _Nonnull pOutNode)
 {
     decl_try_err();
     SFSDirectoryQuery q;
     InodeId entryId;
 
-    try(SerenaFS_CheckAccess_Locked(self, pParentNode, user, kFilePermission_Execute));
-    q.kind = kSFSDirectoryQuery_PathComponent;
-    q.u.pc = pName;
-    try(SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, NULL, &entryId, NULL));
+    Inode_Lock(pParentNode);
+    err = SerenaFS_CheckAccess_Locked(self, pParentNode, user, kFilePermission_Execute);
+    if (err == EOK) {
+        q.kind = kSFSDirectoryQuery_PathComponent;
+        q.u.pc = pName;
+        err = SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, &entryId, NULL);
+    }
+    Inode_Unlock(pParentNode);
+    if (err != EOK) {
+        throw(err);
+    }
+
     try(Filesystem_AcquireNodeWithId((FilesystemRef)self, entryId, NULL, pOutNode));
     return EOK;
 
@@ -872,62 +1771,111 @@ catch:
 // contains 'id' and ENOENT otherwise. If the name of 'id' as stored in the
 // file system is > the capacity of the path component, then ERANGE should
 // be returned.
-errno_t SerenaFS_getNameOfNode(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pParentNode, InodeId id, User user, MutablePathComponent* _Nonnull pComponent)
+errno_t SerenaFS_getNameOfNode(SerenaFSRef _Nonnull self, InodeRef _Nonnull pParentNode, InodeId id, User user, MutablePathComponent* _Nonnull pComponent)
 {
     decl_try_err();
     SFSDirectoryQuery q;
 
+    Inode_Lock(pParentNode);
     try(SerenaFS_CheckAccess_Locked(self, pParentNode, user, kFilePermission_Read | kFilePermission_Execute));
     q.kind = kSFSDirectoryQuery_InodeId;
     q.u.id = id;
-    try(SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, NULL, NULL, pComponent));
+    try(SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, NULL, pComponent));
+    Inode_Unlock(pParentNode);
     return EOK;
 
 catch:
+    Inode_Unlock(pParentNode);
     pComponent->count = 0;
     return err;
 }
 
 // Returns a file info record for the given Inode. The Inode may be of any
 // file type.
-errno_t SerenaFS_getFileInfo(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileInfo* _Nonnull pOutInfo)
+errno_t SerenaFS_getFileInfo(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, FileInfo* _Nonnull pOutInfo)
 {
+    Inode_Lock(pNode);
     Inode_GetFileInfo(pNode, pOutInfo);
+    Inode_Unlock(pNode);
     return EOK;
 }
 
 // Modifies one or more attributes stored in the file info record of the given
 // Inode. The Inode may be of any type.
-errno_t SerenaFS_setFileInfo(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, MutableFileInfo* _Nonnull pInfo)
+errno_t SerenaFS_setFileInfo(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, User user, MutableFileInfo* _Nonnull pInfo)
 {
     decl_try_err();
 
     if (self->isReadOnly) {
-        throw(EROFS);
+        return EROFS;
     }
-    try(Inode_SetFileInfo(pNode, user, pInfo));
 
-catch:
+    Inode_Lock(pNode);
+    err = Inode_SetFileInfo(pNode, user, pInfo);
+    Inode_Unlock(pNode);
+
     return err;
 }
 
+// Removes the directory entry for the inode 'idToRemove' from the directory
+// 'pDirNode'. The space of the removed entry is merged into the entry that
+// precedes it in the same block. The entry is marked as unused if it is the
+// first entry in its block.
 static errno_t SerenaFS_RemoveDirectoryEntry(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode, InodeId idToRemove)
 {
     decl_try_err();
+    SFSInodeInfo* pInfo = Inode_GetInfo(pDirNode);
     SFSDirectoryEntryPointer mp;
     SFSDirectoryQuery q;
+    DiskBlockRef pBlock;
+    size_t blockOffset = 0;
+    size_t freeSize;
 
     q.kind = kSFSDirectoryQuery_InodeId;
     q.u.id = idToRemove;
-    try(SerenaFS_GetDirectoryEntry(self, pDirNode, &q, NULL, &mp, NULL, NULL));
+    try(SerenaFS_GetDirectoryEntry(self, pDirNode, &q, &mp, NULL, NULL));
 
-    try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, mp.lba));
-    SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(self->tmpBlock + mp.offset);
-    memset(dep, 0, sizeof(SFSDirectoryEntry));
-    try(DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, mp.lba));
+    try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, mp.lba, kAcquireBlock_Update, &pBlock));
+    uint8_t* pBlockData = (uint8_t*)DiskBlock_GetMutableData(pBlock);
+    SFSDirectoryEntry* pPrevEntry = NULL;
 
-    if (Inode_GetFileSize(pDirNode) - (FileOffset)sizeof(SFSDirectoryEntry) == mp.fileOffset) {
-        Inode_DecrementFileSize(pDirNode, sizeof(SFSDirectoryEntry));
+    while (blockOffset < mp.offset) {
+        pPrevEntry = (SFSDirectoryEntry*)(pBlockData + blockOffset);
+        if (!SFSDirectoryEntry_IsValid(pPrevEntry, blockOffset)) {
+            DiskCache_RelinquishBlock(gDiskCache, pBlock);
+            throw(EIO);
+        }
+        blockOffset += UInt16_BigToHost(pPrevEntry->recordLength);
+    }
+
+    SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(pBlockData + mp.offset);
+    if (pPrevEntry) {
+        pPrevEntry->recordLength = UInt16_HostToBig(UInt16_BigToHost(pPrevEntry->recordLength) + UInt16_BigToHost(dep->recordLength));
+    }
+    else {
+        dep->id = 0;
+        dep->nameLength = 0;
+    }
+    const errno_t freeSizeErr = SerenaFS_GetDirectoryBlockFreeSize(pBlockData, &freeSize);
+    try(DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync));
+
+
+    // Update the directory index
+    SFSDirectoryIndex* pIndex = pInfo->dirIndex;
+    if (pIndex) {
+        for (int i = 0; i < pIndex->count; i++) {
+            if (pIndex->entries[i].offset == (uint32_t)mp.fileOffset) {
+                DirectoryIndex_RemoveEntryAt(pIndex, i);
+                break;
+            }
+        }
+
+        if (freeSizeErr == EOK) {
+            pIndex->blockFreeSizes[mp.fileOffset >> (FileOffset)kSFSBlockSizeShift] = (uint16_t)freeSize;
+        }
+        else {
+            SerenaFS_DropDirectoryIndex(pInfo);
+        }
     }
 
     return EOK;
@@ -937,75 +1885,116 @@ catch:
 }
 
 // Inserts a new directory entry of the form (pName, id) into the directory node
-// 'pDirNode'. 'pEmptyEntry' is an optional insertion hint. If this pointer exists
-// then the directory entry that it points to will be reused for the new directory
-// entry; otherwise a completely new entry will be added to the directory.
+// 'pDirNode'. The new entry is placed in the first directory block that has
+// enough free space to store it. A new block is appended to the directory if
+// no such block exists.
 // NOTE: this function does not verify that the new entry is unique. The caller
 // has to ensure that it doesn't try to add a duplicate entry to the directory.
-static errno_t SerenaFS_InsertDirectoryEntry(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode, const PathComponent* _Nonnull pName, InodeId id, SFSDirectoryEntryPointer* _Nullable pEmptyPtr)
+static errno_t SerenaFS_InsertDirectoryEntry(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode, const PathComponent* _Nonnull pName, InodeId id)
 {
     decl_try_err();
+    SFSInodeInfo* pInfo = Inode_GetInfo(pDirNode);
+    SFSDirectoryIndex* pIndex;
+    DiskBlockRef pBlock;
+    FileOffset entryOffset;
+    size_t freeSize;
 
     if (pName->count > kSFSMaxFilenameLength) {
         return ENAMETOOLONG;
     }
 
-    if (pEmptyPtr && pEmptyPtr->lba > 0) {
-        // Reuse an empty entry
-        try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, pEmptyPtr->lba));
-        SFSDirectoryEntry* dep = (SFSDirectoryEntry*)(self->tmpBlock + pEmptyPtr->offset);
+    const size_t recLen = SFSDirectoryEntry_GetRecordLength(pName->count);
+
+    // The inode 'id' may have just been allocated. Make sure that its block is
+    // marked as allocated on disk before a directory entry references it
+    try(SerenaFS_FlushAllocationBitmap(self));
+    try(SerenaFS_GetDirectoryIndex(self, pDirNode, &pIndex));
 
-        char* p = String_CopyUpTo(dep->filename, pName->name, pName->count);
-        while (p < &dep->filename[kSFSMaxFilenameLength]) *p++ = '\0';
+    const int blockIdx = DirectoryIndex_FindBlockWithFreeSize(pIndex, recLen);
+    if (blockIdx >= 0) {
+        // Claim the free space at the end of an existing entry
+        LogicalBlockAddress lba;
+        size_t blockOffset = 0;
+
+        try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pDirNode, blockIdx, kSFSBlockMode_Read, &lba));
+        if (lba == 0) {
+            throw(EIO);
+        }
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, kAcquireBlock_Update, &pBlock));
+        uint8_t* pBlockData = (uint8_t*)DiskBlock_GetMutableData(pBlock);
+        SFSDirectoryEntry* dep = (SFSDirectoryEntry*)pBlockData;
+
+        while (blockOffset < kSFSBlockSize && SFSDirectoryEntry_IsValid(dep, blockOffset) && SFSDirectoryEntry_GetFreeSize(dep) < recLen) {
+            blockOffset += UInt16_BigToHost(dep->recordLength);
+            dep = (SFSDirectoryEntry*)(pBlockData + blockOffset);
+        }
+        if (blockOffset >= kSFSBlockSize || !SFSDirectoryEntry_IsValid(dep, blockOffset)) {
+            DiskCache_RelinquishBlock(gDiskCache, pBlock);
+            SerenaFS_DropDirectoryIndex(pInfo);
+            throw(EIO);
+        }
+
+        if (dep->id > 0) {
+            // Split the entry and put the new entry into its free space
+            const size_t usedLen = SFSDirectoryEntry_GetRecordLength(dep->nameLength);
+            const size_t freeLen = UInt16_BigToHost(dep->recordLength) - usedLen;
+
+            dep->recordLength = UInt16_HostToBig(usedLen);
+            blockOffset += usedLen;
+            dep = (SFSDirectoryEntry*)(pBlockData + blockOffset);
+            dep->recordLength = UInt16_HostToBig(freeLen);
+        }
         dep->id = UInt32_HostToBig(id);
+        dep->nameLength = (uint8_t)pName->count;
+        dep->reserved = 0;
+        memcpy(dep->filename, pName->name, pName->count);
 
-        try(DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, pEmptyPtr->lba));
+        entryOffset = ((FileOffset)blockIdx << (FileOffset)kSFSBlockSizeShift) + (FileOffset)blockOffset;
+        const errno_t freeSizeErr = SerenaFS_GetDirectoryBlockFreeSize(pBlockData, &freeSize);
+        try(DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync));
+
+        if (freeSizeErr == EOK) {
+            pIndex->blockFreeSizes[blockIdx] = (uint16_t)freeSize;
+        }
+        else {
+            SerenaFS_DropDirectoryIndex(pInfo);
+        }
     }
     else {
-        // Append a new entry
-        SFSBlockMap* pBlockMap = Inode_GetBlockMap(pDirNode);
+        // Append a new block with the new entry covering the whole block
         const FileOffset size = Inode_GetFileSize(pDirNode);
-        const int remainder = size & kSFSBlockSizeMask;
-        SFSDirectoryEntry* dep;
+        const int newBlockIdx = (int)(size >> (FileOffset)kSFSBlockSizeShift);     //XXX blockIdx should be 64bit
         LogicalBlockAddress lba;
-        int idx = -1;
 
-        if (remainder > 0) {
-            idx = size / kSFSBlockSize;
-            lba = pBlockMap->p[idx];
+        try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pDirNode, newBlockIdx, kSFSBlockMode_Write, &lba));
+        try(SerenaFS_FlushAllocationBitmap(self));
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, kAcquireBlock_Cleared, &pBlock));
 
-            try(DiskDriver_GetBlock(self->diskDriver, self->tmpBlock, lba));
-            dep = (SFSDirectoryEntry*)(self->tmpBlock + remainder);
-        }
-        else {
-            for (int i = 0; i < kSFSMaxDirectDataBlockPointers; i++) {
-                if (pBlockMap->p[i] == 0) {
-                    idx = i;
-                    break;
-                }
-            }
-            if (idx == -1) {
-                throw(EIO);
-            }
+        SFSDirectoryEntry* dep = (SFSDirectoryEntry*)DiskBlock_GetMutableData(pBlock);
+        dep->id = UInt32_HostToBig(id);
+        dep->recordLength = UInt16_HostToBig(kSFSBlockSize);
+        dep->nameLength = (uint8_t)pName->count;
+        memcpy(dep->filename, pName->name, pName->count);
+        try(DiskCache_RelinquishBlockWriting(gDiskCache, pBlock, kWriteBlock_Sync));
 
-            try(SerenaFS_AllocateBlock_Locked(self, &lba));
-            memset(self->tmpBlock, 0, kSFSBlockSize);
-            dep = (SFSDirectoryEntry*)self->tmpBlock;
+        Inode_IncrementFileSize(pDirNode, kSFSBlockSize);
+        entryOffset = size;
+
+        if (DirectoryIndex_AppendBlock(pIndex, kSFSBlockSize - recLen) != EOK) {
+            SerenaFS_DropDirectoryIndex(pInfo);
         }
+    }
 
-        String_CopyUpTo(dep->filename, pName->name, pName->count);
-        dep->id = UInt32_HostToBig(id);
-        try(DiskDriver_PutBlock(self->diskDriver, self->tmpBlock, lba));
-        pBlockMap->p[idx] = lba;
 
-        Inode_IncrementFileSize(pDirNode, sizeof(SFSDirectoryEntry));
+    // Add the new entry to the directory index
+    pIndex = pInfo->dirIndex;
+    if (pIndex && DirectoryIndex_InsertEntry(pIndex, SerenaFS_HashName(pName->name, pName->count), id, (uint32_t)entryOffset) != EOK) {
+        SerenaFS_DropDirectoryIndex(pInfo);
     }
 
 
     // Mark the directory as modified
-    if (err == EOK) {
-        Inode_SetModified(pDirNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
-    }
+    Inode_SetModified(pDirNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
 
 catch:
     return err;
@@ -1019,8 +2008,8 @@ static errno_t SerenaFS_CreateDirectoryDiskNode(SerenaFSRef _Nonnull self, Inode
     try(Filesystem_AllocateNode((FilesystemRef)self, kFileType_Directory, uid, gid, permissions, NULL, &pDirNode));
     const InodeId id = Inode_GetId(pDirNode);
 
-    try(SerenaFS_InsertDirectoryEntry(self, pDirNode, &kPathComponent_Self, id, NULL));
-    try(SerenaFS_InsertDirectoryEntry(self, pDirNode, &kPathComponent_Parent, (parentId > 0) ? parentId : id, NULL));
+    try(SerenaFS_InsertDirectoryEntry(self, pDirNode, &kPathComponent_Self, id));
+    try(SerenaFS_InsertDirectoryEntry(self, pDirNode, &kPathComponent_Parent, (parentId > 0) ? parentId : id));
 
     Filesystem_RelinquishNode((FilesystemRef)self, pDirNode);
     *pOutId = id;
@@ -1035,10 +2024,12 @@ catch:
 // Creates an empty directory as a child of the given directory node and with
 // the given name, user and file permissions. Returns EEXIST if a node with
 // the given name already exists.
-errno_t SerenaFS_createDirectory(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, User user, FilePermissions permissions)
+errno_t SerenaFS_createDirectory(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, User user, FilePermissions permissions)
 {
     decl_try_err();
 
+    Inode_Lock(pParentNode);
+
     // 'pParentNode' must be a directory
     if (!Inode_IsDirectory(pParentNode)) {
         throw(ENOTDIR);
@@ -1050,13 +2041,11 @@ errno_t SerenaFS_createDirectory(SerenaFSRef _Nonnull self, const PathComponent*
 
 
     // Make sure that 'pParentNode' doesn't already have an entry with name 'pName'.
-    // Also figure out whether there's an empty entry that we can reuse.
-    SFSDirectoryEntryPointer ep;
     SFSDirectoryQuery q;
 
     q.kind = kSFSDirectoryQuery_PathComponent;
     q.u.pc = pName;
-    err = SerenaFS_GetDirectoryEntry(self, pParentNode, &q, &ep, NULL, NULL, NULL);
+    err = SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, NULL, NULL);
     if (err == ENOENT) {
         err = EOK;
     } else if (err == EOK) {
@@ -1069,22 +2058,31 @@ errno_t SerenaFS_createDirectory(SerenaFSRef _Nonnull self, const PathComponent*
     // Create the new directory and add it to its parent directory
     InodeId newDirId = 0;
     try(SerenaFS_CreateDirectoryDiskNode(self, Inode_GetId(pParentNode), user.uid, user.gid, permissions, &newDirId));
-    try(SerenaFS_InsertDirectoryEntry(self, pParentNode, pName, newDirId, &ep));
+    try(SerenaFS_InsertDirectoryEntry(self, pParentNode, pName, newDirId));
+
+    // Drop a negative name cache entry while we still hold the directory lock.
+    // A concurrent lookup can not re-enter it because that bumps the generation
+    NameCache_RemoveName(gNameCache, Filesystem_GetId(self), Inode_GetId(pParentNode), pName);
+    Inode_Unlock(pParentNode);
     return EOK;
 
 catch:
     // XXX Unlink new dir disk node
+    Inode_Unlock(pParentNode);
     return err;
 }
 
 // Opens the directory represented by the given node. Returns a directory
 // descriptor object which is the I/O channel that allows you to read the
 // directory content.
-errno_t SerenaFS_openDirectory(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pDirNode, User user, DirectoryRef _Nullable * _Nonnull pOutDir)
+errno_t SerenaFS_openDirectory(SerenaFSRef _Nonnull self, InodeRef _Nonnull pDirNode, User user, DirectoryRef _Nullable * _Nonnull pOutDir)
 {
     decl_try_err();
 
-    try(Inode_CheckAccess(pDirNode, user, kFilePermission_Read));
+    Inode_Lock(pDirNode);
+    err = Inode_CheckAccess(pDirNode, user, kFilePermission_Read);
+    Inode_Unlock(pDirNode);
+    try(err);
     try(Directory_Create((FilesystemRef)self, pDirNode, pOutDir));
 
 catch:
@@ -1094,44 +2092,84 @@ catch:
 errno_t SerenaFS_readDirectory(SerenaFSRef _Nonnull self, DirectoryRef _Nonnull pDir, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
     decl_try_err();
-    InodeRef _Locked pNode = Directory_GetInode(pDir);
-    FileOffset offset = Directory_GetOffset(pDir);
-    SFSDirectoryEntry dirent;
-    ssize_t nAllDirBytesRead = 0;
+    InodeRef pNode = Directory_GetInode(pDir);
+    DiskBlockRef pBlock = NULL;
     ssize_t nBytesRead = 0;
 
-    while (nBytesToRead > 0) {
-        ssize_t nDirBytesRead;
-        const errno_t e1 = SerenaFS_xRead(self, pNode, offset, &dirent, sizeof(SFSDirectoryEntry), &nDirBytesRead);
+    Inode_Lock(pNode);
+    const FileOffset fileSize = Inode_GetFileSize(pNode);
+    const FileOffset startOffset = Directory_GetOffset(pDir);
+    FileOffset offset = startOffset;
 
-        if (e1 != EOK) {
-            err = (nBytesRead == 0) ? e1 : EOK;
-            break;
+    while (nBytesToRead >= sizeof(DirectoryEntry) && offset < fileSize) {
+        const int blockIdx = (int)(offset >> (FileOffset)kSFSBlockSizeShift);
+        size_t blockOffset = offset & (FileOffset)kSFSBlockSizeMask;
+        LogicalBlockAddress lba;
+
+        try(SerenaFS_GetLogicalBlockAddressForFileBlockAddress(self, pNode, blockIdx, kSFSBlockMode_Read, &lba));
+        if (lba == 0) {
+            // Directories don't have holes. Skip the block if it is missing anyway
+            offset += (FileOffset)(kSFSBlockSize - blockOffset);
+            continue;
         }
-        else if (nDirBytesRead == 0) {
-            break;
+
+        try(DiskCache_AcquireBlock(gDiskCache, self->diskDriver, lba, kAcquireBlock_ReadOnly, &pBlock));
+        const uint8_t* pBlockData = (const uint8_t*)DiskBlock_GetData(pBlock);
+
+        // The saved offset points inside of a record if the record that started
+        // there was merged into its predecessor after the offset was saved.
+        // Resynchronize with the record boundaries by walking the block from
+        // its start. This skips the removed entry
+        if (blockOffset > 0) {
+            size_t recOffset = 0;
+
+            while (recOffset < blockOffset) {
+                const SFSDirectoryEntry* dep = (const SFSDirectoryEntry*)(pBlockData + recOffset);
+
+                if (!SFSDirectoryEntry_IsValid(dep, recOffset)) {
+                    throw(EIO);
+                }
+                recOffset += UInt16_BigToHost(dep->recordLength);
+            }
+            offset += (FileOffset)(recOffset - blockOffset);
+            blockOffset = recOffset;
         }
 
-        if (dirent.id > 0) {
-            DirectoryEntry* pEntry = (DirectoryEntry*)((uint8_t*)pBuffer + nBytesRead);
+        while (blockOffset < kSFSBlockSize && nBytesToRead >= sizeof(DirectoryEntry)) {
+            const SFSDirectoryEntry* dep = (const SFSDirectoryEntry*)(pBlockData + blockOffset);
+            const size_t recLen = UInt16_BigToHost(dep->recordLength);
 
-            if (nBytesToRead < sizeof(DirectoryEntry)) {
-                break;
+            if (!SFSDirectoryEntry_IsValid(dep, blockOffset)) {
+                throw(EIO);
+            }
+
+            if (dep->id > 0) {
+                DirectoryEntry* pEntry = (DirectoryEntry*)((uint8_t*)pBuffer + nBytesRead);
+
+                pEntry->inodeId = UInt32_BigToHost(dep->id);
+                memcpy(pEntry->name, dep->filename, dep->nameLength);
+                pEntry->name[dep->nameLength] = '\0';
+                nBytesRead += sizeof(DirectoryEntry);
+                nBytesToRead -= sizeof(DirectoryEntry);
             }
 
-            pEntry->inodeId = UInt32_BigToHost(dirent.id);
-            String_CopyUpTo(pEntry->name, dirent.filename, kSFSMaxFilenameLength);
-            nBytesRead += sizeof(DirectoryEntry);
-            nBytesToRead -= sizeof(DirectoryEntry);
+            blockOffset += recLen;
+            offset += (FileOffset)recLen;
         }
 
-        offset += nDirBytesRead;
-        nAllDirBytesRead += nDirBytesRead;
+        DiskCache_RelinquishBlock(gDiskCache, pBlock);
+        pBlock = NULL;
     }
 
+catch:
+    DiskCache_RelinquishBlock(gDiskCache, pBlock);
     if (nBytesRead > 0) {
-        Directory_IncrementOffset(pDir, nAllDirBytesRead);
+        err = EOK;
     }
+    if (err == EOK) {
+        Directory_IncrementOffset(pDir, offset - startOffset);
+    }
+    Inode_Unlock(pNode);
     *nOutBytesRead = nBytesRead;
 
     return err;
@@ -1143,10 +2181,13 @@ errno_t SerenaFS_readDirectory(SerenaFSRef _Nonnull self, DirectoryRef _Nonnull
 // the mode is exclusive then the file is created if it doesn't exist and
 // an error is thrown if the file exists. Note that the file is not opened.
 // This must be done by calling the open() method.
-errno_t SerenaFS_createFile(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, User user, unsigned int options, FilePermissions permissions, InodeRef _Nullable _Locked * _Nonnull pOutNode)
+errno_t SerenaFS_createFile(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, User user, unsigned int options, FilePermissions permissions, InodeRef _Nullable * _Nonnull pOutNode)
 {
     decl_try_err();
 
+    *pOutNode = NULL;
+    Inode_Lock(pParentNode);
+
     // 'pParentNode' must be a directory
     if (!Inode_IsDirectory(pParentNode)) {
         throw(ENOTDIR);
@@ -1158,14 +2199,12 @@ errno_t SerenaFS_createFile(SerenaFSRef _Nonnull self, const PathComponent* _Non
 
 
     // Make sure that 'pParentNode' doesn't already have an entry with name 'pName'.
-    // Also figure out whether there's an empty entry that we can reuse.
     InodeId existingFileId;
-    SFSDirectoryEntryPointer ep;
     SFSDirectoryQuery q;
 
     q.kind = kSFSDirectoryQuery_PathComponent;
     q.u.pc = pName;
-    err = SerenaFS_GetDirectoryEntry(self, pParentNode, &q, &ep, NULL, &existingFileId, NULL);
+    err = SerenaFS_GetDirectoryEntry(self, pParentNode, &q, NULL, &existingFileId, NULL);
     if (err == ENOENT) {
         err = EOK;
     } else if (err == EOK) {
@@ -1176,10 +2215,13 @@ errno_t SerenaFS_createFile(SerenaFSRef _Nonnull self, const PathComponent* _Non
         else {
             // Non-exclusive mode: File already exists -> acquire it and let the caller open it
             try(Filesystem_AcquireNodeWithId((FilesystemRef)self, existingFileId, NULL, pOutNode));
+            Inode_Unlock(pParentNode);
 
             // Truncate the file to length 0, if requested
             if ((options & kOpen_Truncate) == kOpen_Truncate) {
+                Inode_Lock(*pOutNode);
                 SerenaFS_xTruncateFile(self, *pOutNode, 0);
+                Inode_Unlock(*pOutNode);
             }
 
             return EOK;
@@ -1191,12 +2233,15 @@ errno_t SerenaFS_createFile(SerenaFSRef _Nonnull self, const PathComponent* _Non
 
     // Create the new file and add it to its parent directory
     try(Filesystem_AllocateNode((FilesystemRef)self, kFileType_RegularFile, user.uid, user.gid, permissions, NULL, pOutNode));
-    try(SerenaFS_InsertDirectoryEntry(self, pParentNode, pName, Inode_GetId(*pOutNode), &ep));
+    try(SerenaFS_InsertDirectoryEntry(self, pParentNode, pName, Inode_GetId(*pOutNode)));
+    NameCache_RemoveName(gNameCache, Filesystem_GetId(self), Inode_GetId(pParentNode), pName);
+    Inode_Unlock(pParentNode);
 
     return EOK;
 
 catch:
     // XXX Unlink new file disk node if necessary
+    Inode_Unlock(pParentNode);
     return err;
 }
 
@@ -1205,11 +2250,13 @@ catch:
 // maintains state that is specific to this connection. This state will be
 // protected by the resource's internal locking mechanism. 'pNode' represents
 // the named resource instance that should be represented by the I/O channel.
-errno_t SerenaFS_open(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, unsigned int mode, User user, FileRef _Nullable * _Nonnull pOutFile)
+errno_t SerenaFS_open(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, unsigned int mode, User user, FileRef _Nullable * _Nonnull pOutFile)
 {
     decl_try_err();
     FilePermissions permissions = 0;
 
+    Inode_Lock(pNode);
+
     if (Inode_IsDirectory(pNode)) {
         throw(EISDIR);
     }
@@ -1232,6 +2279,7 @@ errno_t SerenaFS_open(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode
     }
     
 catch:
+    Inode_Unlock(pNode);
     return err;
 }
 
@@ -1253,23 +2301,26 @@ errno_t SerenaFS_close(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile)
 
 errno_t SerenaFS_read(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile, void* _Nonnull pBuffer, ssize_t nBytesToRead, ssize_t* _Nonnull nOutBytesRead)
 {
-    InodeRef _Locked pNode = File_GetInode(pFile);
+    InodeRef pNode = File_GetInode(pFile);
 
+    Inode_Lock(pNode);
     const errno_t err = SerenaFS_xRead(self, 
         pNode, 
         File_GetOffset(pFile),
         pBuffer,
         nBytesToRead,
         nOutBytesRead);
+    Inode_Unlock(pNode);
     File_IncrementOffset(pFile, *nOutBytesRead);
     return err;
 }
 
 errno_t SerenaFS_write(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile, const void* _Nonnull pBuffer, ssize_t nBytesToWrite, ssize_t* _Nonnull nOutBytesWritten)
 {
-    InodeRef _Locked pNode = File_GetInode(pFile);
+    InodeRef pNode = File_GetInode(pFile);
     FileOffset offset;
 
+    Inode_Lock(pNode);
     if (File_IsAppendOnWrite(pFile)) {
         offset = Inode_GetFileSize(pNode);
     } else {
@@ -1282,26 +2333,94 @@ errno_t SerenaFS_write(SerenaFSRef _Nonnull self, FileRef _Nonnull pFile, const
         pBuffer,
         nBytesToWrite,
         nOutBytesWritten);
+    Inode_Unlock(pNode);
     File_IncrementOffset(pFile, *nOutBytesWritten);
     return err;
 }
 
-// Internal file truncation function. Shortens the file 'pNode' to the new and
-// smaller size 'length'. Does not support increasing the size of a file.
-static void SerenaFS_xTruncateFile(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset length)
+// Deallocates the data blocks referenced by the pointer block '*pLba', starting
+// with the block pointer at index 'firstIdx'. The pointer block itself is
+// deallocated too and '*pLba' is set to 0 if 'firstIdx' is 0.
+static void SerenaFS_DeallocatePointerBlockEntries_Locked(SerenaFSRef _Nonnull self, SFSPointerBlock* _Nullable * _Nonnull pCache, LogicalBlockAddress* _Nonnull pLba, int firstIdx)
 {
-    const FileOffset oldLength = Inode_GetFileSize(pNode);
-    const FileOffset oldLengthRoundedUpToBlockBoundary = __Ceil_PowerOf2(oldLength, kSFSBlockSize);
-    const int firstBlockIdx = (int)(oldLengthRoundedUpToBlockBoundary >> (FileOffset)kSFSBlockSizeShift);    //XXX blockIdx should be 64bit
-    SFSBlockMap* pBlockMap = Inode_GetBlockMap(pNode);
+    SFSPointerBlock* pb;
+
+    // XXX check for error here?
+    if (SerenaFS_GetPointerBlock(self, pCache, pLba, kSFSBlockMode_Read, &pb) != EOK || pb == NULL) {
+        return;
+    }
+
+    for (int i = firstIdx; i < kSFSBlockPointersPerBlock; i++) {
+        if (pb->p[i] != 0) {
+            SerenaFS_DeallocateBlock(self, pb->p[i]);
+            pb->p[i] = 0;
+            pb->isDirty = true;
+        }
+    }
+
+    if (firstIdx == 0) {
+        SerenaFS_DeallocateBlock(self, *pLba);
+        pb->lba = 0;
+        pb->isDirty = false;
+        *pLba = 0;
+    }
+}
 
-    for (int i = firstBlockIdx; i < kSFSMaxDirectDataBlockPointers; i++) {
+// Deallocates all data blocks of the file 'pNode' starting with the file block
+// 'firstBlockIdx'. Pointer blocks that no longer map any data blocks are
+// deallocated as well.
+static void SerenaFS_DeallocateFileBlocks_Locked(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int firstBlockIdx)
+{
+    SFSInodeInfo* pInfo = Inode_GetInfo(pNode);
+    SFSBlockMap* pBlockMap = &pInfo->blockMap;
+    int fba = firstBlockIdx;
+
+    for (int i = fba; i < kSFSMaxDirectDataBlockPointers; i++) {
         if (pBlockMap->p[i] != 0) {
             // XXX locking
-            SerenaFS_DeallocateBlock_Locked(self, pBlockMap->p[i]);
+            SerenaFS_DeallocateBlock(self, pBlockMap->p[i]);
             pBlockMap->p[i] = 0;
         }
     }
+    fba = __max(fba - kSFSMaxDirectDataBlockPointers, 0);
+
+
+    SerenaFS_DeallocatePointerBlockEntries_Locked(self, &pInfo->indirect, &pBlockMap->indirect, fba);
+    fba = __max(fba - kSFSMaxIndirectDataBlockPointers, 0);
+
+
+    SFSPointerBlock* pb1;
+    if (SerenaFS_GetPointerBlock(self, &pInfo->doubleIndirect, &pBlockMap->doubleIndirect, kSFSBlockMode_Read, &pb1) == EOK && pb1) {
+        const int firstL1Idx = fba >> kSFSBlockPointersPerBlockShift;
+
+        for (int i = firstL1Idx; i < kSFSBlockPointersPerBlock; i++) {
+            if (pb1->p[i] != 0) {
+                const int firstL2Idx = (i == firstL1Idx) ? (fba & kSFSBlockPointersPerBlockMask) : 0;
+
+                SerenaFS_DeallocatePointerBlockEntries_Locked(self, &pInfo->doubleIndirectL2, &pb1->p[i], firstL2Idx);
+                if (pb1->p[i] == 0) {
+                    pb1->isDirty = true;
+                }
+            }
+        }
+
+        if (fba == 0) {
+            SerenaFS_DeallocateBlock(self, pBlockMap->doubleIndirect);
+            pb1->lba = 0;
+            pb1->isDirty = false;
+            pBlockMap->doubleIndirect = 0;
+        }
+    }
+}
+
+// Internal file truncation function. Shortens the file 'pNode' to the new and
+// smaller size 'length'. Does not support increasing the size of a file.
+static void SerenaFS_xTruncateFile(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset length)
+{
+    const FileOffset lengthRoundedUpToBlockBoundary = __Ceil_PowerOf2(length, kSFSBlockSize);
+    const int firstBlockIdx = (int)(lengthRoundedUpToBlockBoundary >> (FileOffset)kSFSBlockSizeShift);    //XXX blockIdx should be 64bit
+
+    SerenaFS_DeallocateFileBlocks_Locked(self, pNode, firstBlockIdx);
 
     Inode_SetFileSize(pNode, length);
     Inode_SetModified(pNode, kInodeFlag_Updated | kInodeFlag_StatusChanged);
@@ -1314,10 +2433,12 @@ static void SerenaFS_xTruncateFile(SerenaFSRef _Nonnull self, InodeRef _Nonnull
 // old length. Note that a filesystem implementation is free to defer the
 // actual allocation of the new blocks until an attempt is made to read or
 // write them.
-errno_t SerenaFS_truncate(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, FileOffset length)
+errno_t SerenaFS_truncate(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, User user, FileOffset length)
 {
     decl_try_err();
 
+    Inode_Lock(pNode);
+
     if (Inode_IsDirectory(pNode)) {
         throw(EISDIR);
     }
@@ -1343,14 +2464,16 @@ errno_t SerenaFS_truncate(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked p
     }
 
 catch:
+    Inode_Unlock(pNode);
     return err;
 }
 
 // Verifies that the given node is accessible assuming the given access mode.
-errno_t SerenaFS_checkAccess(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, User user, int mode)
+errno_t SerenaFS_checkAccess(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, User user, int mode)
 {
     decl_try_err();
 
+    Inode_Lock(pNode);
     if ((mode & kAccess_Readable) == kAccess_Readable) {
         err = Inode_CheckAccess(pNode, user, kFilePermission_Read);
     }
@@ -1360,6 +2483,7 @@ errno_t SerenaFS_checkAccess(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locke
     if (err == EOK && ((mode & kAccess_Executable) == kAccess_Executable)) {
         err = Inode_CheckAccess(pNode, user, kFilePermission_Execute);
     }
+    Inode_Unlock(pNode);
 
     return err;
 }
@@ -1370,22 +2494,30 @@ errno_t SerenaFS_checkAccess(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locke
 // node of the filesystem.
 // This function must validate that that if 'pNode' is a directory, that the
 // directory is empty (contains nothing except "." and "..").
-errno_t SerenaFS_unlink(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNodeToUnlink, InodeRef _Nonnull _Locked pParentNode, User user)
+errno_t SerenaFS_unlink(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNodeToUnlink, InodeRef _Nonnull pParentNode, User user)
 {
     decl_try_err();
 
+    // The parent directory is locked before its child
+    if (pNodeToUnlink == pParentNode) {
+        return EBUSY;
+    }
+    Inode_Lock(pParentNode);
+    Inode_Lock(pNodeToUnlink);
+
     // We must have write permissions for 'pParentNode'
     try(SerenaFS_CheckAccess_Locked(self, pParentNode, user, kFilePermission_Write));
 
 
     // A directory must be empty in order to be allowed to unlink it
-    if (Inode_IsDirectory(pNodeToUnlink) && !DirectoryNode_IsEmpty(pNodeToUnlink)) {
+    if (Inode_IsDirectory(pNodeToUnlink) && !SerenaFS_IsDirectoryEmpty(self, pNodeToUnlink)) {
         throw(EBUSY);
     }
 
 
     // Remove the directory entry in the parent directory
     try(SerenaFS_RemoveDirectoryEntry(self, pParentNode, Inode_GetId(pNodeToUnlink)));
+    NameCache_RemoveChild(gNameCache, Filesystem_GetId(self), Inode_GetId(pParentNode), Inode_GetId(pNodeToUnlink));
     SerenaFS_xTruncateFile(self, pParentNode, Inode_GetFileSize(pParentNode));
 
 
@@ -1394,13 +2526,15 @@ errno_t SerenaFS_unlink(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNo
     Inode_SetModified(pNodeToUnlink, kInodeFlag_StatusChanged);
 
 catch:
+    Inode_Unlock(pNodeToUnlink);
+    Inode_Unlock(pParentNode);
     return err;
 }
 
 // Renames the node with name 'pName' and which is an immediate child of the
 // node 'pParentNode' such that it becomes a child of 'pNewParentNode' with
 // the name 'pNewName'. All nodes are guaranteed to be owned by the filesystem.
-errno_t SerenaFS_rename(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull _Locked pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull _Locked pNewParentNode, User user)
+errno_t SerenaFS_rename(SerenaFSRef _Nonnull self, const PathComponent* _Nonnull pName, InodeRef _Nonnull pParentNode, const PathComponent* _Nonnull pNewName, InodeRef _Nonnull pNewParentNode, User user)
 {
     // XXX implement me
     return EACCESS;
@@ -1413,6 +2547,7 @@ OVERRIDE_METHOD_IMPL(onAllocateNodeOnDisk, SerenaFS, Filesystem)
 OVERRIDE_METHOD_IMPL(onReadNodeFromDisk, SerenaFS, Filesystem)
 OVERRIDE_METHOD_IMPL(onWriteNodeToDisk, SerenaFS, Filesystem)
 OVERRIDE_METHOD_IMPL(onRemoveNodeFromDisk, SerenaFS, Filesystem)
+OVERRIDE_METHOD_IMPL(onDestroyNode, SerenaFS, Filesystem)
 OVERRIDE_METHOD_IMPL(onMount, SerenaFS, Filesystem)
 OVERRIDE_METHOD_IMPL(onUnmount, SerenaFS, Filesystem)
 OVERRIDE_METHOD_IMPL(acquireRootNode, SerenaFS, Filesystem)
@@ -28,4 +28,8 @@ extern errno_t SerenaFS_FormatDrive(DiskDriverRef _Nonnull pDriver, User user, F
 // survive system restarts.
 errno_t SerenaFS_Create(SerenaFSRef _Nullable * _Nonnull pOutSelf);
 
+// Returns the number of free blocks on the mounted volume. Returns 0 if the
+// filesystem isn't mounted.
+extern LogicalBlockCount SerenaFS_GetFreeBlockCount(SerenaFSRef _Nonnull self);
+
 #endif /* SerenaFS_h */
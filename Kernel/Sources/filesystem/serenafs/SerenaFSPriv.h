@@ -11,6 +11,7 @@
 
 #include "SerenaFS.h"
 #include "VolumeFormat.h"
+#include <filesystem/DiskCache.h>
 #include <dispatcher/ConditionVariable.h>
 #include <dispatcher/Lock.h>
 #include <driver/MonotonicClock.h>
@@ -34,12 +35,65 @@ typedef struct SFSDirectoryQuery {
 } SFSDirectoryQuery;
 
 
+// In-core directory index entry. Maps the hash of a directory entry name to the
+// inode id and the location of the directory entry in the directory file.
+typedef struct SFSDirectoryIndexEntry {
+    uint32_t    hash;
+    InodeId     id;
+    uint32_t    offset;     // Byte offset of the directory entry relative to the start of the directory file
+} SFSDirectoryIndexEntry;
+
+// In-core directory index. The index is built from the directory content the
+// first time that a directory is searched and it is kept up to date as entries
+// are added and removed. The entries are sorted by name hash which allows us
+// to look up a name with a binary search instead of a scan over the whole
+// directory. The index also remembers the size of the largest free space in
+// each directory block so that an insertion can go straight to a block that
+// is able to hold the new entry. The index is never written to disk.
+typedef struct SFSDirectoryIndex {
+    SFSDirectoryIndexEntry* _Nullable   entries;
+    int                                 count;
+    int                                 capacity;
+    uint16_t* _Nullable                 blockFreeSizes;     // Size in bytes of the largest free space in each directory block
+    int                                 blockCount;
+    int                                 blockCapacity;
+} SFSDirectoryIndex;
+
+
 //
 // Inode Extensions
 //
 
+// In-core copy of a pointer block. The block pointers are stored in host byte
+// order.
+typedef struct SFSPointerBlock {
+    LogicalBlockAddress lba;        // LBA of the cached pointer block; 0 if the cache entry is empty
+    bool                isDirty;    // true if the cached pointer block has to be written back to disk
+    uint32_t            p[kSFSBlockPointersPerBlock];
+} SFSPointerBlock;
+
+// Filesystem specific inode state. Holds the inode block map in host byte order
+// and a small cache of the most recently used indirect pointer blocks. The cache
+// entries are allocated on demand. They ensure that a sequential read or write
+// only has to fetch a pointer block once per kSFSBlockPointersPerBlock file
+// blocks rather than once per file block. Dirty pointer blocks are written back
+// when the inode is written back. So are the file blocks in the range of blocks
+// that have been written with a deferred write. Protected by the inode lock.
+typedef struct SFSInodeInfo {
+    SFSBlockMap                     blockMap;
+    int                             dirtyStartBlock;    // File blocks [dirtyStartBlock, dirtyEndBlock) may have deferred writes. Empty if start >= end
+    int                             dirtyEndBlock;
+    SFSPointerBlock* _Nullable      indirect;           // Single-indirect pointer block
+    SFSPointerBlock* _Nullable      doubleIndirect;     // Double-indirect pointer block
+    SFSPointerBlock* _Nullable      doubleIndirectL2;   // Most recently used second level pointer block of the double-indirect tree
+    SFSDirectoryIndex* _Nullable    dirIndex;           // Directory index. Built on demand for directory inodes
+} SFSInodeInfo;
+
+#define Inode_GetInfo(__self) \
+    Inode_GetRefConAs(__self, SFSInodeInfo*)
+
 #define Inode_GetBlockMap(__self) \
-    Inode_GetRefConAs(__self, SFSBlockMap*)
+    (&Inode_GetInfo(__self)->blockMap)
 
 
 //
@@ -47,7 +101,8 @@ typedef struct SFSDirectoryQuery {
 //
 
 CLASS_IVARS(SerenaFS, Filesystem,
-    Lock                    lock;                           // Shared between filesystem proper and inodes
+    Lock                    lock;                           // Protects the mount state. Per-inode state is protected by the inode locks
+    Lock                    allocationLock;                 // Protects the allocation bitmap, its free space summary and its dirty state
     ConditionVariable       notifier;
 
     DiskDriverRef _Nullable diskDriver;
@@ -56,12 +111,16 @@ CLASS_IVARS(SerenaFS, Filesystem,
     LogicalBlockCount       allocationBitmapBlockCount;     // -"-
     uint8_t* _Nullable      allocationBitmap;
     size_t                  allocationBitmapByteSize;
+    bool* _Nullable         allocationBitmapDirtyFlags;     // One flag per allocation bitmap block; true if the block has to be written back to disk
+    bool                    isAllocationBitmapDirty;        // true if at least one allocation bitmap block is dirty
+    uint16_t* _Nullable     allocationBitmapFreeCounts;     // Number of free blocks tracked by each allocation bitmap block
+    LogicalBlockCount       freeBlockCount;                 // Number of free blocks on the volume
+    LogicalBlockAddress     nextFreeLbaHint;                // There's no free block below this LBA
     uint32_t                volumeBlockCount;
 
     LogicalBlockAddress     rootDirLba;                     // Root directory LBA (This is the inode id at the same time)
 
     bool                    isReadOnly;                     // true if mounted read-only; false if mounted read-write
-    uint8_t                 tmpBlock[kSFSBlockSize];
 );
 
 typedef ssize_t (*SFSReadCallback)(void* _Nonnull pDst, const void* _Nonnull pSrc, ssize_t n);
@@ -76,7 +135,12 @@ static InodeId SerenaFS_GetNextAvailableInodeId_Locked(SerenaFSRef _Nonnull self
 static errno_t SerenaFS_FormatWithEmptyFilesystem(SerenaFSRef _Nonnull self);
 static errno_t SerenaFS_CreateDirectoryDiskNode(SerenaFSRef _Nonnull self, InodeId parentId, UserId uid, GroupId gid, FilePermissions permissions, InodeId* _Nonnull pOutId);
 static void SerenaFS_DestroyDiskNode(SerenaFSRef _Nonnull self, SFSInodeRef _Nullable pDiskNode);
+static errno_t SerenaFS_FlushPointerBlock(SerenaFSRef _Nonnull self, SFSPointerBlock* _Nullable pb);
+static void SerenaFS_DeallocateBlock(SerenaFSRef _Nonnull self, LogicalBlockAddress lba);
+static errno_t SerenaFS_GetFileExtent(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, int nMaxBlocks, LogicalBlockAddress* _Nonnull pOutLba, int* _Nonnull pOutBlockCount);
 static errno_t SerenaFS_GetLogicalBlockAddressForFileBlockAddress(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int fba, SFSBlockMode mode, LogicalBlockAddress* _Nonnull pOutLba);
+static void SerenaFS_DeallocateFileBlocks_Locked(SerenaFSRef _Nonnull self, InodeRef _Nonnull pNode, int firstBlockIdx);
+static void SerenaFS_DropDirectoryIndex(SFSInodeInfo* _Nonnull pInfo);
 static void SerenaFS_xTruncateFile(SerenaFSRef _Nonnull self, InodeRef _Nonnull _Locked pNode, FileOffset length);
 
 #endif /* SerenaFSPriv_h */
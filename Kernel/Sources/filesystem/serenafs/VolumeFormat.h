@@ -11,13 +11,18 @@
 
 #include <klib/Types.h>
 
-#define kSFSMaxFilenameLength               28
+#define kSFSMaxFilenameLength               255
 #define kSFSBlockSizeShift                  9
 #define kSFSBlockSize                       (1 << kSFSBlockSizeShift)
 #define kSFSBlockSizeMask                   (kSFSBlockSize - 1)
-#define kSFSDirectoryEntriesPerBlock        (kSFSBlockSize / sizeof(SFSDirectoryEntry))
-#define kSFSDirectoryEntriesPerBlockMask    (kSFSDirectoryEntriesPerBlock - 1)
-#define kSFSMaxDirectDataBlockPointers      114
+#define kSFSDirectoryEntryHeaderSize        8
+#define kSFSDirectoryEntryAlignment         4
+#define kSFSMaxDirectDataBlockPointers      112
+#define kSFSBlockPointersPerBlockShift      7
+#define kSFSBlockPointersPerBlock           (1 << kSFSBlockPointersPerBlockShift)
+#define kSFSBlockPointersPerBlockMask       (kSFSBlockPointersPerBlock - 1)
+#define kSFSMaxIndirectDataBlockPointers    kSFSBlockPointersPerBlock
+#define kSFSMaxDoubleIndirectDataBlockPointers (kSFSBlockPointersPerBlock * kSFSBlockPointersPerBlock)
 
 
 //
@@ -54,7 +59,8 @@ enum {
 enum {
     kSFSVersion_v0_1 = 0x00000100,              // v0.1.0
     kSFSVersion_v1_0 = 0x00010000,              // v1.0.0
-    kSFSVersion_Current = kSFSVersion_v0_1,     // Version to use for formatting a new disk
+    kSFSVersion_v2_0 = 0x00020000,              // v2.0.0
+    kSFSVersion_Current = kSFSVersion_v2_0,     // Version to use for formatting a new disk
 };
 
 enum {
@@ -112,11 +118,21 @@ typedef struct SFSVolumeHeader {
 // directly instead of copying it back and forth. That's okay because the inode
 // lock effectively protects the disk node sitting behind the inode. 
 
-// XXX currently limited to file sizes of 58k. That's fine for now since we'll
-// XXX move to B-Trees for block mapping, directory content and extended
-// XXX attributes anyway.
+// The block map of an inode maps file block addresses to disk block addresses.
+// File blocks #0 to #kSFSMaxDirectDataBlockPointers-1 are mapped by the direct
+// block pointers stored in the inode itself. The following
+// kSFSMaxIndirectDataBlockPointers file blocks are mapped by the single-indirect
+// pointer block and the remaining file blocks are mapped by the double-indirect
+// pointer block. A pointer block is a disk block which holds
+// kSFSBlockPointersPerBlock block pointers. The pointers stored in the double-
+// indirect block point to single-indirect pointer blocks. A block pointer with
+// the value 0 means that the corresponding file block has not been allocated
+// (yet) and that it should be treated as a block filled with zeros.
+// (v1.0 only. Version 0.1 supported just 114 direct pointers)
 typedef struct SFSBlockMap {
     uint32_t    p[kSFSMaxDirectDataBlockPointers];
+    uint32_t    indirect;       // LBA of the single-indirect pointer block
+    uint32_t    doubleIndirect; // LBA of the double-indirect pointer block
 } SFSBlockMap;
 
 typedef struct SFSInode {
@@ -148,22 +164,40 @@ typedef SFSInode* SFSInodeRef;
 //
 // Directory File
 //
-// A directory file stores an array of SFSDirectoryEntry objects in its file
-// content.
-// Internal organisation:
+// A directory file is a sequence of directory blocks. Each block stores a chain
+// of variable-length directory entries which covers the whole block. An entry
+// never crosses a block boundary and thus the size of a directory file is
+// always a multiple of the block size.
+// Internal organisation of the first block:
 // [0] "."
 // [1] ".."
 // [2] userEntry0
 // .
 // [n] userEntryN-1
-// This should be mod(SFSDiskBlockSize, SFSDirectoryEntrySize) == 0
-// The number of entries in the directory file is fileLength / sizeof(SFSDirectoryEntry)
+//
+// 'recordLength' is the distance in bytes from the start of an entry to the
+// start of the next entry in the same block. The last entry in a block extends
+// to the end of the block. An entry with an id of 0 is unused. The filename is
+// stored without a trailing NUL; 'nameLength' is its length in bytes. All bytes
+// between the end of the (aligned) filename and the end of the record are free
+// space which may be claimed by splitting the record. A removed entry is merged
+// into the entry that precedes it in the same block.
+// (v2.0 only. Version 1.0 and older used fixed size 32 byte entries with names
+// of up to 28 bytes)
 //
 // The '.' and '..' entries of the root directory map to the root directory
 // inode id.
 typedef struct SFSDirectoryEntry {
     uint32_t    id;
-    char        filename[kSFSMaxFilenameLength];    // if strlen(filename) < kSFSMaxFilenameLength -> 0 terminated
+    uint16_t    recordLength;   // Size of the record in bytes; multiple of kSFSDirectoryEntryAlignment and >= kSFSDirectoryEntryHeaderSize
+    uint8_t     nameLength;
+    uint8_t     reserved;
+    char        filename[1];    // 'nameLength' bytes; not NUL terminated
 } SFSDirectoryEntry;
 
+// Returns the minimum record length of a directory entry with a filename that
+// is '__nameLength' bytes long
+#define SFSDirectoryEntry_GetRecordLength(__nameLength) \
+    ((kSFSDirectoryEntryHeaderSize + (__nameLength) + (kSFSDirectoryEntryAlignment - 1)) & ~(kSFSDirectoryEntryAlignment - 1))
+
 #endif /* VolumeFormat_h */
@@ -142,6 +142,7 @@ CSWB_HW_HAS_FPU                     equ     0
 SCHED_FLAG_VOLUNTARY_CSW_ENABLED    equ     0
 
 VP_PRIORITY_COUNT                   equ     64
+TIMEOUT_WHEEL_SLOT_COUNT            equ     64
 
     clrso
 vps_running                         so.l    1       ; 4
@@ -156,8 +157,8 @@ vps_csw_hw                          so.b    1       ; 1
 vps_flags                           so.b    1       ; 1
 vps_reserved                        so.b    1       ; 1
 vps_quantums_per_quarter_second     so.l    1       ; 4
-vps_timeout_queue_first             so.l    1       ; 4
-vps_timeout_queue_last              so.l    1       ; 4
+vps_timeout_wheel                   so.l    TIMEOUT_WHEEL_SLOT_COUNT * 2 ; 512
+vps_timeout_wheel_time              so.l    1       ; 4
 vps_sleep_queue_first               so.l    1       ; 4
 vps_sleep_queue_last                so.l    1       ; 4
 vps_scheduler_wait_queue_first      so.l    1       ; 4
@@ -165,7 +166,7 @@ vps_scheduler_wait_queue_last       so.l    1       ; 4
 vps_finalizer_queue_first           so.l    1       ; 4
 vps_finalizer_queue_last            so.l    1       ; 4
 vps_SIZEOF                          so
-    ifeq (vps_SIZEOF == 580)
+    ifeq (vps_SIZEOF == 1088)
         fail "VirtualProcessorScheduler structure size is incorrect."
     endif
 
@@ -9,6 +9,7 @@
 #include "Allocator.h"
 #include "List.h"
 #include "Log.h"
+#include "Memory.h"
 
 
 #if __LP64__
@@ -39,10 +40,22 @@ typedef struct _MemRegion {
 } MemRegion;
 
 
+// Allocator statistics. See HeapInfo
+typedef struct _AllocatorStats {
+    size_t  total_bytes;
+    size_t  bytes_in_use;
+    size_t  peak_bytes_in_use;
+    size_t  alloc_count;
+    size_t  dealloc_count;
+    size_t  alloc_count_by_size[kHeapInfo_SizeBucketCount];
+} AllocatorStats;
+
+
 // An allocator manages memory from a pool of memory contiguous regions.
 typedef struct _Allocator {
     SList               regions;
     MemBlock* _Nullable first_allocated_block;  // Unordered list of allocated blocks (no matter from which memory region they were allocated)
+    AllocatorStats      stats;
 } Allocator;
 
 
@@ -279,10 +292,12 @@ errno_t Allocator_Create(const MemoryDescriptor* _Nonnull pMemDesc, AllocatorRef
     AllocatorRef pAllocator = (AllocatorRef)pAllocatorBase;
     pAllocator->first_allocated_block = NULL;
     SList_Init(&pAllocator->regions);
+    memset(&pAllocator->stats, 0, sizeof(AllocatorStats));
     
     MemRegion* pFirstRegion;
     try_null(pFirstRegion, MemRegion_Create(pFirstMemRegionBase, pMemDesc), ENOMEM);
     SList_InsertAfterLast(&pAllocator->regions, &pFirstRegion->node);
+    pAllocator->stats.total_bytes += pFirstRegion->first_free_block->size;
     
     *pOutAllocator = pAllocator;
     return EOK;
@@ -300,6 +315,7 @@ errno_t Allocator_AddMemoryRegion(AllocatorRef _Nonnull pAllocator, const Memory
 
     try_null(pMemRegion, MemRegion_Create(pMemDesc->lower, pMemDesc), ENOMEM);
     SList_InsertAfterLast(&pAllocator->regions, &pMemRegion->node);
+    pAllocator->stats.total_bytes += pMemRegion->first_free_block->size;
     return EOK;
 
 catch:
@@ -319,6 +335,19 @@ static MemRegion* _Nullable Allocator_GetMemRegionManaging_Locked(AllocatorRef _
     return NULL;
 }
 
+// Returns the index of the HeapInfo size bucket for an allocation of 'nbytes'.
+static int Allocator_GetSizeBucket(ssize_t nbytes)
+{
+    ssize_t limit = 16;
+    int i = 0;
+
+    while (i < kHeapInfo_SizeBucketCount - 1 && nbytes > limit) {
+        limit <<= 1;
+        i++;
+    }
+    return i;
+}
+
 bool Allocator_IsManaging(AllocatorRef _Nonnull pAllocator, void* _Nullable ptr)
 {
     if (ptr == NULL || ptr == CHAR_PTR_MAX) {
@@ -370,6 +399,12 @@ errno_t Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, ssize_t nbytes
     pMemBlock->next = pAllocator->first_allocated_block;
     pAllocator->first_allocated_block = pMemBlock;
 
+    // Update the statistics
+    pAllocator->stats.bytes_in_use += pMemBlock->size;
+    pAllocator->stats.peak_bytes_in_use = __max(pAllocator->stats.peak_bytes_in_use, pAllocator->stats.bytes_in_use);
+    pAllocator->stats.alloc_count++;
+    pAllocator->stats.alloc_count_by_size[Allocator_GetSizeBucket(nbytes)]++;
+
     // Calculate and return the user memory block pointer
     *pOutPtr = ((char*)pMemBlock) + sizeof(MemBlock);
     return EOK;
@@ -422,12 +457,45 @@ errno_t Allocator_DeallocateBytes(AllocatorRef _Nonnull pAllocator, void* _Nulla
     }
     
     
+    // Update the statistics
+    pAllocator->stats.bytes_in_use -= pBlockToFree->size;
+    pAllocator->stats.dealloc_count++;
+
+
     // Tell the memory region to free the memory block
     MemRegion_FreeMemBlock(pMemRegion, pBlockToFree);
     
     return EOK;
 }
 
+// Returns the allocator statistics. Note that this function walks the free
+// lists to find the largest free block.
+void Allocator_GetInfo(AllocatorRef _Nonnull pAllocator, HeapInfo* _Nonnull pOutInfo)
+{
+    const AllocatorStats* pStats = &pAllocator->stats;
+
+    pOutInfo->totalBytes = pStats->total_bytes;
+    pOutInfo->bytesInUse = pStats->bytes_in_use;
+    pOutInfo->peakBytesInUse = pStats->peak_bytes_in_use;
+    pOutInfo->largestFreeBlockSize = 0;
+    pOutInfo->freeBlockCount = 0;
+    pOutInfo->allocationCount = pStats->alloc_count;
+    pOutInfo->deallocationCount = pStats->dealloc_count;
+    for (int i = 0; i < kHeapInfo_SizeBucketCount; i++) {
+        pOutInfo->allocationCountBySize[i] = pStats->alloc_count_by_size[i];
+    }
+
+    SList_ForEach(&pAllocator->regions, MemRegion, {
+        MemBlock* pCurBlock = pCurNode->first_free_block;
+
+        while (pCurBlock) {
+            pOutInfo->largestFreeBlockSize = __max(pOutInfo->largestFreeBlockSize, (size_t)pCurBlock->size);
+            pOutInfo->freeBlockCount++;
+            pCurBlock = pCurBlock->next;
+        }
+    });
+}
+
 void Allocator_Dump(AllocatorRef _Nonnull pAllocator)
 {
     print("Free:\n");
@@ -11,6 +11,7 @@
 
 #include <klib/Error.h>
 #include <hal/Platform.h>
+#include <System/Heap.h>
 
 
 struct _Allocator;
@@ -28,6 +29,9 @@ extern errno_t Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, ssize_t
 // ENOTBLK if the allocator does not manage the given memory block.
 extern errno_t Allocator_DeallocateBytes(AllocatorRef _Nonnull pAllocator, void* _Nullable ptr);
 
+// Returns the allocator statistics.
+extern void Allocator_GetInfo(AllocatorRef _Nonnull pAllocator, HeapInfo* _Nonnull pOutInfo);
+
 extern void Allocator_Dump(AllocatorRef _Nonnull pAllocator);
 extern void Allocator_DumpMemoryRegions(AllocatorRef _Nonnull pAllocator);
 
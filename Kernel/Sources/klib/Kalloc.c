@@ -12,9 +12,41 @@
 #include "Memory.h"
 
 
+// Enable to record the most recent kalloc() and kfree() calls in a ring buffer.
+// kalloc_dump() prints the trace.
+//#define KALLOC_TRACE
+#define KALLOC_TRACE_CAPACITY   64
+
+
+#ifdef KALLOC_TRACE
+typedef struct KallocTraceRecord {
+    void* _Nullable ptr;
+    ssize_t         size;       // Requested size; -1 for a kfree()
+} KallocTraceRecord;
+#endif
+
+
 static Lock         gLock;
 static AllocatorRef gUnifiedMemory;       // CPU + Chipset access (memory range [0..<chipset_upper_dma_limit])
 static AllocatorRef gCpuOnlyMemory;       // CPU only access      (memory range [chipset_upper_dma_limit...])
+#ifdef KALLOC_TRACE
+static KallocTraceRecord    gTrace[KALLOC_TRACE_CAPACITY];
+static size_t               gTraceCount;    // Total number of records written so far
+#endif
+
+
+#ifdef KALLOC_TRACE
+static void kalloc_trace_locked(void* _Nullable ptr, ssize_t size)
+{
+    KallocTraceRecord* pRecord = &gTrace[gTraceCount % KALLOC_TRACE_CAPACITY];
+
+    pRecord->ptr = ptr;
+    pRecord->size = size;
+    gTraceCount++;
+}
+#else
+#define kalloc_trace_locked(__ptr, __size)
+#endif
 
 
 static MemoryDescriptor adjusted_memory_descriptor(const MemoryDescriptor* pMemDesc, char* _Nonnull pInitialHeapBottom, char* _Nonnull pInitialHeapTop)
@@ -100,6 +132,7 @@ errno_t kalloc_options(ssize_t nbytes, unsigned int options, void* _Nullable * _
             try(Allocator_AllocateBytes(gUnifiedMemory, nbytes, pOutPtr));
         }
     }
+    kalloc_trace_locked(*pOutPtr, nbytes);
     Lock_Unlock(&gLock);
 
     // Zero the memory if requested
@@ -126,6 +159,7 @@ void kfree(void* _Nullable ptr)
     } else if (err != EOK) {
         abort();
     }
+    kalloc_trace_locked(ptr, -1);
     Lock_Unlock(&gLock);
 }
 
@@ -148,15 +182,71 @@ errno_t kalloc_add_memory_region(const MemoryDescriptor* _Nonnull pMemDesc)
     return err;
 }
 
+// Returns statistics about the kalloc heap.
+void kalloc_get_info(HeapInfo* _Nonnull pOutInfo)
+{
+    HeapInfo cpuOnlyInfo;
+
+    Lock_Lock(&gLock);
+    Allocator_GetInfo(gUnifiedMemory, pOutInfo);
+    Allocator_GetInfo(gCpuOnlyMemory, &cpuOnlyInfo);
+    Lock_Unlock(&gLock);
+
+    pOutInfo->totalBytes += cpuOnlyInfo.totalBytes;
+    pOutInfo->bytesInUse += cpuOnlyInfo.bytesInUse;
+    pOutInfo->peakBytesInUse += cpuOnlyInfo.peakBytesInUse;
+    pOutInfo->largestFreeBlockSize = __max(pOutInfo->largestFreeBlockSize, cpuOnlyInfo.largestFreeBlockSize);
+    pOutInfo->freeBlockCount += cpuOnlyInfo.freeBlockCount;
+    pOutInfo->allocationCount += cpuOnlyInfo.allocationCount;
+    pOutInfo->deallocationCount += cpuOnlyInfo.deallocationCount;
+    for (int i = 0; i < kHeapInfo_SizeBucketCount; i++) {
+        pOutInfo->allocationCountBySize[i] += cpuOnlyInfo.allocationCountBySize[i];
+    }
+}
+
+static void kalloc_dump_info(const HeapInfo* _Nonnull pInfo)
+{
+    print("   total: %lu, in use: %lu, peak: %lu\n", pInfo->totalBytes, pInfo->bytesInUse, pInfo->peakBytesInUse);
+    print("   free blocks: %lu, largest: %lu\n", pInfo->freeBlockCount, pInfo->largestFreeBlockSize);
+    print("   allocs: %lu, frees: %lu\n", pInfo->allocationCount, pInfo->deallocationCount);
+    print("   by size:");
+    for (int i = 0; i < kHeapInfo_SizeBucketCount; i++) {
+        print(" %lu", pInfo->allocationCountBySize[i]);
+    }
+    print("\n");
+}
+
 // Dumps a description of the kalloc heap to the console
 void kalloc_dump(void)
 {
+    HeapInfo info;
+
     Lock_Lock(&gLock);
     print("Unified:\n");
     Allocator_DumpMemoryRegions(gUnifiedMemory);
+    Allocator_GetInfo(gUnifiedMemory, &info);
+    kalloc_dump_info(&info);
 
     print("\nCPU-only:\n");
     Allocator_DumpMemoryRegions(gCpuOnlyMemory);
+    Allocator_GetInfo(gCpuOnlyMemory, &info);
+    kalloc_dump_info(&info);
+    print("\n");
+
+#ifdef KALLOC_TRACE
+    const size_t nRecords = __min(gTraceCount, KALLOC_TRACE_CAPACITY);
+
+    print("Trace:\n");
+    for (size_t i = gTraceCount - nRecords; i < gTraceCount; i++) {
+        const KallocTraceRecord* pRecord = &gTrace[i % KALLOC_TRACE_CAPACITY];
+
+        if (pRecord->size >= 0) {
+            print("   alloc 0x%p, %ld\n", pRecord->ptr, pRecord->size);
+        } else {
+            print("   free  0x%p\n", pRecord->ptr);
+        }
+    }
     print("\n");
+#endif
     Lock_Unlock(&gLock);
 }
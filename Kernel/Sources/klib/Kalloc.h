@@ -12,6 +12,7 @@
 #include <klib/Types.h>
 #include <klib/Error.h>
 #include <hal/SystemDescription.h>
+#include <System/Heap.h>
 
 
 // kalloc_options options
@@ -47,6 +48,11 @@ extern void kfree(void* _Nullable ptr);
 // heap.
 extern errno_t kalloc_add_memory_region(const MemoryDescriptor* _Nonnull pMemDesc);
 
+// Returns statistics about the kalloc heap. The statistics of the unified and
+// CPU-only memory pools are combined. 'peakBytesInUse' is the sum of the peaks
+// of the two pools.
+extern void kalloc_get_info(HeapInfo* _Nonnull pOutInfo);
+
 // Dumps a description of the kalloc heap to the console
 extern void kalloc_dump(void);
 
@@ -0,0 +1,159 @@
+//
+//  KmemCache.c
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/22/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include "KmemCache.h"
+#include "Kalloc.h"
+#include <dispatcher/Lock.h>
+
+
+// Object sizes are rounded up to a multiple of this alignment
+#define KMEM_CACHE_ALIGNMENT        8
+
+// A slab holds at least this many objects and is at least this big
+#define KMEM_CACHE_MIN_SLAB_OBJECTS 8
+#define KMEM_CACHE_MIN_SLAB_SIZE    1024
+
+
+// A slab is a block of memory from the kalloc heap that is carved up into
+// objects. The slab header is followed by the objects.
+typedef struct _KmemSlab {
+    SListNode   node;
+} KmemSlab;
+
+#define KMEM_SLAB_HEADER_SIZE \
+    __Ceil_PowerOf2(sizeof(KmemSlab), KMEM_CACHE_ALIGNMENT)
+
+
+// A free object. The link is stored in the first word of the object
+typedef struct _KmemFreeObject {
+    struct _KmemFreeObject* _Nullable   next;
+} KmemFreeObject;
+
+
+typedef struct _KmemCache {
+    Lock                        lock;
+    SList                       slabs;
+    KmemFreeObject* _Nullable   freeList;
+    char* _Nullable             slabLower;      // Part of the most recently allocated slab that hasn't been carved up yet
+    char* _Nullable             slabUpper;
+    KmemCache_Ctor _Nullable    ctor;
+    const char* _Nonnull        name;
+    ssize_t                     objectSize;
+    ssize_t                     slabSize;
+    int                         slabCount;
+    int                         inUseCount;
+} KmemCache;
+
+
+errno_t kmem_cache_create(const char* _Nonnull name, ssize_t objectSize, KmemCache_Ctor _Nullable ctor, KmemCacheRef _Nullable * _Nonnull pOutCache)
+{
+    decl_try_err();
+    KmemCacheRef self;
+
+    assert(objectSize > 0);
+
+    try(kalloc_cleared(sizeof(KmemCache), (void**) &self));
+    Lock_Init(&self->lock);
+    SList_Init(&self->slabs);
+    self->ctor = ctor;
+    self->name = name;
+    self->objectSize = __Ceil_PowerOf2(__max(objectSize, sizeof(KmemFreeObject)), KMEM_CACHE_ALIGNMENT);
+
+    const ssize_t nObjectsPerSlab = __max(KMEM_CACHE_MIN_SLAB_SIZE / self->objectSize, KMEM_CACHE_MIN_SLAB_OBJECTS);
+    self->slabSize = KMEM_SLAB_HEADER_SIZE + nObjectsPerSlab * self->objectSize;
+
+    *pOutCache = self;
+    return EOK;
+
+catch:
+    *pOutCache = NULL;
+    return err;
+}
+
+void kmem_cache_destroy(KmemCacheRef _Nullable self)
+{
+    if (self) {
+        KmemSlab* pSlab;
+
+        assert(self->inUseCount == 0);
+
+        while ((pSlab = (KmemSlab*) SList_RemoveFirst(&self->slabs)) != NULL) {
+            kfree(pSlab);
+        }
+        SList_Deinit(&self->slabs);
+        Lock_Deinit(&self->lock);
+        kfree(self);
+    }
+}
+
+// Allocates a new slab and makes it the slab from which new objects are carved.
+static errno_t kmem_cache_grow_locked(KmemCacheRef _Nonnull self)
+{
+    decl_try_err();
+    KmemSlab* pSlab;
+
+    try(kalloc(self->slabSize, (void**) &pSlab));
+    SListNode_Init(&pSlab->node);
+    SList_InsertBeforeFirst(&self->slabs, &pSlab->node);
+    self->slabLower = (char*)pSlab + KMEM_SLAB_HEADER_SIZE;
+    self->slabUpper = (char*)pSlab + self->slabSize;
+    self->slabCount++;
+
+catch:
+    return err;
+}
+
+errno_t kmem_cache_alloc(KmemCacheRef _Nonnull self, void* _Nullable * _Nonnull pOutPtr)
+{
+    decl_try_err();
+    void* ptr;
+    bool isFresh = false;
+
+    Lock_Lock(&self->lock);
+    if (self->freeList) {
+        ptr = self->freeList;
+        self->freeList = self->freeList->next;
+    }
+    else {
+        if (self->slabUpper - self->slabLower < self->objectSize) {
+            try(kmem_cache_grow_locked(self));
+        }
+
+        ptr = self->slabLower;
+        self->slabLower += self->objectSize;
+        isFresh = true;
+    }
+    self->inUseCount++;
+    Lock_Unlock(&self->lock);
+
+    // The constructor runs outside the cache lock since it may take other locks
+    if (isFresh && self->ctor) {
+        self->ctor(ptr);
+    }
+
+    *pOutPtr = ptr;
+    return EOK;
+
+catch:
+    Lock_Unlock(&self->lock);
+    *pOutPtr = NULL;
+    return err;
+}
+
+void kmem_cache_free(KmemCacheRef _Nonnull self, void* _Nullable ptr)
+{
+    if (ptr) {
+        KmemFreeObject* pObj = (KmemFreeObject*)ptr;
+
+        Lock_Lock(&self->lock);
+        pObj->next = self->freeList;
+        self->freeList = pObj;
+        self->inUseCount--;
+        Lock_Unlock(&self->lock);
+    }
+}
@@ -0,0 +1,51 @@
+//
+//  KmemCache.h
+//  kernel
+//
+//  Created by Dietmar Planitzer on 4/22/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef KmemCache_h
+#define KmemCache_h
+
+#include <klib/Types.h>
+#include <klib/Error.h>
+
+
+// An object cache hands out fixed-size objects of a single type. Objects are
+// carved out of slabs which are allocated from the kalloc heap. A freed object
+// goes back on the free list of its cache and it is handed out again by the
+// next allocation. Every cache has its own lock so allocations from different
+// caches do not contend with each other or with kalloc().
+//
+// The optional constructor is invoked once on a fresh object when it is carved
+// out of a slab. The object keeps its constructed state while it sits on the
+// free list, except for its first pointer-sized word which the cache uses to
+// link free objects. So state that is expensive to set up, eg a semaphore, is
+// only initialized once per object rather than on every allocation. Slabs are
+// only returned to the kalloc heap when the cache is destroyed.
+struct _KmemCache;
+typedef struct _KmemCache* KmemCacheRef;
+
+
+// Invoked on a fresh object when it is added to the cache
+typedef void (*KmemCache_Ctor)(void* _Nonnull pObject);
+
+
+// Creates an object cache for objects of size 'objectSize'. 'name' must point
+// to a string that stays valid for the lifetime of the cache.
+extern errno_t kmem_cache_create(const char* _Nonnull name, ssize_t objectSize, KmemCache_Ctor _Nullable ctor, KmemCacheRef _Nullable * _Nonnull pOutCache);
+
+// Destroys the object cache and frees all its slabs. All objects must have
+// been returned to the cache.
+extern void kmem_cache_destroy(KmemCacheRef _Nullable self);
+
+// Allocates an object from the cache.
+extern errno_t kmem_cache_alloc(KmemCacheRef _Nonnull self, void* _Nullable * _Nonnull pOutPtr);
+
+// Returns the object 'ptr' to the cache. 'ptr' must have been allocated from
+// this cache.
+extern void kmem_cache_free(KmemCacheRef _Nonnull self, void* _Nullable ptr);
+
+#endif /* KmemCache_h */
@@ -17,6 +17,7 @@
 #include <klib/Error.h>
 #include <klib/Geometry.h>
 #include <klib/Kalloc.h>
+#include <klib/KmemCache.h>
 #include <klib/List.h>
 #include <klib/Log.h>
 #include <klib/Memory.h>
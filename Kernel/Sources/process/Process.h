@@ -11,6 +11,7 @@
 
 #include <klib/klib.h>
 #include <filesystem/Filesystem.h>
+#include <System/DispatchQueue.h>
 #include <System/Process.h>
 #include <User.h>
 
@@ -79,10 +80,28 @@ extern errno_t Process_SpawnChildProcess(ProcessRef _Nonnull pProc, const char*
 // with the given options. 
 extern errno_t Process_DispatchUserClosure(ProcessRef _Nonnull pProc, int od, unsigned long options, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext);
 
+// Dispatches the execution of the given array of user closures on the given
+// dispatch queue. Nothing is dispatched if an entry is invalid. The closures
+// which were dispatched before a dispatch failure remain enqueued.
+extern errno_t Process_DispatchUserClosureBatch(ProcessRef _Nonnull pProc, int od, const Dispatch_ClosureEntry* _Nonnull pEntries, int count);
+
 // Dispatches the execution of the given user closure on the given dispatch queue
 // after the given deadline.
 extern errno_t Process_DispatchUserClosureAsyncAfter(ProcessRef _Nonnull pProc, int od, TimeInterval deadline, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext);
 
+// Removes all queued instances of the given user closure from the given
+// dispatch queue and returns how many were removed.
+extern errno_t Process_RemoveUserClosure(ProcessRef _Nonnull pProc, int od, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext, int* _Nonnull pOutCount);
+
+// Returns the lane scaling tunables of the given dispatch queue.
+extern errno_t Process_GetDispatchQueueTunables(ProcessRef _Nonnull pProc, int od, DispatchQueueTunables* _Nonnull pOutTunables);
+
+// Replaces the lane scaling tunables of the given dispatch queue.
+extern errno_t Process_SetDispatchQueueTunables(ProcessRef _Nonnull pProc, int od, const DispatchQueueTunables* _Nonnull pTunables);
+
+// Returns the maximum number of concurrency lanes of the given dispatch queue.
+extern errno_t Process_GetDispatchQueueMaxConcurrency(ProcessRef _Nonnull pProc, int od, int* _Nonnull pOutMaxConcurrency);
+
 // Returns the dispatch queue associated with the virtual processor on which the
 // calling code is running. Note this function assumes that it will ALWAYS be
 // called from a system call context and thus the caller will necessarily run in
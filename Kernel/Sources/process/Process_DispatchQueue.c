@@ -10,6 +10,8 @@
 #include <dispatcher/VirtualProcessorPool.h>
 #include <System/DispatchQueue.h>
 
+#define DISPATCH_BATCH_CHUNK_SIZE   16
+
 
 // Creates a new dispatch queue and binds it to the process.
 errno_t Process_CreateDispatchQueue(ProcessRef _Nonnull pProc, int minConcurrency, int maxConcurrency, int qos, int priority, int* _Nullable pOutDescriptor)
@@ -51,6 +53,57 @@ int Process_GetCurrentDispatchQueue(ProcessRef _Nonnull pProc)
     return desc;
 }
 
+// Returns the lane scaling tunables of the given dispatch queue.
+errno_t Process_GetDispatchQueueTunables(ProcessRef _Nonnull pProc, int od, DispatchQueueTunables* _Nonnull pOutTunables)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue;
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
+        if (Object_InstanceOf(pQueue, DispatchQueue)) {
+            DispatchQueue_GetTunables(pQueue, pOutTunables);
+        } else {
+            err = EBADF;
+        }
+        Object_Release(pQueue);
+    }
+    return err;
+}
+
+// Replaces the lane scaling tunables of the given dispatch queue.
+errno_t Process_SetDispatchQueueTunables(ProcessRef _Nonnull pProc, int od, const DispatchQueueTunables* _Nonnull pTunables)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue;
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
+        if (Object_InstanceOf(pQueue, DispatchQueue)) {
+            err = DispatchQueue_SetTunables(pQueue, pTunables);
+        } else {
+            err = EBADF;
+        }
+        Object_Release(pQueue);
+    }
+    return err;
+}
+
+// Returns the maximum number of concurrency lanes of the given dispatch queue.
+errno_t Process_GetDispatchQueueMaxConcurrency(ProcessRef _Nonnull pProc, int od, int* _Nonnull pOutMaxConcurrency)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue;
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
+        if (Object_InstanceOf(pQueue, DispatchQueue)) {
+            *pOutMaxConcurrency = DispatchQueue_GetMaxConcurrency(pQueue);
+        } else {
+            err = EBADF;
+        }
+        Object_Release(pQueue);
+    }
+    return err;
+}
+
 // Dispatches the execution of the given user closure on the given dispatch queue
 // with the given options. 
 errno_t Process_DispatchUserClosure(ProcessRef _Nonnull pProc, int od, unsigned long options, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext)
@@ -79,6 +132,47 @@ errno_t Process_DispatchUserClosure(ProcessRef _Nonnull pProc, int od, unsigned
     return err;
 }
 
+// Dispatches the execution of the given array of user closures on the given
+// dispatch queue. The closures are handed to the dispatch queue in chunks to
+// keep the kernel stack usage bounded. Every chunk is enqueued with a single
+// acquisition of the dispatch queue lock. All entries are validated before the
+// first chunk is dispatched. Nothing is dispatched if an entry is invalid. If
+// dispatching a chunk fails then the closures of the preceding chunks remain
+// enqueued and will execute while the closures of the failed chunk and all
+// following chunks are not executed. The error is returned in this case.
+errno_t Process_DispatchUserClosureBatch(ProcessRef _Nonnull pProc, int od, const Dispatch_ClosureEntry* _Nonnull pEntries, int count)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue;
+    DispatchQueueClosure closures[DISPATCH_BATCH_CHUNK_SIZE];
+
+    for (int i = 0; i < count; i++) {
+        if (pEntries[i].func == NULL) {
+            return EINVAL;
+        }
+    }
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
+        if (Object_InstanceOf(pQueue, DispatchQueue)) {
+            int i = 0;
+
+            while (err == EOK && i < count) {
+                const int n = __min(count - i, DISPATCH_BATCH_CHUNK_SIZE);
+
+                for (int j = 0; j < n; j++) {
+                    closures[j] = DispatchQueueClosure_MakeUser((Closure1Arg_Func)pEntries[i + j].func, pEntries[i + j].context);
+                }
+                err = DispatchQueue_DispatchAsyncBatch(pQueue, closures, n);
+                i += n;
+            }
+        } else {
+            err = EBADF;
+        }
+        Object_Release(pQueue);
+    }
+    return err;
+}
+
 // Dispatches the execution of the given user closure on the given dispatch queue
 // after the given deadline.
 errno_t Process_DispatchUserClosureAsyncAfter(ProcessRef _Nonnull pProc, int od, TimeInterval deadline, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext)
@@ -99,3 +193,21 @@ errno_t Process_DispatchUserClosureAsyncAfter(ProcessRef _Nonnull pProc, int od,
     }
     return err;
 }
+
+// Removes all queued instances of the given user closure from the given
+// dispatch queue and returns how many were removed.
+errno_t Process_RemoveUserClosure(ProcessRef _Nonnull pProc, int od, Closure1Arg_Func _Nonnull pUserClosure, void* _Nullable pContext, int* _Nonnull pOutCount)
+{
+    decl_try_err();
+    DispatchQueueRef pQueue;
+
+    if ((err = Process_CopyPrivateResourceForDescriptor(pProc, od, (ObjectRef*) &pQueue)) == EOK) {
+        if (Object_InstanceOf(pQueue, DispatchQueue)) {
+            *pOutCount = DispatchQueue_RemoveClosure(pQueue, DispatchQueueClosure_MakeUser(pUserClosure, pContext));
+        } else {
+            err = EBADF;
+        }
+        Object_Release(pQueue);
+    }
+    return err;
+}
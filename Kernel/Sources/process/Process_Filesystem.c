@@ -8,6 +8,7 @@
 
 #include "ProcessPriv.h"
 #include <filesystem/FilesystemManager.h>
+#include <filesystem/NameCache.h>
 #include "Pipe.h"
 
 
@@ -354,8 +355,8 @@ errno_t Process_Unlink(ProcessRef _Nonnull pProc, const char* _Nonnull pPath)
     decl_try_err();
     PathResolverResult r;
     InodeRef _Locked pSecondNode = NULL;
-    InodeRef _Weak _Locked pParentNode = NULL;
-    InodeRef _Weak _Locked pNodeToUnlink = NULL;
+    InodeRef _Weak pParentNode = NULL;
+    InodeRef _Weak pNodeToUnlink = NULL;
 
     Lock_Lock(&pProc->lock);
     try(PathResolver_AcquireNodeForPath(&pProc->pathResolver, kPathResolutionMode_ParentOnly, pPath, pProc->realUser, &r));
@@ -426,7 +427,15 @@ errno_t Process_Rename(ProcessRef _Nonnull pProc, const char* pOldPath, const ch
     // unlink the target node if one exists for newpath
     // XXX implement me
     
-    try(Filesystem_Rename(or.filesystem, &or.lastPathComponent, or.inode, &nr.lastPathComponent, nr.inode, pProc->realUser));
+    // Invalidate the cached names before and after the rename. The invalidation
+    // after the rename removes entries that a concurrent lookup added while the
+    // rename was in progress
+    NameCache_RemoveName(gNameCache, Filesystem_GetId(or.filesystem), Inode_GetId(or.inode), &or.lastPathComponent);
+    NameCache_RemoveName(gNameCache, Filesystem_GetId(nr.filesystem), Inode_GetId(nr.inode), &nr.lastPathComponent);
+    err = Filesystem_Rename(or.filesystem, &or.lastPathComponent, or.inode, &nr.lastPathComponent, nr.inode, pProc->realUser);
+    NameCache_RemoveName(gNameCache, Filesystem_GetId(or.filesystem), Inode_GetId(or.inode), &or.lastPathComponent);
+    NameCache_RemoveName(gNameCache, Filesystem_GetId(nr.filesystem), Inode_GetId(nr.inode), &nr.lastPathComponent);
+    try(err);
 
 catch:
     PathResolverResult_Deinit(&or);
@@ -14,8 +14,10 @@
 #include <driver/DriverManager.h>
 #include <driver/InterruptController.h>
 #include <driver/MonotonicClock.h>
-#include <driver/RamDisk.h>
+#include <driver/OverlayDisk.h>
 #include <driver/RomDisk.h>
+#include <filesystem/DiskCache.h>
+#include <filesystem/NameCache.h>
 #include <filesystem/FilesystemManager.h>
 #include <filesystem/serenafs/SerenaFS.h>
 #include <hal/Platform.h>
@@ -112,6 +114,7 @@ static _Noreturn OnStartup(const SystemDescription* _Nonnull pSysDesc)
     
     
     // Initialize the dispatch queue services
+    try_bang(WorkItem_InitCaches());
     try_bang(DispatchQueue_Create(0, 1, kDispatchQoS_Interactive, 0, gVirtualProcessorPool, NULL, (DispatchQueueRef*)&gMainDispatchQueue));
     
     
@@ -132,13 +135,13 @@ static _Noreturn OnStartup(const SystemDescription* _Nonnull pSysDesc)
 static void init_root_filesystem(void)
 {
     decl_try_err();
-    RamDiskRef pRamDisk;
+    RomDiskRef pRomDisk;
+    OverlayDiskRef pRootDisk;
     FilesystemRef pFS;
 
     // XXX This is temporary:
-    // XXX We're creating a RAM disk and then we'll look for a disk image in the
-    // XXX ROM. We then copy this disk image into the RAM disk and use this as
-    // XXX our root filesystem.
+    // XXX We look for a disk image in the ROM and then layer a writable overlay
+    // XXX disk on top of it. The overlay disk is our root filesystem.
     const size_t txt_size = &_etext - &_text;
     const size_t dat_size = &_edata - &_data;
     const char* ps = (const char*)(BOOT_ROM_BASE + txt_size + dat_size);
@@ -159,18 +162,25 @@ static void init_root_filesystem(void)
     }
 
 
-    // Create a RAM disk and copy the ROM disk image into it. We assume for now
-    // that the disk image is exactly 64k in size.
-    try(RamDisk_Create(512, 128, 128, &pRamDisk));
-    for (LogicalBlockAddress lba = 0; lba < 128; lba++) {
-        try(DiskDriver_PutBlock(pRamDisk, &dmg[lba * 512], lba));
-    }
+    // Create a ROM disk for the disk image and a copy-on-write overlay disk on
+    // top of it. Unmodified blocks are read straight from the ROM and a block
+    // is only copied to RAM when it is written to for the first time. We assume
+    // for now that the disk image is exactly 64k in size.
+    try(RomDisk_Create(dmg, 512, 128, false, &pRomDisk));
+    try(OverlayDisk_Create((DiskDriverRef)pRomDisk, 1, &pRootDisk));
+    Object_Release(pRomDisk);
+
+
+    // Create the disk block cache, the name lookup cache and the inode cache
+    try(DiskCache_Create(512, 64, &gDiskCache));
+    try(NameCache_Create(256, &gNameCache));
+    try(Inode_InitCache());
 
 
-    // Create a SerenaFS instance and mount it as the root filesystem on the RAM
-    // disk
+    // Create a SerenaFS instance and mount it as the root filesystem on the
+    // overlay disk
     try(SerenaFS_Create((SerenaFSRef*)&pFS));
-    try(FilesystemManager_Create(pFS, (DiskDriverRef)pRamDisk, &gFilesystemManager));
+    try(FilesystemManager_Create(pFS, (DiskDriverRef)pRootDisk, &gFilesystemManager));
     return;
 
 catch:
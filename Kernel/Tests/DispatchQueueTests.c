@@ -12,6 +12,126 @@
 #include <stdio.h>
 #include <string.h>
 #include <System/System.h>
+#include "Asserts.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: DispatchAsyncBatch
+////////////////////////////////////////////////////////////////////////////////
+
+#define BATCH_SIZE  20
+
+static Lock         gBatchLock;
+static Semaphore    gBatchDone;
+static int          gBatchSum;
+
+static void OnBatchClosure(void* _Nullable pValue)
+{
+    Lock_Lock(&gBatchLock);
+    gBatchSum += (int)pValue;
+    Lock_Unlock(&gBatchLock);
+    Semaphore_Relinquish(&gBatchDone, 1);
+}
+
+void dispatch_batch_test(int argc, char *argv[])
+{
+    Dispatch_ClosureEntry entries[BATCH_SIZE];
+    int queue;
+    int expectedSum = 0;
+
+    assertOK(Lock_Init(&gBatchLock));
+    assertOK(Semaphore_Init(&gBatchDone, 0));
+    assertOK(DispatchQueue_Create(0, 4, kDispatchQoS_Utility, kDispatchPriority_Normal, &queue));
+    gBatchSum = 0;
+
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        entries[i].func = OnBatchClosure;
+        entries[i].context = (void*)(i + 1);
+        expectedSum += i + 1;
+    }
+
+    assertOK(DispatchQueue_DispatchAsyncBatch(queue, entries, BATCH_SIZE));
+    assertOK(Semaphore_Acquire(&gBatchDone, BATCH_SIZE, kTimeInterval_Infinity));
+    assertEquals(expectedSum, gBatchSum);
+    assertOK(DispatchQueue_DispatchAsyncBatch(queue, entries, 0));
+
+    assertOK(DispatchQueue_Destroy(queue));
+    Semaphore_Deinit(&gBatchDone);
+    Lock_Deinit(&gBatchLock);
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Apply
+////////////////////////////////////////////////////////////////////////////////
+
+#define APPLY_ITERATIONS    100
+
+static void OnApplyClosure(void* _Nullable pContext, int index)
+{
+    char* pVisited = (char*)pContext;
+
+    // Every index is handed out exactly once. So no locking is needed here
+    pVisited[index]++;
+}
+
+void dispatch_apply_test(int argc, char *argv[])
+{
+    static char visited[APPLY_ITERATIONS];
+    int queue;
+
+    assertOK(DispatchQueue_Create(0, 4, kDispatchQoS_Utility, kDispatchPriority_Normal, &queue));
+
+    memset(visited, 0, sizeof(visited));
+    assertOK(DispatchQueue_Apply(queue, APPLY_ITERATIONS, OnApplyClosure, visited));
+    for (int i = 0; i < APPLY_ITERATIONS; i++) {
+        assertEquals(1, visited[i]);
+    }
+
+    memset(visited, 0, sizeof(visited));
+    assertOK(DispatchQueue_Apply(queue, 1, OnApplyClosure, visited));
+    assertEquals(1, visited[0]);
+    assertEquals(0, visited[1]);
+    assertOK(DispatchQueue_Apply(queue, 0, OnApplyClosure, visited));
+
+    assertOK(DispatchQueue_Destroy(queue));
+    printf("ok\n");
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// MARK: -
+// MARK: Tunables
+////////////////////////////////////////////////////////////////////////////////
+
+void dispatch_tunables_test(int argc, char *argv[])
+{
+    DispatchQueueTunables tunables, tunables2;
+    int queue;
+
+    assertOK(DispatchQueue_Create(0, 4, kDispatchQoS_Utility, kDispatchPriority_Normal, &queue));
+
+    assertOK(DispatchQueue_GetTunables(queue, &tunables));
+    assertEquals(true, TimeInterval_Greater(tunables.latencyTarget, kTimeInterval_Zero));
+    assertEquals(false, TimeInterval_IsNegative(tunables.idleTimeout));
+
+    tunables.latencyTarget = TimeInterval_MakeMilliseconds(5);
+    tunables.idleTimeout = TimeInterval_MakeMilliseconds(100);
+    assertOK(DispatchQueue_SetTunables(queue, &tunables));
+    assertOK(DispatchQueue_GetTunables(queue, &tunables2));
+    assertEquals(true, TimeInterval_Equals(tunables.latencyTarget, tunables2.latencyTarget));
+    assertEquals(true, TimeInterval_Equals(tunables.idleTimeout, tunables2.idleTimeout));
+
+    tunables.latencyTarget = kTimeInterval_Zero;
+    assertEquals(EINVAL, DispatchQueue_SetTunables(queue, &tunables));
+
+    assertOK(DispatchQueue_Destroy(queue));
+    printf("ok\n");
+}
+
 
 // XXX
 // XXX Port these to user space (was written for kernel space originally)
@@ -173,3 +173,84 @@ void readdir_test(int argc, char *argv[])
     }
     _close(fd);
 }
+
+void large_file_test(int argc, char *argv[])
+{
+    // Write a file which is big enough to require the single- and double-
+    // indirect block maps and then read it back in.
+    static char buf[512];
+    const int nBlocks = 320;
+    int fd;
+    ssize_t r;
+
+    File_Unlink("/large_file");
+    if (File_Create("/large_file", kOpen_ReadWrite | kOpen_Exclusive, 0666, &fd) != 0) {
+        printf("create error\n");
+        return;
+    }
+
+    for (int i = 0; i < nBlocks; i++) {
+        memset(buf, i & 0xff, sizeof(buf));
+        _write(fd, buf, sizeof(buf), &r);
+    }
+
+    File_Seek(fd, 0, NULL, SEEK_SET);
+    for (int i = 0; i < nBlocks; i++) {
+        _read(fd, buf, sizeof(buf), &r);
+        if (r != sizeof(buf) || buf[0] != (char)(i & 0xff) || buf[sizeof(buf) - 1] != (char)(i & 0xff)) {
+            printf("mismatch in block #%d\n", i);
+            break;
+        }
+    }
+    _close(fd);
+
+    print_fileinfo("/large_file");
+    File_Unlink("/large_file");
+}
+
+void long_filename_test(int argc, char *argv[])
+{
+    // Create a directory with a mix of short and long file names, remove some
+    // of them and then list the directory.
+    static char name[PATH_MAX];
+    static char longName[256];
+    int fd;
+
+    memset(longName, 'x', 255);
+    longName[0] = '/';
+    longName[255] = '\0';
+
+    _mkdir("/names");
+    for (int i = 0; i < 40; i++) {
+        sprintf(name, "/names/%d", i);
+        if (File_Create(name, kOpen_ReadWrite | kOpen_Exclusive, 0666, &fd) == 0) {
+            _close(fd);
+        }
+    }
+    sprintf(name, "/names/%s", &longName[1 + 7]);
+    if (File_Create(name, kOpen_ReadWrite | kOpen_Exclusive, 0666, &fd) == 0) {
+        _close(fd);
+    }
+    else {
+        printf("long name create error\n");
+    }
+
+    for (int i = 0; i < 40; i += 2) {
+        sprintf(name, "/names/%d", i);
+        File_Unlink(name);
+    }
+
+    const int dfd = _opendir("/names");
+    DirectoryEntry dirent;
+
+    while (true) {
+        ssize_t r;
+        _read(dfd, &dirent, sizeof(dirent), &r);
+        if (r == 0) {
+            break;
+        }
+
+        printf("%ld:\t\"%.20s\" (%u)\n", dirent.inodeId, dirent.name, (unsigned)strlen(dirent.name));
+    }
+    _close(dfd);
+}
@@ -7,11 +7,13 @@
 //
 
 #include <assert.h>
+#include <malloc.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <System/System.h>
+#include "Asserts.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Process with a child process
@@ -72,3 +74,39 @@ void child_process_test(int argc, char *argv[])
         child_process();
     }
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Heap statistics
+////////////////////////////////////////////////////////////////////////////////
+
+void heap_info_test(int argc, char *argv[])
+{
+    HeapInfo before, after;
+    void* p[3];
+
+    malloc_info(&before);
+    p[0] = malloc(8);
+    p[1] = malloc(100);
+    p[2] = malloc(4000);
+    assertNotNULL(p[0]);
+    assertNotNULL(p[1]);
+    assertNotNULL(p[2]);
+
+    malloc_info(&after);
+    assertEquals(before.allocationCount + 3, after.allocationCount);
+    assertEquals(before.allocationCountBySize[0] + 1, after.allocationCountBySize[0]);
+    assertEquals(true, after.bytesInUse >= before.bytesInUse + 4108);
+    assertEquals(true, after.peakBytesInUse >= after.bytesInUse);
+
+    free(p[0]);
+    free(p[1]);
+    free(p[2]);
+    malloc_info(&after);
+    assertEquals(before.deallocationCount + 3, after.deallocationCount);
+    assertEquals(before.bytesInUse, after.bytesInUse);
+
+    assertOK(Heap_GetKernelInfo(&after));
+    assertEquals(true, after.totalBytes > 0);
+    printf("kernel heap: total: %zu, in use: %zu, peak: %zu\n", after.totalBytes, after.bytesInUse, after.peakBytesInUse);
+}
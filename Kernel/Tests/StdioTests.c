@@ -64,3 +64,106 @@ void fopen_memory_variable_size_test(int argc, char *argv[])
     assertNotEOF(filemem(fp, &q));
     printf("base: %#p, eof: %zu, capacity: %zu", q.base, q.eof, q.capacity);
 }
+
+void setvbuf_test(int argc, char *argv[])
+{
+    static char data[64];
+    static char buf[16];
+    FILE_Memory mem;
+    FILE_MemoryQuery q;
+
+    mem.base = data;
+    mem.initialEof = 0;
+    mem.initialCapacity = sizeof(data);
+    mem.maximumCapacity = mem.initialCapacity;
+    mem.options = 0;
+
+    // Fully buffered: nothing reaches the memory block before the flush
+    FILE* fp = fopen_memory(&mem, "rw");
+    assertNotNULL(fp);
+    assertNotEOF(setvbuf(fp, NULL, _IOFBF, 8));
+    assertNotEOF(fputs("Hello", fp));
+    assertNotEOF(filemem(fp, &q));
+    assertEquals(0, q.eof);
+    assertEquals(5, ftell(fp));
+    assertNotEOF(fflush(fp));
+    assertNotEOF(filemem(fp, &q));
+    assertEquals(5, q.eof);
+
+    // Line buffered: a newline pushes the line out
+    assertNotEOF(setvbuf(fp, NULL, _IOLBF, 16));
+    assertNotEOF(fputs(" World\nab", fp));
+    assertNotEOF(filemem(fp, &q));
+    assertEquals(12, q.eof);
+
+    // Reading flushes the pending write data and the read-ahead is dropped on seek
+    assertNotEOF(fseek(fp, 0, SEEK_SET));
+    assertNotNULL(fgets(buf, sizeof(buf), fp));
+    assertEquals(0, strcmp(buf, "Hello World\n"));
+    assertEquals(12, ftell(fp));
+    assertEquals('a', fgetc(fp));
+    assertEquals(13, ftell(fp));
+    assertNotEOF(fclose(fp));
+    puts("ok");
+}
+
+void fread_fwrite_test(int argc, char *argv[])
+{
+    static char data[256];
+    static char buf[128];
+    static char line[32];
+    FILE_Memory mem;
+    FILE_MemoryQuery q;
+
+    mem.base = data;
+    mem.initialEof = 0;
+    mem.initialCapacity = sizeof(data);
+    mem.maximumCapacity = mem.initialCapacity;
+    mem.options = 0;
+
+    for (int i = 0; i < sizeof(buf); i++) {
+        buf[i] = (char)i;
+    }
+
+    // Small writes go through the buffer, big ones straight to the stream
+    FILE* fp = fopen_memory(&mem, "rw");
+    assertNotNULL(fp);
+    assertNotEOF(setvbuf(fp, NULL, _IOFBF, 16));
+    assertEquals(8, fwrite(buf, 1, 8, fp));
+    assertNotEOF(filemem(fp, &q));
+    assertEquals(0, q.eof);
+    assertEquals(120, fwrite(&buf[8], 1, 120, fp));
+    assertNotEOF(filemem(fp, &q));
+    assertEquals(128, q.eof);
+    assertNotEOF(fputs("line 1\nline 2\n", fp));
+
+    assertNotEOF(fseek(fp, 0, SEEK_SET));
+    memset(buf, 0, sizeof(buf));
+    assertEquals(4, fread(buf, 1, 4, fp));
+    assertEquals(31, fread(&buf[4], 4, 31, fp));
+    for (int i = 0; i < sizeof(buf); i++) {
+        assertEquals((char)i, buf[i]);
+    }
+    assertNotNULL(fgets(line, sizeof(line), fp));
+    assertEquals(0, strcmp(line, "line 1\n"));
+    assertNotNULL(fgets(line, sizeof(line), fp));
+    assertEquals(0, strcmp(line, "line 2\n"));
+    assertEquals(0, fread(buf, 1, 1, fp));
+    assertEOF(feof(fp));
+    assertNotEOF(fclose(fp));
+    puts("ok");
+}
+
+void snprintf_test(int argc, char *argv[])
+{
+    static char buf[16];
+
+    assertEquals(11, snprintf(buf, sizeof(buf), "%s %05d", "Hello", 42));
+    assertEquals(0, strcmp(buf, "Hello 00042"));
+
+    // Truncated output still reports the full length
+    assertEquals(17, snprintf(buf, 8, "%8d|%-8d", 12, 34));
+    assertEquals(7, strlen(buf));
+    assertEquals(6, snprintf(NULL, 0, "%x", 0xabcdef));
+    puts("ok");
+}
@@ -12,6 +12,12 @@
 
 // Process
 extern void child_process_test(int argc, char *argv[]);
+extern void heap_info_test(int argc, char *argv[]);
+
+// Dispatch Queue
+extern void dispatch_batch_test(int argc, char *argv[]);
+extern void dispatch_apply_test(int argc, char *argv[]);
+extern void dispatch_tunables_test(int argc, char *argv[]);
 
 // Console
 extern void interactive_console_test(int argc, char *argv[]);
@@ -21,6 +27,8 @@ extern void chdir_pwd_test(int argc, char *argv[]);
 extern void fileinfo_test(int argc, char *argv[]);
 extern void unlink_test(int argc, char *argv[]);
 extern void readdir_test(int argc, char *argv[]);
+extern void large_file_test(int argc, char *argv[]);
+extern void long_filename_test(int argc, char *argv[]);
 
 // Pipe
 extern void pipe_test(int argc, char *argv[]);
@@ -28,6 +36,9 @@ extern void pipe_test(int argc, char *argv[]);
 // Stdio
 extern void fopen_memory_fixed_size_test(int argc, char *argv[]);
 extern void fopen_memory_variable_size_test(int argc, char *argv[]);
+extern void setvbuf_test(int argc, char *argv[]);
+extern void fread_fwrite_test(int argc, char *argv[]);
+extern void snprintf_test(int argc, char *argv[]);
 
 
 #define RUN_TEST(__test_name) \
@@ -38,12 +49,21 @@ extern void fopen_memory_variable_size_test(int argc, char *argv[]);
 void main_closure(int argc, char *argv[])
 {
     RUN_TEST(child_process_test);
+    //RUN_TEST(heap_info_test);
+    //RUN_TEST(dispatch_batch_test);
+    //RUN_TEST(dispatch_apply_test);
+    //RUN_TEST(dispatch_tunables_test);
     //RUN_TEST(interactive_console_test);
     //RUN_TEST(chdir_pwd_test);
     //RUN_TEST(fileinfo_test);
     //RUN_TEST(unlink_test);
     //RUN_TEST(readdir_test);
+    //RUN_TEST(large_file_test);
+    //RUN_TEST(long_filename_test);
     //RUN_TEST(fopen_memory_fixed_size_test);
     //RUN_TEST(fopen_memory_variable_size_test);
+    //RUN_TEST(setvbuf_test);
+    //RUN_TEST(fread_fwrite_test);
+    //RUN_TEST(snprintf_test);
     //RUN_TEST(pipe_test);
 }
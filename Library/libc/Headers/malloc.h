@@ -11,6 +11,7 @@
 
 #include <System/_cmndef.h>
 #include <System/abi/_size.h>
+#include <System/Heap.h>
 
 __CPP_BEGIN
 
@@ -24,6 +25,9 @@ extern void free(void *ptr);
 // Debugging tools.
 //
 
+// Returns statistics about the process heap.
+extern void malloc_info(HeapInfo* _Nonnull pOutInfo);
+
 // Prints a description of the heap to the console.
 extern void malloc_dump(void);
 
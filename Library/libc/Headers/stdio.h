@@ -75,16 +75,20 @@ typedef struct _FILE {
     struct _FILE*               next;
     FILE_Callbacks              cb;
     void*                       context;
-    char*                       buffer;
+    char*                       buffer;             // Read-ahead or write-behind buffer. Allocated on first I/O if not set with setvbuf()
     size_t                      bufferCapacity;
-    size_t                      bufferCount;
+    size_t                      bufferCount;        // Number of valid bytes in the buffer
+    size_t                      bufferIndex;        // Index of the next unread byte in the buffer if the most recent direction is read
     struct _FILE_Flags {
         unsigned int mode:3;
         unsigned int mostRecentDirection:2;
+        unsigned int bufferMode:2;
         unsigned int hasError:1;
         unsigned int hasEof:1;
         unsigned int shouldFreeOnClose:1;
+        unsigned int shouldFreeBuffer:1;
     }                           flags;
+    char                        unbufferedChar;     // Single byte buffer used by unbuffered streams
 } FILE;
 
 
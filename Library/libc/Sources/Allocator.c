@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <List.h>
 #include <stdio.h>
+#include <string.h>
 
 #if __LP64__
 #define HEAP_ALIGNMENT  16
@@ -20,14 +21,42 @@
 #endif
 
 
+// Small blocks are allocated from per size class free lists. Everything bigger
+// than MAX_SMALL_BLOCK_SIZE (including the block header) is allocated directly
+// from the memory regions.
+#define SIZE_CLASS_COUNT        16
+#define MAX_SMALL_BLOCK_SIZE    512
+
+// Small blocks are carved out of chunks of this size which are allocated from
+// the memory regions. Chunks are never returned to the memory regions.
+#define SMALL_CHUNK_SIZE        2048
+
+// The block sizes of the size classes. Every size is a multiple of 16 and thus
+// of HEAP_ALIGNMENT
+static const uint16_t gSizeClassBlockSizes[SIZE_CLASS_COUNT] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512
+};
+
+
 // A memory block structure describes a freed or allocated block of memory. The
 // structure is placed right in front of the memory block. Note that the block
 // size includes the header size.
+// The header of an allocated block records in the low bits of the size whether
+// the block is a small or a large block. The 'next' field of an allocated large
+// block points to the memory region that owns the block. This allows us to
+// free a block without searching for it.
 typedef struct _MemBlock {
     struct _MemBlock* _Nullable next;
     size_t                      size;   // The size includes sizeof(MemBlock). Max size of a free block is 4GB; max size of an allocated block is 2GB
 } MemBlock;
 
+#define MEM_BLOCK_SMALL     1           // Allocated block from a size class
+#define MEM_BLOCK_LARGE     2           // Allocated block from a memory region
+#define MEM_BLOCK_FLAGS     3
+
+#define MemBlock_GetSize(__pBlock) \
+    ((__pBlock)->size & ~((size_t)MEM_BLOCK_FLAGS))
+
 
 // A heap memory region is a region of contiguous memory which is managed by the
 // heap. Each such region has its own private list of free memory blocks.
@@ -39,10 +68,32 @@ typedef struct _MemRegion {
 } MemRegion;
 
 
+// A size class keeps a LIFO list of free blocks of the same size. New blocks
+// are carved out of the current chunk once the free list is empty.
+typedef struct _SizeClass {
+    MemBlock* _Nullable first_free_block;
+    char* _Nullable     chunk_lower;        // Unused part of the current chunk
+    char* _Nullable     chunk_upper;
+} SizeClass;
+
+
+// Allocator statistics. See HeapInfo
+typedef struct _AllocatorStats {
+    size_t  total_bytes;
+    size_t  bytes_in_use;
+    size_t  peak_bytes_in_use;
+    size_t  alloc_count;
+    size_t  dealloc_count;
+    size_t  alloc_count_by_size[kHeapInfo_SizeBucketCount];
+} AllocatorStats;
+
+
 // An allocator manages memory from a pool of memory contiguous regions.
 typedef struct _Allocator {
     SList               regions;
-    MemBlock* _Nullable first_allocated_block;  // Unordered list of allocated blocks (no matter from which memory region they were allocated)
+    AllocatorStats      stats;
+    SizeClass           classes[SIZE_CLASS_COUNT];
+    uint8_t             class_index[MAX_SMALL_BLOCK_SIZE / HEAP_ALIGNMENT + 1];    // Maps a block size in units of HEAP_ALIGNMENT to the smallest size class that can hold it
 } Allocator;
 
 
@@ -164,8 +215,8 @@ static MemBlock* _Nullable MemRegion_AllocMemBlock(MemRegion* _Nonnull pMemRegio
 }
 
 // Deallocates the given memory block. Expects that the memory block is managed
-// by the given mem region. Expects that the memory block is already removed from
-// the allocators list of allocated memory blocks.
+// by the given mem region and that its header no longer carries the allocated
+// block flags.
 // \param pMemRegion the memory region header
 // \param pBlockToFree pointer to the header of the memory block to free
 void MemRegion_FreeMemBlock(MemRegion* _Nonnull pMemRegion, MemBlock* _Nonnull pBlockToFree)
@@ -277,12 +328,25 @@ errno_t __Allocator_Create(const MemoryDescriptor* _Nonnull pMemDesc, AllocatorR
     char* pFirstMemRegionBase = pAllocatorBase + sizeof(Allocator);
 
     AllocatorRef pAllocator = (AllocatorRef)pAllocatorBase;
-    pAllocator->first_allocated_block = NULL;
     SList_Init(&pAllocator->regions);
+    memset(&pAllocator->stats, 0, sizeof(AllocatorStats));
+
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        pAllocator->classes[i].first_free_block = NULL;
+        pAllocator->classes[i].chunk_lower = NULL;
+        pAllocator->classes[i].chunk_upper = NULL;
+    }
+    for (int i = 0, ci = 0; i <= MAX_SMALL_BLOCK_SIZE / HEAP_ALIGNMENT; i++) {
+        while (gSizeClassBlockSizes[ci] < i * HEAP_ALIGNMENT) {
+            ci++;
+        }
+        pAllocator->class_index[i] = (uint8_t)ci;
+    }
     
     MemRegion* pFirstRegion;
     try_null(pFirstRegion, MemRegion_Create(pFirstMemRegionBase, pMemDesc), ENOMEM);
     SList_InsertAfterLast(&pAllocator->regions, &pFirstRegion->node);
+    pAllocator->stats.total_bytes += pFirstRegion->first_free_block->size;
     
     *pOutAllocator = pAllocator;
     return 0;
@@ -300,6 +364,7 @@ errno_t __Allocator_AddMemoryRegion(AllocatorRef _Nonnull pAllocator, const Memo
 
     try_null(pMemRegion, MemRegion_Create(pMemDesc->lower, pMemDesc), ENOMEM);
     SList_InsertAfterLast(&pAllocator->regions, &pMemRegion->node);
+    pAllocator->stats.total_bytes += pMemRegion->first_free_block->size;
     return 0;
 
 catch:
@@ -319,6 +384,19 @@ static MemRegion* _Nullable Allocator_GetMemRegionManaging_Locked(AllocatorRef _
     return NULL;
 }
 
+// Returns the index of the HeapInfo size bucket for an allocation of 'nbytes'.
+static int Allocator_GetSizeBucket(size_t nbytes)
+{
+    size_t limit = 16;
+    int i = 0;
+
+    while (i < kHeapInfo_SizeBucketCount - 1 && nbytes > limit) {
+        limit <<= 1;
+        i++;
+    }
+    return i;
+}
+
 bool __Allocator_IsManaging(AllocatorRef _Nonnull pAllocator, void* _Nullable ptr)
 {
     if (ptr == NULL || ((uintptr_t) ptr) == UINTPTR_MAX) {
@@ -331,6 +409,60 @@ bool __Allocator_IsManaging(AllocatorRef _Nonnull pAllocator, void* _Nullable pt
     return r;
 }
 
+// Allocates a large block from the first memory region that is able to
+// satisfy the request. 'nBytesToAlloc' has to include the heap block header and
+// the correct alignment.
+static MemBlock* _Nullable Allocator_AllocLargeBlock(AllocatorRef _Nonnull pAllocator, size_t nBytesToAlloc)
+{
+    MemRegion* pCurRegion = (MemRegion*)pAllocator->regions.first;
+
+    while (pCurRegion) {
+        MemBlock* pMemBlock = MemRegion_AllocMemBlock(pCurRegion, nBytesToAlloc);
+
+        if (pMemBlock != NULL) {
+            pMemBlock->next = (MemBlock*)pCurRegion;
+            pMemBlock->size |= MEM_BLOCK_LARGE;
+            return pMemBlock;
+        }
+
+        pCurRegion = (MemRegion*)pCurRegion->node.next;
+    }
+
+    return NULL;
+}
+
+// Allocates a block from the size class 'classIdx'. Takes a block from the
+// free list if possible and carves a new block out of the current chunk
+// otherwise.
+static MemBlock* _Nullable Allocator_AllocSmallBlock(AllocatorRef _Nonnull pAllocator, int classIdx)
+{
+    SizeClass* pClass = &pAllocator->classes[classIdx];
+    const size_t blockSize = gSizeClassBlockSizes[classIdx];
+    MemBlock* pMemBlock = pClass->first_free_block;
+
+    if (pMemBlock) {
+        pClass->first_free_block = pMemBlock->next;
+    }
+    else {
+        if ((size_t)(pClass->chunk_upper - pClass->chunk_lower) < blockSize) {
+            MemBlock* pChunk = Allocator_AllocLargeBlock(pAllocator, sizeof(MemBlock) + SMALL_CHUNK_SIZE);
+
+            if (pChunk == NULL) {
+                return NULL;
+            }
+            pClass->chunk_lower = (char*)pChunk + sizeof(MemBlock);
+            pClass->chunk_upper = (char*)pChunk + MemBlock_GetSize(pChunk);
+        }
+
+        pMemBlock = (MemBlock*)pClass->chunk_lower;
+        pClass->chunk_lower += blockSize;
+    }
+
+    pMemBlock->next = NULL;
+    pMemBlock->size = blockSize | MEM_BLOCK_SMALL;
+    return pMemBlock;
+}
+
 errno_t __Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, size_t nbytes, void* _Nullable * _Nonnull pOutPtr)
 {
     // Return the "empty memory block singleton" if the requested size is 0
@@ -338,27 +470,22 @@ errno_t __Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, size_t nbyte
         *((uintptr_t*) pOutPtr) = UINTPTR_MAX;
         return 0;
     }
+    if (nbytes > SIZE_MAX / 2) {
+        *pOutPtr = NULL;
+        return ENOMEM;
+    }
     
     
     // Compute how many bytes we have to take from free memory
     const size_t nBytesToAlloc = __Ceil_PowerOf2(sizeof(MemBlock) + nbytes, HEAP_ALIGNMENT);
-    
-    
-    // Note that the code here assumes desc 0 is chip RAM and all the others are
-    // fast RAM. This is enforced by Allocator_Create().
-    MemBlock* pMemBlock = NULL;
+    MemBlock* pMemBlock;
     decl_try_err();
 
-    // Go through the available memory region trying to allocate the memory block
-    // until it works.
-    MemRegion* pCurRegion = (MemRegion*)pAllocator->regions.first;
-    while (pCurRegion) {
-        pMemBlock = MemRegion_AllocMemBlock(pCurRegion, nBytesToAlloc);
-        if (pMemBlock != NULL) {
-            break;
-        }
-
-        pCurRegion = (MemRegion*)pCurRegion->node.next;
+    if (nBytesToAlloc <= MAX_SMALL_BLOCK_SIZE) {
+        pMemBlock = Allocator_AllocSmallBlock(pAllocator, pAllocator->class_index[nBytesToAlloc / HEAP_ALIGNMENT]);
+    }
+    else {
+        pMemBlock = Allocator_AllocLargeBlock(pAllocator, nBytesToAlloc);
     }
 
 
@@ -366,9 +493,12 @@ errno_t __Allocator_AllocateBytes(AllocatorRef _Nonnull pAllocator, size_t nbyte
     throw_ifnull(pMemBlock, ENOMEM);
 
 
-    // Add the allocated block to the list of allocated blocks
-    pMemBlock->next = pAllocator->first_allocated_block;
-    pAllocator->first_allocated_block = pMemBlock;
+    // Update the statistics
+    pAllocator->stats.bytes_in_use += MemBlock_GetSize(pMemBlock);
+    pAllocator->stats.peak_bytes_in_use = __max(pAllocator->stats.peak_bytes_in_use, pAllocator->stats.bytes_in_use);
+    pAllocator->stats.alloc_count++;
+    pAllocator->stats.alloc_count_by_size[Allocator_GetSizeBucket(nbytes)]++;
+
 
     // Calculate and return the user memory block pointer
     *pOutPtr = (char*)pMemBlock + sizeof(MemBlock);
@@ -387,45 +517,51 @@ errno_t __Allocator_DeallocateBytes(AllocatorRef _Nonnull pAllocator, void* _Nul
         return 0;
     }
     
-    // Find out which memory region contains the block that we want to free
+    // Find out which memory region contains the block that we want to free. We
+    // can not trust the block header of a pointer that we don't manage
     MemRegion* pMemRegion = Allocator_GetMemRegionManaging_Locked(pAllocator, ptr);
     if (pMemRegion == NULL) {
         // 'ptr' isn't managed by this allocator
         return ENOTBLK;
     }
-    
+
     MemBlock* pBlockToFree = (MemBlock*)(((char*)ptr) - sizeof(MemBlock));
-    
-    
-    // Remove the block 'ptr' from the list of allocated blocks
-    MemBlock* pPrevBlock = NULL;
-    MemBlock* pCurBlock = pAllocator->first_allocated_block;
-    while (pCurBlock) {
-        if (pCurBlock == pBlockToFree) {
-            if (pPrevBlock) {
-                pPrevBlock->next = pBlockToFree->next;
-            } else {
-                pAllocator->first_allocated_block = pBlockToFree->next;
+    const size_t blockSize = MemBlock_GetSize(pBlockToFree);
+
+    switch (pBlockToFree->size & MEM_BLOCK_FLAGS) {
+        case MEM_BLOCK_SMALL: {
+            // Push the block on the free list of its size class
+            if (blockSize > MAX_SMALL_BLOCK_SIZE) {
+                return ENOTBLK;
+            }
+            SizeClass* pClass = &pAllocator->classes[pAllocator->class_index[blockSize / HEAP_ALIGNMENT]];
+
+            pBlockToFree->size = blockSize;
+            pBlockToFree->next = pClass->first_free_block;
+            pClass->first_free_block = pBlockToFree;
+            pAllocator->stats.bytes_in_use -= blockSize;
+            pAllocator->stats.dealloc_count++;
+            return 0;
+        }
+
+        case MEM_BLOCK_LARGE: {
+            // Tell the memory region to free the memory block
+            if (pBlockToFree->next != (MemBlock*)pMemRegion) {
+                return ENOTBLK;
             }
+
+            pBlockToFree->size = blockSize;
             pBlockToFree->next = NULL;
-            break;
+            MemRegion_FreeMemBlock(pMemRegion, pBlockToFree);
+            pAllocator->stats.bytes_in_use -= blockSize;
+            pAllocator->stats.dealloc_count++;
+            return 0;
         }
-        
-        pPrevBlock = pCurBlock;
-        pCurBlock = pCurBlock->next;
-    }
-    
 
-    // Looks like 'ptr' isn't a pointer to an allocated memory block
-    if (pBlockToFree->next != NULL) {
-        return ENOTBLK;
+        default:
+            // Looks like 'ptr' isn't a pointer to an allocated memory block
+            return ENOTBLK;
     }
-    
-    
-    // Tell the memory region to free the memory block
-    MemRegion_FreeMemBlock(pMemRegion, pBlockToFree);
-    
-    return 0;
 }
 
 // Returns the size of the given memory block. This is the size minus the block
@@ -435,7 +571,36 @@ size_t __Allocator_GetBlockSize(AllocatorRef _Nonnull pAllocator, void* _Nonnull
 {
     MemBlock* pMemBlock = (MemBlock*) (((char*)ptr) - sizeof(MemBlock));
 
-    return pMemBlock->size - sizeof(MemBlock);
+    return MemBlock_GetSize(pMemBlock) - sizeof(MemBlock);
+}
+
+// Returns the allocator statistics. Note that this function walks the free
+// lists of the memory regions to find the largest free block. Free blocks of
+// the size classes are not counted as free blocks.
+void __Allocator_GetInfo(AllocatorRef _Nonnull pAllocator, HeapInfo* _Nonnull pOutInfo)
+{
+    const AllocatorStats* pStats = &pAllocator->stats;
+
+    pOutInfo->totalBytes = pStats->total_bytes;
+    pOutInfo->bytesInUse = pStats->bytes_in_use;
+    pOutInfo->peakBytesInUse = pStats->peak_bytes_in_use;
+    pOutInfo->largestFreeBlockSize = 0;
+    pOutInfo->freeBlockCount = 0;
+    pOutInfo->allocationCount = pStats->alloc_count;
+    pOutInfo->deallocationCount = pStats->dealloc_count;
+    for (int i = 0; i < kHeapInfo_SizeBucketCount; i++) {
+        pOutInfo->allocationCountBySize[i] = pStats->alloc_count_by_size[i];
+    }
+
+    SList_ForEach(&pAllocator->regions, MemRegion, {
+        MemBlock* pCurBlock = pCurNode->first_free_block;
+
+        while (pCurBlock) {
+            pOutInfo->largestFreeBlockSize = __max(pOutInfo->largestFreeBlockSize, pCurBlock->size);
+            pOutInfo->freeBlockCount++;
+            pCurBlock = pCurBlock->next;
+        }
+    });
 }
 
 #ifdef ALLOCATOR_DEBUG
@@ -458,17 +623,18 @@ void __Allocator_Dump(AllocatorRef _Nonnull pAllocator)
     }
     putchar('\n');
 
-    MemBlock* pCurBlock = pAllocator->first_allocated_block;
-    int i = 1;
-    printf("Allocated (s: 0x%p):\n", pCurBlock);
-    while (pCurBlock) {
-        char* pCurBlockBase = (char*)pCurBlock;
-        MemRegion* pMemRegion = Allocator_GetMemRegionManaging_Locked(pAllocator, pCurBlockBase);
-        
-        printf(" %d:  0x%p, {a: 0x%p, n: 0x%p s: %zd}\n", i, pCurBlockBase + sizeof(MemBlock), pCurBlock, pCurBlock->next, pCurBlock->size);
-        pCurBlock = pCurBlock->next;
-        i++;
-    }    
+    puts("Size classes:");
+    for (int ci = 0; ci < SIZE_CLASS_COUNT; ci++) {
+        const SizeClass* pClass = &pAllocator->classes[ci];
+        MemBlock* pCurBlock = pClass->first_free_block;
+        int nFree = 0;
+
+        while (pCurBlock) {
+            nFree++;
+            pCurBlock = pCurBlock->next;
+        }
+        printf(" %d:  s: %u, free: %d, chunk: %zd\n", ci, (unsigned)gSizeClassBlockSizes[ci], nFree, (ssize_t)(pClass->chunk_upper - pClass->chunk_lower));
+    }
     putchar('\n');
 }
 
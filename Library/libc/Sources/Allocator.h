@@ -10,6 +10,7 @@
 #define _ALLOCATOR_H 1
 
 #include <__stddef.h>
+#include <System/Heap.h>
 
 // Enable for debugging support
 #define ALLOCATOR_DEBUG
@@ -42,6 +43,9 @@ extern errno_t __Allocator_DeallocateBytes(AllocatorRef _Nonnull pAllocator, voi
 // internal alignment constraints.
 extern size_t __Allocator_GetBlockSize(AllocatorRef _Nonnull pAllocator, void* _Nonnull ptr);
 
+// Returns the allocator statistics.
+extern void __Allocator_GetInfo(AllocatorRef _Nonnull pAllocator, HeapInfo* _Nonnull pOutInfo);
+
 #ifdef ALLOCATOR_DEBUG
 extern void __Allocator_Dump(AllocatorRef _Nonnull pAllocator);
 extern void __Allocator_DumpMemoryRegions(AllocatorRef _Nonnull pAllocator);
@@ -6,6 +6,8 @@
 //  Copyright © 2023 Dietmar Planitzer. All rights reserved.
 //
 
+#include <malloc.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <System/Lock.h>
@@ -21,7 +23,39 @@
 #define EXPANSION_HEAP_SIZE __Ceil_PowerOf2(64*1024, CPU_PAGE_SIZE)
 
 
+// Enable to record the most recent malloc() and free() calls in a ring buffer.
+// malloc_dump() prints the trace.
+//#define MALLOC_TRACE
+#define MALLOC_TRACE_CAPACITY   64
+
+
+#ifdef MALLOC_TRACE
+typedef struct MallocTraceRecord {
+    void* _Nullable ptr;
+    ssize_t         size;       // Requested size; -1 for a free()
+} MallocTraceRecord;
+#endif
+
+
 static Lock __gLock;
+#ifdef MALLOC_TRACE
+static MallocTraceRecord    __gTrace[MALLOC_TRACE_CAPACITY];
+static size_t               __gTraceCount;  // Total number of records written so far
+#endif
+
+
+#ifdef MALLOC_TRACE
+static void __malloc_trace(void* _Nullable ptr, ssize_t size)
+{
+    MallocTraceRecord* pRecord = &__gTrace[__gTraceCount % MALLOC_TRACE_CAPACITY];
+
+    pRecord->ptr = ptr;
+    pRecord->size = size;
+    __gTraceCount++;
+}
+#else
+#define __malloc_trace(__ptr, __size)
+#endif
 
 void __malloc_init(void)
 {
@@ -71,6 +105,7 @@ static void * __malloc(size_t size)
     if (err != EOK) {
         errno = err;
     }
+    __malloc_trace(ptr, (ssize_t)size);
 
     return ptr;
 }
@@ -78,6 +113,7 @@ static void * __malloc(size_t size)
 static void __free(void *ptr)
 {
     __Allocator_DeallocateBytes(__gAllocator, ptr);
+    __malloc_trace(ptr, -1);
 }
 
 
@@ -132,11 +168,45 @@ void *realloc(void *ptr, size_t new_size)
     return np;
 }
 
+void malloc_info(HeapInfo* _Nonnull pOutInfo)
+{
+    try_bang(Lock_Lock(&__gLock));
+    __Allocator_GetInfo(__gAllocator, pOutInfo);
+    try_bang(Lock_Unlock(&__gLock));
+}
+
 void malloc_dump(void)
 {
 #ifdef ALLOCATOR_DEBUG
+    HeapInfo info;
+
     Lock_Lock(&__gLock);
     __Allocator_Dump(__gAllocator);
+    __Allocator_GetInfo(__gAllocator, &info);
+
+    printf("Total: %zu, in use: %zu, peak: %zu\n", info.totalBytes, info.bytesInUse, info.peakBytesInUse);
+    printf("Free blocks: %zu, largest: %zu\n", info.freeBlockCount, info.largestFreeBlockSize);
+    printf("Allocs: %zu, frees: %zu\n", info.allocationCount, info.deallocationCount);
+    printf("By size:");
+    for (int i = 0; i < kHeapInfo_SizeBucketCount; i++) {
+        printf(" %zu", info.allocationCountBySize[i]);
+    }
+    putchar('\n');
+
+#ifdef MALLOC_TRACE
+    const size_t nRecords = __min(__gTraceCount, MALLOC_TRACE_CAPACITY);
+
+    puts("Trace:");
+    for (size_t i = __gTraceCount - nRecords; i < __gTraceCount; i++) {
+        const MallocTraceRecord* pRecord = &__gTrace[i % MALLOC_TRACE_CAPACITY];
+
+        if (pRecord->size >= 0) {
+            printf("  alloc 0x%p, %zd\n", pRecord->ptr, pRecord->size);
+        } else {
+            printf("  free  0x%p\n", pRecord->ptr);
+        }
+    }
+#endif
     Lock_Unlock(&__gLock);
 #endif
 }
\ No newline at end of file
@@ -9,55 +9,123 @@
 #include "Formatter.h"
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 
+errno_t __Formatter_StreamSink(FormatterRef _Nonnull self, const char * _Nonnull pBuffer, size_t nBytes)
+{
+    if (fwrite(pBuffer, 1, nBytes, (FILE*)self->context) < nBytes) {
+        return errno;
+    }
+    return 0;
+}
+
+errno_t __Formatter_StringSink(FormatterRef _Nonnull self, const char * _Nonnull pBuffer, size_t nBytes)
+{
+    self->buffer += nBytes;
+    self->bufferCapacity -= nBytes;
+    return 0;
+}
+
+static errno_t Formatter_Flush(FormatterRef _Nonnull self)
+{
+    decl_try_err();
+
+    if (self->bufferCount > 0) {
+        try(self->sink(self, self->buffer, self->bufferCount));
+        self->bufferCount = 0;
+    }
+
+catch:
+    return err;
+}
+
+// Makes room for at least one character in the buffer if possible. Returns the
+// number of characters that fit into the buffer in 'pOutAvail'. 0 means that
+// the formatter only counts characters.
+static inline errno_t Formatter_Reserve(FormatterRef _Nonnull self, size_t* _Nonnull pOutAvail)
+{
+    decl_try_err();
+
+    if (self->bufferCount == self->bufferCapacity) {
+        try(Formatter_Flush(self));
+    }
+    *pOutAvail = self->bufferCapacity - self->bufferCount;
+
+catch:
+    return err;
+}
+
 static errno_t Formatter_WriteChar(FormatterRef _Nonnull self, char ch)
 {
-    const int r = fputc(ch, self->stream);
+    decl_try_err();
+    size_t nAvail;
 
-    if (r == EOF) {
-        return errno;
+    try(Formatter_Reserve(self, &nAvail));
+    if (nAvail > 0) {
+        self->buffer[self->bufferCount++] = ch;
     }
     self->charactersWritten++;
-    return 0;
+
+catch:
+    return err;
 }
 
-static errno_t Formatter_WriteString(FormatterRef _Nonnull self, const char * _Nonnull str, size_t maxChars)
+static errno_t Formatter_WriteChars(FormatterRef _Nonnull self, const char * _Nonnull pChars, size_t nChars)
 {
-    if (maxChars == SIZE_MAX) {
-        const int r = fputs(str, self->stream);
+    decl_try_err();
+    size_t nAvail;
 
-        if (r == EOF) {
-            return errno;
-        }
-        self->charactersWritten += r;
-    }
-    else {
-        while (maxChars-- > 0) {
-            const char ch = *str++;
-            
-            if (ch != 0) {
-                const int r = fputc(ch, self->stream);
-                if (r == EOF) {
-                    return errno;
-                }
-                self->charactersWritten++;
-            }
-            else {
-                break;
-            }
+    while (nChars > 0) {
+        try(Formatter_Reserve(self, &nAvail));
+        if (nAvail == 0) {
+            self->charactersWritten += nChars;
+            break;
         }
+
+        const size_t nCharsToCopy = __min(nAvail, nChars);
+        memcpy(&self->buffer[self->bufferCount], pChars, nCharsToCopy);
+        self->bufferCount += nCharsToCopy;
+        self->charactersWritten += nCharsToCopy;
+        pChars += nCharsToCopy;
+        nChars -= nCharsToCopy;
     }
 
-    return 0;
+catch:
+    return err;
+}
+
+static errno_t Formatter_WriteString(FormatterRef _Nonnull self, const char * _Nonnull str, size_t maxChars)
+{
+    size_t len;
+
+    if (maxChars == SIZE_MAX) {
+        len = strlen(str);
+    } else {
+        const char* p = memchr(str, '\0', maxChars);
+        len = (p) ? (size_t)(p - str) : maxChars;
+    }
+
+    return Formatter_WriteChars(self, str, len);
 }
 
 static errno_t Formatter_WriteRepChar(FormatterRef _Nonnull self, char ch, int count)
 {
     decl_try_err();
+    size_t nAvail;
+
+    while (count > 0) {
+        try(Formatter_Reserve(self, &nAvail));
+        if (nAvail == 0) {
+            self->charactersWritten += count;
+            break;
+        }
 
-    while(count-- > 0) {
-        try(Formatter_WriteChar(self, ch));
+        const size_t nCharsToFill = __min(nAvail, (size_t)count);
+        memset(&self->buffer[self->bufferCount], ch, nCharsToFill);
+        self->bufferCount += nCharsToFill;
+        self->charactersWritten += nCharsToFill;
+        count -= (int)nCharsToFill;
     }
 
 catch:
@@ -231,9 +299,7 @@ static errno_t Formatter_FormatSignedIntegerField(FormatterRef _Nonnull self, co
         if (nLeadingZeros > 0) {
             try(Formatter_WriteRepChar(self, '0', nLeadingZeros));
         }
-        while(nDigits-- > 0) {
-            try(Formatter_WriteChar(self, *pDigits++));
-        }
+        try(Formatter_WriteChars(self, pDigits, nDigits));
     }
 
     if (nspaces > 0 && spec->flags.isLeftJustified) {
@@ -275,15 +341,11 @@ static errno_t Formatter_FormatUnsignedIntegerField(FormatterRef _Nonnull self,
     }
 
     if (!isEmpty) {
-        while (nRadixChars-- > 0) {
-            try(Formatter_WriteChar(self, *pRadixChars++));
-        }
+        try(Formatter_WriteChars(self, pRadixChars, nRadixChars));
         if (nLeadingZeros > 0) {
             try(Formatter_WriteRepChar(self, '0', nLeadingZeros));
         }
-        while(nDigits-- > 0) {
-            try(Formatter_WriteChar(self, *pDigits++));
-        }
+        try(Formatter_WriteChars(self, pDigits, nDigits));
     }
     else if (radix == 8) {
         try(Formatter_WriteChar(self, '0'));
@@ -470,12 +532,17 @@ errno_t __Formatter_vFormat(FormatterRef _Nonnull self, const char* _Nonnull for
             try(Formatter_FormatArgument(self, *format++, &spec, &ap));
         }
         else {
-            try(Formatter_WriteChar(self, ch));
-            format++;
+            // Copy the literal text up to the next conversion in one go
+            const char* pLiteral = format;
+
+            while (*format != '\0' && *format != '%') {
+                format++;
+            }
+            try(Formatter_WriteChars(self, pLiteral, format - pLiteral));
         }
     }
 
-    return 0;
+    return Formatter_Flush(self);
 
 catch:
     return err;
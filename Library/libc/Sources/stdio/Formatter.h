@@ -17,6 +17,11 @@ struct Formatter;
 typedef struct Formatter* FormatterRef;
 
 
+// Writes 'nBytes' bytes from 'pBuffer' to the sink. Returns one of the EXX
+// constants.
+typedef errno_t (*Formatter_SinkFunc)(FormatterRef _Nonnull self, const char * _Nonnull pBuffer, size_t nBytes);
+
+
 #define LENGTH_MODIFIER_hh      0
 #define LENGTH_MODIFIER_h       1
 #define LENGTH_MODIFIER_none    2
@@ -44,22 +49,49 @@ typedef struct ConversionSpec {
 } ConversionSpec;
 
 
+// The formatter collects the formatted characters in 'buffer' and hands them
+// to the sink whenever the buffer is full and at the end of the format
+// operation. A formatter with a buffer capacity of 0 only counts characters.
 typedef struct Formatter {
-    FILE* _Nonnull  stream;
-    size_t          charactersWritten;
-    char            digits[DIGIT_BUFFER_CAPACITY];
+    Formatter_SinkFunc _Nonnull sink;
+    void* _Nullable             context;
+    size_t                      charactersWritten;
+    size_t                      bufferCount;
+    size_t                      bufferCapacity;
+    char* _Nullable             buffer;
+    char                        digits[DIGIT_BUFFER_CAPACITY];
 } Formatter;
 
 
-static inline void __Formatter_Init(FormatterRef _Nonnull self, FILE* _Nonnull pStream) {
-    self->stream = pStream;
+// Size of the on-stack buffer that printf() and friends use to collect the
+// formatted characters before they write them to the stream
+#define FORMATTER_STREAM_BUFFER_CAPACITY    128
+
+
+static inline void __Formatter_Init(FormatterRef _Nonnull self, Formatter_SinkFunc _Nonnull pSinkFunc, void* _Nullable pContext, char* _Nullable pBuffer, size_t bufferCapacity) {
+    self->sink = pSinkFunc;
+    self->context = pContext;
     self->charactersWritten = 0;
+    self->buffer = pBuffer;
+    self->bufferCapacity = (pBuffer) ? bufferCapacity : 0;
+    self->bufferCount = 0;
 }
 
 static inline void __Formatter_Deinit(FormatterRef _Nullable self) {
-    self->stream = NULL;
+    self->context = NULL;
+    self->buffer = NULL;
 }
 
+// Formats the string and flushes the formatted characters to the sink
 extern errno_t __Formatter_vFormat(FormatterRef _Nonnull self, const char* _Nonnull format, va_list ap);
 
+// Sink which writes to the stream 'context'
+extern errno_t __Formatter_StreamSink(FormatterRef _Nonnull self, const char * _Nonnull pBuffer, size_t nBytes);
+
+// Sink for a formatter that formats straight into the destination string. The
+// formatter buffer is the destination. The sink moves the buffer past the
+// characters that were written to it. The formatter switches to counting once
+// the destination is full.
+extern errno_t __Formatter_StringSink(FormatterRef _Nonnull self, const char * _Nonnull pBuffer, size_t nBytes);
+
 #endif  /* Formatter_h */
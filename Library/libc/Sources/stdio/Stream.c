@@ -80,6 +80,7 @@ errno_t __fopen_init(FILE* _Nonnull self, bool bFreeOnClose, void* context, cons
     self->context = context;
     self->flags.mode = sm;
     self->flags.mostRecentDirection = __kStreamDirection_None;
+    self->flags.bufferMode = _IOFBF;
     self->flags.shouldFreeOnClose = bFreeOnClose;
 
     if (gOpenFiles) {
@@ -108,6 +109,213 @@ catch:
     return NULL;
 }
 
+// Frees the stream buffer if we own it and resets the stream to the state
+// where a buffer will be allocated on the next I/O operation.
+static void __ffree_buffer(FILE* _Nonnull s)
+{
+    if (s->flags.shouldFreeBuffer) {
+        free(s->buffer);
+    }
+    s->buffer = NULL;
+    s->bufferCapacity = 0;
+    s->bufferCount = 0;
+    s->bufferIndex = 0;
+    s->flags.shouldFreeBuffer = 0;
+}
+
+// Makes sure that the stream has a buffer. A buffered stream gets a buffer of
+// the size that was requested with setvbuf() or BUFSIZ bytes. We fall back to
+// unbuffered I/O if we can not allocate the buffer. An unbuffered stream uses
+// its single byte buffer.
+static void __fsetup_buffer(FILE* _Nonnull s)
+{
+    if (s->buffer) {
+        return;
+    }
+
+    if (s->flags.bufferMode != _IONBF) {
+        const size_t capacity = (s->bufferCapacity > 0) ? s->bufferCapacity : BUFSIZ;
+
+        s->buffer = malloc(capacity);
+        if (s->buffer) {
+            s->bufferCapacity = capacity;
+            s->flags.shouldFreeBuffer = 1;
+        } else {
+            s->flags.bufferMode = _IONBF;
+        }
+    }
+
+    if (s->buffer == NULL) {
+        s->buffer = &s->unbufferedChar;
+        s->bufferCapacity = 1;
+    }
+}
+
+// Writes the first 'nBytesToFlush' bytes of the write buffer to the underlying
+// stream. Whatever can not be written stays in the buffer.
+static int __fflush_write_prefix(FILE* _Nonnull s, size_t nBytesToFlush)
+{
+    size_t nBytesWritten = 0;
+    int r = 0;
+
+    while (nBytesWritten < nBytesToFlush) {
+        ssize_t n;
+        const errno_t err = s->cb.write((void*)s->context, &s->buffer[nBytesWritten], (ssize_t)(nBytesToFlush - nBytesWritten), &n);
+
+        if (err != 0 || n <= 0) {
+            s->flags.hasError = 1;
+            errno = (err != 0) ? err : EIO;
+            r = EOF;
+            break;
+        }
+        nBytesWritten += n;
+    }
+
+    if (nBytesWritten > 0 && nBytesWritten < s->bufferCount) {
+        memmove(s->buffer, &s->buffer[nBytesWritten], s->bufferCount - nBytesWritten);
+    }
+    s->bufferCount -= nBytesWritten;
+
+    return r;
+}
+
+// Writes the contents of the write buffer to the underlying stream. Whatever
+// can not be written stays in the buffer.
+static int __fflush_write(FILE* _Nonnull s)
+{
+    return __fflush_write_prefix(s, s->bufferCount);
+}
+
+// Drops the read-ahead data and moves the file position of the underlying
+// stream back to the first byte that the caller hasn't consumed yet.
+static int __fdrop_read(FILE* _Nonnull s)
+{
+    const size_t nBytesUnread = s->bufferCount - s->bufferIndex;
+
+    s->bufferCount = 0;
+    s->bufferIndex = 0;
+
+    if (nBytesUnread > 0 && s->cb.seek) {
+        const errno_t err = s->cb.seek((void*)s->context, -(long long)nBytesUnread, NULL, SEEK_CUR);
+
+        if (err != 0) {
+            s->flags.hasError = 1;
+            errno = err;
+            return EOF;
+        }
+    }
+
+    return 0;
+}
+
+// Writes out pending write data or drops read-ahead data, depending on the
+// most recent I/O direction. The stream has no direction afterwards.
+static int __fflush(FILE* _Nonnull s)
+{
+    int r = 0;
+
+    switch (s->flags.mostRecentDirection) {
+        case __kStreamDirection_Read:
+            r = __fdrop_read(s);
+            break;
+
+        case __kStreamDirection_Write:
+            r = __fflush_write(s);
+            break;
+
+        default:
+            break;
+    }
+
+    if (r == 0) {
+        s->flags.mostRecentDirection = __kStreamDirection_None;
+    }
+    return r;
+}
+
+// Flushes all line buffered streams with pending write data. Called before we
+// read from an unbuffered or line buffered stream so that a prompt shows up
+// before the read blocks.
+static void __fflush_linebuffered(void)
+{
+    FILE* pCurFile = gOpenFiles;
+
+    while (pCurFile) {
+        if (pCurFile->flags.bufferMode == _IOLBF && pCurFile->flags.mostRecentDirection == __kStreamDirection_Write) {
+            (void) __fflush_write(pCurFile);
+        }
+        pCurFile = pCurFile->next;
+    }
+}
+
+// Prepares the stream for reading. Writes out pending write data if the stream
+// was most recently used for writing.
+static int __fbegin_read(FILE* _Nonnull s)
+{
+    if ((s->flags.mode & __kStreamMode_Read) == 0) {
+        s->flags.hasError = 1;
+        errno = EBADF;
+        return EOF;
+    }
+
+    if (s->flags.mostRecentDirection != __kStreamDirection_Read) {
+        if (s->flags.mostRecentDirection == __kStreamDirection_Write && __fflush_write(s) != 0) {
+            return EOF;
+        }
+        __fsetup_buffer(s);
+        s->flags.mostRecentDirection = __kStreamDirection_Read;
+    }
+    return 0;
+}
+
+// Prepares the stream for writing. Drops the read-ahead data if the stream was
+// most recently used for reading.
+static int __fbegin_write(FILE* _Nonnull s)
+{
+    if ((s->flags.mode & __kStreamMode_Write) == 0) {
+        s->flags.hasError = 1;
+        errno = EBADF;
+        return EOF;
+    }
+
+    if (s->flags.mostRecentDirection != __kStreamDirection_Write) {
+        if (s->flags.mostRecentDirection == __kStreamDirection_Read && __fdrop_read(s) != 0) {
+            return EOF;
+        }
+        __fsetup_buffer(s);
+        s->flags.mostRecentDirection = __kStreamDirection_Write;
+    }
+    return 0;
+}
+
+// Refills the read buffer from the underlying stream. Expects that the read
+// buffer is empty.
+static int __ffill(FILE* _Nonnull s)
+{
+    ssize_t nBytesRead;
+
+    if (s->flags.bufferMode != _IOFBF) {
+        __fflush_linebuffered();
+    }
+
+    const errno_t err = s->cb.read((void*)s->context, s->buffer, (ssize_t)s->bufferCapacity, &nBytesRead);
+    s->bufferIndex = 0;
+    s->bufferCount = (err == 0 && nBytesRead > 0) ? (size_t)nBytesRead : 0;
+
+    if (err != 0) {
+        s->flags.hasError = 1;
+        errno = err;
+        return EOF;
+    }
+    if (s->bufferCount == 0) {
+        s->flags.hasEof = 1;
+        return EOF;
+    }
+
+    s->flags.hasEof = 0;
+    return 0;
+}
+
 // Shuts down the given stream but does not free the 's' memory block. 
 int __fclose(FILE * _Nonnull s)
 {
@@ -118,6 +326,7 @@ int __fclose(FILE * _Nonnull s)
         errno = err;
         r = EOF;
     }
+    __ffree_buffer(s);
 
     if (gOpenFiles == s) {
         (s->next)->prev = NULL;
@@ -157,8 +366,38 @@ void setbuf(FILE *s, char *buffer)
 
 int setvbuf(FILE *s, char *buffer, int mode, size_t size)
 {
-    // XXX
-    return EOF;
+    switch (mode) {
+        case _IONBF:
+            break;
+
+        case _IOLBF:
+        case _IOFBF:
+            if (buffer && size == 0) {
+                errno = EINVAL;
+                return EOF;
+            }
+            break;
+
+        default:
+            errno = EINVAL;
+            return EOF;
+    }
+
+    // Get rid of whatever is sitting in the current buffer before we replace it
+    if (__fflush(s) != 0) {
+        return EOF;
+    }
+    __ffree_buffer(s);
+
+    s->flags.bufferMode = mode;
+    if (mode != _IONBF) {
+        // A NULL buffer means that we allocate a buffer of 'size' bytes on the
+        // first I/O operation
+        s->buffer = buffer;
+        s->bufferCapacity = size;
+    }
+
+    return 0;
 }
 
 void clearerr(FILE *s)
@@ -177,6 +416,22 @@ int ferror(FILE *s)
     return (s->flags.hasError) ? EOF : 0;
 }
 
+// Returns the distance between the logical stream position and the file
+// position of the underlying stream which is due to buffered data.
+static long long __fbuffered_delta(FILE* _Nonnull s)
+{
+    switch (s->flags.mostRecentDirection) {
+        case __kStreamDirection_Read:
+            return -(long long)(s->bufferCount - s->bufferIndex);
+
+        case __kStreamDirection_Write:
+            return (long long)s->bufferCount;
+
+        default:
+            return 0ll;
+    }
+}
+
 long ftell(FILE *s)
 {
     long long curpos;
@@ -192,6 +447,7 @@ long ftell(FILE *s)
         errno = err;
         return (long)EOF;
     }
+    curpos += __fbuffered_delta(s);
 
 #if __LONG_WIDTH == 64
     return (long)curpos;
@@ -222,11 +478,8 @@ int fseek(FILE *s, long offset, int whence)
             return EOF;
     }
 
-    if (s->flags.mostRecentDirection == __kStreamDirection_Write) {
-        const int e = fflush(s);
-        if (e != 0) {
-            return EOF;
-        }
+    if (__fflush(s) != 0) {
+        return EOF;
     }
 
     const errno_t err = s->cb.seek((void*)s->context, (long long)offset, NULL, whence);
@@ -256,6 +509,7 @@ int fgetpos(FILE *s, fpos_t *pos)
         errno = err;
         return EOF;
     }
+    pos->offset += __fbuffered_delta(s);
 
     return 0;
 }
@@ -267,11 +521,8 @@ int fsetpos(FILE *s, const fpos_t *pos)
         return EOF;
     }
 
-    if (s->flags.mostRecentDirection == __kStreamDirection_Write) {
-        const int e = fflush(s);
-        if (e != 0) {
-            return EOF;
-        }
+    if (__fflush(s) != 0) {
+        return EOF;
     }
 
     const errno_t err = s->cb.seek((void*)s->context, pos->offset, NULL, SEEK_SET);
@@ -295,54 +546,47 @@ void rewind(FILE *s)
 
 int fgetc(FILE *s)
 {
-    if ((s->flags.mode & __kStreamMode_Read) == 0) {
-        s->flags.hasError = 1;
-        errno = EBADF;
+    if (__fbegin_read(s) != 0) {
         return EOF;
     }
 
-    int r;
-    char buf;
-    ssize_t nBytesRead;
-    const errno_t err = s->cb.read((void*)s->context, &buf, 1, &nBytesRead);
-
-    if (err == 0) {
-        if (nBytesRead == 1) {
-            s->flags.hasEof = 0;
-            r = (int)(unsigned char)buf;
-        } else {
-            s->flags.hasEof = 1;
-            r = EOF;
-        }
-    } else {
-        s->flags.hasError = 1;
-        errno = err;
-        r = EOF;
+    if (s->bufferIndex == s->bufferCount && __ffill(s) != 0) {
+        return EOF;
     }
 
-    return r;
+    return (int)(unsigned char)s->buffer[s->bufferIndex++];
 }
 
 char *fgets(char *str, int count, FILE *s)
 {
-    int nBytesToRead = count - 1;
-    int nBytesRead = 0;
+    size_t nBytesToRead = (count > 0) ? (size_t)(count - 1) : 0;
+    size_t nBytesRead = 0;
 
     if (count < 1) {
         errno = EINVAL;
         return NULL;
     }
+    if (__fbegin_read(s) != 0) {
+        return NULL;
+    }
 
-    while (nBytesToRead-- > 0) {
-        const int ch = fgetc(s);
-
-        if (ch == EOF) {
+    // Copy the buffered data a chunk at a time up to and including the newline
+    while (nBytesToRead > 0) {
+        if (s->bufferIndex == s->bufferCount && __ffill(s) != 0) {
             break;
         }
 
-        str[nBytesRead++] = ch;
+        const char* pSrc = &s->buffer[s->bufferIndex];
+        const size_t nAvail = __min(s->bufferCount - s->bufferIndex, nBytesToRead);
+        const char* pNewline = memchr(pSrc, '\n', nAvail);
+        const size_t nBytesToCopy = (pNewline) ? (size_t)(pNewline - pSrc) + 1 : nAvail;
+
+        memcpy(&str[nBytesRead], pSrc, nBytesToCopy);
+        s->bufferIndex += nBytesToCopy;
+        nBytesRead += nBytesToCopy;
+        nBytesToRead -= nBytesToCopy;
 
-        if (ch == '\n') {
+        if (pNewline) {
             break;
         }
     }
@@ -353,50 +597,36 @@ char *fgets(char *str, int count, FILE *s)
 
 int fputc(int ch, FILE *s)
 {
-    if ((s->flags.mode & __kStreamMode_Write) == 0) {
-        s->flags.hasError = 1;
-        errno = EBADF;
+    const unsigned char c = (unsigned char)ch;
+
+    if (__fbegin_write(s) != 0) {
         return EOF;
     }
 
-    int r;
-    unsigned char buf = (unsigned char)ch;
-    ssize_t nBytesWritten;
-    const errno_t err = s->cb.write((void*)s->context, &buf, 1, &nBytesWritten);
+    // Make room if an earlier flush wasn't able to empty the buffer
+    if (s->bufferCount == s->bufferCapacity && __fflush_write(s) != 0) {
+        return EOF;
+    }
 
-    if (err == 0) {
-        if (nBytesWritten == 1) {
-            s->flags.hasEof = 0;
-            r = (int)buf;
-        } else {
-            s->flags.hasEof = 1;
-            r = EOF;
+    s->buffer[s->bufferCount++] = c;
+
+    if (s->bufferCount == s->bufferCapacity || (s->flags.bufferMode == _IOLBF && c == '\n')) {
+        if (__fflush_write(s) != 0) {
+            return EOF;
         }
-    } else {
-        s->flags.hasError = 1;
-        errno = err;
-        r = EOF;
     }
 
-    return r;
+    return (int)c;
 }
 
 int fputs(const char *str, FILE *s)
 {
-    int nCharsWritten = 0;
-
-    while (*str != '\0') {
-        const int r = fputc(*str++, s);
-
-        if (r == EOF) {
-            return EOF;
-        }
+    const size_t len = strlen(str);
 
-        if (nCharsWritten < INT_MAX) {
-            nCharsWritten++;
-        }
+    if (len > 0 && fwrite(str, 1, len, s) < len) {
+        return EOF;
     }
-    return nCharsWritten;
+    return (len < INT_MAX) ? (int)len : INT_MAX;
 }
 
 int ungetc(int ch, FILE *s)
@@ -410,17 +640,57 @@ size_t fread(void *buffer, size_t size, size_t count, FILE *s)
     if (size == 0 || count == 0) {
         return 0;
     }
+    if (count > SIZE_MAX / size) {
+        s->flags.hasError = 1;
+        errno = EOVERFLOW;
+        return 0;
+    }
+    if (__fbegin_read(s) != 0) {
+        return 0;
+    }
 
+    char* pDst = buffer;
     size_t nBytesToRead = size * count;
     size_t nBytesRead = 0;
-    while (nBytesToRead-- > 0) {
-        const int ch = fgetc(s);
 
-        if (ch == EOF) {
-            break;
+    while (nBytesToRead > 0) {
+        // Hand out what's sitting in the buffer first
+        const size_t nAvail = __min(s->bufferCount - s->bufferIndex, nBytesToRead);
+
+        if (nAvail > 0) {
+            memcpy(&pDst[nBytesRead], &s->buffer[s->bufferIndex], nAvail);
+            s->bufferIndex += nAvail;
+            nBytesRead += nAvail;
+            nBytesToRead -= nAvail;
+            continue;
         }
 
-        ((unsigned char*)buffer)[nBytesRead++] = (unsigned char)ch;
+        if (nBytesToRead >= s->bufferCapacity) {
+            // The buffer is empty and the rest of the request is at least as
+            // big as the buffer. Read straight into the caller's buffer
+            ssize_t n;
+
+            if (s->flags.bufferMode != _IOFBF) {
+                __fflush_linebuffered();
+            }
+
+            const errno_t err = s->cb.read((void*)s->context, &pDst[nBytesRead], (ssize_t)__min(nBytesToRead, (size_t)SSIZE_MAX), &n);
+            if (err != 0) {
+                s->flags.hasError = 1;
+                errno = err;
+                break;
+            }
+            if (n <= 0) {
+                s->flags.hasEof = 1;
+                break;
+            }
+            s->flags.hasEof = 0;
+            nBytesRead += n;
+            nBytesToRead -= n;
+        }
+        else if (__ffill(s) != 0) {
+            break;
+        }
     }
 
     return nBytesRead / size;
@@ -431,52 +701,88 @@ size_t fwrite(const void *buffer, size_t size, size_t count, FILE *s)
     if (size == 0 || count == 0) {
         return 0;
     }
+    if (count > SIZE_MAX / size) {
+        s->flags.hasError = 1;
+        errno = EOVERFLOW;
+        return 0;
+    }
+    if (__fbegin_write(s) != 0) {
+        return 0;
+    }
 
-    size_t nBytesToWrite = size * count;
+    const char* pSrc = buffer;
+    const size_t nBytesToWrite = size * count;
     size_t nBytesWritten = 0;
-    while (nBytesToWrite-- > 0) {
-        const int r = fputc(((const unsigned char*)buffer)[nBytesWritten++], s);
 
-        if (r == EOF) {
-            break;
+    if (s->bufferCount + nBytesToWrite > s->bufferCapacity) {
+        // The data doesn't fit into the buffer. Push out what's buffered and
+        // then write straight from the caller's buffer if the remaining data
+        // would fill the buffer anyway
+        if (s->bufferCount > 0 && __fflush_write(s) != 0) {
+            return 0;
+        }
+
+        while (nBytesToWrite - nBytesWritten >= s->bufferCapacity) {
+            ssize_t n;
+            const errno_t err = s->cb.write((void*)s->context, &pSrc[nBytesWritten], (ssize_t)__min(nBytesToWrite - nBytesWritten, (size_t)SSIZE_MAX), &n);
+
+            if (err != 0 || n <= 0) {
+                s->flags.hasError = 1;
+                errno = (err != 0) ? err : EIO;
+                return nBytesWritten / size;
+            }
+            nBytesWritten += n;
         }
     }
 
-    return nBytesWritten / size;
-}
+    // Buffer the rest
+    const size_t nBytesToCopy = nBytesToWrite - nBytesWritten;
+    if (nBytesToCopy > 0) {
+        const size_t firstIndex = s->bufferCount;
+        size_t nBytesToFlush = 0;
 
-#if 0
-//XXX general approach of bulk writing
-static errno_t __IOChannel_Write(const char* _Nonnull pBuffer, size_t nBytes)
-{
-    ssize_t nBytesWritten = 0;
+        memcpy(&s->buffer[firstIndex], &pSrc[nBytesWritten], nBytesToCopy);
+        s->bufferCount += nBytesToCopy;
 
-    while (nBytesWritten < nBytes) {
-        const ssize_t r = IOChannel_Write(kIOChannel_Stdout, pBuffer, nBytes);
-        
-        if (r < 0) {
-            return (errno_t) -r;
+        if (s->bufferCount == s->bufferCapacity) {
+            nBytesToFlush = s->bufferCount;
         }
-        nBytesWritten += nBytes;
+        else if (s->flags.bufferMode == _IOLBF) {
+            // Push out everything up to and including the last newline. The
+            // rest of the line stays buffered
+            for (size_t i = s->bufferCount; i > firstIndex; i--) {
+                if (s->buffer[i - 1] == '\n') {
+                    nBytesToFlush = i;
+                    break;
+                }
+            }
+        }
+
+        // The data is in the buffer and thus written as far as the caller is
+        // concerned. A failed flush leaves it in the buffer and the next flush
+        // retries it and reports the error
+        if (nBytesToFlush > 0) {
+            (void) __fflush_write_prefix(s, nBytesToFlush);
+        }
+        nBytesWritten = nBytesToWrite;
     }
 
-    return 0;
+    return nBytesWritten / size;
 }
-#endif
 
 int fflush(FILE *s)
 {
     int r = 0;
 
     if (s) {
-        // XXX
+        r = __fflush(s);
     }
     else {
         FILE* pCurFile = gOpenFiles;
         
         while (pCurFile) {
             if (pCurFile->flags.mostRecentDirection == __kStreamDirection_Write) {
-                const int rx = fflush(pCurFile);
+                const int rx = __fflush(pCurFile);
 
                 if (r == 0) {
                     r = rx;
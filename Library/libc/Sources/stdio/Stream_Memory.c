@@ -160,7 +160,12 @@ errno_t __fopen_memory_init(__Memory_FILE* _Nonnull self, FILE_Memory *mem, cons
     mp->currentPosition = 0;
     mp->flags.freeOnClose = ((mem->options & _IOM_FREE_ON_CLOSE) != 0) ? 1 : 0;
 
-    return __fopen_init((FILE*)self, true, mp, &__FILE_mem_callbacks, mode);
+    const errno_t err = __fopen_init((FILE*)self, true, mp, &__FILE_mem_callbacks, mode);
+    if (err == 0) {
+        // The data already lives in memory. Buffering it would just add a copy
+        self->super.flags.bufferMode = _IONBF;
+    }
+    return err;
 }
 
 FILE *fopen_memory(FILE_Memory *mem, const char *mode)
@@ -41,7 +41,11 @@ static const FILE_Callbacks __FILE_null_callbacks = {
 
 errno_t __fopen_null_init(FILE* _Nonnull self, const char *mode)
 {
-    return __fopen_init(self, true, NULL, &__FILE_null_callbacks, mode);
+    const errno_t err = __fopen_init(self, true, NULL, &__FILE_null_callbacks, mode);
+    if (err == 0) {
+        self->flags.bufferMode = _IONBF;
+    }
+    return err;
 }
 
 FILE *__fopen_null(const char *mode)
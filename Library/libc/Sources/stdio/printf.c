@@ -26,8 +26,9 @@ int printf(const char *format, ...)
 int vprintf(const char *format, va_list ap)
 {
     Formatter fmt;
+    char buf[FORMATTER_STREAM_BUFFER_CAPACITY];
 
-    __Formatter_Init(&fmt, stdout);
+    __Formatter_Init(&fmt, __Formatter_StreamSink, stdout, buf, sizeof(buf));
     const errno_t err = __Formatter_vFormat(&fmt, format, ap);
     const size_t nchars = fmt.charactersWritten;
     __Formatter_Deinit(&fmt);
@@ -65,33 +66,19 @@ int snprintf(char *buffer, size_t bufsiz, const char *format, ...)
 int vsnprintf(char *buffer, size_t bufsiz, const char *format, va_list ap)
 {
     decl_try_err();
-    __Memory_FILE file;
-    FILE_Memory mem;
     Formatter fmt;
+    const size_t capacity = (buffer && bufsiz > 0) ? bufsiz - 1 : 0;
 
-    if (buffer && bufsiz > 0) {
-        mem.base = buffer;
-        mem.initialCapacity = bufsiz - 1;
-        mem.maximumCapacity = bufsiz - 1;
-        mem.initialEof = 0;
-        mem.options = 0;
-
-        err = __fopen_memory_init(&file, &mem, "w");
-    }
-    else {
-        // Use a null stream to calculate the length of the formatted string
-        err = __fopen_null_init(&file.super, "w");
-    }
-    if (err != 0) {
-        return -err;
-    }
-
-    __Formatter_Init(&fmt, &file.super);
+    // Format straight into the caller's buffer. The formatter just counts the
+    // characters once the buffer is full or if there is no buffer at all
+    __Formatter_Init(&fmt, __Formatter_StringSink, NULL, buffer, capacity);
     err = __Formatter_vFormat(&fmt, format, ap);
     const size_t nchars = fmt.charactersWritten;
     __Formatter_Deinit(&fmt);
-    buffer[fmt.charactersWritten] = '\0';
-    __fclose(&file.super);
+
+    if (buffer && bufsiz > 0) {
+        buffer[__min(nchars, capacity)] = '\0';
+    }
 
     return (err == 0) ? nchars : -err;
 }
@@ -116,6 +103,7 @@ int vasprintf(char **str_ptr, const char *format, va_list ap)
     FILE_Memory mem;
     FILE_MemoryQuery mq;
     Formatter fmt;
+    char buf[FORMATTER_STREAM_BUFFER_CAPACITY];
 
     if (str_ptr) {
         *str_ptr = NULL;
@@ -135,7 +123,7 @@ int vasprintf(char **str_ptr, const char *format, va_list ap)
         return -err;
     }
 
-    __Formatter_Init(&fmt, &file.super);
+    __Formatter_Init(&fmt, __Formatter_StreamSink, &file.super, buf, sizeof(buf));
     err = __Formatter_vFormat(&fmt, format, ap);
     const size_t nchars = fmt.charactersWritten;
     const int r = (err == 0) ? fputc('\0', &file.super) : EOF; // write terminating NUL
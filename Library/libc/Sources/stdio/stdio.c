@@ -32,6 +32,12 @@ void __stdio_init(void)
     __fdopen_init(&_StdinObj, false, kIOChannel_Stdin, "r");
     __fdopen_init(&_StdoutObj, false, kIOChannel_Stdout, "w");
     // XXX add support for stderr
+
+    // The console read blocks until it has filled the whole request. So stdin
+    // has to be unbuffered for interactive input to work. Stdout is line
+    // buffered. Reading from stdin flushes stdout.
+    setvbuf(_Stdin, NULL, _IONBF, 0);
+    setvbuf(_Stdout, NULL, _IOLBF, 0);
 }
 
 void __stdio_exit(void)
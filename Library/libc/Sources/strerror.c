@@ -49,6 +49,7 @@ char *strerror(int err_no)
         /*EISDIR*/          "Is a directory",
         /*ENOTIOCTLCMD*/    "Not an IOCTL command",
         /*EILSEQ*/          "Invalid multibyte sequence",
+        /*ECANCELED*/       "Operation canceled",
     };
 
     if (err_no >= __EFIRST && err_no <= __ELAST) {
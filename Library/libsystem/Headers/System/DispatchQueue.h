@@ -18,6 +18,24 @@ __CPP_BEGIN
 
 typedef void (*Dispatch_Closure)(void* _Nullable arg);
 
+// A closure and its context. An array of these is passed to
+// DispatchQueue_DispatchAsyncBatch().
+typedef struct Dispatch_ClosureEntry {
+    Dispatch_Closure _Nonnull   func;
+    void* _Nullable             context;
+} Dispatch_ClosureEntry;
+
+typedef void (*Dispatch_ApplyClosure)(void* _Nullable arg, int index);
+
+
+// Tunables of the policy that a dispatch queue uses to decide when it should
+// acquire an additional concurrency lane and when it should give an idle lane
+// back to the system.
+typedef struct DispatchQueueTunables {
+    TimeInterval    latencyTarget;  // A lane is added if queued work items are expected to wait longer than this before they start executing
+    TimeInterval    idleTimeout;    // A lane that has been idle for this long is relinquished unless the queue is at its minimum concurrency
+} DispatchQueueTunables;
+
 #define kDispatchQueue_Main 0
 
 
@@ -43,6 +61,9 @@ typedef void (*Dispatch_Closure)(void* _Nullable arg);
 
 #if !defined(__KERNEL__)
 
+// The dispatch functions below return ECANCELED and do not enqueue anything if
+// the queue is terminating or terminated.
+
 // Synchronously executes the given closure. The closure is executed as soon as
 // possible and the caller remains blocked until the closure has finished
 // execution. This function returns with an EINTR if the queue is flushed or
@@ -59,12 +80,61 @@ extern errno_t DispatchQueue_DispatchSync(int od, Dispatch_Closure _Nonnull pClo
 // @Concurrency: Safe 
 extern errno_t DispatchQueue_DispatchAsync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
 
+// Schedules the 'count' closures in 'pEntries' for asynchronous execution on
+// the given dispatch queue. This is equivalent to calling
+// DispatchQueue_DispatchAsync() once per entry in array order, except that the
+// whole batch is submitted with a single system call and enqueued with a
+// minimal number of queue lock acquisitions. The queue wakes up at most as many
+// concurrency lanes as are needed to execute the batch. Returns ECANCELED and
+// enqueues nothing if the queue is terminating. Returns EINVAL and enqueues
+// nothing if an entry has no closure function. Large batches are enqueued in
+// chunks. If enqueuing a chunk fails then the closures of the preceding chunks
+// remain enqueued and the error is returned.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_DispatchAsyncBatch(int od, const Dispatch_ClosureEntry* _Nonnull pEntries, int count);
+
+// Invokes 'pClosure' once for every index in the range [0, iterations) and
+// returns once all invocations have completed. The index range is split into
+// chunks and the chunks are distributed over the concurrency lanes of the
+// queue. The caller executes chunks itself while it waits for the queue. The
+// invocations may run in parallel and in any order. Helpers that are still
+// queued once the caller has run out of chunks are removed from the queue and
+// the caller only waits for the helpers that have started. So this function
+// may be called from a closure that executes on the same queue and it may be
+// nested. The queue must not be destroyed while the function is waiting for it.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_Apply(int od, int iterations, Dispatch_ApplyClosure _Nonnull pClosure, void* _Nullable pContext);
+
+// Removes all queued instances of the closure 'pClosure' with the context
+// 'pContext' from the given dispatch queue and returns the number of removed
+// instances in 'pOutCount'. Instances which are executing are not affected.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_RemoveClosure(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutCount);
+
 // Asynchronously executes the given closure on or after 'deadline'. The dispatch
 // queue will try to execute the closure as close to 'deadline' as possible.
 // @Concurrency: Safe
 extern errno_t DispatchQueue_DispatchAsyncAfter(int od, TimeInterval deadline, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext);
 
 
+// Returns the current lane scaling tunables of the given dispatch queue.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_GetTunables(int od, DispatchQueueTunables* _Nonnull pOutTunables);
+
+// Replaces the lane scaling tunables of the given dispatch queue. The latency
+// target must be positive and the idle timeout must not be negative. The queue
+// adds a concurrency lane if the measured queue latency or the expected time to
+// drain the queued work items with the current lanes exceeds the latency
+// target. A queue that has not measured any work items yet adds lanes as long
+// as it has more queued work items than lanes.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_SetTunables(int od, const DispatchQueueTunables* _Nonnull pTunables);
+
+// Returns the maximum number of concurrency lanes of the given dispatch queue.
+// @Concurrency: Safe
+extern errno_t DispatchQueue_GetMaxConcurrency(int od, int* _Nonnull pOutMaxConcurrency);
+
+
 // Returns the dispatch queue that is associated with the virtual processor that
 // is running the calling code.
 // @Concurrency: Safe
@@ -0,0 +1,46 @@
+//
+//  Heap.h
+//  libsystem
+//
+//  Created by Dietmar Planitzer on 4/23/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef _SYS_HEAP_H
+#define _SYS_HEAP_H 1
+
+#include <System/_cmndef.h>
+#include <System/Error.h>
+#include <System/Types.h>
+
+__CPP_BEGIN
+
+// Number of allocation size buckets. Bucket i counts the allocations of at
+// most 16 << i bytes. The last bucket counts all bigger allocations.
+#define kHeapInfo_SizeBucketCount   8
+
+// Heap statistics. All sizes are in bytes and they include the allocator's
+// block headers and alignment padding.
+typedef struct HeapInfo {
+    size_t  totalBytes;                 // Total size of all memory regions managed by the heap
+    size_t  bytesInUse;                 // Bytes currently allocated
+    size_t  peakBytesInUse;             // High-water mark of 'bytesInUse'
+    size_t  largestFreeBlockSize;       // Size of the largest free block
+    size_t  freeBlockCount;             // Number of blocks on the free lists of the memory regions
+    size_t  allocationCount;            // Number of allocations since the heap was created
+    size_t  deallocationCount;          // Number of deallocations since the heap was created
+    size_t  allocationCountBySize[kHeapInfo_SizeBucketCount];   // Number of allocations by requested size
+} HeapInfo;
+
+
+#if !defined(__KERNEL__)
+
+// Returns statistics about the kernel heap.
+// @Concurrency: Safe
+extern errno_t Heap_GetKernelInfo(HeapInfo* _Nonnull pOutInfo);
+
+#endif /* __KERNEL__ */
+
+__CPP_END
+
+#endif /* _SYS_HEAP_H */
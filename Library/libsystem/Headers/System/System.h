@@ -19,6 +19,7 @@
 #include <System/Directory.h>
 #include <System/File.h>
 #include <System/FilePermissions.h>
+#include <System/Heap.h>
 #include <System/IOChannel.h>
 #include <System/Lock.h>
 #include <System/Pipe.h>
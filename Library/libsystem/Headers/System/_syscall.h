@@ -64,6 +64,12 @@ enum {
     SC_cv_create,           // errno_t cv_create(int* _Nonnull pOutOd)
     SC_cv_wake,             // errno_t cv_wake(int od, int dlock, unsigned int options)
     sc_cv_wait,             // errno_t cv_wait(int od, int dlock, TimeInterval deadline)
+    SC_get_kalloc_info,     // errno_t Heap_GetKernelInfo(HeapInfo* _Nonnull pOutInfo)
+    SC_dispatch_batch,      // errno_t DispatchQueue_DispatchAsyncBatch(int od, const Dispatch_ClosureEntry* _Nonnull pEntries, int count)
+    SC_dispatch_get_tunables,   // errno_t DispatchQueue_GetTunables(int od, DispatchQueueTunables* _Nonnull pOutTunables)
+    SC_dispatch_set_tunables,   // errno_t DispatchQueue_SetTunables(int od, const DispatchQueueTunables* _Nonnull pTunables)
+    SC_dispatch_get_max_concurrency,    // errno_t DispatchQueue_GetMaxConcurrency(int od, int* _Nonnull pOutMaxConcurrency)
+    SC_dispatch_remove_closure,         // errno_t DispatchQueue_RemoveClosure(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutCount)
 };
 
 
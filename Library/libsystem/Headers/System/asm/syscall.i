@@ -58,9 +58,15 @@ SC_sema_tryacquire          equ 45
 SC_cv_create                equ 46
 SC_cv_wake                  equ 47
 SC_cv_wait                  equ 48
+SC_get_kalloc_info          equ 49
+SC_dispatch_batch           equ 50
+SC_dispatch_get_tunables    equ 51
+SC_dispatch_set_tunables    equ 52
+SC_dispatch_get_max_concurrency equ 53
+SC_dispatch_remove_closure  equ 54
 
 
-SC_numberOfCalls            equ 49
+SC_numberOfCalls            equ 55
 
 
 ; System call macro.
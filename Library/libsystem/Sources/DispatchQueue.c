@@ -7,7 +7,31 @@
 //
 
 #include <System/DispatchQueue.h>
+#include <System/_math.h>
 #include <System/_syscall.h>
+#include <System/Lock.h>
+#include <System/Semaphore.h>
+
+// Maximum number of helper closures that DispatchQueue_Apply() dispatches
+#define APPLY_MAX_HELPER_COUNT  8
+
+// Number of chunks per participant
+#define APPLY_CHUNKS_PER_LANE   4
+
+
+// Shared state of a DispatchQueue_Apply() invocation. User space has no atomic
+// read-modify-write operation and thus the chunk counter is protected by a lock.
+// Chunking keeps the number of lock operations small.
+typedef struct ApplyState {
+    Dispatch_ApplyClosure _Nonnull  func;
+    void* _Nullable                 context;
+    int                             iterations;
+    int                             chunkSize;
+    int                             chunkCount;
+    int                             nextChunk;
+    Lock                            lock;
+    Semaphore                       helpersDone;
+} ApplyState;
 
 
 errno_t DispatchQueue_DispatchSync(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
@@ -20,11 +44,139 @@ errno_t DispatchQueue_DispatchAsync(int od, Dispatch_Closure _Nonnull pClosure,
     return _syscall(SC_dispatch, od, (unsigned long)0, pClosure, pContext);
 }
 
+errno_t DispatchQueue_DispatchAsyncBatch(int od, const Dispatch_ClosureEntry* _Nonnull pEntries, int count)
+{
+    return _syscall(SC_dispatch_batch, od, pEntries, count);
+}
+
+static void _DispatchQueue_ExecuteApplyChunks(ApplyState* _Nonnull self)
+{
+    while (true) {
+        Lock_Lock(&self->lock);
+        const int chunk = self->nextChunk++;
+        Lock_Unlock(&self->lock);
+
+        if (chunk >= self->chunkCount) {
+            break;
+        }
+
+        const int firstIndex = chunk * self->chunkSize;
+        const int lastIndex = __min(firstIndex + self->chunkSize, self->iterations);
+
+        for (int i = firstIndex; i < lastIndex; i++) {
+            self->func(self->context, i);
+        }
+    }
+}
+
+static void _DispatchQueue_ApplyHelper(void* _Nullable pContext)
+{
+    ApplyState* self = (ApplyState*)pContext;
+
+    _DispatchQueue_ExecuteApplyChunks(self);
+    Semaphore_Relinquish(&self->helpersDone, 1);
+}
+
+errno_t DispatchQueue_Apply(int od, int iterations, Dispatch_ApplyClosure _Nonnull pClosure, void* _Nullable pContext)
+{
+    errno_t err = EOK;
+    ApplyState state;
+    Dispatch_ClosureEntry helpers[APPLY_MAX_HELPER_COUNT];
+    int helperCount;
+
+    if (iterations <= 0) {
+        return (iterations == 0) ? EOK : EINVAL;
+    }
+
+    // We participate ourselves. So we only need helpers for the remaining
+    // concurrency lanes. One of those lanes is us if we are running on the
+    // queue
+    if ((err = DispatchQueue_GetMaxConcurrency(od, &helperCount)) != EOK) {
+        return err;
+    }
+    if (DispatchQueue_GetCurrent() == od) {
+        helperCount--;
+    }
+    helperCount = __min(helperCount, APPLY_MAX_HELPER_COUNT);
+
+    state.func = pClosure;
+    state.context = pContext;
+    state.iterations = iterations;
+    state.chunkCount = __min(iterations, (helperCount + 1) * APPLY_CHUNKS_PER_LANE);
+    state.chunkSize = (iterations + state.chunkCount - 1) / state.chunkCount;
+    state.chunkCount = (iterations + state.chunkSize - 1) / state.chunkSize;
+    state.nextChunk = 0;
+    if ((err = Lock_Init(&state.lock)) != EOK) {
+        return err;
+    }
+    if ((err = Semaphore_Init(&state.helpersDone, 0)) != EOK) {
+        Lock_Deinit(&state.lock);
+        return err;
+    }
+
+    helperCount = __min(helperCount, state.chunkCount - 1);
+    if (helperCount > 0) {
+        for (int i = 0; i < helperCount; i++) {
+            helpers[i].func = _DispatchQueue_ApplyHelper;
+            helpers[i].context = &state;
+        }
+
+        // Fails if the queue is terminating
+        if (DispatchQueue_DispatchAsyncBatch(od, helpers, helperCount) != EOK) {
+            // Do all the work ourselves
+            helperCount = 0;
+        }
+    }
+
+    _DispatchQueue_ExecuteApplyChunks(&state);
+
+    // Helpers that haven't started by now would only find that there's nothing
+    // left to do. They may be queued behind us or behind other lanes that are
+    // waiting for an apply themselves. So we take them back out of the queue
+    // and only wait for the helpers that have started. They reference 'state'
+    // and we can not return before all of them are done. Acquiring the permits
+    // only fails if the calling virtual processor is being aborted
+    if (helperCount > 0) {
+        int nRemoved;
+
+        if (DispatchQueue_RemoveClosure(od, _DispatchQueue_ApplyHelper, &state, &nRemoved) == EOK) {
+            helperCount -= nRemoved;
+        }
+        if (helperCount > 0) {
+            err = Semaphore_Acquire(&state.helpersDone, helperCount, kTimeInterval_Infinity);
+        }
+    }
+    Semaphore_Deinit(&state.helpersDone);
+    Lock_Deinit(&state.lock);
+
+    return err;
+}
+
 errno_t DispatchQueue_DispatchAsyncAfter(int od, TimeInterval deadline, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext)
 {
     return _syscall(SC_dispatch_after, od, deadline, pClosure, pContext);
 }
 
+errno_t DispatchQueue_GetTunables(int od, DispatchQueueTunables* _Nonnull pOutTunables)
+{
+    return _syscall(SC_dispatch_get_tunables, od, pOutTunables);
+}
+
+errno_t DispatchQueue_SetTunables(int od, const DispatchQueueTunables* _Nonnull pTunables)
+{
+    return _syscall(SC_dispatch_set_tunables, od, pTunables);
+}
+
+errno_t DispatchQueue_GetMaxConcurrency(int od, int* _Nonnull pOutMaxConcurrency)
+{
+    return _syscall(SC_dispatch_get_max_concurrency, od, pOutMaxConcurrency);
+}
+
+errno_t DispatchQueue_RemoveClosure(int od, Dispatch_Closure _Nonnull pClosure, void* _Nullable pContext, int* _Nonnull pOutCount)
+{
+    return _syscall(SC_dispatch_remove_closure, od, pClosure, pContext, pOutCount);
+}
+
 int DispatchQueue_GetCurrent(void)
 {
     return _syscall(SC_dispatch_queue_current);
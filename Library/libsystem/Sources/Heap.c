@@ -0,0 +1,16 @@
+//
+//  Heap.c
+//  libsystem
+//
+//  Created by Dietmar Planitzer on 4/23/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include <System/Heap.h>
+#include <System/_syscall.h>
+
+
+errno_t Heap_GetKernelInfo(HeapInfo* _Nonnull pOutInfo)
+{
+    return (errno_t)_syscall(SC_get_kalloc_info, pOutInfo);
+}
@@ -10,6 +10,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <klib/klib.h>
+#include <filesystem/DiskCache.h>
+#include <filesystem/NameCache.h>
 #include <filesystem/FilesystemManager.h>
 #include <filesystem/serenafs/SerenaFS.h>
 
@@ -127,6 +129,10 @@ static void createDiskImage(const char* pRootPath, const char* pDstPath)
     
     try(formatDiskImage(pDisk));
 
+    try(DiskCache_Create(512, 64, &gDiskCache));
+    try(NameCache_Create(256, &gNameCache));
+    try(Inode_InitCache());
+
     try(SerenaFS_Create((SerenaFSRef*)&pFS));
     try(FilesystemManager_Create(pFS, pDisk, &gFilesystemManager));
 
@@ -140,6 +146,10 @@ static void createDiskImage(const char* pRootPath, const char* pDstPath)
     try(di_iterate_directory(pRootPath, &cb, rootInode));
     Filesystem_RelinquishNode(pFS, rootInode);
 
+    // Unmount to write back all cached filesystem state and to mark the volume as consistent
+    Filesystem_PurgeCachedNodes(pFS);
+    try(Filesystem_OnUnmount(pFS));
+
     try(DiskDriver_WriteToPath(pDisk, pDstPath));
     
     Object_Release(pFS);
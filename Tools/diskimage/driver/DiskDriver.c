@@ -84,6 +84,85 @@ errno_t DiskDriver_PutBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pB
     return EOK;
 }
 
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'. Needs a single
+// memcpy() per segment because the disk is a flat buffer.
+errno_t DiskDriver_GetBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    if (lba >= self->blockCount || blockCount > self->blockCount - lba) {
+        return EIO;
+    }
+
+    const uint8_t* pSrc = &self->disk[lba * self->blockSize];
+
+    for (int i = 0; i < segmentCount && blockCount > 0; i++) {
+        const LogicalBlockCount nBlocks = __min(pSegments[i].blockCount, blockCount);
+        const size_t nBytes = nBlocks * self->blockSize;
+
+        memcpy(pSegments[i].data, pSrc, nBytes);
+        pSrc += nBytes;
+        blockCount -= nBlocks;
+    }
+
+    return EOK;
+}
+
+// Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+// the buffers described by the scatter/gather list 'pSegments'.
+errno_t DiskDriver_PutBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    if (lba >= self->blockCount || blockCount > self->blockCount - lba) {
+        return EIO;
+    }
+
+    uint8_t* pDst = &self->disk[lba * self->blockSize];
+
+    for (int i = 0; i < segmentCount && blockCount > 0; i++) {
+        const LogicalBlockCount nBlocks = __min(pSegments[i].blockCount, blockCount);
+        const size_t nBytes = nBlocks * self->blockSize;
+
+        memcpy(pDst, pSegments[i].data, nBytes);
+        pDst += nBytes;
+        blockCount -= nBlocks;
+    }
+
+    return EOK;
+}
+
+// Maps the block at index 'lba' and returns a pointer to the block contents.
+// The disk is a flat buffer and thus every block can be mapped in place.
+errno_t DiskDriver_MapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData)
+{
+    if (lba >= self->blockCount) {
+        *pOutData = NULL;
+        return EIO;
+    }
+
+    *pOutData = &self->disk[lba * self->blockSize];
+    return EOK;
+}
+
+// Unmaps a block that was mapped with DiskDriver_MapBlock().
+void DiskDriver_UnmapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, void* _Nonnull pData)
+{
+}
+
+// Executes the request 'pRequest' and invokes its completion function before
+// returning. The disk image tool has no dispatch queues and thus executes all
+// requests synchronously.
+errno_t DiskDriver_BeginIO(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest)
+{
+    if (pRequest->type == kDiskRequest_Read) {
+        pRequest->status = DiskDriver_GetBlocks(self, pRequest->lba, pRequest->blockCount, pRequest->segments, pRequest->segmentCount);
+    }
+    else {
+        pRequest->status = DiskDriver_PutBlocks(self, pRequest->lba, pRequest->blockCount, pRequest->segments, pRequest->segmentCount);
+    }
+    pRequest->done(pRequest);
+
+    return EOK;
+}
+
 // Writes the contents of the disk to the given path as a regular file.
 errno_t DiskDriver_WriteToPath(DiskDriverRef _Nonnull self, const char* pPath)
 {
@@ -11,6 +11,7 @@
 
 #include <klib/Error.h>
 #include <klib/Types.h>
+#include <klib/List.h>
 #include <klib/Object.h>
 
 
@@ -21,6 +22,42 @@ typedef uint32_t    LogicalBlockAddress;
 typedef LogicalBlockAddress LogicalBlockCount;
 
 
+// One entry of a scatter/gather list. Describes a buffer which holds
+// 'blockCount' consecutive blocks.
+typedef struct DiskBufferSegment {
+    void* _Nonnull      data;
+    LogicalBlockCount   blockCount;
+} DiskBufferSegment;
+
+
+// The kind of transfer that a disk request does
+typedef enum DiskRequestType {
+    kDiskRequest_Read,
+    kDiskRequest_Write
+} DiskRequestType;
+
+// An asynchronous disk I/O request. See the kernel DiskDriver.h
+typedef struct DiskRequest {
+    ListNode                            node;
+    DiskRequestType                     type;
+    LogicalBlockAddress                 lba;
+    LogicalBlockCount                   blockCount;
+    const DiskBufferSegment* _Nonnull   segments;
+    int                                 segmentCount;
+    Closure1Arg_Func _Nonnull           done;
+    void* _Nullable                     context;
+    struct _DispatchQueue* _Nullable    completionQueue;
+    errno_t                             status;
+} DiskRequest;
+
+
+// Specifies how DiskDriver_MapBlock() should map a block
+typedef enum MapBlock {
+    kMapBlock_ReadOnly,
+    kMapBlock_Update,
+} MapBlock;
+
+
 OPEN_CLASS_WITH_REF(DiskDriver, Object,
     uint8_t*            disk;
     size_t              blockSize;
@@ -64,6 +101,28 @@ extern errno_t DiskDriver_GetBlock(DiskDriverRef _Nonnull self, void* _Nonnull p
 // The abstract implementation returns EIO.
 extern errno_t DiskDriver_PutBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba);
 
+// Reads the 'blockCount' consecutive blocks starting at index 'lba' into
+// the buffers described by the scatter/gather list 'pSegments'. The
+// segments are filled in order until 'blockCount' blocks have been
+// transferred.
+extern errno_t DiskDriver_GetBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount);
+
+// Writes the 'blockCount' consecutive blocks starting at index 'lba' from
+// the buffers described by the scatter/gather list 'pSegments'.
+extern errno_t DiskDriver_PutBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount);
+
+// Maps the block at index 'lba' and returns a pointer to the block contents.
+// The disk is a flat buffer and thus every block can be mapped in place.
+extern errno_t DiskDriver_MapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData);
+
+// Unmaps a block that was mapped with DiskDriver_MapBlock().
+extern void DiskDriver_UnmapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, void* _Nonnull pData);
+
+// Executes the request 'pRequest' and invokes its completion function before
+// returning. The disk image tool has no dispatch queues and thus executes all
+// requests synchronously.
+extern errno_t DiskDriver_BeginIO(DiskDriverRef _Nonnull self, DiskRequest* _Nonnull pRequest);
+
 // Writes the contents of the disk to the given path as a regular file.
 extern errno_t DiskDriver_WriteToPath(DiskDriverRef _Nonnull self, const char* pPath);
 
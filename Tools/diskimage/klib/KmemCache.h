@@ -0,0 +1,27 @@
+//
+//  KmemCache.h
+//  diskimage
+//
+//  Created by Dietmar Planitzer on 4/22/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#ifndef klib_KmemCache_h
+#define klib_KmemCache_h
+
+#include <klib/Types.h>
+#include <klib/Error.h>
+
+
+struct _KmemCache;
+typedef struct _KmemCache* KmemCacheRef;
+
+typedef void (*KmemCache_Ctor)(void* _Nonnull pObject);
+
+
+extern errno_t kmem_cache_create(const char* _Nonnull name, ssize_t objectSize, KmemCache_Ctor _Nullable ctor, KmemCacheRef _Nullable * _Nonnull pOutCache);
+extern void kmem_cache_destroy(KmemCacheRef _Nullable self);
+extern errno_t kmem_cache_alloc(KmemCacheRef _Nonnull self, void* _Nullable * _Nonnull pOutPtr);
+extern void kmem_cache_free(KmemCacheRef _Nonnull self, void* _Nullable ptr);
+
+#endif /* klib_KmemCache_h */
@@ -17,6 +17,8 @@
 #include <System/_syslimits.h>
 #include <System/Types.h>
 
+typedef void (* _Nonnull Closure1Arg_Func)(void* _Nullable pContext);
+
 extern ssize_t String_Length(const char* _Nonnull pStr);
 extern ssize_t String_LengthUpTo(const char* _Nonnull pStr, ssize_t strsz);
 extern char* _Nonnull String_CopyUpTo(char* _Nonnull pDst, const char* _Nonnull pSrc, ssize_t count);
@@ -82,6 +82,55 @@ void kfree(void* _Nullable ptr)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+
+#include "KmemCache.h"
+
+// Object caches are simply passed through to malloc() and free(). The
+// constructor runs on every allocation since objects are not reused.
+typedef struct _KmemCache {
+    KmemCache_Ctor _Nullable    ctor;
+    ssize_t                     objectSize;
+} KmemCache;
+
+
+errno_t kmem_cache_create(const char* _Nonnull name, ssize_t objectSize, KmemCache_Ctor _Nullable ctor, KmemCacheRef _Nullable * _Nonnull pOutCache)
+{
+    KmemCacheRef self = malloc(sizeof(KmemCache));
+
+    if (self) {
+        self->ctor = ctor;
+        self->objectSize = objectSize;
+    }
+    *pOutCache = self;
+
+    return (self) ? EOK : ENOMEM;
+}
+
+void kmem_cache_destroy(KmemCacheRef _Nullable self)
+{
+    free(self);
+}
+
+errno_t kmem_cache_alloc(KmemCacheRef _Nonnull self, void* _Nullable * _Nonnull pOutPtr)
+{
+    *pOutPtr = malloc(self->objectSize);
+    if (*pOutPtr == NULL) {
+        return ENOMEM;
+    }
+
+    if (self->ctor) {
+        self->ctor(*pOutPtr);
+    }
+    return EOK;
+}
+
+void kmem_cache_free(KmemCacheRef _Nonnull self, void* _Nullable ptr)
+{
+    free(ptr);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <string.h>
@@ -114,3 +163,11 @@ char* _Nonnull String_CopyUpTo(char* _Nonnull pDst, const char* _Nonnull pSrc, s
 
     return pDst;
 }
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+#include "TimeInterval.h"
+#include <limits.h>
+
+const TimeInterval kTimeInterval_Infinity = {LONG_MAX, 1000000000l};
@@ -15,6 +15,7 @@
 #include <klib/Memory.h>
 #include <klib/Error.h>
 #include <klib/Kalloc.h>
+#include <klib/KmemCache.h>
 #include <klib/List.h>
 #include <klib/Object.h>
 
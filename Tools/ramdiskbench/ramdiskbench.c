@@ -0,0 +1,257 @@
+//
+//  ramdiskbench.c
+//  ramdiskbench
+//
+//  Created by Dietmar Planitzer on 4/27/24.
+//  Copyright © 2024 Dietmar Planitzer. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <klib/klib.h>
+#include <driver/RamDisk.h>
+
+
+#define BENCH_BLOCK_SIZE            512
+#define BENCH_EXTENT_BLOCK_COUNT    16
+#define BENCH_DISK_SIZE             (16 * 1024 * 1024)
+#define BENCH_BLOCK_COUNT           (BENCH_DISK_SIZE / BENCH_BLOCK_SIZE)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Minimal DiskDriver base class. The benchmark invokes the RamDisk transfer
+// methods directly and thus doesn't need the kernel request queue.
+////////////////////////////////////////////////////////////////////////////////
+
+errno_t DiskDriver_Create(ClassRef _Nonnull pClass, DiskDriverRef _Nullable * _Nonnull pOutSelf)
+{
+    return _Object_Create(pClass, 0, (ObjectRef*)pOutSelf);
+}
+
+void DiskDriver_deinit(DiskDriverRef _Nonnull self)
+{
+}
+
+size_t DiskDriver_getBlockSize(DiskDriverRef _Nonnull self)
+{
+    return 0;
+}
+
+LogicalBlockCount DiskDriver_getBlockCount(DiskDriverRef _Nonnull self)
+{
+    return 0;
+}
+
+bool DiskDriver_isReadOnly(DiskDriverRef _Nonnull self)
+{
+    return true;
+}
+
+errno_t DiskDriver_getBlock(DiskDriverRef _Nonnull self, void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    return EIO;
+}
+
+errno_t DiskDriver_putBlock(DiskDriverRef _Nonnull self, const void* _Nonnull pBuffer, LogicalBlockAddress lba)
+{
+    return EIO;
+}
+
+errno_t DiskDriver_getBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return EIO;
+}
+
+errno_t DiskDriver_putBlocks(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, LogicalBlockCount blockCount, const DiskBufferSegment* _Nonnull pSegments, int segmentCount)
+{
+    return EIO;
+}
+
+errno_t DiskDriver_mapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, MapBlock mode, void* _Nullable * _Nonnull pOutData)
+{
+    *pOutData = NULL;
+    return ENOSYS;
+}
+
+void DiskDriver_unmapBlock(DiskDriverRef _Nonnull self, LogicalBlockAddress lba, void* _Nonnull pData)
+{
+}
+
+CLASS_METHODS(DiskDriver, IOResource,
+OVERRIDE_METHOD_IMPL(deinit, DiskDriver, Object)
+METHOD_IMPL(getBlockSize, DiskDriver)
+METHOD_IMPL(getBlockCount, DiskDriver)
+METHOD_IMPL(isReadOnly, DiskDriver)
+METHOD_IMPL(getBlock, DiskDriver)
+METHOD_IMPL(putBlock, DiskDriver)
+METHOD_IMPL(getBlocks, DiskDriver)
+METHOD_IMPL(putBlocks, DiskDriver)
+METHOD_IMPL(mapBlock, DiskDriver)
+METHOD_IMPL(unmapBlock, DiskDriver)
+);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+////////////////////////////////////////////////////////////////////////////////
+
+static char gBlock[BENCH_BLOCK_SIZE];
+static uint32_t gRandomState = 1;
+
+
+static void failed(const char* _Nonnull what, errno_t err)
+{
+    printf("%s failed: %d\n", what, err);
+    exit(EXIT_FAILURE);
+}
+
+static LogicalBlockAddress random_lba(void)
+{
+    gRandomState = gRandomState * 1103515245u + 12345u;
+    return (gRandomState >> 8) % BENCH_BLOCK_COUNT;
+}
+
+static void report(const char* _Nonnull name, clock_t start, int nBlocks)
+{
+    const double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    const double mbytes = ((double)nBlocks * BENCH_BLOCK_SIZE) / (1024.0 * 1024.0);
+
+    if (secs > 0.0) {
+        printf("%-24s %8d blocks  %8.3f s  %9.1f MB/s  %7.1f ns/block\n", name, nBlocks, secs, mbytes / secs, (secs * 1.0e9) / nBlocks);
+    }
+    else {
+        printf("%-24s %8d blocks  (below timer resolution)\n", name, nBlocks);
+    }
+}
+
+static RamDiskRef _Nonnull create_disk(void)
+{
+    RamDiskRef pDisk;
+    const errno_t err = RamDisk_Create(BENCH_BLOCK_SIZE, BENCH_BLOCK_COUNT, BENCH_EXTENT_BLOCK_COUNT, &pDisk);
+
+    if (err != EOK) {
+        failed("RamDisk_Create", err);
+    }
+    return pDisk;
+}
+
+static void bench_sequential(void)
+{
+    RamDiskRef pDisk = create_disk();
+    clock_t start;
+    errno_t err;
+
+    start = clock();
+    for (LogicalBlockAddress lba = 0; lba < BENCH_BLOCK_COUNT; lba++) {
+        gBlock[0] = (char)lba;
+        if ((err = Object_InvokeN(putBlock, DiskDriver, pDisk, gBlock, lba)) != EOK) {
+            failed("putBlock", err);
+        }
+    }
+    report("sequential fill", start, BENCH_BLOCK_COUNT);
+
+    start = clock();
+    for (LogicalBlockAddress lba = 0; lba < BENCH_BLOCK_COUNT; lba++) {
+        if ((err = Object_InvokeN(getBlock, DiskDriver, pDisk, gBlock, lba)) != EOK) {
+            failed("getBlock", err);
+        }
+        if (gBlock[0] != (char)lba) {
+            printf("data mismatch at block %u\n", lba);
+            exit(EXIT_FAILURE);
+        }
+    }
+    report("sequential read", start, BENCH_BLOCK_COUNT);
+
+    start = clock();
+    for (LogicalBlockAddress lba = 0; lba < BENCH_BLOCK_COUNT; lba++) {
+        void* pData;
+
+        if ((err = Object_InvokeN(mapBlock, DiskDriver, pDisk, lba, kMapBlock_ReadOnly, &pData)) != EOK) {
+            failed("mapBlock", err);
+        }
+        if (((const char*)pData)[0] != (char)lba) {
+            printf("data mismatch at mapped block %u\n", lba);
+            exit(EXIT_FAILURE);
+        }
+        Object_InvokeN(unmapBlock, DiskDriver, pDisk, lba, pData);
+    }
+    report("sequential mapped read", start, BENCH_BLOCK_COUNT);
+
+    Object_Release(pDisk);
+}
+
+static void bench_random(void)
+{
+    RamDiskRef pDisk = create_disk();
+    clock_t start;
+    errno_t err;
+
+    start = clock();
+    for (int i = 0; i < BENCH_BLOCK_COUNT; i++) {
+        if ((err = Object_InvokeN(putBlock, DiskDriver, pDisk, gBlock, random_lba())) != EOK) {
+            failed("putBlock", err);
+        }
+    }
+    report("random fill", start, BENCH_BLOCK_COUNT);
+
+    start = clock();
+    for (int i = 0; i < BENCH_BLOCK_COUNT; i++) {
+        if ((err = Object_InvokeN(getBlock, DiskDriver, pDisk, gBlock, random_lba())) != EOK) {
+            failed("getBlock", err);
+        }
+    }
+    report("random read", start, BENCH_BLOCK_COUNT);
+
+    Object_Release(pDisk);
+}
+
+static void bench_vectored(void)
+{
+    RamDiskRef pDisk = create_disk();
+    const LogicalBlockCount nBlocksPerTransfer = 64;
+    char* pBuffer = malloc(nBlocksPerTransfer * BENCH_BLOCK_SIZE);
+    DiskBufferSegment seg;
+    clock_t start;
+    errno_t err;
+
+    memset(pBuffer, 0x5a, nBlocksPerTransfer * BENCH_BLOCK_SIZE);
+    seg.data = pBuffer;
+    seg.blockCount = nBlocksPerTransfer;
+
+    start = clock();
+    for (LogicalBlockAddress lba = 0; lba < BENCH_BLOCK_COUNT; lba += nBlocksPerTransfer) {
+        if ((err = Object_InvokeN(putBlocks, DiskDriver, pDisk, lba, nBlocksPerTransfer, &seg, 1)) != EOK) {
+            failed("putBlocks", err);
+        }
+    }
+    report("vectored fill", start, BENCH_BLOCK_COUNT);
+
+    start = clock();
+    for (LogicalBlockAddress lba = 0; lba < BENCH_BLOCK_COUNT; lba += nBlocksPerTransfer) {
+        if ((err = Object_InvokeN(getBlocks, DiskDriver, pDisk, lba, nBlocksPerTransfer, &seg, 1)) != EOK) {
+            failed("getBlocks", err);
+        }
+    }
+    report("vectored read", start, BENCH_BLOCK_COUNT);
+
+    free(pBuffer);
+    Object_Release(pDisk);
+}
+
+int main(int argc, char* argv[])
+{
+    _RegisterClass(&kObjectClass);
+    _RegisterClass(&kIOResourceClass);
+    _RegisterClass(&kDiskDriverClass);
+    _RegisterClass(&kRamDiskClass);
+
+    printf("RAM disk: %d MB, %d byte blocks, %d blocks per extent\n\n", BENCH_DISK_SIZE / (1024 * 1024), BENCH_BLOCK_SIZE, BENCH_EXTENT_BLOCK_COUNT);
+
+    bench_sequential();
+    bench_random();
+    bench_vectored();
+
+    return EXIT_SUCCESS;
+}